@@ -16,11 +16,25 @@
 #define CMD_DOWNLOAD_FOLDER "DOWNLOAD_FOLDER"
 #define CMD_GET_FOLDER_STRUCTURE "GET_FOLDER_STRUCTURE"
 #define CMD_SHARE_FOLDER "SHARE_FOLDER"
-#define CMD_UPLOAD_FILE "UPLOAD_FILE"
 #define CMD_CHECK_SHARE_PROGRESS "CHECK_SHARE_PROGRESS"
 #define CMD_CANCEL_FOLDER_SHARE "CANCEL_FOLDER_SHARE"
+#define CMD_ACCEPT_FOLDER_COPY "ACCEPT_FOLDER_COPY"
+#define CMD_GET_FOLDER_OFFERS "GET_FOLDER_OFFERS"
 #define CMD_CREATE_FOLDER "CREATE_FOLDER"
 
+// Upload khử trùng lặp theo chunk (xem Server/Core/include/chunk_store.h)
+#define CMD_CHUNK_QUERY "CHUNK_QUERY"
+#define CMD_PUT_CHUNK "PUT_CHUNK"
+#define CMD_STOR_CHUNKED "STOR_CHUNKED"
+
+// Tham số cắt chunk: client phải cắt giống server thì chunk mới trùng được
+#define CHUNK_MIN_BYTES 262144      // 256KB
+#define CHUNK_MAX_BYTES 4194304     // 4MB
+#define CHUNK_MASK_BITS 20          // Trung bình ~1MB sau CHUNK_MIN_BYTES
+#define CHUNK_GEAR_SEED 0x5a17c0deULL
+#define CHUNK_QUERY_MAX 100         // Số hash tối đa trong một dòng CHUNK_QUERY
+#define CHUNK_MANIFEST_MAX 65536    // Số chunk tối đa của một STOR_CHUNKED
+
 // Share code commands
 #define CMD_GENERATE_SHARE_CODE "GENERATE_SHARE_CODE"
 #define CMD_REDEEM_SHARE_CODE "REDEEM_SHARE_CODE"
@@ -0,0 +1,90 @@
+#ifndef ACL_CACHE_H
+#define ACL_CACHE_H
+
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+// Cache kết quả kiểm tra quyền đọc (user_id, file_id) -> true/false, nhóm theo user.
+// Giữ tối đa maxUsers user (LRU), mỗi user tối đa maxFilesPerUser mục (đầy thì xóa hết của user đó).
+// Share/revoke/redeem gọi invalidateUser() cho user bị ảnh hưởng.
+//
+// Chống ghi đè kết quả cũ: lấy epoch trước khi hỏi DB, store() bỏ qua nếu trong lúc đó
+// đã có invalidate (epoch đổi).
+class AclCache {
+public:
+    AclCache(size_t maxUsers, size_t maxFilesPerUser)
+        : maxUsers(maxUsers), maxFilesPerUser(maxFilesPerUser) {}
+
+    bool lookup(long long user_id, long long file_id, bool& allowed) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = users.find(user_id);
+        if (it != users.end()) {
+            auto fit = it->second.files.find(file_id);
+            if (fit != it->second.files.end()) {
+                lru.splice(lru.begin(), lru, it->second.lruPos);
+                allowed = fit->second;
+                hits++;
+                return true;
+            }
+        }
+        misses++;
+        return false;
+    }
+
+    unsigned long long currentEpoch() const { return epoch.load(); }
+
+    void store(long long user_id, long long file_id, bool allowed, unsigned long long seenEpoch) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (epoch.load() != seenEpoch) return;
+
+        auto it = users.find(user_id);
+        if (it == users.end()) {
+            lru.push_front(user_id);
+            it = users.emplace(user_id, UserEntry{{}, lru.begin()}).first;
+            if (users.size() > maxUsers) {
+                users.erase(lru.back());
+                lru.pop_back();
+            }
+        } else {
+            lru.splice(lru.begin(), lru, it->second.lruPos);
+        }
+        if (it->second.files.size() >= maxFilesPerUser) it->second.files.clear();
+        it->second.files[file_id] = allowed;
+    }
+
+    void invalidateUser(long long user_id) {
+        std::lock_guard<std::mutex> lock(mtx);
+        epoch++;
+        auto it = users.find(user_id);
+        if (it == users.end()) return;
+        lru.erase(it->second.lruPos);
+        users.erase(it);
+    }
+
+    size_t userCount() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return users.size();
+    }
+
+    long long hitCount() const { return hits.load(); }
+    long long missCount() const { return misses.load(); }
+
+private:
+    struct UserEntry {
+        std::unordered_map<long long, bool> files;
+        std::list<long long>::iterator lruPos;
+    };
+
+    size_t maxUsers;
+    size_t maxFilesPerUser;
+    std::list<long long> lru;  // Đầu list = user vừa dùng
+    std::unordered_map<long long, UserEntry> users;
+    std::mutex mtx;
+    std::atomic<unsigned long long> epoch{0};
+    std::atomic<long long> hits{0};
+    std::atomic<long long> misses{0};
+};
+
+#endif // ACL_CACHE_H
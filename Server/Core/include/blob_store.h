@@ -0,0 +1,67 @@
+#ifndef BLOB_STORE_H
+#define BLOB_STORE_H
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Kho dữ liệu file upload, đặt theo blob_id thay vì tên file:
+//   <STORAGE_PATH>blobs/<xx>/<yy>/<blob_id>   (xx, yy = byte thấp nhất và byte kế tiếp của blob_id, hex)
+// blob_id là FILES.blob_id, NULL nghĩa là chính file_id; bản chép của cloneFolder trỏ về blob gốc.
+// 65536 thư mục lá, id tăng dần rải đều nên mỗi thư mục chỉ giữ ~N/65536 blob.
+// Upload ghi vào <STORAGE_PATH>tmp rồi commit() rename vào chỗ (cùng filesystem, không copy).
+// Mọi đường upload/download (STOR, RETR, guest, folder) đi qua lớp này.
+// Blob đã được ChunkStore cắt chunk thì không còn file ở đây, đọc qua BlobReader.
+class BlobStore {
+public:
+    static std::string pathOf(long long blob_id);
+
+    // Tên file tạm chưa dùng trong <STORAGE_PATH>tmp (chưa tạo file)
+    static std::string newTempPath();
+    // Tạo file tạm để ghi; -1 nếu lỗi. Xong thì commit() hoặc discard()
+    static int create(std::string& tempPath);
+    // Như create() với tên đã lấy từ newTempPath() (caller cần biết tên trước khi tạo file)
+    static int openTemp(const std::string& tempPath);
+    // Đưa file tạm thành blob của blob_id
+    static bool commit(const std::string& tempPath, long long blob_id);
+    // rename file tạm vào path (tạo thư mục cha nếu thiếu); lỗi thì xóa file tạm
+    static bool commitTo(const std::string& tempPath, const std::string& path);
+    // Bỏ file tạm chưa commit
+    static void discard(const std::string& tempPath);
+    // Xóa file của blob đã commit (đã cắt chunk, hoặc dòng FILES không commit được)
+    static void unlink(long long blob_id);
+};
+
+// Blob mở để gửi đi: một file (blob thường, hoặc file cũ trước migration 005 theo legacyName),
+// hoặc chuỗi chunk theo manifest trong DB. Chunk được mở lần lượt khi offset đi tới.
+class BlobReader {
+public:
+    BlobReader() = default;
+    ~BlobReader() { close(); }
+    BlobReader(const BlobReader&) = delete;
+    BlobReader& operator=(const BlobReader&) = delete;
+
+    bool open(long long blob_id, const std::string& legacyName);  // false nếu không có dữ liệu
+    void close();
+    bool isOpen() const { return !segments.empty(); }
+    long long size() const { return totalSize; }
+
+    // Như ZeroCopyIO::sendFileRange, *offset tính từ đầu blob (chỉ tăng dần)
+    long long sendRange(int sockFd, off_t* offset, size_t count);
+
+private:
+    struct Segment {
+        std::string path;  // Rỗng: fd đã mở sẵn (blob một file)
+        off_t start;
+        off_t size;
+    };
+
+    bool openSegment(size_t index);
+
+    std::vector<Segment> segments;
+    size_t current = 0;
+    int fd = -1;
+    long long totalSize = 0;
+};
+
+#endif // BLOB_STORE_H
@@ -0,0 +1,99 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+
+struct ChunkRef;  // db_manager.h
+
+// Kho chunk khử trùng lặp, mỗi chunk lưu một lần theo SHA-256 của nội dung:
+//   <STORAGE_PATH>chunks/<h0h1>/<h2h3>/<sha256 hex>
+// Cắt chunk theo nội dung (gear hash, tham số CHUNK_* trong Protocol.h):
+//   gear[256] = dãy splitmix64 từ CHUNK_GEAR_SEED; h = (h << 1) + gear[byte] từ đầu chunk;
+//   cắt sau byte i khi độ dài >= CHUNK_MIN_BYTES và CHUNK_MASK_BITS bit cao nhất của h đều 0,
+//   hoặc khi đủ CHUNK_MAX_BYTES. h chỉ phụ thuộc 64 byte gần nhất nên thêm/bớt dữ liệu ở đầu
+//   file chỉ làm đổi các chunk quanh chỗ sửa.
+// Blob upload (STOR) từ DEDUP_MIN_BLOB_BYTES được cắt ở thread nền sau khi commit:
+// ghi chunk còn thiếu, lưu manifest (BLOB_CHUNKS) rồi xóa file blob. Khử trùng lặp giữa các
+// user chỉ diễn ra ở đây.
+// Client STOR_CHUNKED cắt trước, chỉ gửi chunk mà chính user chưa có (CHUNK_QUERY / PUT_CHUNK).
+// PUT_CHUNK nằm riêng theo user ở <STORAGE_PATH>chunks/pending/<user_id>/<hex> (CHUNK_UPLOADS,
+// tính vào quota) tới khi STOR_CHUNKED chuyển vào kho chung; quá PENDING_CHUNK_TTL_SECONDS thì
+// thread nền xóa. CHUNKS.ref_count đếm tham chiếu từ file còn sống (DBManager giữ đúng khi
+// tạo/xóa/chép file); cũng theo chu kỳ đó thread nền xóa chunk về 0 khỏi DB và kho chung.
+class ChunkStore {
+public:
+    static ChunkStore& getInstance() {
+        static ChunkStore instance;
+        return instance;
+    }
+
+    void start();  // Thread nền: cắt chunk (CHUNK_DEDUP), dọn chunk PUT_CHUNK quá hạn và chunk ref_count 0
+    void stop();   // Blob còn trong hàng đợi giữ nguyên dạng một file
+
+    static constexpr size_t DIGEST_BYTES = 32;  // SHA-256
+
+    static std::string pathOf(const std::string& hash);
+    static std::string pendingPathOf(long long user_id, const std::string& hash);
+    static bool isValidHash(std::string_view hash);  // 64 ký tự hex chữ thường
+    static std::string toHex(const unsigned char* digest);
+
+    // Kích thước chunk đã có trong kho, -1 nếu chưa có
+    static long long storedSize(const std::string& hash);
+
+    // PUT_CHUNK: file tạm phải đúng size byte và đúng SHA-256 hash, đúng thì thành chunk
+    // pending của user_id. File tạm luôn bị xóa/chuyển đi
+    static bool storeUploaded(const std::string& tempPath, const std::string& hash, long long size,
+                              long long user_id);
+    // STOR_CHUNKED (trong transaction, đã khóa dòng CHUNK_UPLOADS): chuyển chunk pending vào kho
+    // chung. false nếu không còn ở đâu cả
+    static bool promotePending(long long user_id, const std::string& hash);
+
+    // STOR_CHUNKED: file tạm gồm count digest nhị phân liên tiếp -> manifest, size = -1
+    // (DBManager::findHeldChunks điền). File tạm luôn bị xóa; false nếu không đọc đủ count digest
+    static bool readManifest(const std::string& manifestPath, long count, std::vector<ChunkRef>& chunks);
+
+    // Gọi sau BlobStore::commit; bỏ qua blob nhỏ, hoặc khi hàng đợi đầy (blob giữ dạng một file)
+    void scheduleIngest(long long blob_id, long long size);
+
+    void printStats();
+
+private:
+    ChunkStore() = default;
+    ~ChunkStore() { stop(); }
+    ChunkStore(const ChunkStore&) = delete;
+    ChunkStore& operator=(const ChunkStore&) = delete;
+
+    // Độ dài chunk đầu tiên của data[0, len); len < CHUNK_MAX_BYTES chỉ khi đã tới cuối blob
+    static size_t cutPoint(const unsigned char* data, size_t len);
+    // Ghi chunk nếu kho chưa có; existed = true nếu đã có sẵn
+    static bool putChunk(const std::string& hash, const unsigned char* data, size_t len, bool& existed);
+
+    bool ingest(long long blob_id);
+    void ingestLoop();
+    void sweepPending();
+    void collectUnreferenced();
+
+    std::thread thread;
+    std::mutex queueMutex;
+    std::condition_variable queueCv;
+    std::deque<long long> queue;
+    bool running = false;
+
+    std::atomic<long long> blobsIngested{0};
+    std::atomic<long long> chunksWritten{0};
+    std::atomic<long long> chunksReused{0};
+    std::atomic<long long> bytesReused{0};  // Dữ liệu trùng không phải ghi thêm
+    std::atomic<long long> ingestFailures{0};
+    std::atomic<long long> pendingExpired{0};  // Chunk PUT_CHUNK bị dọn vì quá hạn
+    std::atomic<long long> chunksCollected{0};  // Chunk ref_count 0 bị xóa khỏi kho chung
+};
+
+#endif // CHUNK_STORE_H
@@ -3,7 +3,15 @@
 
 #include <string>
 #include <vector>
+#include <functional>
+#include <utility>
 #include <mysql/mysql.h>
+#include "lru_cache.h"
+#include "acl_cache.h"
+#include "metadata_cache.h"
+#include "server_config.h"
+
+class DBLease;
 
 // ===== EXISTING STRUCT - GIỮ NGUYÊN =====
 struct FileRecord {
@@ -25,6 +33,26 @@ struct FileRecordEx {
     std::string owner;
 };
 
+// Thứ tự của LIST/LISTSHARED có phân trang; folder luôn đứng trước
+enum class ListSort {
+    Name,   // Tên tăng dần
+    Size,   // Kích thước (folder: cả cây con) giảm dần
+    Date    // Mới tạo trước
+};
+
+// Một node của cây con (getSubtree)
+struct SubtreeEntry {
+    FileRecordEx item;
+    std::string relativePath;  // Tính từ folder gốc, vd "docs/a.txt" (không gồm tên folder gốc)
+    long long blob_id = 0;     // File: blob trong BlobStore
+};
+
+// Một chunk trong manifest của blob (ChunkStore)
+struct ChunkRef {
+    std::string hash;  // SHA-256, hex chữ thường
+    long long size;
+};
+
 // ===== STRUCT FOR SHARE INFO =====
 struct ShareInfo {
     long long shared_id;
@@ -58,42 +86,114 @@ public:
     }
 
     // ===== EXISTING FUNCTIONS - GIỮ NGUYÊN =====
-    bool connect();
+    bool connect();     // Mở DBConnectionPool (ServerConfig::DB_POOL_SIZE kết nối)
     void disconnect();
-    bool checkUser(std::string user, std::string pass);
+    // Trả về user_id nếu đúng mật khẩu, -1 nếu sai. Session giữ user_id này cho mọi lệnh sau.
+    long long checkUser(std::string user, std::string pass);
     bool registerUser(std::string username, std::string password);
-    std::vector<FileRecord> getFiles(std::string username, long long parent_id = 0);
-    std::vector<FileRecord> getSharedFiles(std::string username);
-    std::vector<FileRecord> getSharedFiles(std::string username, long long parent_id); // Overload for navigation
-    bool hasSharedAccess(long long file_id, std::string username); // Check if user has access to file/folder
-    bool addFile(std::string filename, long filesize, std::string owner, long long parent_id = 0);
-    long getStorageUsed(std::string username);
-    bool shareFile(std::string filename, std::string ownerUsername, std::string targetUsername);
-    bool deleteFile(std::string filename, std::string username);
-    bool renameFile(long long fileId, std::string newName, std::string username);
+
+    // username -> user_id qua userIdCache; chỉ dùng khi không có session (target share, guest...)
+    long long getUserId(const std::string& username);
+    void printCacheStats();
+
+    // Các hàm dưới nhận user_id của session thay vì username (không tra USERS mỗi lệnh)
+    std::vector<FileRecord> getFiles(long long user_id, long long parent_id = 0);
+    std::vector<FileRecord> getSharedFiles(long long user_id);
+    std::vector<FileRecord> getSharedFiles(long long user_id, long long parent_id); // Overload for navigation
+    bool hasSharedAccess(long long file_id, long long user_id); // Check if user has access to file/folder
+
+    // Một trang keyset của LIST (file của user_id trong parent_id) / LISTSHARED (mọi dòng trong
+    // folder parent_id được share cho user_id): tối đa limit dòng đứng sau cursor ("" = trang đầu).
+    // onRow được gọi ngay khi từng dòng đọc xong từ server; nextCursor = "" nếu là trang cuối.
+    // false nếu lỗi DB, cursor không hợp lệ hoặc không có quyền.
+    bool getFilesPage(long long user_id, long long parent_id, ListSort sort, const std::string& cursor, int limit,
+                      const std::function<void(const FileRecord&)>& onRow, std::string& nextCursor);
+    bool getSharedFilesPage(long long user_id, long long parent_id, ListSort sort, const std::string& cursor, int limit,
+                            const std::function<void(const FileRecord&)>& onRow, std::string& nextCursor);
+    // Trả về file_id mới (cũng là blob_id của dữ liệu vừa upload), -1 nếu lỗi.
+    // chunks != nullptr (STOR_CHUNKED): size đã lấy từ findHeldChunks; dùng các chunk pending
+    // (claimChunks) và ghi luôn manifest của blob trong cùng transaction.
+    // blobTempPath != nullptr: file tạm được BlobStore::commit trước khi commit transaction,
+    // lỗi ở bất kỳ bước nào thì file tạm bị xóa (không có dòng FILES trỏ vào blob không tồn tại)
+    long long addFile(std::string filename, long filesize, long long owner_id, long long parent_id = 0,
+                      const std::vector<ChunkRef>* chunks = nullptr, const std::string* blobTempPath = nullptr);
+    long getStorageUsed(long long user_id);
+    // USERS.storage_used_bytes và storage_limit_bytes (NULL -> DEFAULT_USER_QUOTA); dùng cho QuotaLedger
+    bool getStorageAccount(long long user_id, long long& used, long long& limit);
+    bool shareFile(std::string filename, long long owner_id, std::string targetUsername);
+    bool deleteFile(std::string filename, long long user_id);
+    bool renameFile(long long fileId, std::string newName, long long user_id);
 
     // ===== NEW FUNCTIONS FOR FOLDER SHARE =====
     
     // Lấy danh sách items trong một folder
-    std::vector<FileRecordEx> getItemsInFolder(long long parent_id, std::string username);
+    std::vector<FileRecordEx> getItemsInFolder(long long parent_id, long long user_id);
     
-    // Lấy toàn bộ cấu trúc folder (đệ quy)
-    std::vector<FileRecordEx> getFolderStructure(long long folder_id, std::string username);
+    // SEARCH: tên chứa keyword, trong số file user_id sở hữu hoặc được share (trực tiếp hay qua folder cha).
+    // Trang page (từ 0), mỗi trang ServerConfig::SEARCH_PAGE_SIZE dòng.
+    std::vector<FileRecord> searchFiles(long long user_id, const std::string& keyword, long long page);
+
+    // Nạp lại SearchIndex từ FILES; gọi một lần lúc khởi động, sau connect()
+    bool rebuildSearchIndex();
+
+    // Lấy toàn bộ cấu trúc folder (đệ quy), chỉ khi user_id là owner
+    std::vector<FileRecordEx> getFolderStructure(long long folder_id, long long user_id);
+
+    // Toàn bộ cây con của folder (không gồm chính folder) trong một câu SQL.
+    // Thứ tự duyệt trước: folder xuất hiện trước nội dung của nó; cùng cấp thì folder trước, theo tên.
+    std::vector<SubtreeEntry> getSubtree(long long folder_id);
     
     // Tạo folder mới (sử dụng nội bộ bởi folder share)
-    long long createFolder(std::string foldername, long long parent_id, std::string owner);
+    long long createFolder(std::string foldername, long long parent_id, long long owner_id);
     
     // Tạo file trong folder
-    long long createFileInFolder(std::string filename, long long parent_id, long long filesize, std::string owner);
+    long long createFileInFolder(std::string filename, long long parent_id, long long filesize, long long owner_id);
+    
+    // Chép cả cây folder_id (của owner_id) thành một folder gốc mới của new_owner_id, chỉ sao chép
+    // dòng FILES: mỗi cấp của cây là một câu INSERT ... SELECT, dòng mới giữ blob_id của dòng gốc
+    // (blob không bị xóa khi xóa mềm nên dùng chung được). Cộng subtree_size_bytes vào
+    // storage_used của new_owner_id (vượt quota thì từ chối). Trả về file_id folder mới, -1 nếu lỗi.
+    long long cloneFolder(long long folder_id, long long owner_id, long long new_owner_id,
+                          long long& fileCount, long long& totalBytes);
     
     // Lấy thông tin file/folder
     FileRecordEx getFileInfo(long long file_id);
+
+    // BlobStore id của file_id (COALESCE(blob_id, file_id)), -1 nếu không có
+    long long getBlobId(long long file_id);
+
+    // RETR theo tên: file của user_id, không có thì file cùng tên user_id được share (trực tiếp
+    // hay qua folder cha). Trả về blob_id, -1 nếu không có file nào user_id được đọc
+    long long findDownloadBlob(const std::string& filename, long long user_id);
+
+    // Manifest của blob theo thứ tự seq; rỗng nếu blob không bị cắt chunk (hoặc lỗi DB)
+    std::vector<ChunkRef> getChunkManifest(long long blob_id);
+    // Ghi manifest cho blob đã có (ChunkStore cắt blob sau upload); ref_count của từng chunk
+    // tăng theo số file còn sống đang dùng blob
+    bool storeChunkManifest(long long blob_id, const std::vector<ChunkRef>& chunks);
+
+    // Chunk user_id đã có quyền dùng: đã PUT_CHUNK (CHUNK_UPLOADS) hoặc nằm trong file còn sống
+    // của chính user. Điền size cho chunk đó, -1 cho chunk còn lại; pendingBytes = tổng size
+    // của các chunk PUT_CHUNK (mỗi hash một lần)
+    bool findHeldChunks(long long user_id, std::vector<ChunkRef>& chunks, long long* pendingBytes = nullptr);
+    // PUT_CHUNK đã kiểm tra hash: ghi CHUNK_UPLOADS, tính size vào storage_used (lần đầu),
+    // chuyển file tạm tới pendingPath. File tạm luôn bị xóa/chuyển đi
+    bool addPendingChunk(long long user_id, const std::string& hash, long long size,
+                         const std::string& tempPath, const std::string& pendingPath);
+    // (user_id, hash) của các dòng CHUNK_UPLOADS cũ hơn ttlSeconds, tối đa limit dòng
+    std::vector<std::pair<long long, std::string>> getExpiredPendingChunks(int ttlSeconds, int limit);
+    // Xóa dòng nếu vẫn quá hạn: trả quota và xóa pendingPath trong cùng transaction.
+    // false nếu dòng đã được dùng/gửi lại hoặc lỗi DB
+    bool dropPendingChunk(long long user_id, const std::string& hash, int ttlSeconds, const std::string& pendingPath);
+    // Chunk không còn file sống nào dùng (ref_count = 0): xóa dòng CHUNKS và file trong kho chung,
+    // tối đa limit chunk. Trả về số chunk đã xóa, -1 nếu lỗi DB
+    long long dropUnreferencedChunks(int limit);
     
     // Share folder với user khác
     bool shareFolderWithUser(long long folder_id, std::string targetUsername);
     
     // Kiểm tra file có được share với user không
-    bool isFileSharedWithUser(std::string filename, std::string username);
+    bool isFileSharedWithUser(std::string filename, long long user_id);
     
     // Lấy owner của file
     std::string getFileOwner(std::string filename);
@@ -101,22 +201,22 @@ public:
     // ===== SHARE CODE FUNCTIONS =====
     
     // Tạo mã share độc nhất cho file/folder
-    std::string generateShareCode(long long file_id, std::string owner_username, int max_uses = 0);
+    std::string generateShareCode(long long file_id, long long owner_id, int max_uses = 0);
     
     // Redeem mã share - trả về file_id nếu thành công, -1 nếu thất bại
-    long long redeemShareCode(std::string share_code, std::string username);
+    long long redeemShareCode(std::string share_code, long long user_id);
     
     // Lấy danh sách file/folder đã share cho người khác
-    std::vector<ShareInfo> getMyShares(std::string username);
+    std::vector<ShareInfo> getMyShares(long long user_id);
     
     // Thu hồi quyền share với một user cụ thể
-    bool revokeShare(long long file_id, std::string owner_username, std::string target_username);
+    bool revokeShare(long long file_id, long long owner_id, std::string target_username);
     
     // Lấy danh sách mã share của user
-    std::vector<ShareCodeInfo> getMyShareCodes(std::string username);
+    std::vector<ShareCodeInfo> getMyShareCodes(long long user_id);
     
     // Xóa mã share
-    bool deleteShareCode(std::string share_code, std::string owner_username);
+    bool deleteShareCode(std::string share_code, long long owner_id);
     
     // Lấy thông tin file theo ID
     FileRecordEx getFileById(long long file_id);
@@ -133,12 +233,60 @@ public:
     std::vector<FileRecordEx> guestListFolder(long long folder_id);
 
 private:
-    DBManager() : conn(nullptr) {} 
+    // Không giữ kết nối riêng: mỗi hàm mượn một kết nối từ DBConnectionPool (DBLease)
+    DBManager() : userIdCache(USER_ID_CACHE_SIZE), aclCache(ACL_CACHE_USERS, ACL_CACHE_FILES_PER_USER),
+                  metadataCache(ServerConfig::METADATA_CACHE_BYTES) {}
     ~DBManager() { disconnect(); }
-    MYSQL* conn;
+
+    // Username không đổi và user không bị xóa nên cache không cần invalidate
+    static constexpr size_t USER_ID_CACHE_SIZE = 10000;
+    LruCache<std::string, long long> userIdCache;
+
+    // Kết quả hasSharedAccess; share/revoke/redeem xóa mục của user nhận
+    static constexpr size_t ACL_CACHE_USERS = 4096;
+    static constexpr size_t ACL_CACHE_FILES_PER_USER = 1024;
+    AclCache aclCache;
+
+    // Danh sách con của folder và node theo file_id; mọi hàm sửa FILES cập nhật sau khi commit
+    MetadataCache metadataCache;
+
+    // Danh sách con (mọi owner) của folder key (file_id, hoặc MetadataCache::rootKey(user_id)):
+    // lấy từ metadataCache, thiếu thì đọc DB một câu rồi lưu vào cache
+    bool loadFolder(long long key, std::vector<MetadataNode>& children);
     
-    // ===== HELPER FUNCTION FOR RECURSIVE COLLECTION =====
-    void collectFilesRecursive(long long parent_id, std::vector<FileRecordEx>& results, std::string username);
+    // Cộng dồn subtree_size_bytes/subtree_file_count cho folder_id và các folder cha.
+    // Gọi trong cùng transaction với thao tác thay đổi FILES. levels = số folder đã cập nhật.
+    bool adjustFolderTotals(DBLease& lease, long long folder_id, long long deltaBytes, long long deltaFiles,
+                            long long* levels = nullptr);
+
+    // Phần chung của getFilesPage/getSharedFilesPage; ownerFilter = -1 -> không lọc owner
+    bool listPage(long long ownerFilter, long long parent_id, ListSort sort, const std::string& cursor, int limit,
+                  const std::function<void(const FileRecord&)>& onRow, std::string& nextCursor);
+
+    // Gán FILES.path = path của cha + "<file_id>/" cho dòng vừa INSERT, trả path qua tham số
+    bool assignPath(DBLease& lease, long long file_id, std::string& path);
+
+    // USERS.storage_used_bytes += delta; gọi trong transaction, báo QuotaLedger sau khi commit
+    bool adjustStorageUsed(DBLease& lease, long long user_id, long long delta);
+
+    // Ghi BLOB_CHUNKS và cộng ref_count trong CHUNKS (refs = số dòng FILES còn sống dùng blob);
+    // gọi trong transaction
+    bool insertChunkManifest(DBLease& lease, long long blob_id, const std::vector<ChunkRef>& chunks,
+                             long long refs = 1);
+    // ref_count += delta cho mỗi lần chunk xuất hiện trong manifest của blob_id (blob không có
+    // manifest: không đổi gì)
+    bool adjustBlobRefs(DBLease& lease, long long blob_id, long long delta);
+    // Như adjustBlobRefs cho mọi file còn sống trong cây con dưới path (không gồm chính path)
+    bool adjustSubtreeRefs(DBLease& lease, const std::string& path, long long delta);
+
+    // Phần chung của findHeldChunks và claimChunks. lockPending: khóa các dòng CHUNK_UPLOADS
+    // tìm thấy (FOR UPDATE); pendingHashes nhận hash của các dòng đó
+    bool lookupHeldChunks(DBLease& lease, long long user_id, std::vector<ChunkRef>& chunks, long long& pendingBytes,
+                          bool lockPending, std::vector<std::string>* pendingHashes);
+    // STOR_CHUNKED trong addFile: kiểm tra lại user vẫn giữ mọi chunk với đúng size đã tính,
+    // chuyển chunk pending vào kho chung và xóa dòng CHUNK_UPLOADS. claimedBytes = phần đã tính
+    // vào storage_used lúc PUT_CHUNK
+    bool claimChunks(DBLease& lease, long long user_id, const std::vector<ChunkRef>& chunks, long long& claimedBytes);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,136 @@
+#ifndef DB_POOL_H
+#define DB_POOL_H
+
+#include <mysql/mysql.h>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+// Số liệu pool (in ra cùng SYSTEM STATS)
+struct DBPoolStats {
+    std::atomic<long long> acquired{0};
+    std::atomic<long long> timeouts{0};      // Chờ quá DB_POOL_WAIT_MS -> thao tác DB thất bại
+    std::atomic<long long> totalWaitUs{0};   // Tổng thời gian chờ kết nối rảnh
+    std::atomic<long long> maxWaitUs{0};
+    std::atomic<long long> reconnects{0};
+    std::atomic<long long> prepares{0};        // Lần prepare thật (cache miss)
+    std::atomic<long long> stmtCacheHits{0};   // Dùng lại statement đã prepare
+};
+
+// Pool kết nối MySQL cố định, mở sẵn lúc khởi động.
+// Mỗi kết nối chỉ được một thread dùng tại một thời điểm (mượn qua DBLease).
+class DBConnectionPool {
+public:
+    static DBConnectionPool& getInstance() {
+        static DBConnectionPool instance;
+        return instance;
+    }
+
+    // false nếu không mở được kết nối nào. Gọi lại khi đang chạy thì bỏ qua.
+    bool init(int size);
+    void shutdown();
+    void printStats();
+
+private:
+    friend class DBLease;
+
+    struct Slot {
+        MYSQL* conn = nullptr;
+        bool broken = false;  // Mất kết nối giữa chừng: mở lại ở lần mượn sau
+        bool inTransaction = false;
+        std::chrono::steady_clock::time_point lastUsed;
+        // Prepared statement theo câu SQL, chỉ sống cùng kết nối này
+        std::unordered_map<std::string, MYSQL_STMT*> statements;
+    };
+
+    DBConnectionPool() = default;
+    ~DBConnectionPool() { shutdown(); }
+
+    DBConnectionPool(const DBConnectionPool&) = delete;
+    DBConnectionPool& operator=(const DBConnectionPool&) = delete;
+
+    Slot* acquire();  // nullptr nếu pool chưa chạy hoặc chờ quá DB_POOL_WAIT_MS
+    void release(Slot* slot);
+    bool reconnect(Slot* slot);
+    static MYSQL* openConnection();
+    static void closeConnection(Slot* slot);  // Đóng statement trước rồi mới đóng kết nối
+
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::vector<Slot*> idle;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool running = false;
+    DBPoolStats stats;
+};
+
+// Mượn một kết nối trong phạm vi một hàm (RAII).
+// Lease lồng nhau trên cùng thread (hàm DBManager gọi hàm DBManager khác)
+// dùng lại kết nối đang mượn, không lấy thêm từ pool.
+class DBLease {
+public:
+    DBLease();
+    ~DBLease();
+
+    DBLease(const DBLease&) = delete;
+    DBLease& operator=(const DBLease&) = delete;
+
+    // nullptr nếu không mượn được. Tham chiếu vẫn đúng sau khi query() kết nối lại.
+    MYSQL*& handle();
+
+    // mysql_query; nếu server đã đóng kết nối (CR_SERVER_GONE_ERROR) thì
+    // kết nối lại và chạy lại đúng 1 lần. Trả về 0 nếu thành công như mysql_query.
+    int query(const std::string& sql);
+
+    // Prepared statement của kết nối đang mượn (prepare lần đầu, sau đó lấy từ cache).
+    // nullptr nếu không có kết nối hoặc câu SQL lỗi.
+    MYSQL_STMT* prepare(const char* sql);
+
+    // Mở lại kết nối (cache statement bị xóa). Dùng khi CR_SERVER_GONE_ERROR.
+    bool reconnect();
+
+    // Đang trong transaction: mất kết nối thì không được tự chạy lại câu lệnh
+    bool inTransaction() const { return slot && slot->inTransaction; }
+
+    // Số câu lệnh SQL thread hiện tại đã gửi (query + prepared execute).
+    // Lấy hiệu trước/sau một lệnh để đo số round trip của lệnh đó.
+    static long long statementCount() { return statements; }
+    static void countStatement() { statements++; }
+
+private:
+    DBConnectionPool::Slot* slot;
+    MYSQL* noConn = nullptr;
+
+    static thread_local DBConnectionPool::Slot* currentSlot;  // Kết nối thread này đang mượn
+    static thread_local int depth;
+    static thread_local long long statements;
+
+    friend class DBTransaction;
+};
+
+// Transaction trên kết nối đang mượn (RAII): hủy mà chưa commit() thì rollback.
+// Transaction lồng nhau (hàm DBManager gọi nhau) gộp vào transaction ngoài cùng:
+// chỉ đối tượng ngoài cùng thực sự COMMIT/ROLLBACK.
+class DBTransaction {
+public:
+    explicit DBTransaction(DBLease& lease);
+    ~DBTransaction();
+
+    DBTransaction(const DBTransaction&) = delete;
+    DBTransaction& operator=(const DBTransaction&) = delete;
+
+    bool ok() const { return started; }  // false nếu không mở được transaction
+    bool commit();
+
+private:
+    DBLease& lease;
+    bool started = false;
+    bool outermost = false;
+    bool done = false;
+};
+
+#endif // DB_POOL_H
@@ -0,0 +1,78 @@
+#ifndef DB_STATEMENT_H
+#define DB_STATEMENT_H
+
+#include "db_pool.h"
+#include <string>
+#include <vector>
+#include <deque>
+
+// Chạy một prepared statement (binary protocol) trên kết nối đang mượn.
+// Statement lấy từ cache của kết nối: server chỉ parse câu SQL ở lần đầu.
+// Tham số truyền qua bind() nên không cần nối/escape chuỗi vào SQL.
+// Mỗi câu SQL chỉ có một MYSQL_STMT trên một kết nối: đọc hết kết quả trước khi
+// chạy lại cùng câu đó (kể cả qua hàm DBManager lồng nhau).
+//
+//   DBStatement stmt(lease, "SELECT file_id, name FROM FILES WHERE owner_id = ?");
+//   stmt.bind(user_id);
+//   if (!stmt.execute()) return list;
+//   while (stmt.fetch()) { stmt.getInt(0); stmt.getString(1); }
+class DBStatement {
+public:
+    DBStatement(DBLease& lease, const char* sql);
+    ~DBStatement();
+
+    DBStatement(const DBStatement&) = delete;
+    DBStatement& operator=(const DBStatement&) = delete;
+
+    // Tham số theo thứ tự dấu ?
+    DBStatement& bind(long long value);
+    DBStatement& bind(const std::string& value);
+    DBStatement& bindNull();
+
+    bool execute();  // Chạy và nhận toàn bộ kết quả về client (store_result)
+    // Như execute() nhưng không đệm kết quả: mỗi fetch() đọc một dòng từ socket (tương đương
+    // mysql_use_result). Phải đọc hết hoặc hủy statement trước khi chạy câu khác trên kết nối.
+    bool executeStreaming();
+    bool fetch();    // Sang dòng tiếp theo; false khi hết dòng hoặc lỗi
+
+    bool isNull(int col) const;
+    long long getInt(int col) const;          // NULL -> 0
+    std::string getString(int col) const;     // NULL -> ""
+
+    long long affectedRows() const;
+    long long insertId() const;
+    const char* error() const;
+    unsigned int errorCode() const;  // mysql_stmt_errno, vd 1062 = trùng khóa
+
+private:
+    struct Param {
+        enum_field_types type;
+        long long intValue = 0;
+        std::string strValue;
+        unsigned long length = 0;
+        bool isNull = false;
+    };
+
+    struct Column {
+        bool isInt = false;
+        long long intValue = 0;
+        std::vector<char> buffer;
+        unsigned long length = 0;
+        bool isNull = false;
+        bool error = false;
+    };
+
+    bool executeOnce();
+    bool bindResult();
+
+    DBLease& lease;
+    const char* sql;
+    MYSQL_STMT* stmt;
+    std::deque<Param> params;  // deque: địa chỉ không đổi khi thêm tham số
+    std::vector<Column> columns;
+    std::vector<MYSQL_BIND> resultBinds;
+    bool hasResult = false;
+    bool buffered = true;
+};
+
+#endif // DB_STATEMENT_H
@@ -0,0 +1,74 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <utility>
+
+// Cache LRU có giới hạn số phần tử, dùng chung giữa các thread (một mutex).
+// Đầy thì bỏ phần tử lâu không dùng nhất.
+template <typename Key, typename Value>
+class LruCache {
+public:
+    explicit LruCache(size_t capacity) : capacity(capacity) {}
+
+    // true và ghi vào out nếu có trong cache
+    bool get(const Key& key, Value& out) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            misses++;
+            return false;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        out = it->second->second;
+        hits++;
+        return true;
+    }
+
+    void put(const Key& key, const Value& value) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            it->second->second = value;
+            entries.splice(entries.begin(), entries, it->second);
+            return;
+        }
+        entries.emplace_front(key, value);
+        index[key] = entries.begin();
+        if (entries.size() > capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+
+    void erase(const Key& key) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = index.find(key);
+        if (it == index.end()) return;
+        entries.erase(it->second);
+        index.erase(it);
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return entries.size();
+    }
+
+    long long hitCount() const { return hits.load(); }
+    long long missCount() const { return misses.load(); }
+
+private:
+    using Entry = std::pair<Key, Value>;
+
+    size_t capacity;
+    std::list<Entry> entries;  // Đầu list = vừa dùng
+    std::unordered_map<Key, typename std::list<Entry>::iterator> index;
+    std::mutex mtx;
+    std::atomic<long long> hits{0};
+    std::atomic<long long> misses{0};
+};
+
+#endif // LRU_CACHE_H
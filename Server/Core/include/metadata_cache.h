@@ -0,0 +1,100 @@
+#ifndef METADATA_CACHE_H
+#define METADATA_CACHE_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+// Một dòng FILES (chưa xóa) trong cache
+struct MetadataNode {
+    long long file_id = 0;
+    long long owner_id = 0;
+    long long parent_id = 0;        // 0 = thư mục gốc (parent_id IS NULL)
+    std::string name;
+    bool is_folder = false;
+    long long size_bytes = 0;
+    long long subtree_bytes = 0;    // Folder: subtree_size_bytes
+    std::string owner;              // username của owner
+    std::string path;               // FILES.path, vd "/1/4/9/"
+};
+
+// Cache metadata FILES trong process: mỗi folder đã đọc giữ danh sách con đầy đủ (mọi owner),
+// tra node theo file_id qua index. Nạp lười ở lần LIST đầu tiên, bỏ folder lâu không dùng
+// nhất (LRU) khi vượt maxBytes.
+//
+// DBManager gọi các hàm on...() sau khi transaction thay đổi FILES đã commit, nên folder
+// đang nằm trong cache luôn khớp DB. Chống ghi đè bằng dữ liệu cũ giống AclCache: lấy
+// epoch trước khi đọc DB, storeFolder() bỏ qua nếu trong lúc đó có thay đổi hoặc còn
+// UpdateGuard đang mở (dòng đã commit nhưng on...() chưa chạy, cộng delta sẽ bị trùng).
+class MetadataCache {
+public:
+    explicit MetadataCache(size_t maxBytes) : maxBytes(maxBytes) {}
+
+    // Mở trước transaction thay đổi FILES, giữ đến khi đã gọi xong on...()
+    class UpdateGuard {
+    public:
+        explicit UpdateGuard(MetadataCache& cache) : cache(cache) { cache.writers++; cache.epoch++; }
+        ~UpdateGuard() { cache.epoch++; cache.writers--; }
+        UpdateGuard(const UpdateGuard&) = delete;
+        UpdateGuard& operator=(const UpdateGuard&) = delete;
+    private:
+        MetadataCache& cache;
+    };
+
+    // Key của danh sách gốc của một user (parent_id IS NULL); folder thường dùng chính file_id
+    static long long rootKey(long long owner_id) { return -owner_id; }
+
+    // Danh sách con của folder, thứ tự: folder trước, mới tạo trước (file_id giảm dần)
+    bool lookupChildren(long long key, std::vector<MetadataNode>& out);
+    bool lookupNode(long long file_id, MetadataNode& out);
+
+    unsigned long long currentEpoch() const { return epoch.load(); }
+    // folderPath: FILES.path của folder ("" với danh sách gốc)
+    void storeFolder(long long key, const std::string& folderPath,
+                     std::vector<MetadataNode> children, unsigned long long seenEpoch);
+
+    // Write-through sau commit
+    void onInsert(const MetadataNode& node);
+    void onRename(long long file_id, const std::string& newName);
+    void onDelete(long long file_id, const std::string& path);
+    // Cộng subtree_bytes cho levels folder sâu nhất trong folderPath (folder đó và các cấp trên),
+    // levels = số dòng adjustFolderTotals đã cập nhật (DB dừng phía trên folder đã xóa)
+    void onTotalsChanged(const std::string& folderPath, long long deltaBytes, long long levels);
+
+    void printStats();
+
+private:
+    struct Folder {
+        std::string path;
+        std::vector<MetadataNode> children;
+        size_t bytes = 0;
+        std::list<long long>::iterator lruPos;
+    };
+
+    static size_t nodeBytes(const MetadataNode& node);
+    static bool childBefore(const MetadataNode& a, const MetadataNode& b);
+
+    // Các hàm dưới yêu cầu đang giữ mtx
+    void touch(Folder& folder);
+    void eraseFolder(long long key);
+    void evictIfNeeded();
+    MetadataNode* findNode(long long file_id);
+
+    size_t maxBytes;
+    size_t usedBytes = 0;
+    std::list<long long> lru;                          // Đầu list = folder vừa dùng
+    std::unordered_map<long long, Folder> folders;     // key -> danh sách con
+    std::unordered_map<long long, long long> nodeIndex;  // file_id -> key của folder chứa node
+    std::unordered_map<long long, std::string> ownerNames;  // owner_id -> username (username không đổi)
+    std::mutex mtx;
+    std::atomic<unsigned long long> epoch{0};
+    std::atomic<int> writers{0};                       // Số UpdateGuard đang mở
+    std::atomic<long long> hits{0};
+    std::atomic<long long> misses{0};
+    std::atomic<long long> evictions{0};
+};
+
+#endif // METADATA_CACHE_H
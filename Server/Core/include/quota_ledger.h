@@ -0,0 +1,70 @@
+#ifndef QUOTA_LEDGER_H
+#define QUOTA_LEDGER_H
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+class QuotaLedger;
+
+// Dung lượng đã giữ chỗ cho một upload. Hủy (hết mọi bản sao shared_ptr) thì trả lại chỗ.
+// Upload xong thì addFile đã cộng vào storage_used trước khi reservation được hủy.
+class QuotaReservation {
+public:
+    QuotaReservation(long long user_id, long long bytes) : user_id(user_id), bytes(bytes) {}
+    ~QuotaReservation();
+
+    QuotaReservation(const QuotaReservation&) = delete;
+    QuotaReservation& operator=(const QuotaReservation&) = delete;
+
+    long long userId() const { return user_id; }
+    long long size() const { return bytes; }
+
+private:
+    long long user_id;
+    long long bytes;
+};
+
+// Sổ quota trong process: used (đồng bộ với USERS.storage_used_bytes) + reserved (upload đang chạy).
+// Kiểm tra quota là O(1) trên map, không SUM() trên FILES. Tài khoản nạp từ DB ở lần dùng đầu.
+class QuotaLedger {
+public:
+    static QuotaLedger& getInstance() {
+        static QuotaLedger instance;
+        return instance;
+    }
+
+    // Giữ chỗ bytes cho user; nullptr nếu vượt storage_limit_bytes hoặc không đọc được DB
+    std::shared_ptr<QuotaReservation> reserve(long long user_id, long long bytes);
+
+    // DBManager gọi sau khi transaction thay đổi storage_used_bytes đã commit
+    void onUsageChanged(long long user_id, long long delta);
+
+    void printStats();
+
+private:
+    friend class QuotaReservation;
+
+    struct Account {
+        long long used = 0;
+        long long limit = 0;
+        long long reserved = 0;
+    };
+
+    QuotaLedger() = default;
+    QuotaLedger(const QuotaLedger&) = delete;
+    QuotaLedger& operator=(const QuotaLedger&) = delete;
+
+    bool ensureLoaded(long long user_id);
+    void release(long long user_id, long long bytes);
+
+    std::unordered_map<long long, Account> accounts;
+    std::mutex mtx;
+    // Tăng mỗi khi usage đổi trên tài khoản chưa nạp: lần nạp đang chạy song song phải đọc lại
+    std::atomic<unsigned long long> unloadedChanges{0};
+    std::atomic<long long> reservations{0};
+    std::atomic<long long> rejections{0};
+};
+
+#endif // QUOTA_LEDGER_H
@@ -4,6 +4,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include "server.h"
 #include "db_manager.h"
 
@@ -20,42 +25,48 @@ class CmdHandler {
 public:
     static std::string handleList(const ClientSession& session, long long parent_id = 0);
     static std::string handleListShared(const ClientSession& session, long long parent_id = -1);
-    static std::string handleSearch(const ClientSession& session, const std::string& keyword);
+    // LIST/LISTSHARED có phân trang: sort = name|size|date, tối đa pageSize dòng sau cursor
+    // ("" = trang đầu). Dòng cuối "NEXT <cursor>" nếu còn trang sau.
+    static std::string handleListPage(const ClientSession& session, long long parent_id, const std::string& sort,
+                                      long long pageSize, const std::string& cursor);
+    static std::string handleListSharedPage(const ClientSession& session, long long parent_id, const std::string& sort,
+                                            long long pageSize, const std::string& cursor);
+    static std::string handleSearch(const ClientSession& session, const std::string& keyword, long long page = 0);
     static std::string handleShare(const ClientSession& session, const std::string& filename, const std::string& targetUser);
     static std::string handleDelete(const ClientSession& session, const std::string& filename);
     static std::string handleRename(const ClientSession& session, long long fileId, const std::string& newName);
 
-    static std::string handleShareFolder(const ClientSession& session, long long folder_id, const std::string& targetUser);
+    // copy = false: share quyền qua SHAREDFILES; true: mời targetUser nhận bản chép của cây (FolderShareHandler)
+    static std::string handleShareFolder(const ClientSession& session, long long folder_id, const std::string& targetUser,
+                                         bool copy = false);
     static std::string handleGetFolderStructure(const ClientSession& session, long long folder_id);
 };
 
 // Xử lý chuẩn bị I/O (Quota check, Permission check trước khi upload/download)
 class FileIOHandler {
 public:
-    static std::string handleQuotaCheck(const ClientSession& session, long filesize);
-    static bool checkDownloadPermission(const ClientSession& session, const std::string& filename);
-};
-
-struct FileTransferInfo {
-    long long old_file_id;
-    long long new_file_id;
-    std::string name;
-    std::string relative_path;
-    long long size_bytes;
-    bool uploaded;
+    // Giữ chỗ filesize trong QuotaLedger cho STOR kế tiếp (session.quotaReservation)
+    static std::string handleQuotaCheck(ClientSession& session, long filesize);
+    // blob_id: blob của file được phép tải (DBManager::findDownloadBlob)
+    static bool checkDownloadPermission(const ClientSession& session, const std::string& filename, long long& blob_id);
 };
 
+// Lời mời chép folder (SHARE_FOLDER ... COPY): "pending" tới khi người nhận ACCEPT_FOLDER_COPY, rồi "completed"
 struct FolderShareSession {
     std::string session_id;
     std::string owner_username;
+    long long owner_id;
     long long source_folder_id;
+    std::string folder_name;
     std::string recipient_username;
+    long long recipient_id;
     long long new_root_folder_id;
-    std::vector<FileTransferInfo> files_to_transfer;
-    std::map<long long, long long> old_to_new_id_map;
     int total_files;
     int completed_files;
     std::string status;
+
+    std::mutex mtx;  // Khóa các trường tiến độ; session_id, id và total_files không đổi sau khi tạo
+    std::atomic<long long> last_activity_ms{0};  // steady_clock, quá FOLDER_SHARE_SESSION_TTL thì bị hủy
 };
 
 class FolderShareHandler {
@@ -65,37 +76,53 @@ public:
         return instance;
     }
     
+    // Tạo lời mời chép folder cho người nhận (status "pending"): chưa chép gì, chưa trừ quota của ai.
+    // "" nếu lỗi
     std::string initiateFolderShare(const std::string& owner_username, 
                                     long long folder_id, 
                                     const std::string& recipient_username);
+
+    // Người nhận đồng ý: chép cây ngay trên server (DBManager::cloneFolder), trừ quota của người nhận.
+    // Status "pending" -> "accepting" (đang chép, không giữ khóa phiên) -> "completed"; lỗi thì về "pending".
+    // Chạy lâu với cây lớn: worker gọi qua handOffCommand, không gọi trên event loop
+    // Trả về file_id folder mới; -1 nếu không phải lời mời của recipient_id, đã nhận rồi hoặc chép lỗi
+    long long acceptFolderShare(const std::string& session_id, long long recipient_id, long long& fileCount);
+
+    // Lời mời đang chờ recipient_id đồng ý
+    std::vector<std::shared_ptr<FolderShareSession>> pendingOffers(long long recipient_id);
     
-    FolderShareSession* getSession(const std::string& session_id);
-    
-    bool receiveFile(const std::string& session_id, 
-                    long long old_file_id,
-                    const char* file_data,
-                    size_t file_size);
-    
-    bool isComplete(const std::string& session_id);
-    
-    bool finalize(const std::string& session_id);
+    // nullptr nếu không có hoặc đã hết hạn; shared_ptr giữ phiên sống kể cả khi bị cleanup giữa chừng
+    std::shared_ptr<FolderShareSession> getSession(const std::string& session_id);
     
     void cleanup(const std::string& session_id);
     
     std::string getProgress(const std::string& session_id);
 
+    // Quét mọi shard ngay, không chờ chu kỳ một phút; trả về số phiên hết TTL bị hủy
+    size_t sweepAll();
+    size_t sessionCount();
+
 private:
     FolderShareHandler() {}
     ~FolderShareHandler() {}
     
-    std::map<std::string, FolderShareSession> active_sessions;
-    
-    void createFolderStructure(FolderShareSession& session, 
-                              const std::vector<FileRecordEx>& structure);
-    
-    std::string buildRelativePath(long long file_id, 
-                                  const std::vector<FileRecordEx>& all_files);
+    // Bảng phiên chia shard theo hash session_id: các worker/transfer thread khóa riêng từng shard.
+    // Phiên không được dùng quá TTL bị dọn lười khi shard được truy cập
+    static constexpr size_t SESSION_SHARDS = 16;
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, std::shared_ptr<FolderShareSession>> sessions;
+        long long last_sweep_ms = 0;
+    };
+    std::array<Shard, SESSION_SHARDS> shards;
+
+    Shard& shardFor(const std::string& session_id);
+    // Gọi khi đang giữ shard.mtx; force = bỏ qua giới hạn một lần mỗi phút
+    size_t sweepExpired(Shard& shard, long long now_ms, bool force = false);
     
+    // Gọi khi đang giữ session.mtx
+    std::string progressLocked(const FolderShareSession& session);
+
     std::string generateSessionId();
 };
 
@@ -0,0 +1,67 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <shared_mutex>
+#include <atomic>
+#include <cstdint>
+
+// Chỉ mục tên file (FILES chưa xóa) cho SEARCH: tên viết thường, posting list theo trigram.
+// Truy vấn >= 3 ký tự giao các posting list rồi kiểm tra lại bằng find(); ngắn hơn thì quét
+// toàn bộ tên. Dựng lại một lần lúc khởi động (DBManager::rebuildSearchIndex), sau đó DBManager
+// gọi các hàm on...() sau khi transaction thay đổi FILES đã commit.
+class SearchIndex {
+public:
+    static SearchIndex& getInstance() {
+        static SearchIndex instance;
+        return instance;
+    }
+
+    void clear();
+    void onInsert(long long file_id, long long owner_id, const std::string& name, const std::string& path);
+    void onRename(long long file_id, const std::string& newName);
+    // Folder: bỏ luôn mọi dòng có path nằm dưới path của nó
+    void onDelete(long long file_id, const std::string& path, bool isFolder);
+
+    // file_id khớp keyword (không phân biệt hoa thường) mà user_id thấy được: là owner, hoặc
+    // một id trong path (chính nó hay folder cha) thuộc sharedRoots. Bỏ offset kết quả đầu,
+    // trả tối đa limit. Thứ tự ổn định khi chỉ mục không đổi.
+    std::vector<long long> search(const std::string& keyword, long long user_id,
+                                  const std::unordered_set<long long>& sharedRoots,
+                                  size_t offset, size_t limit);
+
+    void printStats();
+
+private:
+    struct Doc {
+        long long file_id = 0;     // 0 = slot trống
+        long long owner_id = 0;
+        std::string name;          // Đã viết thường
+        std::string path;          // FILES.path, vd "/1/4/9/"
+    };
+
+    SearchIndex() = default;
+    SearchIndex(const SearchIndex&) = delete;
+    SearchIndex& operator=(const SearchIndex&) = delete;
+
+    static std::string lower(const std::string& s);
+    static std::vector<uint32_t> trigrams(const std::string& s);
+    static bool visible(const Doc& doc, long long user_id, const std::unordered_set<long long>& sharedRoots);
+
+    // Các hàm dưới yêu cầu đang giữ lock ghi
+    void addPostings(uint32_t slot);
+    void removeSlot(uint32_t slot);
+
+    std::vector<Doc> docs;
+    std::vector<uint32_t> freeSlots;
+    std::unordered_map<long long, uint32_t> slotOf;                 // file_id -> slot trong docs
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings;   // trigram -> slot (tăng dần)
+    std::shared_mutex mtx;
+    std::atomic<long long> searches{0};
+    std::atomic<long long> totalMicros{0};
+};
+
+#endif // SEARCH_INDEX_H
@@ -4,16 +4,30 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
+#include <cstdint>
 #include <netinet/in.h>
+#include "quota_ledger.h"
 
 // Trạng thái của một Client đang kết nối
 struct ClientSession {
     int socketFd;
     std::string username;
+    long long userId;       // Lấy một lần khi PASS thành công, -1 khi chưa đăng nhập
     bool isAuthenticated;
     std::string currentDir;
+    std::string inBuf;  // Byte đã nhận nhưng chưa đủ dòng lệnh (tách theo '\n')
 
-    ClientSession() : socketFd(-1), isAuthenticated(false), currentDir("/") {}
+    // Phản hồi chưa gửi hết, worker drain bằng sendmsg() khi có EPOLLOUT
+    std::deque<std::string> outQueue;
+    size_t outHeadOffset = 0;   // Byte đã gửi của outQueue.front()
+    size_t outBytes = 0;        // Tổng byte còn chờ gửi
+    uint32_t epollEvents = 0;   // Events đang đăng ký với epoll của worker
+
+    // Chỗ đã giữ bởi SITE QUOTA_CHECK, STOR lấy đi; session bị hủy thì tự trả lại
+    std::shared_ptr<QuotaReservation> quotaReservation;
+
+    ClientSession() : socketFd(-1), userId(-1), isAuthenticated(false), currentDir("/") {}
 };
 
 #endif // SERVER_H
\ No newline at end of file
@@ -1,6 +1,14 @@
 #ifndef SERVER_CONFIG_H
 #define SERVER_CONFIG_H
 
+#include <cstddef>
+
+// Cách server chạy upload/download (chọn lúc khởi động bằng --transfer-mode=...)
+enum class TransferMode {
+    Dedicated,  // Socket chuyển sang thread của TransferExecutor, I/O blocking
+    Epoll       // State machine non-blocking ngay trong epoll của WorkerThread
+};
+
 // Cấu hình tập trung cho toàn bộ server
 struct ServerConfig {
     // ============ NETWORK CONFIG ============
@@ -11,15 +19,23 @@ struct ServerConfig {
     static constexpr int FIXED_WORKER_THREADS = 10;  // Số worker threads cố định trong pool
     
     // ============ DEDICATED THREAD CONFIG ============
-    // File I/O threads - điều chỉnh theo:
+    // File I/O threads (TransferExecutor, tạo sẵn lúc khởi động) - điều chỉnh theo:
     // - RAM: 8GB → 100-200 threads OK
     // - HDD: 50-100 (tránh thrashing)
     // - SSD: 100-300 (tốc độ cao hơn)
     static constexpr int MAX_DEDICATED_THREADS = 100;  // Upload/Download đồng thời
+    static constexpr int TRANSFER_QUEUE_CAPACITY = 1000;   // Transfer chờ tối đa, vượt quá -> 503
+    static constexpr long SMALL_TRANSFER_BYTES = 1048576;  // <= 1MB: hàng đợi ưu tiên cao
+    static constexpr int TRANSFER_STARVATION_MS = 2000;    // Chờ quá lâu thì task ưu tiên thấp được chạy trước
+    
+    // ============ TRANSFER MODE ============
+    // Giá trị duy nhất không phải constexpr: main() ghi đè từ tham số dòng lệnh trước khi tạo thread
+    static inline TransferMode transferMode = TransferMode::Dedicated;
+    static constexpr size_t MAX_EPOLL_TRANSFERS_PER_WORKER = 500;  // Vượt quá -> 503
     
     // ============ MONITOR CONFIG ============
     static constexpr int MONITOR_INTERVAL_SECONDS = 5;     // In stats mỗi 5 giây
-    static constexpr int CLEANUP_INTERVAL_SECONDS = 5;     // Cleanup threads mỗi 5 giây
+    static constexpr int LATENCY_SAMPLE_WINDOW = 1024;     // Số mẫu latency gần nhất giữ cho mỗi lệnh
     
     // ============ LOAD BALANCING CONFIG ============
     // Không cần config - tự động chọn worker ít kết nối nhất
@@ -30,13 +46,38 @@ struct ServerConfig {
     static constexpr const char* DB_PASS = "040424";
     static constexpr const char* DB_NAME = "file_management";
     static constexpr int DB_PORT = 3306;
+    // Kết nối mở sẵn: một cho mỗi thread có thể chạm DB (worker, transfer thread, thread ChunkStore).
+    // Mỗi thread giữ tối đa một kết nối (lease lồng nhau dùng chung) nên acquire không phải chờ và
+    // event loop của worker không bị chặn. MySQL cần max_connections lớn hơn số này (mặc định 151)
+    static constexpr int DB_POOL_SIZE = FIXED_WORKER_THREADS + MAX_DEDICATED_THREADS + 1;
+    static constexpr int DB_POOL_WAIT_MS = 5000;      // Chỉ chờ khi có thread ngoài các thread trên (bench); quá -> thao tác DB thất bại
+    static constexpr int DB_IDLE_PING_SECONDS = 30;   // Kết nối rảnh lâu hơn thì mysql_ping trước khi dùng
+    static constexpr int LIST_STATEMENT_BUDGET = 4;   // LIST/LISTSHARED gửi quá số câu SQL này: log cảnh báo, test_list_statements fail
+    static constexpr size_t METADATA_CACHE_BYTES = 64 * 1024 * 1024;  // Cache danh sách folder (MetadataCache), vượt -> bỏ LRU
+    static constexpr int SEARCH_PAGE_SIZE = 50;       // Số kết quả mỗi trang của SEARCH
+    static constexpr int LIST_PAGE_MAX = 1000;        // Page size tối đa của LIST/LISTSHARED có phân trang
+    static constexpr int FOLDER_SHARE_SESSION_TTL_SECONDS = 3600;  // Phiên folder share bỏ dở quá lâu thì bị hủy
     
     // ============ STORAGE CONFIG ============
     static constexpr const char* STORAGE_PATH = "/home/cuong/DuAnPMCSF/File_Management_App/Server/storage/";
     static constexpr long DEFAULT_USER_QUOTA = 1073741824;  // 1GB in bytes
+    // Khử trùng lặp: blob upload từ DEDUP_MIN_BLOB_BYTES được ChunkStore cắt chunk ở thread nền
+    static constexpr bool CHUNK_DEDUP = true;
+    static constexpr long DEDUP_MIN_BLOB_BYTES = 1048576;   // Nhỏ hơn: giữ nguyên một file
+    static constexpr size_t DEDUP_QUEUE_CAPACITY = 10000;   // Hàng đợi đầy thì blob mới giữ nguyên một file
+    static constexpr int PENDING_CHUNK_TTL_SECONDS = 86400;  // PUT_CHUNK chưa được STOR_CHUNKED dùng quá lâu -> xóa, trả quota
+    static constexpr int PENDING_CHUNK_SWEEP_SECONDS = 600;  // Chu kỳ dọn chunk quá hạn và chunk ref_count 0
     
     // ============ BUFFER CONFIG ============
     static constexpr int BUFFER_SIZE = 4096;  // 4KB buffer cho file I/O
+    static constexpr size_t MAX_COMMAND_LINE = 8192;  // Dòng lệnh dài hơn -> ngắt kết nối
+    // Phản hồi tồn đọng vượt HIGH_WATER: ngừng đọc lệnh mới của client đó tới khi còn <= LOW_WATER
+    static constexpr size_t OUTPUT_HIGH_WATER = 262144;  // 256KB
+    static constexpr size_t OUTPUT_LOW_WATER = 65536;    // 64KB
+    
+    // ============ ZERO-COPY CONFIG ============
+    // Upload nhận socket -> pipe -> file bằng splice(); false = read()+write() qua buffer
+    static constexpr bool ZERO_COPY_UPLOAD = true;
 };
 
 #endif // SERVER_CONFIG_H
@@ -7,7 +7,16 @@
 #include <atomic>
 #include <map>
 #include <algorithm>
+#include <memory>
+#include <functional>
+#include <string_view>
+#include <sys/epoll.h>
 #include "server.h"
+#include "transfer_state_machine.h"
+#include "transfer_executor.h"
+#include "server_config.h"
+
+struct SubtreeEntry;  // db_manager.h
 
 // Class xử lý đa nhiệm (Worker)
 class WorkerThread {
@@ -19,33 +28,133 @@ public:
     void stop();
     int getConnectionCount() const { return client_sockets.size(); }
 
+    // Tách dòng lệnh thành tên lệnh + tham số và tra bảng lệnh như handleCommand (dùng cho bench_dispatch)
+    static std::string_view splitCommand(std::string_view line, std::string_view& arg);
+    static bool isKnownCommand(std::string_view name) { return findCommand(name) != nullptr; }
+
 private:
-    void handleClientMessage(int fd);
+    void handleClientMessage(int fd);            // Đọc socket vào inBuf của session
+    void processInput(int fd);                   // Chạy lần lượt mọi dòng lệnh đủ trong inBuf
+    void handleCommand(int fd, std::string msg); // Xử lý 1 dòng lệnh
+
+    // Bảng lệnh: tên trong Protocol.h -> handler. Handler trả về dòng phản hồi,
+    // chuỗi rỗng nếu socket đã chuyển sang transfer.
+    using CommandHandler = std::string (WorkerThread::*)(int fd, std::string_view arg);
+    struct CommandEntry {
+        std::string_view name;
+        CommandHandler handler;
+    };
+    static CommandHandler findCommand(std::string_view name);  // nullptr nếu lệnh lạ
+
+    std::string cmdUser(int fd, std::string_view arg);
+    std::string cmdPass(int fd, std::string_view arg);
+    std::string cmdRegister(int fd, std::string_view arg);
+    std::string cmdList(int fd, std::string_view arg);
+    std::string cmdListShared(int fd, std::string_view arg);
+    std::string cmdSearch(int fd, std::string_view arg);
+    std::string cmdShare(int fd, std::string_view arg);
+    std::string cmdDelete(int fd, std::string_view arg);
+    std::string cmdRename(int fd, std::string_view arg);
+    std::string cmdQuotaCheck(int fd, std::string_view arg);
+    std::string cmdUpload(int fd, std::string_view arg);
+    std::string cmdDownload(int fd, std::string_view arg);
+    std::string cmdDownloadFolder(int fd, std::string_view arg);
+    std::string cmdGetFolderStructure(int fd, std::string_view arg);
+    std::string cmdShareFolder(int fd, std::string_view arg);
+    std::string cmdChunkQuery(int fd, std::string_view arg);
+    std::string cmdPutChunk(int fd, std::string_view arg);
+    std::string cmdStorChunked(int fd, std::string_view arg);
+    std::string cmdCreateFolder(int fd, std::string_view arg);
+    std::string cmdAcceptFolderCopy(int fd, std::string_view arg);
+    std::string cmdGetFolderOffers(int fd, std::string_view arg);
+    std::string cmdCheckShareProgress(int fd, std::string_view arg);
+    std::string cmdCancelFolderShare(int fd, std::string_view arg);
+    std::string cmdGenerateShareCode(int fd, std::string_view arg);
+    std::string cmdRedeemShareCode(int fd, std::string_view arg);
+    std::string cmdGetMyShares(int fd, std::string_view arg);
+    std::string cmdRevokeShare(int fd, std::string_view arg);
+    std::string cmdGetMyShareCodes(int fd, std::string_view arg);
+    std::string cmdDeleteShareCode(int fd, std::string_view arg);
+    std::string cmdGuestRedeem(int fd, std::string_view arg);
+    std::string cmdGuestList(int fd, std::string_view arg);
+    std::string cmdGuestDownload(int fd, std::string_view arg);
+    std::string cmdGuestDownloadFolder(int fd, std::string_view arg);
+    
+    // Phản hồi đi qua hàng đợi của session, không chặn worker khi client đọc chậm
+    void queueResponse(int fd, std::string data);
+    void handleClientWritable(int fd);
+    void updateClientEvents(int fd, ClientSession& session);  // Gọi khi đang giữ mtx
     
     // CẬP NHẬT: Thêm tham số closeSocket (mặc định là true)
     // Nếu false: Chỉ ngừng theo dõi, không đóng socket (để chuyển cho thread khác)
     void removeClient(int fd, bool closeSocket = true);
 
+    // Đánh thức epoll_wait từ thread khác (pendingInput, stop)
+    void wakeUp();
+
+    // Chuyển socket sang TransferExecutor (transfer ở --transfer-mode=dedicated, handOffCommand).
+    // false nếu hàng đợi đầy, socket vẫn thuộc worker (caller trả 503)
+    bool handOffTransfer(int fd, TransferPriority priority, std::function<void(const ClientSession&)> job);
+    // Lệnh chặn lâu (chép folder, commit upload): chạy work trên TransferExecutor, gửi phản hồi
+    // nó trả về rồi trả socket về worker. Mọi transfer mode; false nếu hàng đợi đầy
+    bool handOffCommand(int fd, TransferPriority priority, std::function<std::string()> work);
+    // DOWNLOAD_FOLDER / GUEST_DOWNLOAD_FOLDER theo transfer mode hiện tại; false -> 503
+    bool startFolderDownload(int fd, long long folder_id, const std::string& folderName);
+    // Nhận size byte ngay sau dòng lệnh vào tempPath (phần đã nằm trong inBuf trước) rồi gọi commit,
+    // theo transfer mode hiện tại. Trả về "" nếu đã chuyển socket sang transfer, ngược lại là phản hồi lỗi
+    std::string startTempUpload(int fd, const std::string& tempPath, long size, TempUploadCommit commit);
+
+    // --transfer-mode=epoll: transfer chạy ngay trên event loop này
+    bool canStartTransfer() const { return transfers.size() < ServerConfig::MAX_EPOLL_TRANSFERS_PER_WORKER; }
+    void startTransfer(int fd, std::unique_ptr<TransferStateMachine> transfer);
+    void handleTransferEvent(int fd, uint32_t events);
+    void applyTransferResult(int fd, TransferStateMachine::Result result);
+    void checkTransferTimers();
+
     std::vector<int> client_sockets;
     std::map<int, ClientSession> sessions;
     std::mutex mtx;
     std::atomic<bool> running;
     int epoll_fd;  // epoll file descriptor
+    int wake_fd;   // eventfd trong epoll_fd, ghi vào bởi wakeUp()
     std::thread::id myThreadId;  // Lưu thread ID thực tế của worker này
+    std::string lastCommand;     // Lệnh vừa xử lý, để đo latency
+    std::vector<int> pendingInput;  // Socket trả về từ transfer còn lệnh trong inBuf (ghi dưới mtx)
+    
+    // Chỉ truy cập từ thread chạy run() nên không cần khóa
+    struct TransferSlot {
+        std::unique_ptr<TransferStateMachine> machine;
+        uint32_t armedEvents = EPOLLIN;  // Events đang đăng ký với epoll cho fd này
+    };
+    std::map<int, TransferSlot> transfers;
 };
 
 // Class xử lý riêng (Dedicated)
 class DedicatedThread {
 public:
-    void handleUpload(int socketFd, std::string filename, long filesize, std::string username, long long parent_id, WorkerThread* workerRef);
-    void handleDownload(int socketFd, std::string filename, std::string username, WorkerThread* workerRef);
-    void handleFolderDownload(int socketFd, long long folder_id, const std::string& folderName, const std::string& username, WorkerThread* workerRef);
+    // session: bản sao session của worker, trả nguyên về worker khi transfer xong
+    void handleUpload(int socketFd, std::string filename, long filesize, const ClientSession& session, long long parent_id, WorkerThread* workerRef);
+    // PUT_CHUNK, STOR_CHUNKED: nhận vào tempPath rồi gửi phản hồi của commit.
+    // initialData: phần dữ liệu worker đã lỡ đọc vào inBuf cùng dòng lệnh
+    void handleTempUpload(int socketFd, const std::string& tempPath, long filesize,
+                          const std::string& initialData, const TempUploadCommit& commit,
+                          const ClientSession& session, WorkerThread* workerRef);
+    // expectAcks = false cho guest client (không gửi 151 ACK sau mỗi 1MB)
+    // blob_id lấy từ FILES (checkDownloadPermission / getBlobId); filename dùng cho file cũ chưa vào BlobStore
+    void handleDownload(int socketFd, long long blob_id, std::string filename, const ClientSession& session, WorkerThread* workerRef, bool expectAcks = true);
+    void handleFolderDownload(int socketFd, long long folder_id, const std::string& folderName,
+                              const ClientSession& session, WorkerThread* workerRef);
     
 private:
     void sendFile(int socketFd, const std::string& fullPath, const std::string& relativePath);
-    void sendFileFromDb(int socketFd, const std::string& filename, const std::string& relativePath);
-    void sendDirectoryFromDb(int socketFd, long long folder_id, const std::string& relativePath, const std::string& username);
+    // false nếu gửi hỏng giữa chừng: header đã báo kích thước nên cả luồng folder phải ngắt
+    bool sendFileFromDb(int socketFd, long long blob_id, const std::string& filename, const std::string& relativePath);
+    bool sendDirectoryFromDb(int socketFd, const std::string& rootPath, const std::vector<SubtreeEntry>& subtree);
     void sendDirectory(int socketFd, const std::string& basePath, const std::string& relativePath);
+    void waitForChunkAck(int socketFd);
+    // Nhận body upload vào fileFd từ vị trí alreadyReceived, trả về tổng byte đã có (< filesize nếu mất kết nối)
+    long receiveBody(int socketFd, int fileFd, long alreadyReceived, long filesize, bool sendAcks);
+    void returnToWorker(int socketFd, const ClientSession& session, WorkerThread* workerRef);
 };
 
 // Class chấp nhận kết nối (Acceptor)
@@ -8,7 +8,7 @@
 #include <chrono>
 #include <vector>
 #include <map>
-#include <set>
+#include <string>
 #include <iostream>
 
 // Forward declaration
@@ -18,6 +18,7 @@ class WorkerThread;
 struct ThreadStats {
     std::atomic<int> activeWorkerThreads{0};      // Số WorkerThread đang chạy
     std::atomic<int> activeDedicatedThreads{0};   // Số DedicatedThread đang chạy
+    std::atomic<int> activeEpollTransfers{0};     // Số transfer đang chạy trong epoll của worker
     std::atomic<int> totalConnections{0};         // Tổng số connections đang xử lý
     std::atomic<long long> totalBytesTransferred{0}; // Tổng bytes đã transfer
 };
@@ -40,22 +41,19 @@ public:
     void reportWorkerThreadEnd();
     void reportDedicatedThreadStart();
     void reportDedicatedThreadEnd();
+    void reportEpollTransferStart();
+    void reportEpollTransferEnd();
     void reportConnectionCount(std::thread::id workerId, int count);  // Báo cáo từ từng worker
     void reportBytesTransferred(long long bytes);
+    void reportCommandLatency(const std::string& command, long long micros);  // Thời gian worker xử lý 1 lệnh
 
     // Lấy thông tin stats (cho admin console)
     void printStats();
     
-    bool canCreateDedicatedThread();  // Kiểm tra còn slot để tạo DedicatedThread không
-    
     // Quản lý Worker Thread Pool
     void registerWorkerThread(WorkerThread* worker, std::thread::id threadId);
     void unregisterWorkerThread(std::thread::id threadId);
     int getActiveWorkerCount() const;
-    
-    // Quản lý Dedicated Thread Pool (cleanup finished threads)
-    void registerDedicatedThread(std::thread::id threadId, std::thread&& thread);
-    void cleanupFinishedThreads();
 
 private:
     ThreadMonitor() = default;
@@ -75,13 +73,17 @@ private:
     std::map<std::thread::id, WorkerThread*> workerPool;
     std::map<std::thread::id, int> workerConnections;  // Track connections per worker
     
-    // Dedicated Thread Pool (cho cleanup)
-    std::mutex dedicatedMutex;
-    std::vector<std::thread> dedicatedThreads;
-    std::set<std::thread::id> finishedThreadIds;
+    // Latency theo lệnh: vòng LATENCY_SAMPLE_WINDOW mẫu gần nhất, in p50/p99/max
+    struct LatencyWindow {
+        std::vector<long long> samples;
+        size_t next = 0;
+        long long count = 0;
+    };
+    std::mutex latencyMutex;
+    std::map<std::string, LatencyWindow> commandLatency;
+    void printLatencyStats();
     
     // Ngưỡng cảnh báo - Sử dụng ServerConfig
-    static constexpr int MAX_DEDICATED_THREADS = ServerConfig::MAX_DEDICATED_THREADS;
     static constexpr int FIXED_WORKER_THREADS = ServerConfig::FIXED_WORKER_THREADS;
 };
 
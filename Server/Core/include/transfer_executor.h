@@ -0,0 +1,81 @@
+#ifndef TRANSFER_EXECUTOR_H
+#define TRANSFER_EXECUTOR_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <functional>
+
+// Mức ưu tiên của một transfer trong hàng đợi
+enum class TransferPriority {
+    High = 0,    // File nhỏ: xong nhanh, không nên chờ sau file lớn
+    Normal = 1,  // STOR/RETR thường
+    Low = 2      // Folder download, guest
+};
+
+// Số liệu của từng hàng đợi (in ra cùng SYSTEM STATS)
+struct TransferQueueStats {
+    std::atomic<long long> submitted{0};
+    std::atomic<long long> completed{0};
+    std::atomic<long long> rejected{0};     // Hàng đợi đầy -> 503
+    std::atomic<long long> totalWaitMs{0};  // Tổng thời gian chờ trong hàng đợi
+    std::atomic<long long> maxWaitMs{0};
+    size_t maxDepth = 0;                    // Ghi dưới queueMutex
+};
+
+// Pool thread cố định cho upload/download.
+// Thread được tạo một lần lúc start(), transfer vượt quá số thread thì chờ trong
+// hàng đợi có giới hạn thay vì bị từ chối ngay.
+class TransferExecutor {
+public:
+    static TransferExecutor& getInstance() {
+        static TransferExecutor instance;
+        return instance;
+    }
+
+    void start(int threadCount, size_t queueCapacity);
+
+    // Dừng nhận việc mới, chờ các transfer đang chạy xong. Việc còn trong hàng đợi bị bỏ,
+    // socket của nó bị đóng (client thấy mất kết nối thay vì treo).
+    void stop();
+
+    // fd: socket client mà task sở hữu, bị đóng nếu task bị bỏ lúc stop()
+    // false nếu hàng đợi đã đầy (hoặc executor chưa chạy): caller trả 503 cho client
+    bool submit(TransferPriority priority, int fd, std::function<void()> task);
+
+    void printStats();
+
+private:
+    TransferExecutor() = default;
+    ~TransferExecutor() { stop(); }
+
+    TransferExecutor(const TransferExecutor&) = delete;
+    TransferExecutor& operator=(const TransferExecutor&) = delete;
+
+    struct Task {
+        std::function<void()> fn;
+        int fd = -1;
+        std::chrono::steady_clock::time_point enqueuedAt;
+    };
+
+    static constexpr int PRIORITY_COUNT = 3;
+
+    void workerLoop();
+    int pickQueue();  // Gọi khi đang giữ queueMutex và có ít nhất 1 task
+
+    std::vector<std::thread> threads;
+    std::mutex queueMutex;
+    std::condition_variable queueCv;
+    std::deque<Task> queues[PRIORITY_COUNT];
+    size_t queuedCount = 0;
+    size_t capacity = 0;
+    bool running = false;
+    std::atomic<int> busyThreads{0};
+    TransferQueueStats stats[PRIORITY_COUNT];
+};
+
+#endif // TRANSFER_EXECUTOR_H
@@ -0,0 +1,113 @@
+#ifndef TRANSFER_STATE_MACHINE_H
+#define TRANSFER_STATE_MACHINE_H
+
+#include "server.h"
+#include "zero_copy_io.h"
+#include "blob_store.h"
+#include <string>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include <sys/types.h>
+
+// Upload/download non-blocking chạy ngay trong vòng epoll của WorkerThread
+// (chế độ --transfer-mode=epoll). Mỗi lần socket sẵn sàng, worker gọi advance():
+// state machine chuyển dữ liệu tới khi gặp EAGAIN rồi trả quyền lại cho event loop.
+// Giao thức trên dây giống hệt DedicatedThread (150 / 151 mỗi 1MB / 226).
+
+// Upload vào file tạm (PUT_CHUNK, STOR_CHUNKED): nhận đủ thì gọi hàm này, giá trị trả về
+// là dòng phản hồi cho client. Hàm tự xử lý file tạm; nhận dở dang thì file tạm bị xóa, không gọi.
+using TempUploadCommit = std::function<std::string()>;
+
+class TransferStateMachine {
+public:
+    enum class Result {
+        Pending,   // Còn dữ liệu, chờ epoll báo wantedEvents()
+        Finished,  // Xong, socket quay về chế độ lệnh
+        Failed     // Lỗi/peer đóng kết nối: worker đóng socket
+    };
+
+    // Trả về nullptr nếu không bắt đầu được; error là dòng phản hồi gửi cho client
+    static std::unique_ptr<TransferStateMachine> createUpload(int socketFd, const std::string& filename, long filesize,
+                                                              const ClientSession& session, long long parent_id,
+                                                              std::shared_ptr<QuotaReservation> quota,
+                                                              std::string& error);
+    // Nhận filesize byte vào tempPath rồi gọi commit. Không gửi 151 ACK;
+    // initialData là phần dữ liệu đã nằm trong inBuf của session
+    static std::unique_ptr<TransferStateMachine> createTempUpload(int socketFd, const std::string& tempPath,
+                                                                  long filesize, const std::string& initialData,
+                                                                  TempUploadCommit commit, std::string& error);
+    static std::unique_ptr<TransferStateMachine> createDownload(int socketFd, long long blob_id, const std::string& filename,
+                                                                bool expectAcks, std::string& error);
+    // Luồng folder (TYPE_DIR / TYPE_FILE / TYPE_END), gửi kèm dòng "150 Ready to send folder"
+    static std::unique_ptr<TransferStateMachine> createFolderDownload(int socketFd, long long folder_id,
+                                                                      const std::string& folderName);
+
+    ~TransferStateMachine();
+    TransferStateMachine(const TransferStateMachine&) = delete;
+    TransferStateMachine& operator=(const TransferStateMachine&) = delete;
+
+    Result advance();
+    Result onTimer(std::chrono::steady_clock::time_point now);  // Hết hạn chờ 151 ACK thì gửi tiếp
+    uint32_t wantedEvents() const;                               // EPOLLIN hoặc EPOLLOUT
+    void prependOutput(const std::string& data) { outBuf.insert(0, data); }  // Phản hồi tồn đọng của session
+    // Upload đã nhận đủ (Finished): phần ghi DB / kiểm tra chunk còn lại, trả về dòng phản hồi.
+    // Worker chạy nó qua TransferExecutor thay vì trên event loop; rỗng với download
+    TempUploadCommit takeCommit() { return std::move(pendingCommit); }
+
+private:
+    enum class State { Sending, WaitingAck, Receiving, SendingFolder, Finishing };
+
+    struct FolderEntry {
+        std::string relativePath;
+        std::string storageName;  // Tên file cũ (fallback của BlobReader::open), rỗng nếu là folder
+        long long blobId;
+        bool isDir;
+    };
+
+    TransferStateMachine(int socketFd, int fileFd, State state);
+
+    bool flushOutput();  // false nếu lỗi socket
+    Result pumpSend();
+    Result pumpReceive();
+    Result readAck();
+    Result pumpFolder();
+    void finishUpload();
+
+    int socketFd;
+    int fileFd;
+    int savedSocketFlags;
+    State state;
+    std::string outBuf;  // Dòng trạng thái (150/151/226) chưa gửi hết
+    off_t offset = 0;
+    long fileSize = 0;
+    long long bytesDone = 0;  // Byte của các file đã gửi xong (folder)
+
+    // Download, upload (false = upload vào file tạm)
+    bool expectAcks = true;
+    off_t nextAckAt = 0;
+    std::chrono::steady_clock::time_point ackDeadline;
+
+    // Upload
+    std::string filename;
+    std::string path;  // File tạm, commit vào BlobStore khi xong
+    long long userId = -1;
+    long long parentId = 0;
+    std::shared_ptr<QuotaReservation> quota;  // Trả lại khi transfer bị hủy hoặc sau addFile
+    long bytesSinceLastAck = 0;
+    SplicePipe pipe;
+    TempUploadCommit commitTemp;  // Có: createTempUpload, gọi thay cho addFile
+    TempUploadCommit pendingCommit;  // finishUpload đặt, worker lấy bằng takeCommit
+
+    // Download: blob đang gửi (file hoặc chuỗi chunk)
+    std::unique_ptr<BlobReader> blob;
+
+    // Folder download
+    std::vector<FolderEntry> folderEntries;
+    size_t nextEntry = 0;
+    bool corked = false;
+};
+
+#endif // TRANSFER_STATE_MACHINE_H
@@ -0,0 +1,55 @@
+#ifndef ZERO_COPY_IO_H
+#define ZERO_COPY_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+// Pipe trung gian cho splice() (file/socket <-> pipe <-> socket/file)
+struct SplicePipe {
+    int readFd = -1;
+    int writeFd = -1;
+
+    SplicePipe() = default;
+    SplicePipe(const SplicePipe&) = delete;
+    SplicePipe& operator=(const SplicePipe&) = delete;
+    ~SplicePipe() { close(); }
+
+    bool open();
+    void close();
+    bool isOpen() const { return readFd >= 0; }
+};
+
+// Các primitive truyền file không copy dữ liệu qua user space.
+// Dùng chung cho RETR, GUEST_DOWNLOAD và folder download.
+class ZeroCopyIO {
+public:
+    // Gửi toàn bộ buffer, lặp tới khi xong. flags truyền thẳng cho send() (vd MSG_MORE)
+    static bool sendAll(int sockFd, const void* data, size_t len, int flags = 0);
+
+    // Gửi count byte của fileFd bắt đầu tại *offset ra socket, *offset được cập nhật.
+    // Thứ tự: sendfile() -> splice() qua pipe -> pread()+send().
+    // Trả về số byte đã gửi; nhỏ hơn count khi socket non-blocking báo EAGAIN
+    // (errno = EAGAIN) hoặc file ngắn hơn dự kiến. -1 nếu lỗi.
+    static long long sendFileRange(int sockFd, int fileFd, off_t* offset, size_t count);
+
+    // Gửi header gộp chung segment với payload đầu tiên của file (MSG_MORE)
+    static bool sendHeaderAndFile(int sockFd, const std::string& header, int fileFd, size_t fileSize);
+
+    // Header TYPE_FILE / TYPE_DIR của luồng folder download, build thành 1 buffer
+    static std::string buildFileHeader(const std::string& relativePath, uint64_t fileSize);
+    static std::string buildDirHeader(const std::string& relativePath);
+
+    // Nhận tối đa count byte từ socket, ghi thẳng vào fileFd tại *offset.
+    // pipe != nullptr: socket -> pipe -> file bằng splice(), không qua user space.
+    // pipe == nullptr (hoặc splice không hỗ trợ): read() + pwrite() qua buffer 64KB.
+    // Trả về số byte đã ghi, 0 nếu peer đóng kết nối, -1 nếu lỗi (errno = EAGAIN
+    // khi socket non-blocking chưa có dữ liệu).
+    static long long receiveToFile(int sockFd, int fileFd, off_t* offset, size_t count, SplicePipe* pipe);
+
+    // Bật/tắt TCP_CORK: gom header + dữ liệu nhỏ thành segment đầy, tắt để flush
+    static void setCork(int sockFd, bool enabled);
+};
+
+#endif // ZERO_COPY_IO_H
@@ -0,0 +1,272 @@
+#include "../../include/db_pool.h"
+#include "../../include/server_config.h"
+#include "../../include/db_config.h"
+#include <mysql/errmsg.h>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+thread_local DBConnectionPool::Slot* DBLease::currentSlot = nullptr;
+thread_local int DBLease::depth = 0;
+thread_local long long DBLease::statements = 0;
+
+// libmysqlclient cần mysql_thread_init/mysql_thread_end trên mỗi thread dùng API
+struct MySqlThreadGuard {
+    MySqlThreadGuard() { mysql_thread_init(); }
+    ~MySqlThreadGuard() { mysql_thread_end(); }
+};
+
+MYSQL* DBConnectionPool::openConnection() {
+    MYSQL* conn = mysql_init(nullptr);
+    if (!conn) {
+        std::cerr << "[DB] mysql_init() failed" << std::endl;
+        return nullptr;
+    }
+
+    if (!mysql_real_connect(conn, DB_HOST, DB_USER, DB_PASS,
+                            DB_NAME, DB_PORT, nullptr, 0)) {
+        std::cerr << "[DB] Connection failed: " << mysql_error(conn) << std::endl;
+        mysql_close(conn);
+        return nullptr;
+    }
+    return conn;
+}
+
+void DBConnectionPool::closeConnection(Slot* slot) {
+    for (auto& entry : slot->statements) {
+        mysql_stmt_close(entry.second);
+    }
+    slot->statements.clear();
+    if (slot->conn) mysql_close(slot->conn);
+    slot->conn = nullptr;
+    slot->inTransaction = false;
+}
+
+bool DBConnectionPool::init(int size) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (running) return true;
+
+    slots.clear();
+    idle.clear();
+    mysql_library_init(0, nullptr, nullptr);
+
+    int opened = 0;
+    for (int i = 0; i < size; i++) {
+        auto slot = std::make_unique<Slot>();
+        slot->conn = openConnection();
+        slot->broken = (slot->conn == nullptr);
+        slot->lastUsed = std::chrono::steady_clock::now();
+        if (slot->conn) opened++;
+        idle.push_back(slot.get());
+        slots.push_back(std::move(slot));
+    }
+
+    if (opened == 0) {
+        idle.clear();
+        slots.clear();
+        return false;
+    }
+
+    running = true;
+    std::cout << "[DB] Connection pool ready: " << opened << "/" << size << " connections" << std::endl;
+    return true;
+}
+
+void DBConnectionPool::shutdown() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!running) return;
+    running = false;
+
+    // Kết nối đang được mượn sẽ đóng khi lease trả về (release)
+    for (Slot* slot : idle) {
+        closeConnection(slot);
+    }
+    idle.clear();
+    cv.notify_all();
+    std::cout << "[DB] Connection pool closed" << std::endl;
+}
+
+DBConnectionPool::Slot* DBConnectionPool::acquire() {
+    auto start = std::chrono::steady_clock::now();
+    Slot* slot = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        bool ready = cv.wait_for(lock, std::chrono::milliseconds(ServerConfig::DB_POOL_WAIT_MS),
+                                 [this] { return !running || !idle.empty(); });
+        if (!running) return nullptr;
+        if (!ready) {
+            stats.timeouts++;
+            std::cerr << "[DB] No free connection after " << ServerConfig::DB_POOL_WAIT_MS << "ms" << std::endl;
+            return nullptr;
+        }
+        slot = idle.back();
+        idle.pop_back();
+    }
+
+    long long waitUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    stats.acquired++;
+    stats.totalWaitUs += waitUs;
+    long long prevMax = stats.maxWaitUs.load();
+    while (waitUs > prevMax && !stats.maxWaitUs.compare_exchange_weak(prevMax, waitUs)) {}
+
+    // Health check: kết nối hỏng hoặc rảnh quá lâu (server có thể đã đóng do wait_timeout)
+    auto idleFor = std::chrono::steady_clock::now() - slot->lastUsed;
+    if (slot->broken || !slot->conn) {
+        reconnect(slot);
+    } else if (idleFor > std::chrono::seconds(ServerConfig::DB_IDLE_PING_SECONDS) && mysql_ping(slot->conn) != 0) {
+        std::cerr << "[DB] Ping failed: " << mysql_error(slot->conn) << std::endl;
+        reconnect(slot);
+    }
+    return slot;
+}
+
+void DBConnectionPool::release(Slot* slot) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!running) {
+            closeConnection(slot);
+            return;
+        }
+        slot->lastUsed = std::chrono::steady_clock::now();
+        idle.push_back(slot);
+    }
+    cv.notify_one();
+}
+
+bool DBConnectionPool::reconnect(Slot* slot) {
+    closeConnection(slot);
+    slot->conn = openConnection();
+    slot->broken = (slot->conn == nullptr);
+    stats.reconnects++;
+    std::cout << "[DB] Reconnect " << (slot->conn ? "succeeded" : "failed") << std::endl;
+    return slot->conn != nullptr;
+}
+
+void DBConnectionPool::printStats() {
+    size_t total, free;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        total = slots.size();
+        free = idle.size();
+    }
+    long long acquired = stats.acquired.load();
+    std::cout << "DB Pool:            " << (total - free) << "/" << total << " in use"
+              << ", leases " << acquired
+              << ", avg wait " << (acquired ? stats.totalWaitUs.load() / acquired : 0) << "us"
+              << ", max wait " << stats.maxWaitUs.load() << "us"
+              << ", timeouts " << stats.timeouts.load()
+              << ", reconnects " << stats.reconnects.load() << "\n";
+    std::cout << "DB Statements:      " << stats.prepares.load() << " prepared, "
+              << stats.stmtCacheHits.load() << " reused from cache\n";
+}
+
+DBLease::DBLease() : slot(nullptr) {
+    static thread_local MySqlThreadGuard threadGuard;
+    (void)threadGuard;
+
+    if (depth == 0) {
+        currentSlot = DBConnectionPool::getInstance().acquire();
+    }
+    slot = currentSlot;
+    depth++;
+}
+
+DBLease::~DBLease() {
+    depth--;
+    if (depth == 0 && currentSlot) {
+        DBConnectionPool::getInstance().release(currentSlot);
+        currentSlot = nullptr;
+    }
+}
+
+MYSQL*& DBLease::handle() {
+    return slot ? slot->conn : noConn;
+}
+
+int DBLease::query(const std::string& sql) {
+    if (!slot || !slot->conn) return 1;
+
+    countStatement();
+    int rc = mysql_query(slot->conn, sql.c_str());
+    if (rc == 0) return 0;
+
+    unsigned int err = mysql_errno(slot->conn);
+    if (slot->inTransaction) {
+        // Kết nối mới không còn transaction cũ: để transaction thất bại và rollback
+        if (err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST) slot->broken = true;
+    } else if (err == CR_SERVER_GONE_ERROR) {
+        // Câu lệnh chưa tới server: chạy lại an toàn trên kết nối mới
+        std::cerr << "[DB] Server gone, reconnecting: " << mysql_error(slot->conn) << std::endl;
+        if (DBConnectionPool::getInstance().reconnect(slot)) {
+            rc = mysql_query(slot->conn, sql.c_str());
+        }
+    } else if (err == CR_SERVER_LOST) {
+        // Mất kết nối giữa câu lệnh: không rõ đã chạy hay chưa nên không chạy lại
+        slot->broken = true;
+    }
+    return rc;
+}
+
+MYSQL_STMT* DBLease::prepare(const char* sql) {
+    if (!slot || !slot->conn) return nullptr;
+
+    DBConnectionPool& pool = DBConnectionPool::getInstance();
+    auto it = slot->statements.find(sql);
+    if (it != slot->statements.end()) {
+        pool.stats.stmtCacheHits++;
+        return it->second;
+    }
+
+    MYSQL_STMT* stmt = mysql_stmt_init(slot->conn);
+    if (!stmt) return nullptr;
+    if (mysql_stmt_prepare(stmt, sql, strlen(sql)) != 0) {
+        std::cerr << "[DB] Prepare failed: " << mysql_stmt_error(stmt) << std::endl;
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+    pool.stats.prepares++;
+    slot->statements.emplace(sql, stmt);
+    return stmt;
+}
+
+bool DBLease::reconnect() {
+    return slot && DBConnectionPool::getInstance().reconnect(slot);
+}
+
+DBTransaction::DBTransaction(DBLease& lease) : lease(lease) {
+    auto* slot = lease.slot;
+    if (!slot || !slot->conn) return;
+    if (slot->inTransaction) {
+        started = true;  // Gộp vào transaction ngoài
+        return;
+    }
+    if (lease.query("START TRANSACTION")) {
+        std::cerr << "[DB] START TRANSACTION failed: " << mysql_error(slot->conn) << std::endl;
+        return;
+    }
+    slot->inTransaction = true;
+    started = true;
+    outermost = true;
+}
+
+DBTransaction::~DBTransaction() {
+    if (!outermost || done) return;
+    auto* slot = lease.slot;
+    if (slot->conn && !slot->broken && mysql_query(slot->conn, "ROLLBACK")) {
+        std::cerr << "[DB] ROLLBACK failed: " << mysql_error(slot->conn) << std::endl;
+        slot->broken = true;
+    }
+    slot->inTransaction = false;
+}
+
+bool DBTransaction::commit() {
+    if (!started) return false;
+    if (!outermost) return true;
+    auto* slot = lease.slot;
+    bool ok = slot->conn && !slot->broken && lease.query("COMMIT") == 0;
+    if (!ok) return false;  // Destructor sẽ rollback
+    slot->inTransaction = false;
+    done = true;
+    return true;
+}
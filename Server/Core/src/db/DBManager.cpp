@@ -1,5 +1,11 @@
 #include "../../include/db_manager.h"
-#include "../../include/db_config.h"
+#include "../../include/db_pool.h"
+#include "../../include/db_statement.h"
+#include "../../include/server_config.h"
+#include "../../include/quota_ledger.h"
+#include "../../include/search_index.h"
+#include "../../include/blob_store.h"
+#include "../../include/chunk_store.h"
 #include <iostream>
 #include <sstream>
 #include <openssl/sha.h>
@@ -10,6 +16,11 @@
 #include <cerrno>
 #include <chrono>
 #include <thread>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <charconv>
 
 // Define STORAGE_PATH if not already defined
 #ifndef STORAGE_PATH
@@ -28,567 +39,741 @@ std::string sha256(const std::string& str) {
 }
 
 bool DBManager::connect() {
-    conn = mysql_init(nullptr);
-    if (!conn) {
-        std::cerr << "[DB] mysql_init() failed" << std::endl;
-        return false;
-    }
-
-    if (!mysql_real_connect(conn, DB_HOST, DB_USER, DB_PASS, 
-                            DB_NAME, DB_PORT, nullptr, 0)) {
-        std::cerr << "[DB] Connection failed: " << mysql_error(conn) << std::endl;
-        return false;
-    }
-
-    return true;
+    // Gọi lại khi pool đã mở thì không mở thêm kết nối
+    return DBConnectionPool::getInstance().init(ServerConfig::DB_POOL_SIZE);
 }
 
 void DBManager::disconnect() {
-    if (conn) {
-        mysql_close(conn);
-        conn = nullptr;
-    }
+    DBConnectionPool::getInstance().shutdown();
 }
 
-bool DBManager::checkUser(std::string user, std::string pass) {
-    if (!conn) return false;
+long long DBManager::checkUser(std::string user, std::string pass) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return -1;
 
     std::string hashed_pass = sha256(pass);
     
-    std::string query = "SELECT user_id FROM USERS WHERE username = '" + user + 
-                       "' AND password_hash = '" + hashed_pass + "'";
-    
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] Query failed: " << mysql_error(conn) << std::endl;
-        return false;
-    }
+    DBStatement stmt(lease, "SELECT user_id FROM USERS WHERE username = ? AND password_hash = ?");
+    stmt.bind(user).bind(hashed_pass);
+    if (!stmt.execute() || !stmt.fetch()) return -1;
 
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return false;
+    long long user_id = stmt.getInt(0);
+    userIdCache.put(user, user_id);
+    return user_id;
+}
 
-    bool found = (mysql_num_rows(result) > 0);
-    mysql_free_result(result);
-    
-    return found;
+long long DBManager::getUserId(const std::string& username) {
+    long long user_id;
+    if (userIdCache.get(username, user_id)) return user_id;
+
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return -1;
+
+    DBStatement stmt(lease, "SELECT user_id FROM USERS WHERE username = ?");
+    stmt.bind(username);
+    if (!stmt.execute() || !stmt.fetch()) return -1;  // Không cache kết quả "không tồn tại"
+
+    user_id = stmt.getInt(0);
+    userIdCache.put(username, user_id);
+    return user_id;
+}
+
+void DBManager::printCacheStats() {
+    std::cout << "User ID Cache:      " << userIdCache.size() << " entries, "
+              << userIdCache.hitCount() << " hits, " << userIdCache.missCount() << " misses\n";
+    std::cout << "ACL Cache:          " << aclCache.userCount() << " users, "
+              << aclCache.hitCount() << " hits, " << aclCache.missCount() << " misses\n";
+    metadataCache.printStats();
 }
 
 bool DBManager::registerUser(std::string username, std::string password) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     if (!conn) {
         std::cerr << "[DB] Not connected to database" << std::endl;
         return false;
     }
 
-    std::string check_query = "SELECT user_id FROM USERS WHERE username = '" + username + "'";
-    if (mysql_query(conn, check_query.c_str())) {
-        std::cerr << "[DB] Check query failed: " << mysql_error(conn) << std::endl;
-        return false;
+    {
+        DBStatement check(lease, "SELECT user_id FROM USERS WHERE username = ?");
+        check.bind(username);
+        if (!check.execute()) {
+            std::cerr << "[DB] Check query failed: " << check.error() << std::endl;
+            return false;
+        }
+        if (check.fetch()) {
+            std::cerr << "[DB] Username '" << username << "' already exists" << std::endl;
+            return false;
+        }
     }
 
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) {
-        std::cerr << "[DB] Failed to get result: " << mysql_error(conn) << std::endl;
+    std::string hashed_pass = sha256(password);
+    
+    DBStatement insert(lease, "INSERT INTO USERS (username, password_hash, created_at) VALUES (?, ?, NOW())");
+    insert.bind(username).bind(hashed_pass);
+    if (!insert.execute()) {
+        std::cerr << "[DB] Insert failed: " << insert.error() << std::endl;
         return false;
     }
 
-    bool exists = (mysql_num_rows(result) > 0);
-    mysql_free_result(result);
+    return true;
+}
 
-    if (exists) {
-        std::cerr << "[DB] Username '" << username << "' already exists" << std::endl;
-        return false;
-    }
+// Kích thước folder = toàn bộ cây con, đọc từ cột subtree_size_bytes
+// (cập nhật khi thêm/xóa file, xem adjustFolderTotals)
+#define LISTING_SIZE_COLUMN "IF(f.is_folder, f.subtree_size_bytes, f.size_bytes)"
 
-    std::string hashed_pass = sha256(password);
-    
-    std::string insert_query = "INSERT INTO USERS (username, password_hash, created_at) VALUES ('" + 
-                               username + "', '" + hashed_pass + "', NOW())";
-    
-    if (mysql_query(conn, insert_query.c_str())) {
-        std::cerr << "[DB] Insert failed: " << mysql_error(conn) << std::endl;
-        return false;
-    }
+// FILES.path là chuỗi id tổ tiên "/1/4/9/" (gồm chính nó). Mọi con cháu có path trong
+// khoảng (path, upper): thay dấu '/' cuối bằng '0', ký tự ngay sau '/' trong bảng ASCII.
+static std::string pathUpperBound(const std::string& path) {
+    return path.substr(0, path.size() - 1) + "0";
+}
+
+// Cột: name, size, owner, file_id, is_folder
+static FileRecord readListingRow(const DBStatement& stmt) {
+    FileRecord rec;
+    rec.name = stmt.getString(0);
+    rec.size = stmt.getInt(1);
+    rec.owner = stmt.getString(2);
+    rec.file_id = stmt.getInt(3);
+    rec.is_folder = stmt.getInt(4) != 0;
+    return rec;
+}
+
+// "/1/4/9/" -> "/1/4/"; "" nếu ở thư mục gốc
+static std::string parentPathOf(const std::string& path) {
+    if (path.size() < 2) return "";
+    size_t pos = path.rfind('/', path.size() - 2);
+    return pos == 0 ? "" : path.substr(0, pos + 1);
+}
+
+static FileRecord toListingRecord(const MetadataNode& node) {
+    FileRecord rec;
+    rec.name = node.name;
+    rec.size = node.is_folder ? node.subtree_bytes : node.size_bytes;
+    rec.owner = node.owner;
+    rec.file_id = node.file_id;
+    rec.is_folder = node.is_folder;
+    return rec;
+}
+
+static FileRecordEx toRecordEx(const MetadataNode& node) {
+    FileRecordEx rec;
+    rec.file_id = node.file_id;
+    rec.owner_id = node.owner_id;
+    rec.parent_id = node.parent_id;
+    rec.name = node.name;
+    rec.is_folder = node.is_folder;
+    rec.size = node.size_bytes;
+    rec.owner = node.owner;
+    return rec;
+}
+
+// Thứ tự của getItemsInFolder/guestListFolder: folder trước, theo tên
+static void sortByName(std::vector<FileRecordEx>& list) {
+    std::sort(list.begin(), list.end(), [](const FileRecordEx& a, const FileRecordEx& b) {
+        if (a.is_folder != b.is_folder) return a.is_folder;
+        return a.name < b.name;
+    });
+}
+
+bool DBManager::loadFolder(long long key, std::vector<MetadataNode>& children) {
+    if (metadataCache.lookupChildren(key, children)) return true;
+    unsigned long long epoch = metadataCache.currentEpoch();
+
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return false;
 
+    // Folder thường: LEFT JOIN để folder rỗng vẫn trả một dòng mang path của folder.
+    // Thứ tự giống MetadataCache: folder trước, mới tạo trước.
+    const char* sql = key < 0
+        ? "SELECT f.file_id, f.owner_id, f.parent_id, f.name, f.is_folder, f.size_bytes, "
+          "f.subtree_size_bytes, u.username, f.path, '' "
+          "FROM FILES f "
+          "JOIN USERS u ON f.owner_id = u.user_id "
+          "WHERE f.owner_id = ? AND f.parent_id IS NULL AND f.is_deleted = FALSE "
+          "ORDER BY f.is_folder DESC, f.file_id DESC"
+        : "SELECT f.file_id, f.owner_id, f.parent_id, f.name, f.is_folder, f.size_bytes, "
+          "f.subtree_size_bytes, u.username, f.path, x.path "
+          "FROM FILES x "
+          "LEFT JOIN FILES f ON f.parent_id = x.file_id AND f.is_deleted = FALSE "
+          "LEFT JOIN USERS u ON f.owner_id = u.user_id "
+          "WHERE x.file_id = ? "
+          "ORDER BY f.is_folder DESC, f.file_id DESC";
+
+    DBStatement stmt(lease, sql);
+    stmt.bind(key < 0 ? -key : key);
+    if (!stmt.execute()) return false;
+
+    std::string folderPath;
+    children.clear();
+    while (stmt.fetch()) {
+        folderPath = stmt.getString(9);
+        if (stmt.isNull(0)) continue;  // Folder rỗng
+        MetadataNode node;
+        node.file_id = stmt.getInt(0);
+        node.owner_id = stmt.getInt(1);
+        node.parent_id = stmt.getInt(2);
+        node.name = stmt.getString(3);
+        node.is_folder = stmt.getInt(4) != 0;
+        node.size_bytes = stmt.getInt(5);
+        node.subtree_bytes = stmt.getInt(6);
+        node.owner = stmt.getString(7);
+        node.path = stmt.getString(8);
+        children.push_back(std::move(node));
+    }
+    metadataCache.storeFolder(key, folderPath, children, epoch);
     return true;
 }
 
-std::vector<FileRecord> DBManager::getFiles(std::string username, long long parent_id) {
+std::vector<FileRecord> DBManager::getFiles(long long user_id, long long parent_id) {
     std::vector<FileRecord> list;
-    if (!conn) return list;
+    std::vector<MetadataNode> children;
 
-    std::string query = "SELECT user_id FROM USERS WHERE username = '" + username + "'";
-    if (mysql_query(conn, query.c_str())) return list;
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return list;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return list;
+    // parent_id = 0 là thư mục gốc (parent_id IS NULL)
+    long long key = parent_id == 0 ? MetadataCache::rootKey(user_id) : parent_id;
+    if (!loadFolder(key, children)) return list;
+
+    for (const auto& node : children) {
+        if (node.file_id == 1 || node.owner_id != user_id) continue;
+        list.push_back(toListingRecord(node));
     }
-    std::string user_id = row[0];
-    mysql_free_result(result);
+    return list;
+}
 
-    if (parent_id == 0) {
-        query = "SELECT f.name, f.size_bytes, u.username, f.created_at, f.file_id, f.is_folder "
-                "FROM FILES f "
-                "JOIN USERS u ON f.owner_id = u.user_id "
-                "WHERE f.file_id != 1 "
-                "AND f.owner_id = " + user_id + " "
-                "AND f.parent_id IS NULL "
-                "AND f.is_deleted = FALSE "
-                "ORDER BY f.is_folder DESC, f.created_at DESC";
-    } else {
-        query = "SELECT f.name, f.size_bytes, u.username, f.created_at, f.file_id, f.is_folder "
-                "FROM FILES f "
-                "JOIN USERS u ON f.owner_id = u.user_id "
-                "WHERE f.file_id != 1 "
-                "AND f.owner_id = " + user_id + " "
-                "AND f.parent_id = " + std::to_string(parent_id) + " "
-                "AND f.is_deleted = FALSE "
-                "ORDER BY f.is_folder DESC, f.created_at DESC";
-    }
-
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] Query failed: " << mysql_error(conn) << std::endl;
-        return list;
+std::vector<FileRecord> DBManager::getSharedFiles(long long user_id) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    std::vector<FileRecord> list;
+    if (!conn) return list;
+
+    // Một file có thể được share nhiều quyền (nhiều dòng SHAREDFILES): gom theo file_id
+    DBStatement stmt(lease,
+        "SELECT f.name, " LISTING_SIZE_COLUMN ", u.username, f.file_id, f.is_folder "
+        "FROM FILES f "
+        "JOIN USERS u ON f.owner_id = u.user_id "
+        "JOIN SHAREDFILES sf ON f.file_id = sf.file_id "
+        "WHERE sf.user_id = ? "
+        "AND f.owner_id != ? "
+        "AND f.is_deleted = FALSE "
+        "GROUP BY f.file_id, u.username "
+        "ORDER BY f.is_folder DESC, MAX(sf.shared_at) DESC");
+    stmt.bind(user_id).bind(user_id);
+    if (!stmt.execute()) return list;
+
+    while (stmt.fetch()) {
+        list.push_back(readListingRow(stmt));
     }
+    return list;
+}
 
-    result = mysql_store_result(conn);
-    if (!result) return list;
+std::vector<FileRecord> DBManager::getSharedFiles(long long user_id, long long parent_id) {
+    std::vector<FileRecord> list;
 
-    while ((row = mysql_fetch_row(result))) {
-        FileRecord rec;
-        rec.name = row[0] ? row[0] : "";
-        rec.size = row[1] ? std::stol(row[1]) : 0;
-        rec.owner = row[2] ? row[2] : "";
-        rec.file_id = row[4] ? std::stoll(row[4]) : 0;
-        rec.is_folder = row[5] && std::string(row[5]) == "1";
-        
-        if (rec.is_folder) {
-            std::string size_query = 
-                "SELECT COALESCE(SUM(size_bytes), 0) FROM FILES "
-                "WHERE parent_id = " + std::to_string(rec.file_id) + " "
-                "AND is_folder = FALSE AND is_deleted = FALSE";
-            
-            if (mysql_query(conn, size_query.c_str()) == 0) {
-                MYSQL_RES* size_result = mysql_store_result(conn);
-                if (size_result) {
-                    MYSQL_ROW size_row = mysql_fetch_row(size_result);
-                    if (size_row && size_row[0]) {
-                        rec.size = std::stol(size_row[0]);
-                    }
-                    mysql_free_result(size_result);
-                }
-            }
+    if (parent_id > 0) {
+        if (!hasSharedAccess(parent_id, user_id)) {
+            std::cerr << "[DB] User " << user_id << " has no access to folder " << parent_id << std::endl;
+            return list;
         }
-        
-        list.push_back(rec);
     }
 
-    mysql_free_result(result);
+    std::vector<MetadataNode> children;
+    if (!loadFolder(parent_id, children)) return list;
+    for (const auto& node : children) {
+        list.push_back(toListingRecord(node));
+    }
+
+    std::cout << "[DB] Retrieved " << list.size() << " items in shared folder " << parent_id 
+              << " for user " << user_id << std::endl;
     return list;
 }
 
-std::vector<FileRecord> DBManager::getSharedFiles(std::string username) {
-    std::vector<FileRecord> list;
-    if (!conn) return list;
+// Cursor phân trang: "<sort>:<is_folder>:<file_id>:<giá trị cột sắp xếp>" của dòng cuối trang,
+// mã hóa hex để client chỉ việc gửi lại nguyên văn (không chứa khoảng trắng)
+struct ListCursor {
+    bool isFolder = false;
+    long long file_id = 0;
+    std::string value;
+};
 
-    std::string query = "SELECT user_id FROM USERS WHERE username = '" + username + "'";
-    if (mysql_query(conn, query.c_str())) return list;
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return list;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return list;
+static char sortTag(ListSort sort) {
+    return sort == ListSort::Name ? 'n' : sort == ListSort::Size ? 's' : 'd';
+}
+
+static std::string encodeCursor(ListSort sort, bool isFolder, long long file_id, const std::string& value) {
+    static const char hex[] = "0123456789abcdef";
+    std::string raw = std::string(1, sortTag(sort)) + (isFolder ? ":1:" : ":0:") + std::to_string(file_id) + ":" + value;
+    std::string out;
+    out.reserve(raw.size() * 2);
+    for (unsigned char c : raw) {
+        out += hex[c >> 4];
+        out += hex[c & 15];
     }
-    std::string user_id = row[0];
-    mysql_free_result(result);
+    return out;
+}
 
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
 
-    query = "SELECT f.name, f.size_bytes, u.username, f.file_id, f.is_folder "
-            "FROM FILES f "
-            "JOIN USERS u ON f.owner_id = u.user_id "
-            "JOIN SHAREDFILES sf ON f.file_id = sf.file_id "
-            "WHERE sf.user_id = " + user_id + " "
-            "AND f.owner_id != " + user_id + " "
-            "AND f.is_deleted = FALSE "
-            "ORDER BY f.is_folder DESC, sf.shared_at DESC";
+static bool decodeCursor(const std::string& cursor, ListSort sort, ListCursor& out) {
+    if (cursor.size() % 2 != 0) return false;
+    std::string raw;
+    for (size_t i = 0; i < cursor.size(); i += 2) {
+        int hi = hexDigit(cursor[i]), lo = hexDigit(cursor[i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        raw += (char)(hi << 4 | lo);
+    }
+
+    // Cursor của thứ tự khác không dùng được
+    if (raw.size() < 6 || raw[0] != sortTag(sort) || raw[1] != ':' || raw[3] != ':') return false;
+    if (raw[2] != '0' && raw[2] != '1') return false;
+    size_t colon = raw.find(':', 4);
+    if (colon == std::string::npos) return false;
+    auto parsed = std::from_chars(raw.data() + 4, raw.data() + colon, out.file_id);
+    if (parsed.ec != std::errc() || parsed.ptr != raw.data() + colon) return false;
+    out.isFolder = raw[2] == '1';
+    out.value = raw.substr(colon + 1);
+    return true;
+}
 
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] Query failed: " << mysql_error(conn) << std::endl;
-        return list;
-    }
+bool DBManager::listPage(long long ownerFilter, long long parent_id, ListSort sort, const std::string& cursor, int limit,
+                         const std::function<void(const FileRecord&)>& onRow, std::string& nextCursor) {
+    nextCursor.clear();
+    if (limit <= 0 || limit > ServerConfig::LIST_PAGE_MAX) return false;
+    ListCursor after;
+    bool hasCursor = !cursor.empty();
+    if (hasCursor && !decodeCursor(cursor, sort, after)) return false;
+
+    std::string column = sort == ListSort::Name ? "f.name" : sort == ListSort::Size ? "f.listing_size_bytes" : "f.created_at";
+    std::string dir = sort == ListSort::Name ? "ASC" : "DESC";
+    std::string cmp = sort == ListSort::Name ? ">" : "<";
+
+    // Thứ tự khớp index idx_list_* (owner_id, parent_id, ...) hoặc idx_shared_* (parent_id, ...):
+    // MySQL đọc index từ vị trí cursor và dừng sau limit + 1 dòng, không sort cả folder.
+    // Chỉ có 24 biến thể câu SQL nên vẫn dùng được cache prepared statement.
+    std::string sql =
+        "SELECT f.name, f.listing_size_bytes, u.username, f.file_id, f.is_folder, " + column + " "
+        "FROM FILES f JOIN USERS u ON f.owner_id = u.user_id WHERE ";
+    if (ownerFilter >= 0) sql += "f.owner_id = ? AND f.file_id != 1 AND ";
+    sql += parent_id == 0 ? "f.parent_id IS NULL " : "f.parent_id = ? ";
+    sql += "AND f.is_deleted = FALSE ";
+    if (hasCursor) {
+        sql += "AND (f.is_folder < ? OR (f.is_folder = ? AND (" + column + " " + cmp + " ? OR (" +
+               column + " = ? AND f.file_id " + cmp + " ?)))) ";
+    }
+    sql += "ORDER BY f.is_folder DESC, " + column + " " + dir + ", f.file_id " + dir + " LIMIT ?";
+
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return false;
 
-    result = mysql_store_result(conn);
-    if (!result) return list;
+    DBStatement stmt(lease, sql.c_str());
+    if (ownerFilter >= 0) stmt.bind(ownerFilter);
+    if (parent_id != 0) stmt.bind(parent_id);
+    if (hasCursor) {
+        stmt.bind((long long)after.isFolder).bind((long long)after.isFolder);
+        for (int i = 0; i < 2; i++) {
+            if (sort == ListSort::Size) stmt.bind(std::atoll(after.value.c_str()));
+            else stmt.bind(after.value);
+        }
+        stmt.bind(after.file_id);
+    }
+    stmt.bind((long long)limit + 1);  // Dòng thừa cho biết còn trang sau
+    if (!stmt.executeStreaming()) return false;
 
-    while ((row = mysql_fetch_row(result))) {
-        FileRecord rec;
-        rec.name = row[0] ? row[0] : "";
-        rec.size = row[1] ? std::stol(row[1]) : 0;
-        rec.owner = row[2] ? row[2] : "";
-        rec.file_id = row[3] ? std::stoll(row[3]) : 0;
-        rec.is_folder = row[4] && std::string(row[4]) == "1";
-        
-        if (rec.is_folder) {
-            std::string size_query = 
-                "SELECT COALESCE(SUM(size_bytes), 0) FROM FILES "
-                "WHERE parent_id = " + std::to_string(rec.file_id) + " "
-                "AND is_folder = FALSE AND is_deleted = FALSE";
-            
-            if (mysql_query(conn, size_query.c_str()) == 0) {
-                MYSQL_RES* size_result = mysql_store_result(conn);
-                if (size_result) {
-                    MYSQL_ROW size_row = mysql_fetch_row(size_result);
-                    if (size_row && size_row[0]) {
-                        rec.size = std::stol(size_row[0]);
-                    }
-                    mysql_free_result(size_result);
-                }
-            }
+    // onRow chạy khi kết quả còn đang đọc dở trên kết nối: không được gọi DBManager bên trong
+    int count = 0;
+    while (stmt.fetch()) {
+        FileRecord rec = readListingRow(stmt);
+        if (count == limit) {
+            return true;  // Còn dòng phía sau: nextCursor đã trỏ tới dòng cuối trang
         }
-        
-        list.push_back(rec);
+        nextCursor = encodeCursor(sort, rec.is_folder, rec.file_id, stmt.getString(5));
+        onRow(rec);
+        count++;
     }
+    nextCursor.clear();  // Hết dữ liệu: đây là trang cuối
+    return true;
+}
 
-    mysql_free_result(result);
-    return list;
+bool DBManager::getFilesPage(long long user_id, long long parent_id, ListSort sort, const std::string& cursor, int limit,
+                             const std::function<void(const FileRecord&)>& onRow, std::string& nextCursor) {
+    return listPage(user_id, parent_id, sort, cursor, limit, onRow, nextCursor);
 }
 
-std::vector<FileRecord> DBManager::getSharedFiles(std::string username, long long parent_id) {
+bool DBManager::getSharedFilesPage(long long user_id, long long parent_id, ListSort sort, const std::string& cursor,
+                                   int limit, const std::function<void(const FileRecord&)>& onRow,
+                                   std::string& nextCursor) {
+    nextCursor.clear();
+    if (parent_id <= 0 || !hasSharedAccess(parent_id, user_id)) {
+        std::cerr << "[DB] User " << user_id << " has no access to folder " << parent_id << std::endl;
+        return false;
+    }
+    return listPage(-1, parent_id, sort, cursor, limit, onRow, nextCursor);
+}
+
+bool DBManager::hasSharedAccess(long long file_id, long long user_id) {
+    // Owner luôn có quyền: node đã nằm trong metadataCache thì không cần hỏi DB
+    MetadataNode node;
+    if (metadataCache.lookupNode(file_id, node) && node.owner_id == user_id) return true;
+
+    bool allowed;
+    if (aclCache.lookup(user_id, file_id, allowed)) return allowed;
+    unsigned long long epoch = aclCache.currentEpoch();
+
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return false;
+
+    // Một round trip: được share chính file hoặc một folder cha bất kỳ (id nằm trong path),
+    // hoặc là owner của file. Chỉ duyệt các share của user (idx_user), không đi ngược cây.
+    DBStatement stmt(lease,
+        "SELECT EXISTS(SELECT 1 FROM FILES x JOIN SHAREDFILES sf "
+        "              ON sf.user_id = ? AND LOCATE(CONCAT('/', sf.file_id, '/'), x.path) > 0 "
+        "              WHERE x.file_id = ?) "
+        "    OR EXISTS(SELECT 1 FROM FILES WHERE file_id = ? AND owner_id = ?)");
+    stmt.bind(user_id).bind(file_id).bind(file_id).bind(user_id);
+    if (!stmt.execute() || !stmt.fetch()) return false;  // Lỗi DB: không cache
+
+    allowed = stmt.getInt(0) != 0;
+    aclCache.store(user_id, file_id, allowed, epoch);
+    return allowed;
+}
+
+std::vector<FileRecord> DBManager::searchFiles(long long user_id, const std::string& keyword, long long page) {
     std::vector<FileRecord> list;
+    if (keyword.empty() || page < 0) return list;
+
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     if (!conn) return list;
 
-    std::string query = "SELECT user_id FROM USERS WHERE username = '" + username + "'";
-    if (mysql_query(conn, query.c_str())) return list;
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return list;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return list;
+    // Các dòng được share trực tiếp; con cháu của chúng khớp qua path trong SearchIndex
+    std::unordered_set<long long> sharedRoots;
+    {
+        DBStatement stmt(lease, "SELECT file_id FROM SHAREDFILES WHERE user_id = ?");
+        stmt.bind(user_id);
+        if (!stmt.execute()) return list;
+        while (stmt.fetch()) sharedRoots.insert(stmt.getInt(0));
     }
-    std::string user_id = row[0];
-    mysql_free_result(result);
 
-    if (parent_id > 0) {
-        if (!hasSharedAccess(parent_id, username)) {
-            std::cerr << "[DB] User '" << username << "' has no access to folder " << parent_id << std::endl;
-            return list;
-        }
-    }
+    std::vector<long long> ids = SearchIndex::getInstance().search(
+        keyword, user_id, sharedRoots, (size_t)page * ServerConfig::SEARCH_PAGE_SIZE, ServerConfig::SEARCH_PAGE_SIZE);
+    if (ids.empty()) return list;
 
-    query = "SELECT f.name, f.size_bytes, u.username, f.file_id, f.is_folder "
-            "FROM FILES f "
-            "JOIN USERS u ON f.owner_id = u.user_id "
-            "WHERE f.parent_id = " + std::to_string(parent_id) + " "
-            "AND f.is_deleted = FALSE "
-            "ORDER BY f.is_folder DESC, f.created_at DESC";
+    // Tên, kích thước và owner hiện tại của cả trang trong một câu (tra theo khóa chính).
+    // Số phần tử IN thay đổi theo trang nên không dùng prepared statement.
+    std::string query = "SELECT f.name, " LISTING_SIZE_COLUMN ", u.username, f.file_id, f.is_folder "
+                        "FROM FILES f JOIN USERS u ON f.owner_id = u.user_id "
+                        "WHERE f.is_deleted = FALSE AND f.file_id IN (";
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (i > 0) query += ",";
+        query += std::to_string(ids[i]);
+    }
+    query += ")";
 
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] Query failed: " << mysql_error(conn) << std::endl;
+    if (lease.query(query)) {
+        std::cerr << "[DB] Search lookup failed: " << mysql_error(conn) << std::endl;
         return list;
     }
-
-    result = mysql_store_result(conn);
+    MYSQL_RES* result = mysql_store_result(conn);
     if (!result) return list;
 
+    std::unordered_map<long long, FileRecord> rows;
+    MYSQL_ROW row;
     while ((row = mysql_fetch_row(result))) {
         FileRecord rec;
         rec.name = row[0] ? row[0] : "";
         rec.size = row[1] ? std::stol(row[1]) : 0;
         rec.owner = row[2] ? row[2] : "";
-        rec.file_id = row[3] ? std::stoll(row[3]) : 0;
+        rec.file_id = std::stoll(row[3]);
         rec.is_folder = row[4] && std::string(row[4]) == "1";
-        
-        if (rec.is_folder) {
-            std::string size_query = 
-                "SELECT COALESCE(SUM(size_bytes), 0) FROM FILES "
-                "WHERE parent_id = " + std::to_string(rec.file_id) + " "
-                "AND is_folder = FALSE AND is_deleted = FALSE";
-            
-            if (mysql_query(conn, size_query.c_str()) == 0) {
-                MYSQL_RES* size_result = mysql_store_result(conn);
-                if (size_result) {
-                    MYSQL_ROW size_row = mysql_fetch_row(size_result);
-                    if (size_row && size_row[0]) {
-                        rec.size = std::stol(size_row[0]);
-                    }
-                    mysql_free_result(size_result);
-                }
-            }
-        }
-        
-        list.push_back(rec);
+        rows[rec.file_id] = std::move(rec);
     }
-
     mysql_free_result(result);
-    std::cout << "[DB] Retrieved " << list.size() << " items in shared folder " << parent_id 
-              << " for user '" << username << "'" << std::endl;
+
+    // Giữ thứ tự của SearchIndex để phân trang ổn định
+    for (long long id : ids) {
+        auto it = rows.find(id);
+        if (it != rows.end()) list.push_back(std::move(it->second));
+    }
     return list;
 }
 
-bool DBManager::hasSharedAccess(long long file_id, std::string username) {
+bool DBManager::rebuildSearchIndex() {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     if (!conn) return false;
 
-    std::string query = "SELECT user_id FROM USERS WHERE username = '" + username + "'";
-    if (mysql_query(conn, query.c_str())) return false;
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return false;
-    }
-    std::string user_id = row[0];
-    mysql_free_result(result);
+    DBStatement stmt(lease, "SELECT file_id, owner_id, name, path FROM FILES WHERE is_deleted = FALSE");
+    if (!stmt.execute()) return false;
 
-    long long current_id = file_id;
-    
-    while (current_id > 0) {
-        query = "SELECT COUNT(*) FROM SHAREDFILES "
-                "WHERE file_id = " + std::to_string(current_id) + " "
-                "AND user_id = " + user_id;
-        
-        if (mysql_query(conn, query.c_str())) return false;
-        
-        result = mysql_store_result(conn);
-        if (!result) return false;
-        
-        row = mysql_fetch_row(result);
-        if (row && row[0] && std::stoi(row[0]) > 0) {
-            mysql_free_result(result);
-            return true;
-        }
-        mysql_free_result(result);
-        
-        query = "SELECT parent_id FROM FILES WHERE file_id = " + std::to_string(current_id);
-        if (mysql_query(conn, query.c_str())) return false;
-        
-        result = mysql_store_result(conn);
-        if (!result) return false;
-        
-        row = mysql_fetch_row(result);
-        if (!row || !row[0]) {
-            mysql_free_result(result);
-            break;
-        }
-        
-        current_id = std::stoll(row[0]);
-        mysql_free_result(result);
+    SearchIndex& index = SearchIndex::getInstance();
+    index.clear();
+    long long count = 0;
+    while (stmt.fetch()) {
+        index.onInsert(stmt.getInt(0), stmt.getInt(1), stmt.getString(2), stmt.getString(3));
+        count++;
     }
-    
-    query = "SELECT COUNT(*) FROM FILES f "
-            "JOIN USERS u ON f.owner_id = u.user_id "
-            "WHERE f.file_id = " + std::to_string(file_id) + " "
-            "AND u.username = '" + username + "'";
-    
-    if (mysql_query(conn, query.c_str())) return false;
-    
-    result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    row = mysql_fetch_row(result);
-    bool is_owner = (row && row[0] && std::stoi(row[0]) > 0);
-    mysql_free_result(result);
-    
-    return is_owner;
+    std::cout << "[DB] Search index built: " << count << " names" << std::endl;
+    return true;
 }
 
-bool DBManager::addFile(std::string filename, long filesize, std::string owner, long long parent_id) {
-    if (!conn) return false;
+long long DBManager::addFile(std::string filename, long filesize, long long owner_id, long long parent_id,
+                             const std::vector<ChunkRef>* chunks, const std::string* blobTempPath) {
+    // Mọi đường return -1 trước khi blob vào chỗ: file tạm không còn dùng tới
+    struct TempGuard {
+        const std::string* path;
+        ~TempGuard() { if (path) BlobStore::discard(*path); }
+    } tempGuard{blobTempPath};
 
-    std::string query = "SELECT user_id FROM USERS WHERE username = '" + owner + "'";
-    if (mysql_query(conn, query.c_str())) return false;
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return false;
-    }
-    std::string owner_id = row[0];
-    mysql_free_result(result);
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return -1;
 
-    std::stringstream ss;
-    if (parent_id == 0) {
-        ss << "INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) VALUES ("
-           << owner_id << ", NULL, '" << filename << "', FALSE, " << filesize << ") "
-           << "ON DUPLICATE KEY UPDATE size_bytes = " << filesize 
-           << ", is_deleted = FALSE, updated_at = NOW()";
-    } else {
-        ss << "INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) VALUES ("
-           << owner_id << ", " << parent_id << ", '" << filename << "', FALSE, " << filesize << ") "
-           << "ON DUPLICATE KEY UPDATE size_bytes = " << filesize 
-           << ", is_deleted = FALSE, updated_at = NOW()";
-    }
+    MetadataCache::UpdateGuard cacheUpdate(metadataCache);
+    DBTransaction tx(lease);
+    if (!tx.ok()) return -1;
+
+    // Chunk PUT_CHUNK đã tính vào storage_used: chuyển sang tính theo size file
+    long long claimedBytes = 0;
+    if (chunks && !claimChunks(lease, owner_id, *chunks, claimedBytes)) return -1;
+
+    // parent_id = 0 -> NULL (thư mục gốc)
+    DBStatement stmt(lease,
+        "INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) VALUES (?, ?, ?, FALSE, ?)");
+    stmt.bind(owner_id);
+    if (parent_id == 0) stmt.bindNull(); else stmt.bind(parent_id);
+    stmt.bind(filename).bind((long long)filesize);
     
-    if (mysql_query(conn, ss.str().c_str())) {
-        std::cerr << "[DB] Insert failed: " << mysql_error(conn) << std::endl;
-        return false;
+    if (!stmt.execute()) {
+        std::cerr << "[DB] Insert failed: " << stmt.error() << std::endl;
+        return -1;
     }
+    MetadataNode node;
+    node.file_id = stmt.insertId();
+    node.owner_id = owner_id;
+    node.parent_id = parent_id;
+    node.name = filename;
+    node.size_bytes = filesize;
+    long long levels = 0;
+    if (!assignPath(lease, node.file_id, node.path)) return -1;
+    if (chunks && !insertChunkManifest(lease, node.file_id, *chunks)) return -1;
+    if (parent_id != 0 && !adjustFolderTotals(lease, parent_id, filesize, 1, &levels)) return -1;
+    if (!adjustStorageUsed(lease, owner_id, filesize - claimedBytes)) return -1;
+    // commitTo tự xóa file tạm khi lỗi
+    if (blobTempPath) {
+        tempGuard.path = nullptr;
+        if (!BlobStore::commit(*blobTempPath, node.file_id)) return -1;
+    }
+    if (!tx.commit()) {
+        if (blobTempPath) BlobStore::unlink(node.file_id);
+        return -1;
+    }
+    QuotaLedger::getInstance().onUsageChanged(owner_id, filesize - claimedBytes);
+    metadataCache.onInsert(node);
+    metadataCache.onTotalsChanged(parentPathOf(node.path), filesize, levels);
+    SearchIndex::getInstance().onInsert(node.file_id, owner_id, filename, node.path);
 
     std::cout << "[DB] File '" << filename << "' saved to database (parent_id: " << parent_id << ")" << std::endl;
-    return true;
+    return node.file_id;
 }
 
-long DBManager::getStorageUsed(std::string username) {
+long DBManager::getStorageUsed(long long user_id) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     if (!conn) return 0;
 
-    std::string query = "SELECT COALESCE(SUM(f.size_bytes), 0) FROM FILES f "
-                       "JOIN USERS u ON f.owner_id = u.user_id "
-                       "WHERE u.username = '" + username + "' AND f.is_deleted = FALSE";
-    
-    if (mysql_query(conn, query.c_str())) return 0;
+    DBStatement stmt(lease, "SELECT storage_used_bytes FROM USERS WHERE user_id = ?");
+    stmt.bind(user_id);
+    if (!stmt.execute() || !stmt.fetch()) return 0;
     
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return 0;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    long used = row && row[0] ? std::stol(row[0]) : 0;
-    
-    mysql_free_result(result);
-    return used;
+    return stmt.getInt(0);
 }
 
-bool DBManager::shareFile(std::string filename, std::string ownerUsername, std::string targetUsername) {
+bool DBManager::getStorageAccount(long long user_id, long long& used, long long& limit) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     if (!conn) return false;
 
-    std::cout << "[DB] shareFile called: file='" << filename << "' owner='" << ownerUsername << "' target='" << targetUsername << "'" << std::endl;
+    DBStatement stmt(lease, "SELECT storage_used_bytes, storage_limit_bytes FROM USERS WHERE user_id = ?");
+    stmt.bind(user_id);
+    if (!stmt.execute() || !stmt.fetch()) return false;
 
-    std::string query = "SELECT user_id FROM USERS WHERE username = '" + ownerUsername + "'";
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] Get owner_id failed: " << mysql_error(conn) << std::endl;
-        return false;
-    }
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return false;
-    }
-    std::string owner_id = row[0];
-    mysql_free_result(result);
+    used = stmt.getInt(0);
+    limit = stmt.isNull(1) ? ServerConfig::DEFAULT_USER_QUOTA : stmt.getInt(1);
+    return true;
+}
 
-    query = "SELECT user_id FROM USERS WHERE username = '" + targetUsername + "'";
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] Get target_user_id failed: " << mysql_error(conn) << std::endl;
-        return false;
-    }
-    
-    result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
+bool DBManager::shareFile(std::string filename, long long owner_id, std::string targetUsername) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return false;
+
+    std::cout << "[DB] shareFile called: file='" << filename << "' owner_id=" << owner_id << " target='" << targetUsername << "'" << std::endl;
+
+    long long target_id = getUserId(targetUsername);
+    if (target_id < 0) {
         std::cerr << "[DB] Target user not found: " << targetUsername << std::endl;
         return false;
     }
-    std::string target_user_id = row[0];
-    mysql_free_result(result);
 
-    query = "SELECT file_id FROM FILES WHERE name = '" + filename + "' AND owner_id = " + owner_id + " AND is_deleted = FALSE";
-    std::cout << "[DB] Searching for file: query='" << query << "'" << std::endl;
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] Get file_id failed: " << mysql_error(conn) << std::endl;
-        return false;
-    }
-    
-    result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        std::cerr << "[DB] File not found or not owned by user: file='" << filename << "' owner_id=" << owner_id << std::endl;
-        return false;
+    long long file_id;
+    {
+        DBStatement select(lease, "SELECT file_id FROM FILES WHERE name = ? AND owner_id = ? AND is_deleted = FALSE");
+        select.bind(filename).bind(owner_id);
+        if (!select.execute()) {
+            std::cerr << "[DB] Get file_id failed: " << select.error() << std::endl;
+            return false;
+        }
+        if (!select.fetch()) {
+            std::cerr << "[DB] File not found or not owned by user: file='" << filename << "' owner_id=" << owner_id << std::endl;
+            return false;
+        }
+        file_id = select.getInt(0);
     }
-    std::string file_id = row[0];
     std::cout << "[DB] Found file_id: " << file_id << std::endl;
-    mysql_free_result(result);
 
-    query = "INSERT INTO SHAREDFILES (file_id, user_id, permission_id) VALUES (" 
-            + file_id + ", " + target_user_id + ", 1) "
-            "ON DUPLICATE KEY UPDATE shared_at = CURRENT_TIMESTAMP";
-    
-    std::cout << "[DB] Executing share insert: " << query << std::endl;
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] Share file failed: " << mysql_error(conn) << std::endl;
+    DBStatement insert(lease,
+        "INSERT INTO SHAREDFILES (file_id, user_id, permission_id) VALUES (?, ?, 1) "
+        "ON DUPLICATE KEY UPDATE shared_at = CURRENT_TIMESTAMP");
+    insert.bind(file_id).bind(target_id);
+    if (!insert.execute()) {
+        std::cerr << "[DB] Share file failed: " << insert.error() << std::endl;
         return false;
     }
+    aclCache.invalidateUser(target_id);
 
-    std::cout << "[DB] File '" << filename << "' shared from " << ownerUsername 
+    std::cout << "[DB] File '" << filename << "' shared from user " << owner_id 
               << " to " << targetUsername << std::endl;
     return true;
 }
 
-bool DBManager::deleteFile(std::string filename, std::string username) {
+bool DBManager::deleteFile(std::string filename, long long user_id) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     if (!conn) return false;
 
-    std::string query = "UPDATE FILES f "
-                       "JOIN USERS u ON f.owner_id = u.user_id "
-                       "SET f.is_deleted = TRUE "
-                       "WHERE f.name = '" + filename + "' "
-                       "AND u.username = '" + username + "' "
-                       "AND f.is_deleted = FALSE";
-    
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] Delete file failed: " << mysql_error(conn) << std::endl;
+    MetadataCache::UpdateGuard cacheUpdate(metadataCache);
+    DBTransaction tx(lease);
+    if (!tx.ok()) return false;
+
+    // Khóa các dòng sẽ xóa và lấy phần dung lượng cần trừ khỏi folder cha
+    struct Removed {
+        long long file_id; long long parent_id; bool isFolder; std::string path;
+        long long bytes; long long files; long long levels; long long blob_id;
+    };
+    std::vector<Removed> removed;
+    {
+        DBStatement select(lease,
+            "SELECT parent_id, is_folder, size_bytes, subtree_size_bytes, subtree_file_count, path, file_id, "
+            "       COALESCE(blob_id, file_id) "
+            "FROM FILES WHERE name = ? AND owner_id = ? AND is_deleted = FALSE FOR UPDATE");
+        select.bind(filename).bind(user_id);
+        if (!select.execute()) return false;
+        while (select.fetch()) {
+            bool isFolder = select.getInt(1) != 0;
+            removed.push_back({select.getInt(6), select.isNull(0) ? 0 : select.getInt(0), isFolder,
+                               select.getString(5),
+                               isFolder ? select.getInt(3) : select.getInt(2),
+                               isFolder ? select.getInt(4) : 1, 0, select.getInt(7)});
+        }
+    }
+    // File bị xóa bớt một tham chiếu tới các chunk trong blob của nó
+    for (const auto& r : removed) {
+        if (!r.isFolder && !adjustBlobRefs(lease, r.blob_id, -1)) return false;
+    }
+
+    DBStatement stmt(lease,
+        "UPDATE FILES SET is_deleted = TRUE WHERE name = ? AND owner_id = ? AND is_deleted = FALSE");
+    stmt.bind(filename).bind(user_id);
+    if (!stmt.execute()) {
+        std::cerr << "[DB] Delete file failed: " << stmt.error() << std::endl;
         return false;
     }
 
-    if (mysql_affected_rows(conn) == 0) {
+    if (stmt.affectedRows() == 0) {
         std::cerr << "[DB] File not found or user is not the owner" << std::endl;
         return false;
     }
 
-    std::cout << "[DB] File '" << filename << "' deleted by " << username << std::endl;
+    // Xóa folder thì xóa luôn nội dung bên trong (range scan trên idx_path).
+    // ref_count chỉ trừ cho dòng còn sống: dòng đã xóa ở trên hoặc trong folder lồng nhau không bị trừ hai lần
+    for (const auto& r : removed) {
+        if (!r.isFolder || r.path.empty()) continue;
+        if (!adjustSubtreeRefs(lease, r.path, -1)) return false;
+        DBStatement cascade(lease,
+            "UPDATE FILES SET is_deleted = TRUE "
+            "WHERE path > ? AND path < ? AND is_deleted = FALSE");
+        cascade.bind(r.path).bind(pathUpperBound(r.path));
+        if (!cascade.execute()) {
+            std::cerr << "[DB] Delete folder contents failed: " << cascade.error() << std::endl;
+            return false;
+        }
+    }
+
+    long long freedBytes = 0;
+    for (auto& r : removed) {
+        // Dòng nằm trong một folder khác cũng vừa bị xóa: đã tính trong subtree của folder đó
+        bool nested = false;
+        for (const auto& outer : removed) {
+            if (&outer != &r && outer.isFolder && !outer.path.empty() &&
+                r.path.size() > outer.path.size() && r.path.compare(0, outer.path.size(), outer.path) == 0) {
+                nested = true;
+                break;
+            }
+        }
+        if (!nested) freedBytes += r.bytes;
+
+        if (r.parent_id == 0) continue;
+        if (!adjustFolderTotals(lease, r.parent_id, -r.bytes, -r.files, &r.levels)) return false;
+    }
+    if (!adjustStorageUsed(lease, user_id, -freedBytes)) return false;
+    if (!tx.commit()) return false;
+    QuotaLedger::getInstance().onUsageChanged(user_id, -freedBytes);
+    for (const auto& r : removed) {
+        metadataCache.onTotalsChanged(parentPathOf(r.path), -r.bytes, r.levels);
+        metadataCache.onDelete(r.file_id, r.isFolder ? r.path : "");
+        SearchIndex::getInstance().onDelete(r.file_id, r.path, r.isFolder);
+    }
+
+    std::cout << "[DB] File '" << filename << "' deleted by user " << user_id << std::endl;
     return true;
 }
 
-bool DBManager::renameFile(long long fileId, std::string newName, std::string username) {
+bool DBManager::renameFile(long long fileId, std::string newName, long long user_id) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     if (!conn) return false;
 
+    MetadataCache::UpdateGuard cacheUpdate(metadataCache);
+
     // First, get the file info (old name, type, owner verification)
-    std::string checkQuery = "SELECT f.name, f.is_folder FROM FILES f "
-                            "JOIN USERS u ON f.owner_id = u.user_id "
-                            "WHERE f.file_id = " + std::to_string(fileId) + " "
-                            "AND u.username = '" + username + "' "
-                            "AND f.is_deleted = FALSE";
-    
-    if (mysql_query(conn, checkQuery.c_str())) {
-        std::cerr << "[DB] Failed to check item: " << mysql_error(conn) << std::endl;
-        return false;
-    }
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result || mysql_num_rows(result) == 0) {
-        if (result) mysql_free_result(result);
-        std::cerr << "[DB] Item not found or user is not the owner" << std::endl;
-        return false;
+    std::string oldName;
+    bool isFolder;
+    {
+        DBStatement check(lease, "SELECT name, is_folder FROM FILES WHERE file_id = ? AND owner_id = ? AND is_deleted = FALSE");
+        check.bind(fileId).bind(user_id);
+        if (!check.execute()) {
+            std::cerr << "[DB] Failed to check item: " << check.error() << std::endl;
+            return false;
+        }
+        if (!check.fetch()) {
+            std::cerr << "[DB] Item not found or user is not the owner" << std::endl;
+            return false;
+        }
+        oldName = check.getString(0);
+        isFolder = check.getInt(1) != 0;
     }
     
-    MYSQL_ROW row = mysql_fetch_row(result);
-    std::string oldName = row[0] ? row[0] : "";
-    bool isFolder = (row[1] && std::string(row[1]) == "1");
-    mysql_free_result(result);
-    
     std::string itemType = isFolder ? "FOLDER" : "FILE";
-    std::cout << "[DB RENAME " << itemType << "] File ID: " << fileId << ", Renaming: '" << oldName << "' -> '" << newName << "' by user: " << username << std::endl;
+    std::cout << "[DB RENAME " << itemType << "] File ID: " << fileId << ", Renaming: '" << oldName << "' -> '" << newName << "' by user: " << user_id << std::endl;
 
     // Handle physical rename based on type
     if (isFolder) {
@@ -622,15 +807,10 @@ bool DBManager::renameFile(long long fileId, std::string newName, std::string us
     }
 
     // Update database
-    std::string updateQuery = "UPDATE FILES f "
-                             "JOIN USERS u ON f.owner_id = u.user_id "
-                             "SET f.name = '" + newName + "' "
-                             "WHERE f.file_id = " + std::to_string(fileId) + " "
-                             "AND u.username = '" + username + "' "
-                             "AND f.is_deleted = FALSE";
-    
-    if (mysql_query(conn, updateQuery.c_str())) {
-        std::cerr << "[DB RENAME " << itemType << "] Database update failed: " << mysql_error(conn) << std::endl;
+    DBStatement update(lease, "UPDATE FILES SET name = ? WHERE file_id = ? AND owner_id = ? AND is_deleted = FALSE");
+    update.bind(newName).bind(fileId).bind(user_id);
+    if (!update.execute()) {
+        std::cerr << "[DB RENAME " << itemType << "] Database update failed: " << update.error() << std::endl;
         // Rollback physical rename if it was a folder
         if (isFolder) {
             std::string oldPath = std::string(STORAGE_PATH) + oldName;
@@ -641,7 +821,7 @@ bool DBManager::renameFile(long long fileId, std::string newName, std::string us
         return false;
     }
 
-    if (mysql_affected_rows(conn) == 0) {
+    if (update.affectedRows() == 0) {
         std::cerr << "[DB RENAME " << itemType << "] No rows affected" << std::endl;
         // Rollback physical rename if it was a folder
         if (isFolder) {
@@ -653,331 +833,883 @@ bool DBManager::renameFile(long long fileId, std::string newName, std::string us
         return false;
     }
     
+    metadataCache.onRename(fileId, newName);
+    SearchIndex::getInstance().onRename(fileId, newName);
     std::cout << "[DB RENAME " << itemType << "] Database updated successfully" << std::endl;
 
     std::cout << "[DB RENAME " << itemType << "] SUCCESS: '" << oldName << "' -> '" << newName << "'" << std::endl;
     return true;
 }
 
-std::vector<FileRecordEx> DBManager::getItemsInFolder(long long parent_id, std::string username) {
+std::vector<FileRecordEx> DBManager::getItemsInFolder(long long parent_id, long long user_id) {
     std::vector<FileRecordEx> list;
-    if (!conn) return list;
+    std::vector<MetadataNode> children;
+    if (parent_id == -1) {
+        // Con của folder 1 thuộc user_id
+        if (!loadFolder(1, children)) return list;
+        for (const auto& node : children) {
+            if (node.owner_id == user_id) list.push_back(toRecordEx(node));
+        }
+    } else {
+        if (!loadFolder(parent_id, children)) return list;
+        for (const auto& node : children) list.push_back(toRecordEx(node));
+    }
+    sortByName(list);
 
-    std::string query = "SELECT user_id FROM USERS WHERE username = '" + username + "'";
-    if (mysql_query(conn, query.c_str())) return list;
+    std::cout << "[DB] Retrieved " << list.size() << " items in folder (parent_id=" 
+              << parent_id << ")" << std::endl;
+    return list;
+}
+
+std::vector<SubtreeEntry> DBManager::getSubtree(long long folder_id) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    std::vector<SubtreeEntry> tree;
+    if (!conn) return tree;
+
+    // Con cháu của x là các dòng có path bắt đầu bằng x.path: một range scan trên idx_path.
+    // x là const table (khớp PK) nên cận của range là hằng khi tối ưu câu lệnh.
+    DBStatement stmt(lease,
+        "SELECT d.file_id, d.owner_id, d.parent_id, d.name, d.is_folder, d.size_bytes, u.username, "
+        "       COALESCE(d.blob_id, d.file_id) "
+        "FROM FILES x "
+        "JOIN FILES d ON d.path > x.path AND d.path < CONCAT(LEFT(x.path, LENGTH(x.path) - 1), '0') "
+        "JOIN USERS u ON d.owner_id = u.user_id "
+        "WHERE x.file_id = ? AND x.path != '' AND d.is_deleted = FALSE");
+    stmt.bind(folder_id);
+    if (!stmt.execute()) return tree;
+
+    std::vector<FileRecordEx> nodes;
+    std::vector<long long> blobs;
+    std::unordered_map<long long, std::vector<size_t>> children;  // parent_id -> index trong nodes
+    while (stmt.fetch()) {
+        FileRecordEx rec;
+        rec.file_id = stmt.getInt(0);
+        rec.owner_id = stmt.getInt(1);
+        rec.parent_id = stmt.getInt(2);
+        rec.name = stmt.getString(3);
+        rec.is_folder = stmt.getInt(4) != 0;
+        rec.size = stmt.getInt(5);
+        rec.owner = stmt.getString(6);
+        children[rec.parent_id].push_back(nodes.size());
+        nodes.push_back(std::move(rec));
+        blobs.push_back(stmt.getInt(7));
+    }
+
+    for (auto& entry : children) {
+        std::sort(entry.second.begin(), entry.second.end(), [&nodes](size_t a, size_t b) {
+            if (nodes[a].is_folder != nodes[b].is_folder) return nodes[a].is_folder;
+            return nodes[a].name < nodes[b].name;
+        });
+    }
+
+    // Duyệt trước bằng stack (cây sâu không làm tràn stack); đẩy con theo thứ tự ngược
+    struct Pending { size_t index; std::string parentPath; };
+    std::vector<Pending> stack;
+    auto pushChildren = [&](long long parent, const std::string& parentPath) {
+        auto it = children.find(parent);
+        if (it == children.end()) return;
+        for (auto rit = it->second.rbegin(); rit != it->second.rend(); ++rit) {
+            stack.push_back({*rit, parentPath});
+        }
+    };
+
+    tree.reserve(nodes.size());
+    pushChildren(folder_id, "");
+    while (!stack.empty()) {
+        Pending p = std::move(stack.back());
+        stack.pop_back();
+        FileRecordEx& rec = nodes[p.index];
+        std::string path = p.parentPath.empty() ? rec.name : p.parentPath + "/" + rec.name;
+        if (rec.is_folder) pushChildren(rec.file_id, path);
+        tree.push_back({std::move(rec), std::move(path), blobs[p.index]});
+    }
+    return tree;
+}
+
+std::vector<FileRecordEx> DBManager::getFolderStructure(long long folder_id, long long user_id) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    std::vector<FileRecordEx> allFiles;
+    if (!conn) return allFiles;
+
+    std::string query = "SELECT file_id FROM FILES WHERE file_id = " + std::to_string(folder_id) +
+            " AND owner_id = " + std::to_string(user_id) + " AND is_folder = TRUE AND is_deleted = FALSE";
     
+    if (lease.query(query)) return allFiles;
     MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return list;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return list;
+    if (!result || mysql_num_rows(result) == 0) {
+        if (result) mysql_free_result(result);
+        std::cerr << "[DB] Folder not found or not owned by user" << std::endl;
+        return allFiles;
     }
-    std::string user_id = row[0];
     mysql_free_result(result);
 
-    std::stringstream ss;
-    if (parent_id == -1) {
-        ss << "SELECT file_id, owner_id, parent_id, name, is_folder, size_bytes, created_at "
-           << "FROM FILES WHERE parent_id = 1 AND owner_id = " << user_id 
-           << " AND is_deleted = FALSE ORDER BY is_folder DESC, name ASC";
-    } else {
-        ss << "SELECT file_id, owner_id, parent_id, name, is_folder, size_bytes, created_at "
-           << "FROM FILES WHERE parent_id = " << parent_id 
-           << " AND is_deleted = FALSE ORDER BY is_folder DESC, name ASC";
+    for (auto& entry : getSubtree(folder_id)) {
+        allFiles.push_back(std::move(entry.item));
+    }
+    
+    std::cout << "[DB] Collected " << allFiles.size() << " items in folder structure" << std::endl;
+    return allFiles;
+}
+
+long long DBManager::createFolder(std::string foldername, long long parent_id, long long owner_id) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return -1;
+
+    MetadataCache::UpdateGuard cacheUpdate(metadataCache);
+    DBTransaction tx(lease);
+    if (!tx.ok()) return -1;
+
+    DBStatement insert(lease,
+        "INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) VALUES (?, ?, ?, TRUE, 0)");
+    insert.bind(owner_id);
+    // Root level folder - parent is NULL or 1
+    if (parent_id == -1 || parent_id == 0) insert.bindNull();
+    else insert.bind(parent_id);
+    insert.bind(foldername);
+    if (!insert.execute()) {
+        std::cerr << "[DB] Create folder failed: " << insert.error() << std::endl;
+        return -1;
+    }
+
+    MetadataNode node;
+    node.file_id = insert.insertId();
+    node.owner_id = owner_id;
+    node.parent_id = parent_id == -1 ? 0 : parent_id;
+    node.name = foldername;
+    node.is_folder = true;
+    if (!assignPath(lease, node.file_id, node.path) || !tx.commit()) return -1;
+    metadataCache.onInsert(node);
+    SearchIndex::getInstance().onInsert(node.file_id, owner_id, foldername, node.path);
+
+    long long new_folder_id = node.file_id;
+    std::cout << "[DB] Folder '" << foldername << "' created with ID: " << new_folder_id << std::endl;
+    return new_folder_id;
+}
+
+long long DBManager::createFileInFolder(std::string filename, long long parent_id, long long filesize, long long owner_id) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return -1;
+
+    MetadataCache::UpdateGuard cacheUpdate(metadataCache);
+    DBTransaction tx(lease);
+    if (!tx.ok()) return -1;
+
+    DBStatement insert(lease,
+        "INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) VALUES (?, ?, ?, FALSE, ?)");
+    insert.bind(owner_id).bind(parent_id).bind(filename).bind(filesize);
+    if (!insert.execute()) {
+        std::cerr << "[DB] Create file failed: " << insert.error() << std::endl;
+        return -1;
+    }
+
+    MetadataNode node;
+    node.file_id = insert.insertId();
+    node.owner_id = owner_id;
+    node.parent_id = parent_id;
+    node.name = filename;
+    node.size_bytes = filesize;
+    long long levels = 0;
+    if (!assignPath(lease, node.file_id, node.path) || !adjustFolderTotals(lease, parent_id, filesize, 1, &levels) ||
+        !adjustStorageUsed(lease, owner_id, filesize) || !tx.commit()) {
+        return -1;
+    }
+    QuotaLedger::getInstance().onUsageChanged(owner_id, filesize);
+    metadataCache.onInsert(node);
+    metadataCache.onTotalsChanged(parentPathOf(node.path), filesize, levels);
+    SearchIndex::getInstance().onInsert(node.file_id, owner_id, filename, node.path);
+
+    long long new_file_id = node.file_id;
+    std::cout << "[DB] File '" << filename << "' created in folder " << parent_id 
+              << " with ID: " << new_file_id << std::endl;
+    return new_file_id;
+}
+
+long long DBManager::cloneFolder(long long folder_id, long long owner_id, long long new_owner_id,
+                                  long long& fileCount, long long& totalBytes) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return -1;
+
+    // old_id -> new_id của các folder đã chép; depth để mỗi vòng chỉ mở rộng một cấp.
+    // Bảng tạm thuộc kết nối nên các lease khác không thấy
+    if (lease.query("CREATE TEMPORARY TABLE IF NOT EXISTS clone_map ("
+                    "old_id BIGINT PRIMARY KEY, new_id BIGINT NOT NULL, "
+                    "new_path VARCHAR(2048) CHARACTER SET ascii COLLATE ascii_bin NOT NULL, "
+                    "depth INT NOT NULL, INDEX idx_depth (depth)) ENGINE=InnoDB") ||
+        lease.query("DELETE FROM clone_map")) {
+        std::cerr << "[DB] Prepare clone map failed: " << mysql_error(conn) << std::endl;
+        return -1;
+    }
+
+    MetadataCache::UpdateGuard cacheUpdate(metadataCache);
+    DBTransaction tx(lease);
+    if (!tx.ok()) return -1;
+
+    MetadataNode root;
+    {
+        DBStatement select(lease,
+            "SELECT name, subtree_size_bytes, subtree_file_count FROM FILES "
+            "WHERE file_id = ? AND owner_id = ? AND is_folder = TRUE AND is_deleted = FALSE FOR SHARE");
+        select.bind(folder_id).bind(owner_id);
+        if (!select.execute() || !select.fetch()) {
+            std::cerr << "[DB] Folder not found or not owned by user" << std::endl;
+            return -1;
+        }
+        root.name = select.getString(0);
+        totalBytes = select.getInt(1);
+        fileCount = select.getInt(2);
+    }
+
+    // Bản sao tính vào quota của người nhận; giữ chỗ tới khi đã cộng vào storage_used
+    auto quota = QuotaLedger::getInstance().reserve(new_owner_id, totalBytes);
+    if (!quota) {
+        std::cerr << "[DB] Clone rejected: quota exceeded for user " << new_owner_id << std::endl;
+        return -1;
+    }
+
+    DBStatement insertRoot(lease,
+        "INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes, subtree_size_bytes, subtree_file_count) "
+        "VALUES (?, NULL, ?, TRUE, 0, ?, ?)");
+    insertRoot.bind(new_owner_id).bind(root.name).bind(totalBytes).bind(fileCount);
+    if (!insertRoot.execute()) {
+        std::cerr << "[DB] Clone root failed: " << insertRoot.error() << std::endl;
+        return -1;
+    }
+    root.file_id = insertRoot.insertId();
+    root.owner_id = new_owner_id;
+    root.is_folder = true;
+    root.subtree_bytes = totalBytes;
+    if (!assignPath(lease, root.file_id, root.path)) return -1;
+
+    DBStatement mapRoot(lease, "INSERT INTO clone_map (old_id, new_id, new_path, depth) VALUES (?, ?, ?, 0)");
+    mapRoot.bind(folder_id).bind(root.file_id).bind(root.path);
+    if (!mapRoot.execute()) return -1;
+
+    // Dòng mới tạm mang path "<path của cha mới>#<file_id cũ>" để nối lại với dòng gốc,
+    // sau đó mới đổi thành path thật (cần file_id mới)
+    std::string upper = pathUpperBound(root.path);
+    for (long long depth = 0;; depth++) {
+        DBStatement copy(lease,
+            "INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes, blob_id, "
+            "                   subtree_size_bytes, subtree_file_count, path) "
+            "SELECT ?, m.new_id, s.name, s.is_folder, s.size_bytes, IF(s.is_folder, NULL, COALESCE(s.blob_id, s.file_id)), "
+            "       s.subtree_size_bytes, s.subtree_file_count, CONCAT(m.new_path, '#', s.file_id) "
+            "FROM clone_map m JOIN FILES s ON s.parent_id = m.old_id AND s.is_deleted = FALSE "
+            "WHERE m.depth = ?");
+        copy.bind(new_owner_id).bind(depth);
+        if (!copy.execute()) {
+            std::cerr << "[DB] Clone level " << depth << " failed: " << copy.error() << std::endl;
+            return -1;
+        }
+        if (copy.affectedRows() == 0) break;
+
+        DBStatement map(lease,
+            "INSERT INTO clone_map (old_id, new_id, new_path, depth) "
+            "SELECT CAST(SUBSTRING_INDEX(path, '#', -1) AS UNSIGNED), file_id, "
+            "       CONCAT(SUBSTRING_INDEX(path, '#', 1), file_id, '/'), ? "
+            "FROM FILES WHERE path > ? AND path < ? AND path LIKE '%#%' AND is_folder = TRUE");
+        map.bind(depth + 1).bind(root.path).bind(upper);
+        DBStatement fixPath(lease,
+            "UPDATE FILES SET path = CONCAT(SUBSTRING_INDEX(path, '#', 1), file_id, '/'), updated_at = updated_at "
+            "WHERE path > ? AND path < ? AND path LIKE '%#%'");
+        fixPath.bind(root.path).bind(upper);
+        if (!map.execute()) {
+            std::cerr << "[DB] Clone map level " << depth << " failed: " << map.error() << std::endl;
+            return -1;
+        }
+        if (!fixPath.execute()) {
+            std::cerr << "[DB] Clone path level " << depth << " failed: " << fixPath.error() << std::endl;
+            return -1;
+        }
+    }
+
+    // Bản chép dùng chung blob với dòng gốc: mỗi file mới là thêm một tham chiếu tới các chunk
+    if (!adjustSubtreeRefs(lease, root.path, 1)) return -1;
+    if (!adjustStorageUsed(lease, new_owner_id, totalBytes) || !tx.commit()) return -1;
+    QuotaLedger::getInstance().onUsageChanged(new_owner_id, totalBytes);
+    metadataCache.onInsert(root);
+
+    // Cây mới: một range scan trên idx_path để đưa vào SearchIndex
+    SearchIndex& index = SearchIndex::getInstance();
+    index.onInsert(root.file_id, new_owner_id, root.name, root.path);
+    DBStatement added(lease,
+        "SELECT file_id, name, path FROM FILES WHERE path > ? AND path < ? AND is_deleted = FALSE");
+    added.bind(root.path).bind(upper);
+    if (added.execute()) {
+        while (added.fetch()) {
+            index.onInsert(added.getInt(0), new_owner_id, added.getString(1), added.getString(2));
+        }
+    }
+
+    std::cout << "[DB] Folder " << folder_id << " cloned to user " << new_owner_id << " as " << root.file_id
+              << " (" << fileCount << " files, " << totalBytes << " bytes)" << std::endl;
+    return root.file_id;
+}
+
+bool DBManager::adjustFolderTotals(DBLease& lease, long long folder_id, long long deltaBytes, long long deltaFiles,
+                                   long long* levels) {
+    // Đi từ folder_id lên gốc trong một câu lệnh (recursive CTE).
+    // Dừng phía trên folder đã xóa: phần của nó đã được trừ khỏi các cấp trên lúc xóa.
+    DBStatement stmt(lease,
+        "UPDATE FILES f JOIN ("
+        "  WITH RECURSIVE chain (file_id, parent_id, is_deleted) AS ("
+        "    SELECT file_id, parent_id, is_deleted FROM FILES WHERE file_id = ? "
+        "    UNION ALL "
+        "    SELECT p.file_id, p.parent_id, p.is_deleted FROM FILES p "
+        "    JOIN chain c ON p.file_id = c.parent_id WHERE c.is_deleted = FALSE"
+        "  ) SELECT file_id FROM chain"
+        ") a ON a.file_id = f.file_id "
+        "SET f.subtree_size_bytes = f.subtree_size_bytes + ?, "
+        "    f.subtree_file_count = f.subtree_file_count + ?, "
+        "    f.updated_at = f.updated_at");
+    stmt.bind(folder_id).bind(deltaBytes).bind(deltaFiles);
+    if (!stmt.execute()) {
+        std::cerr << "[DB] Update folder totals failed: " << stmt.error() << std::endl;
+        return false;
+    }
+    if (levels) *levels = stmt.affectedRows();
+    return true;
+}
+
+bool DBManager::adjustStorageUsed(DBLease& lease, long long user_id, long long delta) {
+    if (delta == 0) return true;
+    DBStatement stmt(lease, "UPDATE USERS SET storage_used_bytes = storage_used_bytes + ? WHERE user_id = ?");
+    stmt.bind(delta).bind(user_id);
+    if (!stmt.execute()) {
+        std::cerr << "[DB] Update storage used failed: " << stmt.error() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DBManager::insertChunkManifest(DBLease& lease, long long blob_id, const std::vector<ChunkRef>& chunks,
+                                    long long refs) {
+    // Chunk lặp lại trong cùng blob được cộng mỗi lần. Cập nhật theo thứ tự hash (std::map)
+    // để hai transaction cùng chạm các chunk giống nhau khóa theo cùng một thứ tự
+    std::map<std::string, std::pair<long long, long long>> counts;  // hash -> (size, số lần)
+    for (const ChunkRef& chunk : chunks) {
+        auto& count = counts[chunk.hash];
+        count.first = chunk.size;
+        count.second++;
+    }
+    for (const auto& [hash, count] : counts) {
+        DBStatement ref(lease,
+            "INSERT INTO CHUNKS (chunk_hash, size_bytes, ref_count) VALUES (UNHEX(?), ?, ?) "
+            "ON DUPLICATE KEY UPDATE ref_count = ref_count + ?");
+        ref.bind(hash).bind(count.first).bind(count.second * refs).bind(count.second * refs);
+        if (!ref.execute()) {
+            std::cerr << "[DB] Chunk ref failed: " << ref.error() << std::endl;
+            return false;
+        }
+        // Đã khóa dòng: dropUnreferencedChunks không xóa file được nữa, nhưng có thể đã xóa trước đó
+        if (ChunkStore::storedSize(hash) < 0) {
+            std::cerr << "[DB] Chunk " << hash << " is missing from the store" << std::endl;
+            return false;
+        }
+    }
+
+    for (size_t seq = 0; seq < chunks.size(); seq++) {
+        const ChunkRef& chunk = chunks[seq];
+        DBStatement entry(lease,
+            "INSERT INTO BLOB_CHUNKS (blob_id, seq, chunk_hash, size_bytes) VALUES (?, ?, UNHEX(?), ?)");
+        entry.bind(blob_id).bind((long long)seq).bind(chunk.hash).bind(chunk.size);
+        if (!entry.execute()) {
+            std::cerr << "[DB] Manifest insert failed: " << entry.error() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// UPDATE nhiều bảng đọc BLOB_CHUNKS / FILES bằng shared lock: manifest đang được ChunkStore ghi
+// thì chờ nó commit rồi mới đếm
+bool DBManager::adjustBlobRefs(DBLease& lease, long long blob_id, long long delta) {
+    DBStatement stmt(lease,
+        "UPDATE CHUNKS c JOIN ("
+        "  SELECT chunk_hash, COUNT(*) AS n FROM BLOB_CHUNKS WHERE blob_id = ? GROUP BY chunk_hash"
+        ") m ON m.chunk_hash = c.chunk_hash "
+        "SET c.ref_count = c.ref_count + m.n * ?");
+    stmt.bind(blob_id).bind(delta);
+    if (!stmt.execute()) {
+        std::cerr << "[DB] Update chunk refs failed: " << stmt.error() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DBManager::adjustSubtreeRefs(DBLease& lease, const std::string& path, long long delta) {
+    DBStatement stmt(lease,
+        "UPDATE CHUNKS c JOIN ("
+        "  SELECT bc.chunk_hash, COUNT(*) AS n FROM FILES f "
+        "  JOIN BLOB_CHUNKS bc ON bc.blob_id = COALESCE(f.blob_id, f.file_id) "
+        "  WHERE f.path > ? AND f.path < ? AND f.is_deleted = FALSE AND f.is_folder = FALSE "
+        "  GROUP BY bc.chunk_hash"
+        ") m ON m.chunk_hash = c.chunk_hash "
+        "SET c.ref_count = c.ref_count + m.n * ?");
+    stmt.bind(path).bind(pathUpperBound(path)).bind(delta);
+    if (!stmt.execute()) {
+        std::cerr << "[DB] Update subtree chunk refs failed: " << stmt.error() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DBManager::assignPath(DBLease& lease, long long file_id, std::string& path) {
+    DBStatement stmt(lease,
+        "UPDATE FILES f LEFT JOIN FILES p ON p.file_id = f.parent_id "
+        "SET f.path = CONCAT(COALESCE(p.path, '/'), f.file_id, '/'), f.updated_at = f.updated_at "
+        "WHERE f.file_id = ?");
+    stmt.bind(file_id);
+    if (!stmt.execute()) {
+        std::cerr << "[DB] Assign path failed: " << stmt.error() << std::endl;
+        return false;
+    }
+
+    DBStatement select(lease, "SELECT path FROM FILES WHERE file_id = ?");
+    select.bind(file_id);
+    if (!select.execute() || !select.fetch()) return false;
+    path = select.getString(0);
+    return true;
+}
+
+FileRecordEx DBManager::getFileInfo(long long file_id) {
+    MetadataNode node;
+    if (metadataCache.lookupNode(file_id, node)) {
+        FileRecordEx rec = toRecordEx(node);
+        if (rec.parent_id == 0) rec.parent_id = -1;
+        return rec;
+    }
+
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    FileRecordEx rec;
+    rec.file_id = -1;
+    if (!conn) return rec;
+
+    DBStatement stmt(lease,
+        "SELECT f.file_id, f.owner_id, f.parent_id, f.name, f.is_folder, "
+        "f.size_bytes, u.username FROM FILES f "
+        "JOIN USERS u ON f.owner_id = u.user_id "
+        "WHERE f.file_id = ?");
+    stmt.bind(file_id);
+    if (!stmt.execute()) return rec;
+
+    if (stmt.fetch()) {
+        rec.file_id = stmt.getInt(0);
+        rec.owner_id = stmt.getInt(1);
+        rec.parent_id = stmt.isNull(2) ? -1 : stmt.getInt(2);
+        rec.name = stmt.getString(3);
+        rec.is_folder = stmt.getInt(4) != 0;
+        rec.size = stmt.getInt(5);
+        rec.owner = stmt.getString(6);
+    }
+    
+    return rec;
+}
+
+long long DBManager::getBlobId(long long file_id) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return -1;
+
+    DBStatement stmt(lease,
+        "SELECT COALESCE(blob_id, file_id) FROM FILES WHERE file_id = ? AND is_folder = FALSE AND is_deleted = FALSE");
+    stmt.bind(file_id);
+    if (!stmt.execute() || !stmt.fetch()) return -1;
+    return stmt.getInt(0);
+}
+
+long long DBManager::findDownloadBlob(const std::string& filename, long long user_id) {
+    struct Candidate { long long file_id; long long blob_id; };
+    std::vector<Candidate> shared;
+    {
+        DBLease lease;
+        MYSQL*& conn = lease.handle();
+        if (!conn) return -1;
+
+        // File của chính user đứng đầu; trùng tên thì lấy bản mới nhất (idx_name)
+        DBStatement stmt(lease,
+            "SELECT file_id, owner_id, COALESCE(blob_id, file_id) FROM FILES "
+            "WHERE name = ? AND is_folder = FALSE AND is_deleted = FALSE "
+            "ORDER BY owner_id = ? DESC, file_id DESC");
+        stmt.bind(filename).bind(user_id);
+        if (!stmt.execute()) return -1;
+        while (stmt.fetch()) {
+            if (stmt.getInt(1) == user_id) return stmt.getInt(2);
+            shared.push_back({stmt.getInt(0), stmt.getInt(2)});
+        }
     }
-    
-    if (mysql_query(conn, ss.str().c_str())) {
-        std::cerr << "[DB] Query failed: " << mysql_error(conn) << std::endl;
-        return list;
+
+    // hasSharedAccess dùng AclCache, chỉ hỏi DB khi chưa có trong cache
+    for (const auto& c : shared) {
+        if (hasSharedAccess(c.file_id, user_id)) return c.blob_id;
     }
+    return -1;
+}
 
-    result = mysql_store_result(conn);
-    if (!result) return list;
+std::vector<ChunkRef> DBManager::getChunkManifest(long long blob_id) {
+    std::vector<ChunkRef> chunks;
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return chunks;
 
-    while ((row = mysql_fetch_row(result))) {
-        FileRecordEx rec;
-        rec.file_id = row[0] ? std::stoll(row[0]) : 0;
-        rec.owner_id = row[1] ? std::stoll(row[1]) : 0;
-        rec.parent_id = row[2] ? std::stoll(row[2]) : -1;
-        rec.name = row[3] ? row[3] : "";
-        rec.is_folder = row[4] && std::string(row[4]) == "1";
-        rec.size = row[5] ? std::stoll(row[5]) : 0;
-        rec.owner = username;
-        list.push_back(rec);
+    DBStatement stmt(lease,
+        "SELECT LOWER(HEX(chunk_hash)), size_bytes FROM BLOB_CHUNKS WHERE blob_id = ? ORDER BY seq");
+    stmt.bind(blob_id);
+    if (!stmt.execute()) return chunks;
+    while (stmt.fetch()) {
+        chunks.push_back({stmt.getString(0), stmt.getInt(1)});
     }
+    return chunks;
+}
 
-    mysql_free_result(result);
-    std::cout << "[DB] Retrieved " << list.size() << " items in folder (parent_id=" 
-              << parent_id << ")" << std::endl;
-    return list;
+bool DBManager::storeChunkManifest(long long blob_id, const std::vector<ChunkRef>& chunks) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return false;
+
+    DBTransaction tx(lease);
+    if (!tx.ok()) return false;
+
+    // Số dòng FILES còn sống dùng blob này: chính nó (blob_id NULL) và các bản chép (idx_blob).
+    // Đọc có khóa: xóa/chép song song phải chờ commit, sau đó chúng thấy manifest và tự cộng/trừ
+    long long refs = 0;
+    {
+        DBStatement self(lease,
+            "SELECT COUNT(*) FROM FILES WHERE file_id = ? AND blob_id IS NULL AND is_deleted = FALSE FOR SHARE");
+        self.bind(blob_id);
+        if (!self.execute() || !self.fetch()) return false;
+        refs += self.getInt(0);
+    }
+    {
+        DBStatement copies(lease,
+            "SELECT COUNT(*) FROM FILES WHERE blob_id = ? AND is_deleted = FALSE FOR SHARE");
+        copies.bind(blob_id);
+        if (!copies.execute() || !copies.fetch()) return false;
+        refs += copies.getInt(0);
+    }
+
+    if (!insertChunkManifest(lease, blob_id, chunks, refs)) return false;
+    return tx.commit();
 }
 
-void DBManager::collectFilesRecursive(long long parent_id, std::vector<FileRecordEx>& results, std::string username) {
-    auto items = getItemsInFolder(parent_id, username);
-    
-    for (const auto& item : items) {
-        results.push_back(item);
-        
-        if (item.is_folder) {
-            collectFilesRecursive(item.file_id, results, username);
+// Số hash trong một câu IN (...): câu SQL cố định để dùng lại prepared statement,
+// lô cuối lặp lại hash cuối cho đủ
+static constexpr size_t HELD_CHUNK_BATCH = 32;
+
+bool DBManager::lookupHeldChunks(DBLease& lease, long long user_id, std::vector<ChunkRef>& chunks,
+                                 long long& pendingBytes, bool lockPending, std::vector<std::string>* pendingHashes) {
+    static const std::string hashList = [] {
+        std::string list;
+        for (size_t i = 0; i < HELD_CHUNK_BATCH; i++) list += i ? ", UNHEX(?)" : "UNHEX(?)";
+        return list;
+    }();
+    static const std::string pendingSql =
+        "SELECT LOWER(HEX(chunk_hash)), size_bytes FROM CHUNK_UPLOADS "
+        "WHERE user_id = ? AND chunk_hash IN (" + hashList + ")";
+    static const std::string pendingLockSql = pendingSql + " FOR UPDATE";
+    // File còn sống của user trỏ tới blob: dòng của chính blob (blob_id NULL) hoặc bản chép (idx_blob)
+    static const std::string ownedSql =
+        "SELECT DISTINCT LOWER(HEX(bc.chunk_hash)), bc.size_bytes FROM BLOB_CHUNKS bc "
+        "WHERE bc.chunk_hash IN (" + hashList + ") AND ("
+        "  EXISTS (SELECT 1 FROM FILES f WHERE f.file_id = bc.blob_id AND f.blob_id IS NULL "
+        "          AND f.owner_id = ? AND f.is_deleted = FALSE) OR "
+        "  EXISTS (SELECT 1 FROM FILES f WHERE f.blob_id = bc.blob_id "
+        "          AND f.owner_id = ? AND f.is_deleted = FALSE))";
+
+    // Khóa theo thứ tự hash tăng dần: hai STOR_CHUNKED của cùng user không deadlock
+    std::vector<std::string> unique;
+    unique.reserve(chunks.size());
+    for (const ChunkRef& chunk : chunks) unique.push_back(chunk.hash);
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+    std::unordered_map<std::string, long long> held;
+    pendingBytes = 0;
+    for (size_t start = 0; start < unique.size(); start += HELD_CHUNK_BATCH) {
+        auto bindBatch = [&](DBStatement& stmt) {
+            for (size_t i = 0; i < HELD_CHUNK_BATCH; i++) {
+                stmt.bind(unique[std::min(start + i, unique.size() - 1)]);
+            }
+        };
+
+        DBStatement pending(lease, (lockPending ? pendingLockSql : pendingSql).c_str());
+        pending.bind(user_id);
+        bindBatch(pending);
+        if (!pending.execute()) return false;
+        while (pending.fetch()) {
+            std::string hash = pending.getString(0);
+            pendingBytes += pending.getInt(1);
+            held[hash] = pending.getInt(1);
+            if (pendingHashes) pendingHashes->push_back(std::move(hash));
         }
+
+        DBStatement owned(lease, ownedSql.c_str());
+        bindBatch(owned);
+        owned.bind(user_id).bind(user_id);
+        if (!owned.execute()) return false;
+        while (owned.fetch()) held.emplace(owned.getString(0), owned.getInt(1));
+    }
+
+    for (ChunkRef& chunk : chunks) {
+        auto it = held.find(chunk.hash);
+        chunk.size = it != held.end() ? it->second : -1;
     }
+    return true;
 }
 
-std::vector<FileRecordEx> DBManager::getFolderStructure(long long folder_id, std::string username) {
-    std::vector<FileRecordEx> allFiles;
-    if (!conn) return allFiles;
+bool DBManager::findHeldChunks(long long user_id, std::vector<ChunkRef>& chunks, long long* pendingBytes) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return false;
 
-    std::string query = "SELECT user_id FROM USERS WHERE username = '" + username + "'";
-    if (mysql_query(conn, query.c_str())) return allFiles;
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return allFiles;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return allFiles;
-    }
-    std::string user_id = row[0];
-    mysql_free_result(result);
+    long long pending = 0;
+    if (!lookupHeldChunks(lease, user_id, chunks, pending, false, nullptr)) return false;
+    if (pendingBytes) *pendingBytes = pending;
+    return true;
+}
 
-    query = "SELECT file_id FROM FILES WHERE file_id = " + std::to_string(folder_id) +
-            " AND owner_id = " + user_id + " AND is_folder = TRUE AND is_deleted = FALSE";
-    
-    if (mysql_query(conn, query.c_str())) return allFiles;
-    result = mysql_store_result(conn);
-    if (!result || mysql_num_rows(result) == 0) {
-        if (result) mysql_free_result(result);
-        std::cerr << "[DB] Folder not found or not owned by user" << std::endl;
-        return allFiles;
+bool DBManager::claimChunks(DBLease& lease, long long user_id, const std::vector<ChunkRef>& chunks,
+                            long long& claimedBytes) {
+    std::vector<ChunkRef> held;
+    held.reserve(chunks.size());
+    for (const ChunkRef& chunk : chunks) held.push_back({chunk.hash, -1});
+    std::vector<std::string> pendingHashes;
+    if (!lookupHeldChunks(lease, user_id, held, claimedBytes, true, &pendingHashes)) return false;
+
+    // Dòng pending vừa bị dọn, hoặc file chứa chunk vừa bị xóa, sau lúc caller tính size/quota
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (held[i].size < 0 || held[i].size != chunks[i].size) {
+            std::cerr << "[DB] Chunk " << chunks[i].hash << " no longer held by user " << user_id << std::endl;
+            return false;
+        }
     }
-    mysql_free_result(result);
 
-    collectFilesRecursive(folder_id, allFiles, username);
-    
-    std::cout << "[DB] Collected " << allFiles.size() << " items in folder structure" << std::endl;
-    return allFiles;
+    std::unordered_map<std::string, long long> sizes;
+    for (const ChunkRef& chunk : chunks) sizes[chunk.hash] = chunk.size;
+    for (const std::string& hash : pendingHashes) {
+        // Khóa (hoặc tạo) dòng CHUNKS trước khi promotePending xem kho chung: chunk ref_count 0
+        // không bị dropUnreferencedChunks xóa file sau khi bản pending đã bị bỏ
+        DBStatement lock(lease,
+            "INSERT INTO CHUNKS (chunk_hash, size_bytes, ref_count) VALUES (UNHEX(?), ?, 0) "
+            "ON DUPLICATE KEY UPDATE ref_count = ref_count");
+        lock.bind(hash).bind(sizes[hash]);
+        if (!lock.execute()) {
+            std::cerr << "[DB] Lock chunk failed: " << lock.error() << std::endl;
+            return false;
+        }
+        if (!ChunkStore::promotePending(user_id, hash)) {
+            std::cerr << "[DB] Pending chunk " << hash << " of user " << user_id << " is missing" << std::endl;
+            return false;
+        }
+        DBStatement done(lease, "DELETE FROM CHUNK_UPLOADS WHERE user_id = ? AND chunk_hash = UNHEX(?)");
+        done.bind(user_id).bind(hash);
+        if (!done.execute()) {
+            std::cerr << "[DB] Claim pending chunk failed: " << done.error() << std::endl;
+            return false;
+        }
+    }
+    return true;
 }
 
-long long DBManager::createFolder(std::string foldername, long long parent_id, std::string owner) {
-    if (!conn) return -1;
+bool DBManager::addPendingChunk(long long user_id, const std::string& hash, long long size,
+                                const std::string& tempPath, const std::string& pendingPath) {
+    struct TempGuard {
+        const std::string* path;
+        ~TempGuard() { if (path) BlobStore::discard(*path); }
+    } tempGuard{&tempPath};
 
-    std::string query = "SELECT user_id FROM USERS WHERE username = '" + owner + "'";
-    if (mysql_query(conn, query.c_str())) return -1;
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return -1;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return -1;
-    }
-    std::string owner_id = row[0];
-    mysql_free_result(result);
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return false;
 
-    std::stringstream ss;
-    if (parent_id == -1 || parent_id == 0) {
-        // Root level folder - parent is NULL or 1
-        ss << "INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) VALUES ("
-           << owner_id << ", NULL, '" << foldername << "', TRUE, 0)";
-    } else {
-        ss << "INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) VALUES ("
-           << owner_id << ", " << parent_id << ", '" << foldername << "', TRUE, 0)";
+    DBTransaction tx(lease);
+    if (!tx.ok()) return false;
+
+    // affectedRows: 1 = dòng mới (tính quota); gửi lại chunk đang pending chỉ làm mới uploaded_at
+    DBStatement stmt(lease,
+        "INSERT INTO CHUNK_UPLOADS (user_id, chunk_hash, size_bytes) VALUES (?, UNHEX(?), ?) "
+        "ON DUPLICATE KEY UPDATE uploaded_at = CURRENT_TIMESTAMP");
+    stmt.bind(user_id).bind(hash).bind(size);
+    if (!stmt.execute()) {
+        std::cerr << "[DB] Record pending chunk failed: " << stmt.error() << std::endl;
+        return false;
     }
-    
-    if (mysql_query(conn, ss.str().c_str())) {
-        std::cerr << "[DB] Create folder failed: " << mysql_error(conn) << std::endl;
-        return -1;
+    bool inserted = stmt.affectedRows() == 1;
+    if (inserted && !adjustStorageUsed(lease, user_id, size)) return false;
+
+    // Đã giữ khóa dòng: lượt dọn không thể xóa file pending giữa rename và commit
+    tempGuard.path = nullptr;
+    if (!BlobStore::commitTo(tempPath, pendingPath)) return false;
+    if (!tx.commit()) {
+        if (inserted) BlobStore::discard(pendingPath);
+        return false;
     }
+    if (inserted) QuotaLedger::getInstance().onUsageChanged(user_id, size);
+    return true;
+}
 
-    long long new_folder_id = mysql_insert_id(conn);
-    std::cout << "[DB] Folder '" << foldername << "' created with ID: " << new_folder_id << std::endl;
-    return new_folder_id;
+std::vector<std::pair<long long, std::string>> DBManager::getExpiredPendingChunks(int ttlSeconds, int limit) {
+    std::vector<std::pair<long long, std::string>> expired;
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return expired;
+
+    DBStatement stmt(lease,
+        "SELECT user_id, LOWER(HEX(chunk_hash)) FROM CHUNK_UPLOADS "
+        "WHERE uploaded_at < NOW() - INTERVAL ? SECOND LIMIT ?");
+    stmt.bind((long long)ttlSeconds).bind((long long)limit);
+    if (!stmt.execute()) return expired;
+    while (stmt.fetch()) {
+        expired.emplace_back(stmt.getInt(0), stmt.getString(1));
+    }
+    return expired;
 }
 
-long long DBManager::createFileInFolder(std::string filename, long long parent_id, long long filesize, std::string owner) {
-    if (!conn) return -1;
+bool DBManager::dropPendingChunk(long long user_id, const std::string& hash, int ttlSeconds,
+                                 const std::string& pendingPath) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return false;
 
-    std::string query = "SELECT user_id FROM USERS WHERE username = '" + owner + "'";
-    if (mysql_query(conn, query.c_str())) return -1;
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return -1;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return -1;
+    DBTransaction tx(lease);
+    if (!tx.ok()) return false;
+
+    // Đọc lại có khóa: STOR_CHUNKED vừa dùng hoặc PUT_CHUNK vừa gửi lại thì bỏ qua
+    long long size = 0;
+    {
+        DBStatement select(lease,
+            "SELECT size_bytes FROM CHUNK_UPLOADS WHERE user_id = ? AND chunk_hash = UNHEX(?) "
+            "AND uploaded_at < NOW() - INTERVAL ? SECOND FOR UPDATE");
+        select.bind(user_id).bind(hash).bind((long long)ttlSeconds);
+        if (!select.execute() || !select.fetch()) return false;
+        size = select.getInt(0);
     }
-    std::string owner_id = row[0];
-    mysql_free_result(result);
 
-    std::stringstream ss;
-    ss << "INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) VALUES ("
-       << owner_id << ", " << parent_id << ", '" << filename << "', FALSE, " << filesize << ")";
-    
-    if (mysql_query(conn, ss.str().c_str())) {
-        std::cerr << "[DB] Create file failed: " << mysql_error(conn) << std::endl;
-        return -1;
+    DBStatement stmt(lease, "DELETE FROM CHUNK_UPLOADS WHERE user_id = ? AND chunk_hash = UNHEX(?)");
+    stmt.bind(user_id).bind(hash);
+    if (!stmt.execute()) {
+        std::cerr << "[DB] Drop pending chunk failed: " << stmt.error() << std::endl;
+        return false;
     }
+    if (!adjustStorageUsed(lease, user_id, -size)) return false;
+    // Xóa file khi còn giữ khóa dòng: PUT_CHUNK cùng hash phải chờ tới sau commit mới rename vào
+    BlobStore::discard(pendingPath);
+    if (!tx.commit()) return false;
+    QuotaLedger::getInstance().onUsageChanged(user_id, -size);
 
-    long long new_file_id = mysql_insert_id(conn);
-    std::cout << "[DB] File '" << filename << "' created in folder " << parent_id 
-              << " with ID: " << new_file_id << std::endl;
-    return new_file_id;
+    std::cout << "[DB] Expired pending chunk " << hash << " of user " << user_id << std::endl;
+    return true;
 }
 
-FileRecordEx DBManager::getFileInfo(long long file_id) {
-    FileRecordEx rec;
-    rec.file_id = -1;
-    if (!conn) return rec;
+long long DBManager::dropUnreferencedChunks(int limit) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return -1;
 
-    std::string query = "SELECT f.file_id, f.owner_id, f.parent_id, f.name, f.is_folder, "
-                       "f.size_bytes, u.username FROM FILES f "
-                       "JOIN USERS u ON f.owner_id = u.user_id "
-                       "WHERE f.file_id = " + std::to_string(file_id);
-    
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] Query failed: " << mysql_error(conn) << std::endl;
-        return rec;
+    DBTransaction tx(lease);
+    if (!tx.ok()) return -1;
+
+    // Dòng đang bị khóa là đang được cộng/trừ ref_count (tạo/xóa file, cắt blob): để lượt sau
+    std::vector<std::string> hashes;
+    {
+        DBStatement select(lease,
+            "SELECT LOWER(HEX(chunk_hash)) FROM CHUNKS WHERE ref_count = 0 LIMIT ? FOR UPDATE SKIP LOCKED");
+        select.bind((long long)limit);
+        if (!select.execute()) return -1;
+        while (select.fetch()) hashes.push_back(select.getString(0));
+    }
+    for (const std::string& hash : hashes) {
+        DBStatement stmt(lease, "DELETE FROM CHUNKS WHERE chunk_hash = UNHEX(?)");
+        stmt.bind(hash);
+        if (!stmt.execute()) {
+            std::cerr << "[DB] Drop chunk failed: " << stmt.error() << std::endl;
+            return -1;
+        }
     }
+    // Xóa file khi còn giữ khóa dòng: tạo file/cắt blob dùng lại chunk phải chờ tới sau commit
+    // và thấy chunk không còn trong kho. Commit lỗi thì dòng ref_count 0 còn lại không có file,
+    // lượt sau xóa tiếp; ai cần chunk đó sẽ ghi lại file (putChunk, promotePending)
+    for (const std::string& hash : hashes) BlobStore::discard(ChunkStore::pathOf(hash));
+    if (!tx.commit()) return -1;
 
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return rec;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (row) {
-        rec.file_id = std::stoll(row[0]);
-        rec.owner_id = std::stoll(row[1]);
-        rec.parent_id = row[2] ? std::stoll(row[2]) : -1;
-        rec.name = row[3] ? row[3] : "";
-        rec.is_folder = row[4] && std::string(row[4]) == "1";
-        rec.size = row[5] ? std::stoll(row[5]) : 0;
-        rec.owner = row[6] ? row[6] : "";
-    }
-    
-    mysql_free_result(result);
-    return rec;
+    if (!hashes.empty()) std::cout << "[DB] Dropped " << hashes.size() << " unreferenced chunks" << std::endl;
+    return static_cast<long long>(hashes.size());
 }
 
 bool DBManager::shareFolderWithUser(long long folder_id, std::string targetUsername) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     if (!conn) return false;
 
     std::cout << "[DB] shareFolderWithUser called: folder_id=" << folder_id << " target='" << targetUsername << "'" << std::endl;
 
-    std::string query = "SELECT user_id FROM USERS WHERE username = '" + targetUsername + "'";
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] Get target_user_id failed: " << mysql_error(conn) << std::endl;
-        return false;
-    }
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
+    long long target_id = getUserId(targetUsername);
+    if (target_id < 0) {
         std::cerr << "[DB] Target user not found: " << targetUsername << std::endl;
         return false;
     }
-    std::string target_user_id = row[0];
-    mysql_free_result(result);
-    std::cout << "[DB] Found target user_id: " << target_user_id << std::endl;
+    std::cout << "[DB] Found target user_id: " << target_id << std::endl;
 
-    query = "INSERT INTO SHAREDFILES (file_id, user_id, permission_id) VALUES (" 
-            + std::to_string(folder_id) + ", " + target_user_id + ", 1) "
-            "ON DUPLICATE KEY UPDATE shared_at = CURRENT_TIMESTAMP";
-    
-    std::cout << "[DB] Executing folder share: " << query << std::endl;
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] Share folder failed: " << mysql_error(conn) << std::endl;
+    DBStatement insert(lease,
+        "INSERT INTO SHAREDFILES (file_id, user_id, permission_id) VALUES (?, ?, 1) "
+        "ON DUPLICATE KEY UPDATE shared_at = CURRENT_TIMESTAMP");
+    insert.bind(folder_id).bind(target_id);
+    if (!insert.execute()) {
+        std::cerr << "[DB] Share folder failed: " << insert.error() << std::endl;
         return false;
     }
+    aclCache.invalidateUser(target_id);
 
     std::cout << "[DB] Folder (ID=" << folder_id << ") shared with " << targetUsername 
               << " (recursive access via hasSharedAccess)" << std::endl;
     return true;
 }
 
-bool DBManager::isFileSharedWithUser(std::string filename, std::string username) {
+bool DBManager::isFileSharedWithUser(std::string filename, long long user_id) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     if (!conn) return false;
     
-    std::string query = "SELECT file_id FROM FILES WHERE name = '" + filename + "' AND is_deleted = FALSE";
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] isFileSharedWithUser query failed: " << mysql_error(conn) << std::endl;
-        return false;
-    }
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return false;
-    }
-    long long file_id = std::stoll(row[0]);
-    mysql_free_result(result);
-    
-    query = "SELECT user_id FROM USERS WHERE username = '" + username + "'";
-    if (mysql_query(conn, query.c_str())) {
-        return false;
-    }
-    
-    result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return false;
-    }
-    std::string user_id = row[0];
-    mysql_free_result(result);
-    
-    query = "SELECT COUNT(*) FROM SHAREDFILES WHERE file_id = " + std::to_string(file_id) 
-            + " AND user_id = " + user_id;
-    
-    if (mysql_query(conn, query.c_str())) {
-        return false;
+    long long file_id;
+    {
+        DBStatement select(lease, "SELECT file_id FROM FILES WHERE name = ? AND is_deleted = FALSE");
+        select.bind(filename);
+        if (!select.execute()) {
+            std::cerr << "[DB] isFileSharedWithUser query failed: " << select.error() << std::endl;
+            return false;
+        }
+        if (!select.fetch()) return false;
+        file_id = select.getInt(0);
     }
     
-    result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    row = mysql_fetch_row(result);
-    bool isShared = (row && std::stoi(row[0]) > 0);
-    mysql_free_result(result);
-    
-    return isShared;
+    DBStatement count(lease, "SELECT COUNT(*) FROM SHAREDFILES WHERE file_id = ? AND user_id = ?");
+    count.bind(file_id).bind(user_id);
+    if (!count.execute() || !count.fetch()) return false;
+    return count.getInt(0) > 0;
 }
 
 std::string DBManager::getFileOwner(std::string filename) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     if (!conn) return "";
     
-    std::string query = "SELECT u.username FROM FILES f "
-                       "JOIN USERS u ON f.owner_id = u.user_id "
-                       "WHERE f.name = '" + filename + "' AND f.is_deleted = FALSE";
-    
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] getFileOwner query failed: " << mysql_error(conn) << std::endl;
+    DBStatement select(lease,
+        "SELECT u.username FROM FILES f "
+        "JOIN USERS u ON f.owner_id = u.user_id "
+        "WHERE f.name = ? AND f.is_deleted = FALSE");
+    select.bind(filename);
+    if (!select.execute()) {
+        std::cerr << "[DB] getFileOwner query failed: " << select.error() << std::endl;
         return "";
     }
     
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return "";
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
     std::string owner = "";
-    if (row && row[0]) {
-        owner = row[0];
-    }
-    mysql_free_result(result);
-    
+    if (select.fetch()) owner = select.getString(0);
     return owner;
 }
 
@@ -1040,40 +1772,24 @@ static std::string generateUniqueCode(long long owner_id, long long file_id, int
     return code; // Total: 16 characters
 }
 
-std::string DBManager::generateShareCode(long long file_id, std::string owner_username, int max_uses) {
-    // Lấy owner_id
-    std::string ownerQuery = "SELECT user_id FROM USERS WHERE username = '" + owner_username + "'";
-    if (mysql_query(conn, ownerQuery.c_str())) {
-        std::cerr << "[DB] generateShareCode: Failed to get owner_id" << std::endl;
-        return "";
-    }
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return "";
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return "";
-    }
-    long long owner_id = std::stoll(row[0]);
-    mysql_free_result(result);
+std::string DBManager::generateShareCode(long long file_id, long long owner_id, int max_uses) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return "";
     
     // Kiểm tra file có thuộc về owner không
-    std::string checkQuery = "SELECT file_id FROM FILES WHERE file_id = " + std::to_string(file_id) + 
-                            " AND owner_id = " + std::to_string(owner_id) + " AND is_deleted = FALSE";
-    if (mysql_query(conn, checkQuery.c_str())) {
-        std::cerr << "[DB] generateShareCode: Failed to verify ownership" << std::endl;
-        return "";
-    }
-    
-    result = mysql_store_result(conn);
-    if (!result || mysql_num_rows(result) == 0) {
-        if (result) mysql_free_result(result);
-        std::cerr << "[DB] generateShareCode: File not owned by user" << std::endl;
-        return "";
+    {
+        DBStatement check(lease, "SELECT file_id FROM FILES WHERE file_id = ? AND owner_id = ? AND is_deleted = FALSE");
+        check.bind(file_id).bind(owner_id);
+        if (!check.execute()) {
+            std::cerr << "[DB] generateShareCode: Failed to verify ownership" << std::endl;
+            return "";
+        }
+        if (!check.fetch()) {
+            std::cerr << "[DB] generateShareCode: File not owned by user" << std::endl;
+            return "";
+        }
     }
-    mysql_free_result(result);
     
     // Generate unique code with retry on collision
     const int MAX_ATTEMPTS = 5;
@@ -1083,11 +1799,10 @@ std::string DBManager::generateShareCode(long long file_id, std::string owner_us
         code = generateUniqueCode(owner_id, file_id, attempt);
         
         // Try to insert - will fail if code already exists (UNIQUE constraint)
-        std::string insertQuery = "INSERT INTO SHARE_CODES (share_code, file_id, owner_id, max_uses) VALUES ('" +
-                                 code + "', " + std::to_string(file_id) + ", " + std::to_string(owner_id) + ", " +
-                                 std::to_string(max_uses) + ")";
+        DBStatement insert(lease, "INSERT INTO SHARE_CODES (share_code, file_id, owner_id, max_uses) VALUES (?, ?, ?, ?)");
+        insert.bind(code).bind(file_id).bind(owner_id).bind(max_uses);
         
-        if (mysql_query(conn, insertQuery.c_str()) == 0) {
+        if (insert.execute()) {
             // Success
             std::cout << "[DB] Generated share code: " << code << " for file_id: " << file_id 
                       << " (attempt: " << (attempt + 1) << ")" << std::endl;
@@ -1095,14 +1810,14 @@ std::string DBManager::generateShareCode(long long file_id, std::string owner_us
         }
         
         // Check if error is duplicate key
-        unsigned int err = mysql_errno(conn);
+        unsigned int err = insert.errorCode();
         if (err == 1062) { // ER_DUP_ENTRY
             std::cerr << "[DB] generateShareCode: Code collision, retrying... (attempt " << (attempt + 1) << ")" << std::endl;
             // Add small delay and retry
             std::this_thread::sleep_for(std::chrono::milliseconds(10 * (attempt + 1)));
             continue;
         } else {
-            std::cerr << "[DB] generateShareCode: Insert failed: " << mysql_error(conn) << std::endl;
+            std::cerr << "[DB] generateShareCode: Insert failed: " << insert.error() << std::endl;
             return "";
         }
     }
@@ -1111,35 +1826,34 @@ std::string DBManager::generateShareCode(long long file_id, std::string owner_us
     return "";
 }
 
-long long DBManager::redeemShareCode(std::string share_code, std::string username) {
+long long DBManager::redeemShareCode(std::string share_code, long long user_id) {
+    DBLease lease;
+    if (!lease.handle()) return -1;
     // Lấy thông tin mã share
-    std::string query = "SELECT sc.code_id, sc.file_id, sc.owner_id, sc.max_uses, sc.current_uses, "
-                       "sc.expires_at, sc.is_active FROM SHARE_CODES sc "
-                       "WHERE sc.share_code = '" + share_code + "'";
-    
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] redeemShareCode: Query failed" << std::endl;
-        return -1;
-    }
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return -1;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        std::cerr << "[DB] redeemShareCode: Code not found" << std::endl;
-        return -1;
+    long long code_id, file_id, owner_id;
+    int max_uses, current_uses;
+    bool is_active;
+    {
+        DBStatement select(lease,
+            "SELECT code_id, file_id, owner_id, max_uses, current_uses, is_active "
+            "FROM SHARE_CODES WHERE share_code = ?");
+        select.bind(share_code);
+        if (!select.execute()) {
+            std::cerr << "[DB] redeemShareCode: Query failed: " << select.error() << std::endl;
+            return -1;
+        }
+        if (!select.fetch()) {
+            std::cerr << "[DB] redeemShareCode: Code not found" << std::endl;
+            return -1;
+        }
+        code_id = select.getInt(0);
+        file_id = select.getInt(1);
+        owner_id = select.getInt(2);
+        max_uses = static_cast<int>(select.getInt(3));
+        current_uses = static_cast<int>(select.getInt(4));
+        is_active = select.getInt(5) != 0;
     }
     
-    long long code_id = std::stoll(row[0]);
-    long long file_id = std::stoll(row[1]);
-    long long owner_id = std::stoll(row[2]);
-    int max_uses = row[3] ? std::stoi(row[3]) : 0;
-    int current_uses = row[4] ? std::stoi(row[4]) : 0;
-    bool is_active = row[6] ? (std::string(row[6]) == "1") : false;
-    mysql_free_result(result);
-    
     // Kiểm tra mã có active không
     if (!is_active) {
         std::cerr << "[DB] redeemShareCode: Code is not active" << std::endl;
@@ -1152,23 +1866,6 @@ long long DBManager::redeemShareCode(std::string share_code, std::string usernam
         return -1;
     }
     
-    // Lấy user_id của người redeem
-    std::string userQuery = "SELECT user_id FROM USERS WHERE username = '" + username + "'";
-    if (mysql_query(conn, userQuery.c_str())) {
-        return -1;
-    }
-    
-    result = mysql_store_result(conn);
-    if (!result) return -1;
-    
-    row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return -1;
-    }
-    long long user_id = std::stoll(row[0]);
-    mysql_free_result(result);
-    
     // Không cho phép redeem file của chính mình
     if (user_id == owner_id) {
         std::cerr << "[DB] redeemShareCode: Cannot redeem own file" << std::endl;
@@ -1176,50 +1873,49 @@ long long DBManager::redeemShareCode(std::string share_code, std::string usernam
     }
     
     // Kiểm tra xem đã share chưa
-    std::string checkShareQuery = "SELECT shared_id FROM SHAREDFILES WHERE file_id = " + std::to_string(file_id) +
-                                 " AND user_id = " + std::to_string(user_id);
-    if (mysql_query(conn, checkShareQuery.c_str())) {
-        return -1;
-    }
-    
-    result = mysql_store_result(conn);
-    if (result && mysql_num_rows(result) > 0) {
-        mysql_free_result(result);
-        std::cerr << "[DB] redeemShareCode: Already shared with this user" << std::endl;
-        return file_id; // Đã share rồi, trả về file_id
+    {
+        DBStatement check(lease, "SELECT shared_id FROM SHAREDFILES WHERE file_id = ? AND user_id = ?");
+        check.bind(file_id).bind(user_id);
+        if (!check.execute()) return -1;
+        if (check.fetch()) {
+            std::cerr << "[DB] redeemShareCode: Already shared with this user" << std::endl;
+            return file_id; // Đã share rồi, trả về file_id
+        }
     }
-    if (result) mysql_free_result(result);
     
     // Share file cho user (permission_id = 1 = VIEW)
-    std::string shareQuery = "INSERT INTO SHAREDFILES (file_id, user_id, permission_id) VALUES (" +
-                            std::to_string(file_id) + ", " + std::to_string(user_id) + ", 1)";
-    if (mysql_query(conn, shareQuery.c_str())) {
-        std::cerr << "[DB] redeemShareCode: Failed to share: " << mysql_error(conn) << std::endl;
+    DBStatement share(lease, "INSERT INTO SHAREDFILES (file_id, user_id, permission_id) VALUES (?, ?, 1)");
+    share.bind(file_id).bind(user_id);
+    if (!share.execute()) {
+        std::cerr << "[DB] redeemShareCode: Failed to share: " << share.error() << std::endl;
         return -1;
     }
+    aclCache.invalidateUser(user_id);
     
     // Tăng current_uses
-    std::string updateQuery = "UPDATE SHARE_CODES SET current_uses = current_uses + 1 WHERE code_id = " + std::to_string(code_id);
-    mysql_query(conn, updateQuery.c_str());
+    DBStatement update(lease, "UPDATE SHARE_CODES SET current_uses = current_uses + 1 WHERE code_id = ?");
+    update.bind(code_id);
+    update.execute();
     
-    std::cout << "[DB] Redeemed share code: " << share_code << " for user: " << username << std::endl;
+    std::cout << "[DB] Redeemed share code: " << share_code << " for user: " << user_id << std::endl;
     return file_id;
 }
 
-std::vector<ShareInfo> DBManager::getMyShares(std::string username) {
+std::vector<ShareInfo> DBManager::getMyShares(long long user_id) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     std::vector<ShareInfo> shares;
     
     std::string query = "SELECT sf.shared_id, sf.file_id, f.name, f.is_folder, u2.username as shared_with, "
                        "p.name as permission, sf.shared_at "
                        "FROM SHAREDFILES sf "
                        "JOIN FILES f ON sf.file_id = f.file_id "
-                       "JOIN USERS u1 ON f.owner_id = u1.user_id "
                        "JOIN USERS u2 ON sf.user_id = u2.user_id "
                        "JOIN PERMISSIONS p ON sf.permission_id = p.permission_id "
-                       "WHERE u1.username = '" + username + "' AND f.is_deleted = FALSE "
+                       "WHERE f.owner_id = " + std::to_string(user_id) + " AND f.is_deleted = FALSE "
                        "ORDER BY sf.shared_at DESC";
     
-    if (mysql_query(conn, query.c_str())) {
+    if (lease.query(query)) {
         std::cerr << "[DB] getMyShares: Query failed: " << mysql_error(conn) << std::endl;
         return shares;
     }
@@ -1241,53 +1937,26 @@ std::vector<ShareInfo> DBManager::getMyShares(std::string username) {
     }
     
     mysql_free_result(result);
-    std::cout << "[DB] getMyShares: Found " << shares.size() << " shares for " << username << std::endl;
+    std::cout << "[DB] getMyShares: Found " << shares.size() << " shares for user " << user_id << std::endl;
     return shares;
 }
 
-bool DBManager::revokeShare(long long file_id, std::string owner_username, std::string target_username) {
-    // Xác nhận owner
-    std::string ownerQuery = "SELECT user_id FROM USERS WHERE username = '" + owner_username + "'";
-    if (mysql_query(conn, ownerQuery.c_str())) {
-        return false;
-    }
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return false;
-    }
-    long long owner_id = std::stoll(row[0]);
-    mysql_free_result(result);
+bool DBManager::revokeShare(long long file_id, long long owner_id, std::string target_username) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     
     // Xác nhận target user
-    std::string targetQuery = "SELECT user_id FROM USERS WHERE username = '" + target_username + "'";
-    if (mysql_query(conn, targetQuery.c_str())) {
-        return false;
-    }
-    
-    result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return false;
-    }
-    long long target_id = std::stoll(row[0]);
-    mysql_free_result(result);
+    long long target_id = getUserId(target_username);
+    if (target_id < 0) return false;
     
     // Kiểm tra file có thuộc về owner không
     std::string checkQuery = "SELECT file_id FROM FILES WHERE file_id = " + std::to_string(file_id) +
                             " AND owner_id = " + std::to_string(owner_id);
-    if (mysql_query(conn, checkQuery.c_str())) {
+    if (lease.query(checkQuery)) {
         return false;
     }
     
-    result = mysql_store_result(conn);
+    MYSQL_RES* result = mysql_store_result(conn);
     if (!result || mysql_num_rows(result) == 0) {
         if (result) mysql_free_result(result);
         std::cerr << "[DB] revokeShare: Not file owner" << std::endl;
@@ -1298,11 +1967,12 @@ bool DBManager::revokeShare(long long file_id, std::string owner_username, std::
     // Xóa share
     std::string deleteQuery = "DELETE FROM SHAREDFILES WHERE file_id = " + std::to_string(file_id) +
                              " AND user_id = " + std::to_string(target_id);
-    if (mysql_query(conn, deleteQuery.c_str())) {
+    if (lease.query(deleteQuery)) {
         std::cerr << "[DB] revokeShare: Delete failed: " << mysql_error(conn) << std::endl;
         return false;
     }
     
+    aclCache.invalidateUser(target_id);
     if (mysql_affected_rows(conn) == 0) {
         std::cerr << "[DB] revokeShare: No share found to revoke" << std::endl;
         return false;
@@ -1312,18 +1982,19 @@ bool DBManager::revokeShare(long long file_id, std::string owner_username, std::
     return true;
 }
 
-std::vector<ShareCodeInfo> DBManager::getMyShareCodes(std::string username) {
+std::vector<ShareCodeInfo> DBManager::getMyShareCodes(long long user_id) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     std::vector<ShareCodeInfo> codes;
     
     std::string query = "SELECT sc.code_id, sc.share_code, sc.file_id, f.name, f.is_folder, "
                        "sc.max_uses, sc.current_uses, sc.expires_at, sc.is_active, sc.created_at "
                        "FROM SHARE_CODES sc "
                        "JOIN FILES f ON sc.file_id = f.file_id "
-                       "JOIN USERS u ON sc.owner_id = u.user_id "
-                       "WHERE u.username = '" + username + "' AND sc.is_active = TRUE "
+                       "WHERE sc.owner_id = " + std::to_string(user_id) + " AND sc.is_active = TRUE "
                        "ORDER BY sc.created_at DESC";
     
-    if (mysql_query(conn, query.c_str())) {
+    if (lease.query(query)) {
         std::cerr << "[DB] getMyShareCodes: Query failed: " << mysql_error(conn) << std::endl;
         return codes;
     }
@@ -1351,36 +2022,28 @@ std::vector<ShareCodeInfo> DBManager::getMyShareCodes(std::string username) {
     return codes;
 }
 
-bool DBManager::deleteShareCode(std::string share_code, std::string owner_username) {
-    // Lấy owner_id
-    std::string ownerQuery = "SELECT user_id FROM USERS WHERE username = '" + owner_username + "'";
-    if (mysql_query(conn, ownerQuery.c_str())) {
-        return false;
-    }
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        return false;
-    }
-    long long owner_id = std::stoll(row[0]);
-    mysql_free_result(result);
+bool DBManager::deleteShareCode(std::string share_code, long long owner_id) {
+    DBLease lease;
+    if (!lease.handle()) return false;
     
     // Xóa mã (hoặc deactivate)
-    std::string deleteQuery = "UPDATE SHARE_CODES SET is_active = FALSE WHERE share_code = '" + share_code +
-                             "' AND owner_id = " + std::to_string(owner_id);
-    if (mysql_query(conn, deleteQuery.c_str())) {
-        std::cerr << "[DB] deleteShareCode: Failed: " << mysql_error(conn) << std::endl;
+    DBStatement update(lease, "UPDATE SHARE_CODES SET is_active = FALSE WHERE share_code = ? AND owner_id = ?");
+    update.bind(share_code).bind(owner_id);
+    if (!update.execute()) {
+        std::cerr << "[DB] deleteShareCode: Failed: " << update.error() << std::endl;
         return false;
     }
     
-    return mysql_affected_rows(conn) > 0;
+    return update.affectedRows() > 0;
 }
 
 FileRecordEx DBManager::getFileById(long long file_id) {
+    // Node trong cache luôn là dòng chưa xóa
+    MetadataNode node;
+    if (metadataCache.lookupNode(file_id, node)) return toRecordEx(node);
+
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
     FileRecordEx record;
     record.file_id = -1;
     
@@ -1388,7 +2051,7 @@ FileRecordEx DBManager::getFileById(long long file_id) {
                        "FROM FILES f JOIN USERS u ON f.owner_id = u.user_id "
                        "WHERE f.file_id = " + std::to_string(file_id) + " AND f.is_deleted = FALSE";
     
-    if (mysql_query(conn, query.c_str())) {
+    if (lease.query(query)) {
         return record;
     }
     
@@ -1414,42 +2077,42 @@ FileRecordEx DBManager::getFileById(long long file_id) {
 bool DBManager::guestRedeemShareCode(std::string share_code, long long &out_file_id, 
                                      std::string &out_filename, bool &out_is_folder, 
                                      std::string &out_owner, long long &out_size) {
-    // Lấy thông tin share code
-    std::string query = "SELECT sc.code_id, sc.file_id, sc.max_uses, sc.current_uses, sc.is_active, sc.expires_at, "
-                       "f.name, f.is_folder, f.size_bytes, u.username "
-                       "FROM SHARE_CODES sc "
-                       "JOIN FILES f ON sc.file_id = f.file_id "
-                       "JOIN USERS u ON sc.owner_id = u.user_id "
-                       "WHERE sc.share_code = '" + share_code + "' AND f.is_deleted = FALSE";
-    
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] guestRedeemShareCode: Query failed" << std::endl;
-        return false;
-    }
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return false;
-    
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (!row) {
-        mysql_free_result(result);
-        std::cerr << "[DB] guestRedeemShareCode: Code not found" << std::endl;
-        return false;
+    DBLease lease;
+    if (!lease.handle()) return false;
+    // Lấy thông tin share code; hết hạn so với NOW() ngay trong câu SELECT
+    long long code_id;
+    int max_uses, current_uses;
+    bool is_active, expired;
+    {
+        DBStatement select(lease,
+            "SELECT sc.code_id, sc.file_id, sc.max_uses, sc.current_uses, sc.is_active, "
+            "       sc.expires_at IS NOT NULL AND NOW() > sc.expires_at, "
+            "       f.name, f.is_folder, f.size_bytes, u.username "
+            "FROM SHARE_CODES sc "
+            "JOIN FILES f ON sc.file_id = f.file_id "
+            "JOIN USERS u ON sc.owner_id = u.user_id "
+            "WHERE sc.share_code = ? AND f.is_deleted = FALSE");
+        select.bind(share_code);
+        if (!select.execute()) {
+            std::cerr << "[DB] guestRedeemShareCode: Query failed: " << select.error() << std::endl;
+            return false;
+        }
+        if (!select.fetch()) {
+            std::cerr << "[DB] guestRedeemShareCode: Code not found" << std::endl;
+            return false;
+        }
+        code_id = select.getInt(0);
+        out_file_id = select.getInt(1);
+        max_uses = static_cast<int>(select.getInt(2));
+        current_uses = static_cast<int>(select.getInt(3));
+        is_active = select.getInt(4) != 0;
+        expired = select.getInt(5) != 0;
+        out_filename = select.getString(6);
+        out_is_folder = select.getInt(7) != 0;
+        out_size = select.getInt(8);
+        out_owner = select.getString(9);
     }
     
-    long long code_id = std::stoll(row[0]);
-    out_file_id = std::stoll(row[1]);
-    int max_uses = std::stoi(row[2]);
-    int current_uses = std::stoi(row[3]);
-    bool is_active = (std::string(row[4]) == "1");
-    std::string expires_at = row[5] ? row[5] : "";
-    out_filename = row[6] ? row[6] : "";
-    out_is_folder = (std::string(row[7]) == "1");
-    out_size = row[8] ? std::stoll(row[8]) : 0;
-    out_owner = row[9] ? row[9] : "";
-    
-    mysql_free_result(result);
-    
     // Kiểm tra code còn hoạt động không
     if (!is_active) {
         std::cerr << "[DB] guestRedeemShareCode: Code is inactive" << std::endl;
@@ -1463,26 +2126,15 @@ bool DBManager::guestRedeemShareCode(std::string share_code, long long &out_file
     }
     
     // Kiểm tra hết hạn
-    if (!expires_at.empty()) {
-        std::string checkExpiry = "SELECT NOW() > '" + expires_at + "'";
-        if (mysql_query(conn, checkExpiry.c_str()) == 0) {
-            MYSQL_RES* expResult = mysql_store_result(conn);
-            if (expResult) {
-                MYSQL_ROW expRow = mysql_fetch_row(expResult);
-                if (expRow && std::string(expRow[0]) == "1") {
-                    mysql_free_result(expResult);
-                    std::cerr << "[DB] guestRedeemShareCode: Code expired" << std::endl;
-                    return false;
-                }
-                mysql_free_result(expResult);
-            }
-        }
+    if (expired) {
+        std::cerr << "[DB] guestRedeemShareCode: Code expired" << std::endl;
+        return false;
     }
     
     // Tăng current_uses
-    std::string updateQuery = "UPDATE SHARE_CODES SET current_uses = current_uses + 1 WHERE code_id = " + 
-                             std::to_string(code_id);
-    mysql_query(conn, updateQuery.c_str());
+    DBStatement update(lease, "UPDATE SHARE_CODES SET current_uses = current_uses + 1 WHERE code_id = ?");
+    update.bind(code_id);
+    update.execute();
     
     std::cout << "[DB] Guest redeemed code: " << share_code << " for file: " << out_filename << std::endl;
     return true;
@@ -1490,33 +2142,10 @@ bool DBManager::guestRedeemShareCode(std::string share_code, long long &out_file
 
 std::vector<FileRecordEx> DBManager::guestListFolder(long long folder_id) {
     std::vector<FileRecordEx> files;
-    
-    std::string query = "SELECT f.file_id, f.owner_id, f.parent_id, f.name, f.is_folder, f.size_bytes, u.username "
-                       "FROM FILES f JOIN USERS u ON f.owner_id = u.user_id "
-                       "WHERE f.parent_id = " + std::to_string(folder_id) + " AND f.is_deleted = FALSE "
-                       "ORDER BY f.is_folder DESC, f.name ASC";
-    
-    if (mysql_query(conn, query.c_str())) {
-        std::cerr << "[DB] guestListFolder: Query failed" << std::endl;
-        return files;
-    }
-    
-    MYSQL_RES* result = mysql_store_result(conn);
-    if (!result) return files;
-    
-    MYSQL_ROW row;
-    while ((row = mysql_fetch_row(result))) {
-        FileRecordEx record;
-        record.file_id = std::stoll(row[0]);
-        record.owner_id = std::stoll(row[1]);
-        record.parent_id = row[2] ? std::stoll(row[2]) : 0;
-        record.name = row[3] ? row[3] : "";
-        record.is_folder = (std::string(row[4]) == "1");
-        record.size = row[5] ? std::stoll(row[5]) : 0;
-        record.owner = row[6] ? row[6] : "";
-        files.push_back(record);
-    }
-    
-    mysql_free_result(result);
+    std::vector<MetadataNode> children;
+    if (!loadFolder(folder_id, children)) return files;
+
+    for (const auto& node : children) files.push_back(toRecordEx(node));
+    sortByName(files);
     return files;
 }
\ No newline at end of file
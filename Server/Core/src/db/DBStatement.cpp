@@ -0,0 +1,197 @@
+#include "../../include/db_statement.h"
+#include <mysql/errmsg.h>
+#include <iostream>
+#include <cstring>
+#include <charconv>
+
+static constexpr unsigned long INITIAL_COLUMN_BYTES = 256;  // Cột dài hơn thì đọc lại bằng fetch_column
+
+static bool isIntegerType(enum_field_types type) {
+    return type == MYSQL_TYPE_TINY || type == MYSQL_TYPE_SHORT || type == MYSQL_TYPE_LONG ||
+           type == MYSQL_TYPE_INT24 || type == MYSQL_TYPE_LONGLONG;
+}
+
+DBStatement::DBStatement(DBLease& lease, const char* sql)
+    : lease(lease), sql(sql), stmt(lease.prepare(sql)) {}
+
+DBStatement::~DBStatement() {
+    // Chỉ giải phóng kết quả phía client (executeStreaming: bỏ các dòng chưa đọc);
+    // statement vẫn nằm trong cache của kết nối
+    if (stmt && hasResult) mysql_stmt_free_result(stmt);
+}
+
+DBStatement& DBStatement::bind(long long value) {
+    Param p;
+    p.type = MYSQL_TYPE_LONGLONG;
+    p.intValue = value;
+    params.push_back(std::move(p));
+    return *this;
+}
+
+DBStatement& DBStatement::bind(const std::string& value) {
+    Param p;
+    p.type = MYSQL_TYPE_STRING;
+    p.strValue = value;
+    p.length = value.size();
+    params.push_back(std::move(p));
+    return *this;
+}
+
+DBStatement& DBStatement::bindNull() {
+    Param p;
+    p.type = MYSQL_TYPE_NULL;
+    p.isNull = true;
+    params.push_back(std::move(p));
+    return *this;
+}
+
+bool DBStatement::execute() {
+    if (!stmt) return false;
+    if (executeOnce()) return true;
+
+    // Server đã đóng kết nối trước khi nhận lệnh: mở lại, prepare lại và chạy lại 1 lần
+    // (trừ khi đang trong transaction: kết nối mới không còn transaction đó)
+    if (mysql_stmt_errno(stmt) != CR_SERVER_GONE_ERROR || lease.inTransaction()) {
+        std::cerr << "[DB] Statement failed: " << mysql_stmt_error(stmt) << std::endl;
+        return false;
+    }
+    std::cerr << "[DB] Server gone, reconnecting: " << mysql_stmt_error(stmt) << std::endl;
+    stmt = lease.reconnect() ? lease.prepare(sql) : nullptr;
+    if (!stmt) return false;
+    if (!executeOnce()) {
+        std::cerr << "[DB] Statement failed: " << mysql_stmt_error(stmt) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DBStatement::executeStreaming() {
+    buffered = false;
+    return execute();
+}
+
+bool DBStatement::executeOnce() {
+    if (params.size() != mysql_stmt_param_count(stmt)) {
+        std::cerr << "[DB] Statement expects " << mysql_stmt_param_count(stmt)
+                  << " params, got " << params.size() << std::endl;
+        return false;
+    }
+
+    std::vector<MYSQL_BIND> binds(params.size());
+    for (size_t i = 0; i < params.size(); i++) {
+        Param& p = params[i];
+        MYSQL_BIND& b = binds[i];
+        memset(&b, 0, sizeof(b));
+        b.buffer_type = p.type;
+        b.is_null = &p.isNull;
+        if (p.type == MYSQL_TYPE_LONGLONG) {
+            b.buffer = &p.intValue;
+        } else if (p.type == MYSQL_TYPE_STRING) {
+            b.buffer = const_cast<char*>(p.strValue.data());
+            b.buffer_length = p.length;
+            b.length = &p.length;
+        }
+    }
+
+    if (!binds.empty() && mysql_stmt_bind_param(stmt, binds.data())) return false;
+    DBLease::countStatement();
+    if (mysql_stmt_execute(stmt)) return false;
+    return bindResult();
+}
+
+bool DBStatement::bindResult() {
+    MYSQL_RES* meta = mysql_stmt_result_metadata(stmt);
+    if (!meta) return true;  // INSERT/UPDATE/DELETE: không có tập kết quả
+
+    unsigned int count = mysql_num_fields(meta);
+    MYSQL_FIELD* fields = mysql_fetch_fields(meta);
+
+    columns.assign(count, Column());
+    resultBinds.assign(count, MYSQL_BIND());
+    for (unsigned int i = 0; i < count; i++) {
+        Column& c = columns[i];
+        MYSQL_BIND& b = resultBinds[i];
+        memset(&b, 0, sizeof(b));
+        c.isInt = isIntegerType(fields[i].type);
+        if (c.isInt) {
+            b.buffer_type = MYSQL_TYPE_LONGLONG;
+            b.buffer = &c.intValue;
+        } else {
+            c.buffer.resize(INITIAL_COLUMN_BYTES);
+            b.buffer_type = MYSQL_TYPE_STRING;
+            b.buffer = c.buffer.data();
+            b.buffer_length = c.buffer.size();
+        }
+        b.length = &c.length;
+        b.is_null = &c.isNull;
+        b.error = &c.error;
+    }
+    mysql_free_result(meta);
+
+    if (mysql_stmt_bind_result(stmt, resultBinds.data())) return false;
+    if (buffered && mysql_stmt_store_result(stmt)) return false;
+    hasResult = true;
+    return true;
+}
+
+bool DBStatement::fetch() {
+    if (!stmt || !hasResult) return false;
+
+    int rc = mysql_stmt_fetch(stmt);
+    if (rc == MYSQL_DATA_TRUNCATED) {
+        // Cột chuỗi dài hơn buffer: nới buffer và đọc lại riêng cột đó
+        bool rebind = false;
+        for (size_t i = 0; i < columns.size(); i++) {
+            Column& c = columns[i];
+            if (!c.error || c.isInt) continue;
+            c.buffer.resize(c.length);
+            MYSQL_BIND& b = resultBinds[i];
+            b.buffer = c.buffer.data();
+            b.buffer_length = c.buffer.size();
+            mysql_stmt_fetch_column(stmt, &b, i, 0);
+            rebind = true;
+        }
+        if (rebind) mysql_stmt_bind_result(stmt, resultBinds.data());
+        return true;
+    }
+    return rc == 0;
+}
+
+bool DBStatement::isNull(int col) const {
+    return columns[col].isNull;
+}
+
+long long DBStatement::getInt(int col) const {
+    const Column& c = columns[col];
+    if (c.isNull) return 0;
+    if (c.isInt) return c.intValue;
+
+    // DECIMAL (SUM/COUNT trên một số server) nhận về dạng chuỗi
+    long long value = 0;
+    size_t len = std::min<size_t>(c.length, c.buffer.size());
+    std::from_chars(c.buffer.data(), c.buffer.data() + len, value);
+    return value;
+}
+
+std::string DBStatement::getString(int col) const {
+    const Column& c = columns[col];
+    if (c.isNull) return "";
+    if (c.isInt) return std::to_string(c.intValue);
+    return std::string(c.buffer.data(), std::min<size_t>(c.length, c.buffer.size()));
+}
+
+long long DBStatement::affectedRows() const {
+    return stmt ? (long long)mysql_stmt_affected_rows(stmt) : 0;
+}
+
+long long DBStatement::insertId() const {
+    return stmt ? (long long)mysql_stmt_insert_id(stmt) : 0;
+}
+
+const char* DBStatement::error() const {
+    return stmt ? mysql_stmt_error(stmt) : "no connection";
+}
+
+unsigned int DBStatement::errorCode() const {
+    return stmt ? mysql_stmt_errno(stmt) : CR_SERVER_GONE_ERROR;
+}
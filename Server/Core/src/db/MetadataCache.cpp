@@ -0,0 +1,203 @@
+#include "../../include/metadata_cache.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+// Ước lượng bộ nhớ: struct + chuỗi + một mục trong nodeIndex
+size_t MetadataCache::nodeBytes(const MetadataNode& node) {
+    return sizeof(MetadataNode) + node.name.size() + node.owner.size() + node.path.size() + 32;
+}
+
+// Cùng thứ tự với listing SQL: is_folder DESC, created_at DESC (file_id tăng theo thời gian tạo)
+bool MetadataCache::childBefore(const MetadataNode& a, const MetadataNode& b) {
+    if (a.is_folder != b.is_folder) return a.is_folder;
+    return a.file_id > b.file_id;
+}
+
+void MetadataCache::touch(Folder& folder) {
+    lru.splice(lru.begin(), lru, folder.lruPos);
+}
+
+void MetadataCache::eraseFolder(long long key) {
+    auto it = folders.find(key);
+    if (it == folders.end()) return;
+    for (const auto& child : it->second.children) {
+        auto idx = nodeIndex.find(child.file_id);
+        if (idx != nodeIndex.end() && idx->second == key) nodeIndex.erase(idx);
+    }
+    usedBytes -= it->second.bytes;
+    lru.erase(it->second.lruPos);
+    folders.erase(it);
+}
+
+void MetadataCache::evictIfNeeded() {
+    while (usedBytes > maxBytes && !lru.empty()) {
+        eraseFolder(lru.back());
+        evictions++;
+    }
+}
+
+MetadataNode* MetadataCache::findNode(long long file_id) {
+    auto idx = nodeIndex.find(file_id);
+    if (idx == nodeIndex.end()) return nullptr;
+    auto fit = folders.find(idx->second);
+    if (fit == folders.end()) return nullptr;
+    for (auto& child : fit->second.children) {
+        if (child.file_id == file_id) return &child;
+    }
+    return nullptr;
+}
+
+bool MetadataCache::lookupChildren(long long key, std::vector<MetadataNode>& out) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = folders.find(key);
+    if (it == folders.end()) {
+        misses++;
+        return false;
+    }
+    touch(it->second);
+    out = it->second.children;
+    hits++;
+    return true;
+}
+
+bool MetadataCache::lookupNode(long long file_id, MetadataNode& out) {
+    std::lock_guard<std::mutex> lock(mtx);
+    MetadataNode* node = findNode(file_id);
+    if (!node) {
+        misses++;
+        return false;
+    }
+    touch(folders[nodeIndex[file_id]]);
+    out = *node;
+    hits++;
+    return true;
+}
+
+void MetadataCache::storeFolder(long long key, const std::string& folderPath,
+                                std::vector<MetadataNode> children, unsigned long long seenEpoch) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (epoch.load() != seenEpoch || writers.load() != 0) return;
+
+    eraseFolder(key);
+    std::sort(children.begin(), children.end(), childBefore);
+
+    size_t bytes = sizeof(Folder) + folderPath.size() + 64;
+    for (const auto& child : children) bytes += nodeBytes(child);
+    if (bytes > maxBytes) return;  // Folder quá lớn: luôn đọc DB
+
+    for (const auto& child : children) {
+        nodeIndex[child.file_id] = key;
+        ownerNames[child.owner_id] = child.owner;
+    }
+    lru.push_front(key);
+    Folder& folder = folders[key];
+    folder.path = folderPath;
+    folder.children = std::move(children);
+    folder.bytes = bytes;
+    folder.lruPos = lru.begin();
+    usedBytes += bytes;
+    evictIfNeeded();
+}
+
+void MetadataCache::onInsert(const MetadataNode& node) {
+    std::lock_guard<std::mutex> lock(mtx);
+    epoch++;
+    long long key = node.parent_id != 0 ? node.parent_id : rootKey(node.owner_id);
+    auto it = folders.find(key);
+    if (it == folders.end()) return;
+
+    MetadataNode copy = node;
+    if (copy.owner.empty()) {
+        auto name = ownerNames.find(copy.owner_id);
+        if (name == ownerNames.end()) {
+            eraseFolder(key);  // Không biết username: để lần LIST sau đọc lại từ DB
+            return;
+        }
+        copy.owner = name->second;
+    }
+
+    Folder& folder = it->second;
+    size_t bytes = nodeBytes(copy);
+    auto pos = std::lower_bound(folder.children.begin(), folder.children.end(), copy, childBefore);
+    folder.children.insert(pos, std::move(copy));
+    folder.bytes += bytes;
+    usedBytes += bytes;
+    nodeIndex[node.file_id] = key;
+    touch(folder);
+    evictIfNeeded();
+}
+
+void MetadataCache::onRename(long long file_id, const std::string& newName) {
+    std::lock_guard<std::mutex> lock(mtx);
+    epoch++;
+    MetadataNode* node = findNode(file_id);
+    if (!node) return;
+    Folder& folder = folders[nodeIndex[file_id]];
+    folder.bytes += newName.size();
+    folder.bytes -= node->name.size();
+    usedBytes += newName.size();
+    usedBytes -= node->name.size();
+    node->name = newName;
+}
+
+void MetadataCache::onDelete(long long file_id, const std::string& path) {
+    std::lock_guard<std::mutex> lock(mtx);
+    epoch++;
+
+    auto idx = nodeIndex.find(file_id);
+    if (idx != nodeIndex.end()) {
+        long long key = idx->second;
+        Folder& folder = folders[key];
+        auto pos = std::find_if(folder.children.begin(), folder.children.end(),
+                                [file_id](const MetadataNode& n) { return n.file_id == file_id; });
+        if (pos != folder.children.end()) {
+            size_t bytes = nodeBytes(*pos);
+            folder.bytes -= bytes;
+            usedBytes -= bytes;
+            folder.children.erase(pos);
+        }
+        nodeIndex.erase(idx);
+    }
+
+    // Folder bị xóa kéo theo cả cây con: bỏ mọi danh sách nằm dưới path
+    if (path.empty()) return;
+    std::vector<long long> dropped;
+    for (const auto& entry : folders) {
+        const std::string& p = entry.second.path;
+        if (p.size() >= path.size() && p.compare(0, path.size(), path) == 0) dropped.push_back(entry.first);
+    }
+    for (long long key : dropped) eraseFolder(key);
+}
+
+void MetadataCache::onTotalsChanged(const std::string& folderPath, long long deltaBytes, long long levels) {
+    // "/1/4/9/" -> 1, 4, 9
+    std::vector<long long> ids;
+    size_t start = 1;
+    while (start < folderPath.size()) {
+        size_t end = folderPath.find('/', start);
+        if (end == std::string::npos) break;
+        ids.push_back(std::atoll(folderPath.c_str() + start));
+        start = end + 1;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    epoch++;
+    for (auto it = ids.rbegin(); it != ids.rend() && levels > 0; ++it, --levels) {
+        MetadataNode* node = findNode(*it);
+        if (node && node->is_folder) node->subtree_bytes += deltaBytes;
+    }
+}
+
+void MetadataCache::printStats() {
+    size_t folderCount, nodeCount, bytes;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        folderCount = folders.size();
+        nodeCount = nodeIndex.size();
+        bytes = usedBytes;
+    }
+    std::cout << "Metadata Cache:     " << folderCount << " folders, " << nodeCount << " nodes, "
+              << bytes / 1024 << "/" << maxBytes / 1024 << " KB, " << hits.load() << " hits, "
+              << misses.load() << " misses, " << evictions.load() << " evictions\n";
+}
@@ -0,0 +1,78 @@
+#include "../../include/quota_ledger.h"
+#include "../../include/db_manager.h"
+#include <iostream>
+
+QuotaReservation::~QuotaReservation() {
+    QuotaLedger::getInstance().release(user_id, bytes);
+}
+
+bool QuotaLedger::ensureLoaded(long long user_id) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (accounts.count(user_id)) return true;
+    }
+
+    // Đọc DB ngoài lock; nếu trong lúc đó usage của tài khoản chưa nạp bị đổi thì đọc lại
+    for (int attempt = 0; attempt < 3; attempt++) {
+        unsigned long long seen = unloadedChanges.load();
+        long long used, limit;
+        if (!DBManager::getInstance().getStorageAccount(user_id, used, limit)) return false;
+
+        std::lock_guard<std::mutex> lock(mtx);
+        if (accounts.count(user_id)) return true;
+        if (unloadedChanges.load() != seen) continue;
+        Account& acc = accounts[user_id];
+        acc.used = used;
+        acc.limit = limit;
+        return true;
+    }
+    std::cerr << "[Quota] Could not load account " << user_id << " (usage changing)" << std::endl;
+    return false;
+}
+
+std::shared_ptr<QuotaReservation> QuotaLedger::reserve(long long user_id, long long bytes) {
+    if (user_id < 0 || bytes < 0 || !ensureLoaded(user_id)) return nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        Account& acc = accounts[user_id];
+        if (acc.used + acc.reserved + bytes > acc.limit) {
+            rejections++;
+            std::cout << "[Quota] User " << user_id << " over limit: used " << acc.used
+                      << " + reserved " << acc.reserved << " + " << bytes << " > " << acc.limit << std::endl;
+            return nullptr;
+        }
+        acc.reserved += bytes;
+    }
+    reservations++;
+    return std::make_shared<QuotaReservation>(user_id, bytes);
+}
+
+void QuotaLedger::release(long long user_id, long long bytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = accounts.find(user_id);
+    if (it != accounts.end()) it->second.reserved -= bytes;
+}
+
+void QuotaLedger::onUsageChanged(long long user_id, long long delta) {
+    if (delta == 0) return;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = accounts.find(user_id);
+    if (it == accounts.end()) {
+        unloadedChanges++;
+        return;
+    }
+    it->second.used += delta;
+}
+
+void QuotaLedger::printStats() {
+    long long reserved = 0;
+    size_t count;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        count = accounts.size();
+        for (const auto& entry : accounts) reserved += entry.second.reserved;
+    }
+    std::cout << "Quota Ledger:       " << count << " accounts, " << reserved << " bytes reserved, "
+              << reservations.load() << " reservations, " << rejections.load() << " rejected\n";
+}
@@ -0,0 +1,193 @@
+#include "../../include/search_index.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+
+std::string SearchIndex::lower(const std::string& s) {
+    // Chỉ hạ chữ ASCII; byte UTF-8 (tiếng Việt có dấu) giữ nguyên
+    std::string out = s;
+    for (char& c : out) {
+        if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+    }
+    return out;
+}
+
+std::vector<uint32_t> SearchIndex::trigrams(const std::string& s) {
+    std::vector<uint32_t> grams;
+    for (size_t i = 0; i + 3 <= s.size(); i++) {
+        grams.push_back((uint32_t)(unsigned char)s[i] << 16 | (uint32_t)(unsigned char)s[i + 1] << 8 |
+                        (uint32_t)(unsigned char)s[i + 2]);
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+bool SearchIndex::visible(const Doc& doc, long long user_id, const std::unordered_set<long long>& sharedRoots) {
+    if (doc.owner_id == user_id) return true;
+    if (sharedRoots.empty()) return false;
+    // "/1/4/9/" -> 1, 4, 9
+    size_t start = 1;
+    while (start < doc.path.size()) {
+        size_t end = doc.path.find('/', start);
+        if (end == std::string::npos) break;
+        if (sharedRoots.count(std::atoll(doc.path.c_str() + start))) return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+void SearchIndex::addPostings(uint32_t slot) {
+    for (uint32_t gram : trigrams(docs[slot].name)) {
+        auto& list = postings[gram];
+        list.insert(std::lower_bound(list.begin(), list.end(), slot), slot);
+    }
+}
+
+void SearchIndex::removeSlot(uint32_t slot) {
+    for (uint32_t gram : trigrams(docs[slot].name)) {
+        auto it = postings.find(gram);
+        if (it == postings.end()) continue;
+        auto& list = it->second;
+        auto pos = std::lower_bound(list.begin(), list.end(), slot);
+        if (pos != list.end() && *pos == slot) list.erase(pos);
+        if (list.empty()) postings.erase(it);
+    }
+    slotOf.erase(docs[slot].file_id);
+    docs[slot] = Doc();
+    freeSlots.push_back(slot);
+}
+
+void SearchIndex::clear() {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    docs.clear();
+    freeSlots.clear();
+    slotOf.clear();
+    postings.clear();
+}
+
+void SearchIndex::onInsert(long long file_id, long long owner_id, const std::string& name, const std::string& path) {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    auto existing = slotOf.find(file_id);
+    if (existing != slotOf.end()) removeSlot(existing->second);
+
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        slot = (uint32_t)docs.size();
+        docs.emplace_back();
+    }
+    Doc& doc = docs[slot];
+    doc.file_id = file_id;
+    doc.owner_id = owner_id;
+    doc.name = lower(name);
+    doc.path = path;
+    slotOf[file_id] = slot;
+    addPostings(slot);
+}
+
+void SearchIndex::onRename(long long file_id, const std::string& newName) {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    auto it = slotOf.find(file_id);
+    if (it == slotOf.end()) return;
+    uint32_t slot = it->second;
+
+    Doc doc = docs[slot];
+    removeSlot(slot);
+    freeSlots.pop_back();  // Dùng lại đúng slot cũ
+    doc.name = lower(newName);
+    docs[slot] = std::move(doc);
+    slotOf[docs[slot].file_id] = slot;
+    addPostings(slot);
+}
+
+void SearchIndex::onDelete(long long file_id, const std::string& path, bool isFolder) {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    auto it = slotOf.find(file_id);
+    if (it != slotOf.end()) removeSlot(it->second);
+
+    // Xóa folder hiếm gặp nên quét toàn bộ chỉ mục là chấp nhận được
+    if (!isFolder || path.empty()) return;
+    for (uint32_t slot = 0; slot < docs.size(); slot++) {
+        const Doc& doc = docs[slot];
+        if (doc.file_id != 0 && doc.path.compare(0, path.size(), path) == 0) removeSlot(slot);
+    }
+}
+
+std::vector<long long> SearchIndex::search(const std::string& keyword, long long user_id,
+                                           const std::unordered_set<long long>& sharedRoots,
+                                           size_t offset, size_t limit) {
+    auto start = std::chrono::steady_clock::now();
+    std::string needle = lower(keyword);
+    std::vector<long long> result;
+    size_t skipped = 0;
+
+    // true khi đã đủ một trang
+    auto consider = [&](const Doc& doc) {
+        if (doc.file_id == 0 || doc.name.find(needle) == std::string::npos) return false;
+        if (!visible(doc, user_id, sharedRoots)) return false;
+        if (skipped < offset) {
+            skipped++;
+            return false;
+        }
+        result.push_back(doc.file_id);
+        return result.size() >= limit;
+    };
+
+    {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        std::vector<uint32_t> grams = trigrams(needle);
+        if (grams.empty()) {
+            // Dưới 3 ký tự: quét toàn bộ
+            for (const Doc& doc : docs) {
+                if (consider(doc)) break;
+            }
+        } else {
+            // Giao các posting list, bắt đầu từ list ngắn nhất
+            std::vector<const std::vector<uint32_t>*> lists;
+            bool missing = false;
+            for (uint32_t gram : grams) {
+                auto it = postings.find(gram);
+                if (it == postings.end()) {
+                    missing = true;
+                    break;
+                }
+                lists.push_back(&it->second);
+            }
+            if (!missing) {
+                std::sort(lists.begin(), lists.end(),
+                          [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b) {
+                              return a->size() < b->size();
+                          });
+                for (uint32_t slot : *lists[0]) {
+                    bool inAll = true;
+                    for (size_t i = 1; i < lists.size() && inAll; i++) {
+                        inAll = std::binary_search(lists[i]->begin(), lists[i]->end(), slot);
+                    }
+                    if (inAll && consider(docs[slot])) break;
+                }
+            }
+        }
+    }
+
+    searches++;
+    totalMicros += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void SearchIndex::printStats() {
+    size_t docCount, gramCount;
+    {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        docCount = slotOf.size();
+        gramCount = postings.size();
+    }
+    long long count = searches.load();
+    std::cout << "Search Index:       " << docCount << " names, " << gramCount << " trigrams, "
+              << count << " searches, avg " << (count ? totalMicros.load() / count : 0) << " us\n";
+}
@@ -19,7 +19,9 @@ std::string AuthHandler::handlePass(int fd, ClientSession& session, const std::s
         return std::string(CODE_FAIL) + " Login with USER first\n";
     }
 
-    if (DBManager::getInstance().checkUser(session.username, password)) {
+    long long user_id = DBManager::getInstance().checkUser(session.username, password);
+    if (user_id >= 0) {
+        session.userId = user_id;
         session.isAuthenticated = true;
         std::cout << "[SERVER] LOGIN SUCCESS: " << session.username << std::endl;
         std::cout << "[AuthHandler::PASS] Login SUCCESS for " << session.username << std::endl;
@@ -1,10 +1,21 @@
 #include "../../include/request_handler.h"
 #include "../../include/db_manager.h"
+#include "../../include/db_pool.h"
+#include "../../include/server_config.h"
 #include "../../../../Common/Protocol.h"
 #include <iostream>
 #include <sstream>
 #include <vector>
 
+// Listing phải có số câu SQL cố định, không tăng theo số dòng (N+1)
+static void checkStatementBudget(const char* cmd, long long statementsBefore) {
+    long long used = DBLease::statementCount() - statementsBefore;
+    if (used > ServerConfig::LIST_STATEMENT_BUDGET) {
+        std::cerr << "[CmdHandler::" << cmd << "] WARNING: " << used << " SQL statements (budget "
+                  << ServerConfig::LIST_STATEMENT_BUDGET << ")" << std::endl;
+    }
+}
+
 std::string CmdHandler::handleList(const ClientSession& session, long long parent_id) {
     std::cout << "[CmdHandler::LIST] User: " << session.username << ", Parent ID: " << parent_id << std::endl;
     
@@ -13,7 +24,9 @@ std::string CmdHandler::handleList(const ClientSession& session, long long paren
         return std::string(CODE_FAIL) + " Please login first\n";
     }
 
-    auto files = DBManager::getInstance().getFiles(session.username, parent_id);
+    long long statementsBefore = DBLease::statementCount();
+    auto files = DBManager::getInstance().getFiles(session.userId, parent_id);
+    checkStatementBudget("LIST", statementsBefore);
     std::cout << "[CmdHandler::LIST] Found " << files.size() << " items" << std::endl;
     
     if (files.empty()) {
@@ -38,11 +51,13 @@ std::string CmdHandler::handleListShared(const ClientSession& session, long long
 
     std::vector<FileRecord> files;
     
+    long long statementsBefore = DBLease::statementCount();
     if (parent_id < 0) {
-        files = DBManager::getInstance().getSharedFiles(session.username);
+        files = DBManager::getInstance().getSharedFiles(session.userId);
     } else {
-        files = DBManager::getInstance().getSharedFiles(session.username, parent_id);
+        files = DBManager::getInstance().getSharedFiles(session.userId, parent_id);
     }
+    checkStatementBudget("LISTSHARED", statementsBefore);
     
     if (files.empty()) {
         return "210 No shared files\n";
@@ -56,10 +71,74 @@ std::string CmdHandler::handleListShared(const ClientSession& session, long long
     return response;
 }
 
-std::string CmdHandler::handleSearch(const ClientSession& session, const std::string& keyword) {
+static bool parseListSort(const std::string& name, ListSort& sort) {
+    if (name == "name") sort = ListSort::Name;
+    else if (name == "size") sort = ListSort::Size;
+    else if (name == "date") sort = ListSort::Date;
+    else return false;
+    return true;
+}
+
+static void appendListingRow(std::string& response, const FileRecord& f) {
+    response += f.name;
+    response += f.is_folder ? "|Folder|" : "|File|";
+    response += std::to_string(f.size) + "|" + f.owner + "|" + std::to_string(f.file_id) + "\n";
+}
+
+// Các dòng được ghi vào response ngay khi đọc từ MySQL; không giữ cả folder trong bộ nhớ
+static std::string listPageResponse(const char* cmd, bool shared, const ClientSession& session, long long parent_id,
+                                    const std::string& sortName, long long pageSize, const std::string& cursor) {
+    std::cout << "[CmdHandler::" << cmd << "] User: " << session.username << ", Parent ID: " << parent_id
+              << ", Sort: " << sortName << ", Page size: " << pageSize << std::endl;
+
     if (!session.isAuthenticated) return std::string(CODE_FAIL) + " Please login first\n";
 
-    return "Result_File_1.txt|1024|admin\n";
+    ListSort sort;
+    if (!parseListSort(sortName, sort) || pageSize <= 0 || pageSize > ServerConfig::LIST_PAGE_MAX) {
+        return std::string(CODE_FAIL) + " Invalid format\n";
+    }
+
+    std::string response;
+    std::string next;
+    auto onRow = [&response](const FileRecord& f) { appendListingRow(response, f); };
+    DBManager& db = DBManager::getInstance();
+    bool ok = shared ? db.getSharedFilesPage(session.userId, parent_id, sort, cursor, (int)pageSize, onRow, next)
+                     : db.getFilesPage(session.userId, parent_id, sort, cursor, (int)pageSize, onRow, next);
+    if (!ok) return std::string(CODE_FAIL) + " Invalid cursor or folder\n";
+
+    if (response.empty()) {
+        return shared ? "210 No shared files\n" : "210 Empty folder\n";
+    }
+    if (!next.empty()) response += "NEXT " + next + "\n";
+    return response;
+}
+
+std::string CmdHandler::handleListPage(const ClientSession& session, long long parent_id, const std::string& sort,
+                                       long long pageSize, const std::string& cursor) {
+    return listPageResponse("LIST", false, session, parent_id, sort, pageSize, cursor);
+}
+
+std::string CmdHandler::handleListSharedPage(const ClientSession& session, long long parent_id, const std::string& sort,
+                                             long long pageSize, const std::string& cursor) {
+    return listPageResponse("LISTSHARED", true, session, parent_id, sort, pageSize, cursor);
+}
+
+std::string CmdHandler::handleSearch(const ClientSession& session, const std::string& keyword, long long page) {
+    std::cout << "[CmdHandler::SEARCH] User: " << session.username << ", Keyword: " << keyword
+              << ", Page: " << page << std::endl;
+
+    if (!session.isAuthenticated) return std::string(CODE_FAIL) + " Please login first\n";
+    if (keyword.empty() || page < 0) return std::string(CODE_FAIL) + " Invalid format\n";
+
+    auto files = DBManager::getInstance().searchFiles(session.userId, keyword, page);
+    if (files.empty()) {
+        return "210 No results\n";
+    }
+
+    // Cùng định dạng với LIST; ít hơn SEARCH_PAGE_SIZE dòng nghĩa là trang cuối
+    std::string response = "";
+    for (const auto& f : files) appendListingRow(response, f);
+    return response;
 }
 
 std::string CmdHandler::handleShare(const ClientSession& session, const std::string& filename, const std::string& targetUser) {
@@ -70,7 +149,7 @@ std::string CmdHandler::handleShare(const ClientSession& session, const std::str
         return std::string(CODE_FAIL) + " Please login first\n";
     }
 
-    bool success = DBManager::getInstance().shareFile(filename, session.username, targetUser);
+    bool success = DBManager::getInstance().shareFile(filename, session.userId, targetUser);
     std::cout << "[CmdHandler::SHARE] Result: " << (success ? "SUCCESS" : "FAILED") << std::endl;
     
     if (success) {
@@ -90,7 +169,7 @@ std::string CmdHandler::handleDelete(const ClientSession& session, const std::st
         return std::string(CODE_FAIL) + " Please login first\n";
     }
 
-    bool success = DBManager::getInstance().deleteFile(filename, session.username);
+    bool success = DBManager::getInstance().deleteFile(filename, session.userId);
     std::cout << "[CmdHandler::DELETE] Result: " << (success ? "SUCCESS" : "FAILED") << std::endl;
     
     if (success) {
@@ -112,7 +191,7 @@ std::string CmdHandler::handleRename(const ClientSession& session, long long fil
         return std::string(CODE_FAIL) + " Please login first\n";
     }
 
-    bool success = DBManager::getInstance().renameFile(fileId, newName, session.username);
+    bool success = DBManager::getInstance().renameFile(fileId, newName, session.userId);
     std::cout << "[CmdHandler::RENAME] Result: " << (success ? "SUCCESS" : "FAILED") << std::endl;
     
     if (success) {
@@ -126,11 +205,22 @@ std::string CmdHandler::handleRename(const ClientSession& session, long long fil
 
 std::string CmdHandler::handleShareFolder(const ClientSession& session, 
                                           long long folder_id, 
-                                          const std::string& targetUser) {
+                                          const std::string& targetUser,
+                                          bool copy) {
     if (!session.isAuthenticated) {
         return std::string(CODE_FAIL) + " Please login first\n";
     }
     
+    if (copy) {
+        // Chỉ tạo lời mời: người nhận ACCEPT_FOLDER_COPY thì mới chép (vào quota của họ)
+        std::string session_id = FolderShareHandler::getInstance().initiateFolderShare(session.username, folder_id,
+                                                                                       targetUser);
+        if (session_id.empty()) {
+            return std::string(CODE_FAIL) + " Failed to offer folder copy\n";
+        }
+        return std::string(CODE_OK) + " Folder copy offered|SESSION_ID:" + session_id + "\n";
+    }
+    
     std::cout << "[CmdHandler] Sharing folder " << folder_id 
               << " from " << session.username 
               << " to " << targetUser << std::endl;
@@ -155,7 +245,7 @@ std::string CmdHandler::handleGetFolderStructure(const ClientSession& session,
         return std::string(CODE_FAIL) + " Please login first\n";
     }
     
-    auto structure = DBManager::getInstance().getFolderStructure(folder_id, session.username);
+    auto structure = DBManager::getInstance().getFolderStructure(folder_id, session.userId);
     std::cout << "[CmdHandler::GET_FOLDER_STRUCTURE] Found " << structure.size() << " items" << std::endl;
     
     if (structure.empty()) {
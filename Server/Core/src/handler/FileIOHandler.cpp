@@ -7,7 +7,7 @@
 
 namespace fs = std::filesystem;
 
-std::string FileIOHandler::handleQuotaCheck(const ClientSession& session, long filesize) {
+std::string FileIOHandler::handleQuotaCheck(ClientSession& session, long filesize) {
     std::cout << "[FileIOHandler::QUOTA_CHECK] User: " << session.username << ", File size: " << filesize << " bytes" << std::endl;
     
     if (!session.isAuthenticated) {
@@ -28,12 +28,11 @@ std::string FileIOHandler::handleQuotaCheck(const ClientSession& session, long f
         }
     }
 
-    long used = DBManager::getInstance().getStorageUsed(session.username);
-    long limit = 1073741824;
+    // Bỏ chỗ của lần kiểm tra trước (chưa STOR) rồi mới giữ chỗ mới
+    session.quotaReservation.reset();
+    session.quotaReservation = QuotaLedger::getInstance().reserve(session.userId, filesize);
     
-    std::cout << "[FileIOHandler::QUOTA_CHECK] Used: " << used << " bytes, Limit: " << limit << " bytes" << std::endl;
-    
-    if (used + filesize > limit) {
+    if (!session.quotaReservation) {
         std::cout << "[FileIOHandler::QUOTA_CHECK] QUOTA EXCEEDED" << std::endl;
         return std::string(CODE_FAIL) + " Quota exceeded\n";
     }
@@ -42,7 +41,7 @@ std::string FileIOHandler::handleQuotaCheck(const ClientSession& session, long f
     return std::string(CODE_OK) + " Quota OK\n";
 }
 
-bool FileIOHandler::checkDownloadPermission(const ClientSession& session, const std::string& filename) {
+bool FileIOHandler::checkDownloadPermission(const ClientSession& session, const std::string& filename, long long& blob_id) {
     std::cout << "[FileIOHandler::CHECK_PERMISSION] User: " << session.username << ", File: " << filename << std::endl;
     
     if (!session.isAuthenticated) {
@@ -50,38 +49,13 @@ bool FileIOHandler::checkDownloadPermission(const ClientSession& session, const
         return false;
     }
     
-    std::string filePath = std::string(ServerConfig::STORAGE_PATH) + filename;
-    
-    if (!fs::exists(filePath)) {
-        std::cerr << "[FileIOHandler] File not found: " << filePath << std::endl;
+    // Dữ liệu nằm trong BlobStore theo blob_id: file phải có dòng FILES mà user được đọc
+    blob_id = DBManager::getInstance().findDownloadBlob(filename, session.userId);
+    if (blob_id < 0) {
+        std::cerr << "[FileIOHandler] Permission denied for user '" << session.username << "' to access '" << filename << "'" << std::endl;
         return false;
     }
     
-    DBManager& dbManager = DBManager::getInstance();
-    if (!dbManager.connect()) {
-        std::cerr << "[FileIOHandler] Database connection failed!" << std::endl;
-        return false;
-    }
-    
-    std::string owner = dbManager.getFileOwner(filename);
-    
-    if (owner.empty()) {
-        std::cout << "[FileIOHandler::CHECK_PERMISSION] No owner found, allowing access" << std::endl;
-        return true;
-    }
-    
-    if (owner == session.username) {
-        std::cout << "[FileIOHandler::CHECK_PERMISSION] User is owner, access GRANTED" << std::endl;
-        return true;
-    }
-    
-    bool isShared = dbManager.isFileSharedWithUser(filename, session.username);
-    
-    if (isShared) {
-        std::cout << "[FileIOHandler] File '" << filename << "' is shared with user '" << session.username << "'" << std::endl;
-        return true;
-    }
-    
-    std::cerr << "[FileIOHandler] Permission denied for user '" << session.username << "' to access '" << filename << "'" << std::endl;
-    return false;
+    std::cout << "[FileIOHandler::CHECK_PERMISSION] Access GRANTED (blob " << blob_id << ")" << std::endl;
+    return true;
 }
\ No newline at end of file
@@ -4,12 +4,18 @@
 #include <random>
 #include <sstream>
 #include <iomanip>
-#include <fstream>
-#include <filesystem>
 #include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <chrono>
+#include "../../include/server_config.h"
 
-namespace fs = std::filesystem;
-const std::string STORAGE_DIR = "storage";
+static long long nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 std::string FolderShareHandler::generateSessionId() {
     std::random_device rd;
@@ -25,65 +31,6 @@ std::string FolderShareHandler::generateSessionId() {
     return ss.str();
 }
 
-std::string FolderShareHandler::buildRelativePath(long long file_id, 
-                                                  const std::vector<FileRecordEx>& all_files) {
-    std::vector<std::string> path_parts;
-    long long current_id = file_id;
-    
-    std::map<long long, FileRecordEx> file_map;
-    for (const auto& f : all_files) {
-        file_map[f.file_id] = f;
-    }
-    
-    while (current_id != -1 && file_map.find(current_id) != file_map.end()) {
-        const auto& file = file_map[current_id];
-        path_parts.insert(path_parts.begin(), file.name);
-        current_id = file.parent_id;
-        
-        if (current_id == 1) break;
-    }
-    
-    std::string result;
-    for (size_t i = 0; i < path_parts.size(); i++) {
-        result += path_parts[i];
-        if (i < path_parts.size() - 1) {
-            result += "/";
-        }
-    }
-    
-    return result;
-}
-
-void FolderShareHandler::createFolderStructure(FolderShareSession& session,
-                                              const std::vector<FileRecordEx>& structure) {
-    std::vector<FileRecordEx> folders;
-    for (const auto& item : structure) {
-        if (item.is_folder && item.file_id != session.source_folder_id) {
-            folders.push_back(item);
-        }
-    }
-    
-    std::sort(folders.begin(), folders.end(), [](const FileRecordEx& a, const FileRecordEx& b) {
-        return a.parent_id < b.parent_id;
-    });
-    
-    for (const auto& folder : folders) {
-        long long new_parent_id = session.old_to_new_id_map[folder.parent_id];
-        
-        long long new_folder_id = DBManager::getInstance().createFolder(
-            folder.name,
-            new_parent_id,
-            session.recipient_username
-        );
-        
-        if (new_folder_id != -1) {
-            session.old_to_new_id_map[folder.file_id] = new_folder_id;
-            std::cout << "[FolderShare] Created folder: " << folder.name 
-                      << " (old_id=" << folder.file_id << ", new_id=" << new_folder_id << ")" << std::endl;
-        }
-    }
-}
-
 std::string FolderShareHandler::initiateFolderShare(const std::string& owner_username,
                                                     long long folder_id,
                                                     const std::string& recipient_username) {
@@ -102,172 +49,161 @@ std::string FolderShareHandler::initiateFolderShare(const std::string& owner_use
         return "";
     }
     
-    std::vector<FileRecordEx> structure = DBManager::getInstance().getFolderStructure(folder_id, owner_username);
-    
-    if (structure.empty()) {
-        std::cerr << "[FolderShare] Empty folder or failed to get structure" << std::endl;
+    long long recipient_id = DBManager::getInstance().getUserId(recipient_username);
+    if (recipient_id < 0) {
+        std::cerr << "[FolderShare] Recipient not found: " << recipient_username << std::endl;
         return "";
     }
     
-    FolderShareSession session;
-    session.session_id = generateSessionId();
-    session.owner_username = owner_username;
-    session.source_folder_id = folder_id;
-    session.recipient_username = recipient_username;
-    session.total_files = 0;
-    session.completed_files = 0;
-    session.status = "pending";
-    
-    session.new_root_folder_id = DBManager::getInstance().createFolder(
-        folder_info.name,
-        -1,
-        recipient_username
-    );
-    
-    if (session.new_root_folder_id == -1) {
-        std::cerr << "[FolderShare] Failed to create root folder" << std::endl;
+    if (recipient_id == folder_info.owner_id) {
+        std::cerr << "[FolderShare] Cannot copy a folder to its owner" << std::endl;
         return "";
     }
     
-    session.old_to_new_id_map[folder_id] = session.new_root_folder_id;
-    
-    createFolderStructure(session, structure);
-    
-    for (const auto& item : structure) {
-        if (!item.is_folder) {
-            FileTransferInfo info;
-            info.old_file_id = item.file_id;
-            info.new_file_id = -1;
-            info.name = item.name;
-            info.relative_path = buildRelativePath(item.file_id, structure);
-            info.size_bytes = item.size;
-            info.uploaded = false;
-            
-            session.files_to_transfer.push_back(info);
-            session.total_files++;
-        }
-    }
-    
-    active_sessions[session.session_id] = session;
-    
-    std::cout << "[FolderShare] Session created: " << session.session_id 
-              << ", total files: " << session.total_files << std::endl;
-    
-    return session.session_id;
+    // Chưa chép: bản chép tính vào quota người nhận nên phải chờ người nhận đồng ý
+    auto session = std::make_shared<FolderShareSession>();
+    session->session_id = generateSessionId();
+    session->owner_username = owner_username;
+    session->owner_id = folder_info.owner_id;
+    session->source_folder_id = folder_id;
+    session->folder_name = folder_info.name;
+    session->recipient_username = recipient_username;
+    session->recipient_id = recipient_id;
+    session->new_root_folder_id = -1;
+    session->total_files = 0;
+    session->completed_files = 0;
+    session->status = "pending";
+    session->last_activity_ms = nowMs();
+    
+    Shard& shard = shardFor(session->session_id);
+    {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        sweepExpired(shard, session->last_activity_ms);
+        shard.sessions[session->session_id] = session;
+    }
+    
+    std::cout << "[FolderShare] Copy offered: " << session->session_id << std::endl;
+    return session->session_id;
 }
 
-FolderShareSession* FolderShareHandler::getSession(const std::string& session_id) {
-    auto it = active_sessions.find(session_id);
-    if (it != active_sessions.end()) {
-        return &(it->second);
-    }
-    return nullptr;
-}
-
-bool FolderShareHandler::receiveFile(const std::string& session_id,
-                                    long long old_file_id,
-                                    const char* file_data,
-                                    size_t file_size) {
+long long FolderShareHandler::acceptFolderShare(const std::string& session_id, long long recipient_id,
+                                                long long& fileCount) {
     auto session = getSession(session_id);
-    if (!session) {
-        std::cerr << "[FolderShare] Invalid session_id: " << session_id << std::endl;
-        return false;
+    if (!session || session->recipient_id != recipient_id) {
+        std::cerr << "[FolderShare] No offer " << session_id << " for user " << recipient_id << std::endl;
+        return -1;
     }
-    
-    FileTransferInfo* file_info = nullptr;
-    for (auto& f : session->files_to_transfer) {
-        if (f.old_file_id == old_file_id) {
-            file_info = &f;
-            break;
+
+    // "accepting" đặt dưới khóa: ACCEPT thứ hai bị từ chối, còn lúc chép thì không giữ session->mtx
+    // (GET_FOLDER_OFFERS, CHECK_SHARE_PROGRESS không phải chờ cả lần chép)
+    {
+        std::lock_guard<std::mutex> lock(session->mtx);
+        if (session->status != "pending") {
+            std::cerr << "[FolderShare] Offer already " << session->status << ": " << session_id << std::endl;
+            return -1;
         }
+        session->status = "accepting";
     }
-    
-    if (!file_info) {
-        std::cerr << "[FolderShare] File not in transfer list: " << old_file_id << std::endl;
-        return false;
-    }
-    
-    if (file_info->uploaded) {
-        std::cerr << "[FolderShare] File already uploaded: " << old_file_id << std::endl;
-        return false;
-    }
-    
-    FileRecordEx old_file = DBManager::getInstance().getFileInfo(old_file_id);
-    if (old_file.file_id == -1) {
-        std::cerr << "[FolderShare] Old file not found: " << old_file_id << std::endl;
-        return false;
+
+    // Chép cây ngay trên server: chỉ thêm dòng FILES, dữ liệu file dùng chung blob
+    long long total_bytes = 0;
+    fileCount = 0;
+    long long new_root_id = DBManager::getInstance().cloneFolder(session->source_folder_id, session->owner_id,
+                                                                 recipient_id, fileCount, total_bytes);
+
+    std::lock_guard<std::mutex> lock(session->mtx);
+    if (new_root_id == -1) {
+        std::cerr << "[FolderShare] Failed to clone folder " << session->source_folder_id << std::endl;
+        session->status = "pending";  // Người nhận có thể thử lại
+        return -1;
     }
-    
-    long long new_parent_id = session->old_to_new_id_map[old_file.parent_id];
-    
-    long long new_file_id = DBManager::getInstance().createFileInFolder(
-        old_file.name,
-        new_parent_id,
-        file_size,
-        session->recipient_username
-    );
-    
-    if (new_file_id == -1) {
-        std::cerr << "[FolderShare] Failed to create file record" << std::endl;
-        return false;
+
+    // Giữ phiên để CHECK_SHARE_PROGRESS vẫn trả về trạng thái hoàn tất (tới khi hết TTL)
+    session->new_root_folder_id = new_root_id;
+    session->total_files = fileCount;
+    session->completed_files = fileCount;
+    session->status = "completed";
+    std::cout << "[FolderShare] Folder cloned: " << session_id << ", total files: " << fileCount << std::endl;
+    return new_root_id;
+}
+
+std::vector<std::shared_ptr<FolderShareSession>> FolderShareHandler::pendingOffers(long long recipient_id) {
+    std::vector<std::shared_ptr<FolderShareSession>> candidates, offers;
+    long long now = nowMs();
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        sweepExpired(shard, now);
+        for (const auto& entry : shard.sessions) {
+            if (entry.second->recipient_id == recipient_id) candidates.push_back(entry.second);
+        }
     }
-    
-    std::string user_dir = STORAGE_DIR + "/" + session->recipient_username;
-    
-    try {
-        fs::create_directories(user_dir);
-    } catch (const std::exception& e) {
-        std::cerr << "[FolderShare] Failed to create directory: " << e.what() << std::endl;
-        return false;
+    // session->mtx không bao giờ lấy khi đang giữ shard.mtx
+    for (auto& session : candidates) {
+        std::lock_guard<std::mutex> sessionLock(session->mtx);
+        if (session->status == "pending") offers.push_back(std::move(session));
     }
-    
-    std::string file_path = user_dir + "/" + std::to_string(new_file_id);
-    std::ofstream out(file_path, std::ios::binary);
-    if (!out) {
-        std::cerr << "[FolderShare] Failed to create file: " << file_path << std::endl;
-        return false;
+    return offers;
+}
+
+FolderShareHandler::Shard& FolderShareHandler::shardFor(const std::string& session_id) {
+    return shards[std::hash<std::string>{}(session_id) % SESSION_SHARDS];
+}
+
+size_t FolderShareHandler::sweepExpired(Shard& shard, long long now_ms, bool force) {
+    // Mỗi shard quét tối đa một lần mỗi phút
+    if (!force && now_ms - shard.last_sweep_ms < 60 * 1000) return 0;
+    shard.last_sweep_ms = now_ms;
+
+    const long long ttl_ms = ServerConfig::FOLDER_SHARE_SESSION_TTL_SECONDS * 1000LL;
+    size_t expired = 0;
+    for (auto it = shard.sessions.begin(); it != shard.sessions.end();) {
+        if (now_ms - it->second->last_activity_ms > ttl_ms) {
+            std::cout << "[FolderShare] Session expired: " << it->first << std::endl;
+            it = shard.sessions.erase(it);
+            expired++;
+        } else {
+            ++it;
+        }
     }
-    
-    out.write(file_data, file_size);
-    out.close();
-    
-    file_info->new_file_id = new_file_id;
-    file_info->uploaded = true;
-    session->completed_files++;
-    session->old_to_new_id_map[old_file_id] = new_file_id;
-    session->status = "uploading";
-    
-    std::cout << "[FolderShare] File uploaded: " << old_file.name 
-              << " (" << session->completed_files << "/" << session->total_files << ")" << std::endl;
-    
-    return true;
+    return expired;
 }
 
-bool FolderShareHandler::isComplete(const std::string& session_id) {
-    auto session = getSession(session_id);
-    if (!session) return false;
-    
-    return session->completed_files >= session->total_files;
+size_t FolderShareHandler::sweepAll() {
+    size_t expired = 0;
+    for (Shard& shard : shards) {
+        long long now = nowMs();
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        expired += sweepExpired(shard, now, true);
+    }
+    return expired;
 }
 
-bool FolderShareHandler::finalize(const std::string& session_id) {
-    auto session = getSession(session_id);
-    if (!session) return false;
-    
-    for (const auto& pair : session->old_to_new_id_map) {
-        long long new_file_id = pair.second;
-        
-        DBManager::getInstance().shareFolderWithUser(new_file_id, session->recipient_username);
+size_t FolderShareHandler::sessionCount() {
+    size_t count = 0;
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        count += shard.sessions.size();
     }
-    
-    session->status = "completed";
-    std::cout << "[FolderShare] Share completed: " << session_id << std::endl;
-    
-    return true;
+    return count;
+}
+
+std::shared_ptr<FolderShareSession> FolderShareHandler::getSession(const std::string& session_id) {
+    Shard& shard = shardFor(session_id);
+    long long now = nowMs();
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    sweepExpired(shard, now);
+    auto it = shard.sessions.find(session_id);
+    if (it == shard.sessions.end()) return nullptr;
+    it->second->last_activity_ms = now;
+    return it->second;
 }
 
 void FolderShareHandler::cleanup(const std::string& session_id) {
-    active_sessions.erase(session_id);
+    Shard& shard = shardFor(session_id);
+    {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        shard.sessions.erase(session_id);
+    }
     std::cout << "[FolderShare] Session cleaned up: " << session_id << std::endl;
 }
 
@@ -277,13 +213,18 @@ std::string FolderShareHandler::getProgress(const std::string& session_id) {
         return "ERROR: Session not found";
     }
     
+    std::lock_guard<std::mutex> lock(session->mtx);
+    return progressLocked(*session);
+}
+
+std::string FolderShareHandler::progressLocked(const FolderShareSession& session) {
     std::stringstream ss;
-    ss << "STATUS:" << session->status << "|";
-    ss << "COMPLETED:" << session->completed_files << "|";
-    ss << "TOTAL:" << session->total_files << "|";
+    ss << "STATUS:" << session.status << "|";
+    ss << "COMPLETED:" << session.completed_files << "|";
+    ss << "TOTAL:" << session.total_files << "|";
     
-    int percentage = (session->total_files > 0) 
-        ? (session->completed_files * 100 / session->total_files) 
+    int percentage = (session.total_files > 0) 
+        ? (session.completed_files * 100 / session.total_files) 
         : 0;
     ss << "PROGRESS:" << percentage << "%";
     
@@ -0,0 +1,159 @@
+#include "../../include/blob_store.h"
+#include "../../include/chunk_store.h"
+#include "../../include/db_manager.h"
+#include "../../include/zero_copy_io.h"
+#include "../../include/server_config.h"
+#include <iostream>
+#include <filesystem>
+#include <atomic>
+#include <mutex>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static std::string tempDir() {
+    static std::once_flag created;
+    static const std::string dir = std::string(ServerConfig::STORAGE_PATH) + "tmp";
+    std::call_once(created, [] {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        if (ec) std::cerr << "[BlobStore] Cannot create " << dir << ": " << ec.message() << std::endl;
+    });
+    return dir;
+}
+
+std::string BlobStore::pathOf(long long blob_id) {
+    char fanout[8];
+    snprintf(fanout, sizeof(fanout), "%02x/%02x", (unsigned)(blob_id & 0xff), (unsigned)((blob_id >> 8) & 0xff));
+    return std::string(ServerConfig::STORAGE_PATH) + "blobs/" + fanout + "/" + std::to_string(blob_id);
+}
+
+std::string BlobStore::newTempPath() {
+    static std::atomic<unsigned long long> counter{0};
+    return tempDir() + "/" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+}
+
+int BlobStore::create(std::string& tempPath) {
+    tempPath = newTempPath();
+    return openTemp(tempPath);
+}
+
+int BlobStore::openTemp(const std::string& tempPath) {
+    int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "[BlobStore] Cannot create " << tempPath << ": " << strerror(errno) << std::endl;
+    }
+    return fd;
+}
+
+bool BlobStore::commit(const std::string& tempPath, long long blob_id) {
+    return commitTo(tempPath, pathOf(blob_id));
+}
+
+bool BlobStore::commitTo(const std::string& tempPath, const std::string& path) {
+    if (rename(tempPath.c_str(), path.c_str()) == 0) return true;
+
+    // Thư mục lá được tạo lười ở blob/chunk đầu tiên rơi vào nó
+    if (errno == ENOENT) {
+        std::error_code ec;
+        std::filesystem::create_directories(path.substr(0, path.find_last_of('/')), ec);
+        if (!ec && rename(tempPath.c_str(), path.c_str()) == 0) return true;
+    }
+    std::cerr << "[BlobStore] Commit " << tempPath << " -> " << path << " failed: " << strerror(errno) << std::endl;
+    ::unlink(tempPath.c_str());
+    return false;
+}
+
+void BlobStore::discard(const std::string& tempPath) {
+    ::unlink(tempPath.c_str());
+}
+
+void BlobStore::unlink(long long blob_id) {
+    std::string path = pathOf(blob_id);
+    if (::unlink(path.c_str()) < 0 && errno != ENOENT) {
+        std::cerr << "[BlobStore] Cannot remove " << path << ": " << strerror(errno) << std::endl;
+    }
+}
+
+bool BlobReader::open(long long blob_id, const std::string& legacyName) {
+    close();
+    fd = ::open(BlobStore::pathOf(blob_id).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT) {
+        // ChunkStore commit manifest trước rồi mới xóa file blob: không thấy file thì manifest đã có
+        std::vector<ChunkRef> chunks = DBManager::getInstance().getChunkManifest(blob_id);
+        if (!chunks.empty()) {
+            off_t start = 0;
+            for (const ChunkRef& chunk : chunks) {
+                segments.push_back({ChunkStore::pathOf(chunk.hash), start, static_cast<off_t>(chunk.size)});
+                start += chunk.size;
+            }
+            totalSize = start;
+            // Mở chunk đầu ngay: thiếu dữ liệu thì báo trước khi gửi header
+            if (!openSegment(0)) {
+                close();
+                return false;
+            }
+            return true;
+        }
+        // Dòng FILES có trước migration 005: file cũ STORAGE_PATH + tên
+        if (!legacyName.empty()) {
+            fd = ::open((std::string(ServerConfig::STORAGE_PATH) + legacyName).c_str(), O_RDONLY | O_CLOEXEC);
+        }
+    }
+
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        close();
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    segments.push_back({"", 0, st.st_size});
+    totalSize = st.st_size;
+    return true;
+}
+
+void BlobReader::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    segments.clear();
+    current = 0;
+    totalSize = 0;
+}
+
+bool BlobReader::openSegment(size_t index) {
+    if (fd >= 0) ::close(fd);
+    current = index;
+    fd = ::open(segments[index].path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "[BlobReader] Missing chunk " << segments[index].path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return true;
+}
+
+long long BlobReader::sendRange(int sockFd, off_t* offset, size_t count) {
+    long long total = 0;
+    while (count > 0) {
+        while (current + 1 < segments.size() && *offset >= segments[current].start + segments[current].size) {
+            if (!openSegment(current + 1)) return total > 0 ? total : -1;
+        }
+        const Segment& seg = segments[current];
+        off_t local = *offset - seg.start;
+        size_t want = std::min<off_t>(static_cast<off_t>(count), seg.size - local);
+        if (want == 0) break;
+
+        long long sent = ZeroCopyIO::sendFileRange(sockFd, fd, &local, want);
+        if (sent < 0) return total > 0 ? total : -1;
+        *offset += sent;
+        total += sent;
+        count -= sent;
+        // EAGAIN hoặc chunk ngắn hơn manifest: errno giữ nguyên cho caller
+        if (static_cast<size_t>(sent) < want) break;
+    }
+    return total;
+}
@@ -0,0 +1,300 @@
+#include "../../include/chunk_store.h"
+#include "../../include/blob_store.h"
+#include "../../include/db_manager.h"
+#include "../../include/server_config.h"
+#include "../../../../Common/Protocol.h"
+#include <openssl/sha.h>
+#include <iostream>
+#include <array>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static_assert(ChunkStore::DIGEST_BYTES == SHA256_DIGEST_LENGTH, "DIGEST_BYTES phải bằng SHA-256");
+
+static const uint64_t* gearTable() {
+    // splitmix64: client dựng lại đúng bảng này từ CHUNK_GEAR_SEED
+    static const std::array<uint64_t, 256> table = [] {
+        std::array<uint64_t, 256> t{};
+        uint64_t x = CHUNK_GEAR_SEED;
+        for (uint64_t& v : t) {
+            x += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = x;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            v = z ^ (z >> 31);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+size_t ChunkStore::cutPoint(const unsigned char* data, size_t len) {
+    if (len <= CHUNK_MIN_BYTES) return len;
+    const uint64_t* gear = gearTable();
+    const uint64_t mask = ~0ULL << (64 - CHUNK_MASK_BITS);
+    size_t end = std::min<size_t>(len, CHUNK_MAX_BYTES);
+
+    // Byte cũ hơn 64 vị trí đã bị dịch ra khỏi h: bắt đầu trước mốc min 64 byte cho kết quả
+    // giống hệt việc hash từ đầu chunk
+    uint64_t h = 0;
+    for (size_t i = CHUNK_MIN_BYTES - 64; i < end; i++) {
+        h = (h << 1) + gear[data[i]];
+        if (i + 1 >= CHUNK_MIN_BYTES && (h & mask) == 0) return i + 1;
+    }
+    return end;
+}
+
+std::string ChunkStore::pathOf(const std::string& hash) {
+    return std::string(ServerConfig::STORAGE_PATH) + "chunks/" + hash.substr(0, 2) + "/" + hash.substr(2, 2) + "/" + hash;
+}
+
+std::string ChunkStore::pendingPathOf(long long user_id, const std::string& hash) {
+    return std::string(ServerConfig::STORAGE_PATH) + "chunks/pending/" + std::to_string(user_id) + "/" + hash;
+}
+
+bool ChunkStore::isValidHash(std::string_view hash) {
+    if (hash.size() != SHA256_DIGEST_LENGTH * 2) return false;
+    for (char c : hash) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    }
+    return true;
+}
+
+std::string ChunkStore::toHex(const unsigned char* digest) {
+    static const char HEX[] = "0123456789abcdef";
+    std::string hex(SHA256_DIGEST_LENGTH * 2, '0');
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        hex[2 * i] = HEX[digest[i] >> 4];
+        hex[2 * i + 1] = HEX[digest[i] & 0x0f];
+    }
+    return hex;
+}
+
+long long ChunkStore::storedSize(const std::string& hash) {
+    // Chunk chỉ xuất hiện ở đây sau khi đã kiểm tra hash và rename vào chỗ: có file là đủ
+    struct stat st;
+    return stat(pathOf(hash).c_str(), &st) == 0 ? static_cast<long long>(st.st_size) : -1;
+}
+
+bool ChunkStore::putChunk(const std::string& hash, const unsigned char* data, size_t len, bool& existed) {
+    existed = storedSize(hash) >= 0;
+    if (existed) return true;
+
+    std::string tempPath;
+    int fd = BlobStore::create(tempPath);
+    if (fd < 0) return false;
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(fd, data + written, len - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "[ChunkStore] Write chunk failed: " << strerror(errno) << std::endl;
+            close(fd);
+            BlobStore::discard(tempPath);
+            return false;
+        }
+        written += n;
+    }
+    close(fd);
+    // Hai blob cùng ghi một chunk mới: nội dung như nhau, rename sau thắng cũng không sao
+    return BlobStore::commitTo(tempPath, pathOf(hash));
+}
+
+bool ChunkStore::storeUploaded(const std::string& tempPath, const std::string& hash, long long size,
+                               long long user_id) {
+    std::vector<unsigned char> data(size);
+    int fd = open(tempPath.c_str(), O_RDONLY | O_CLOEXEC);
+    ssize_t got = fd >= 0 ? pread(fd, data.data(), data.size(), 0) : -1;
+    if (fd >= 0) close(fd);
+
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    if (got != static_cast<ssize_t>(size) ||
+        toHex(SHA256(data.data(), data.size(), digest)) != hash) {
+        std::cerr << "[ChunkStore] Uploaded chunk does not match " << hash << std::endl;
+        BlobStore::discard(tempPath);
+        return false;
+    }
+    // Kể cả khi kho chung đã có: user vẫn phải gửi đủ dữ liệu mới được dùng chunk này
+    return DBManager::getInstance().addPendingChunk(user_id, hash, size, tempPath, pendingPathOf(user_id, hash));
+}
+
+bool ChunkStore::promotePending(long long user_id, const std::string& hash) {
+    std::string pending = pendingPathOf(user_id, hash);
+    struct stat st;
+    // Không còn file pending: lần STOR_CHUNKED trước đã chuyển đi nhưng transaction không commit
+    if (stat(pending.c_str(), &st) != 0) return storedSize(hash) >= 0;
+    if (storedSize(hash) >= 0) {
+        BlobStore::discard(pending);
+        return true;
+    }
+    return BlobStore::commitTo(pending, pathOf(hash));
+}
+
+bool ChunkStore::readManifest(const std::string& manifestPath, long count, std::vector<ChunkRef>& chunks) {
+    std::vector<unsigned char> raw(count * DIGEST_BYTES);
+    int fd = open(manifestPath.c_str(), O_RDONLY | O_CLOEXEC);
+    ssize_t got = fd >= 0 ? pread(fd, raw.data(), raw.size(), 0) : -1;
+    if (fd >= 0) close(fd);
+    BlobStore::discard(manifestPath);
+    if (got != static_cast<ssize_t>(raw.size())) return false;
+
+    chunks.clear();
+    chunks.reserve(count);
+    for (long i = 0; i < count; i++) {
+        chunks.push_back({toHex(raw.data() + i * DIGEST_BYTES), -1});
+    }
+    return true;
+}
+
+void ChunkStore::start() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (running) return;
+    running = true;
+    thread = std::thread(&ChunkStore::ingestLoop, this);
+    std::cout << "[ChunkStore] Chunk thread started" << std::endl;
+}
+
+void ChunkStore::stop() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running) return;
+        running = false;
+        queue.clear();
+    }
+    queueCv.notify_all();
+    if (thread.joinable()) thread.join();
+    std::cout << "[ChunkStore] Chunk thread stopped" << std::endl;
+}
+
+void ChunkStore::scheduleIngest(long long blob_id, long long size) {
+    if (!ServerConfig::CHUNK_DEDUP || size < ServerConfig::DEDUP_MIN_BLOB_BYTES) return;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running || queue.size() >= ServerConfig::DEDUP_QUEUE_CAPACITY) return;
+        queue.push_back(blob_id);
+    }
+    queueCv.notify_one();
+}
+
+void ChunkStore::ingestLoop() {
+    auto nextSweep = std::chrono::steady_clock::now();
+    while (true) {
+        long long blob_id = -1;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCv.wait_until(lock, nextSweep, [this] { return !running || !queue.empty(); });
+            if (!running) return;
+            if (!queue.empty()) {
+                blob_id = queue.front();
+                queue.pop_front();
+            }
+        }
+        if (blob_id >= 0 && !ingest(blob_id)) ingestFailures++;
+
+        // Hàng đợi dài không làm trễ việc dọn: kiểm tra sau mỗi blob
+        auto now = std::chrono::steady_clock::now();
+        if (now >= nextSweep) {
+            sweepPending();
+            collectUnreferenced();
+            nextSweep = now + std::chrono::seconds(ServerConfig::PENDING_CHUNK_SWEEP_SECONDS);
+        }
+    }
+}
+
+void ChunkStore::sweepPending() {
+    DBManager& db = DBManager::getInstance();
+    const int ttl = ServerConfig::PENDING_CHUNK_TTL_SECONDS;
+    // Mỗi lượt tối đa 1000 dòng, phần còn lại để lượt sau
+    for (const auto& [user_id, hash] : db.getExpiredPendingChunks(ttl, 1000)) {
+        if (db.dropPendingChunk(user_id, hash, ttl, pendingPathOf(user_id, hash))) pendingExpired++;
+    }
+}
+
+void ChunkStore::collectUnreferenced() {
+    // Mỗi lượt tối đa 1000 chunk như sweepPending, phần còn lại để lượt sau
+    long long dropped = DBManager::getInstance().dropUnreferencedChunks(1000);
+    if (dropped > 0) chunksCollected += dropped;
+}
+
+bool ChunkStore::ingest(long long blob_id) {
+    std::string blobPath = BlobStore::pathOf(blob_id);
+    int fd = open(blobPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "[ChunkStore] Cannot open blob " << blob_id << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Cửa sổ CHUNK_MAX_BYTES: cắt chunk đầu, dời phần còn lại lên đầu rồi đọc tiếp cho đầy
+    std::vector<unsigned char> buf(CHUNK_MAX_BYTES);
+    std::vector<ChunkRef> chunks;
+    size_t have = 0;
+    off_t readPos = 0;
+    bool eof = false;
+    long long written = 0, reused = 0, reusedBytes = 0;
+
+    while (true) {
+        while (!eof && have < buf.size()) {
+            ssize_t n = pread(fd, buf.data() + have, buf.size() - have, readPos);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                std::cerr << "[ChunkStore] Read blob " << blob_id << " failed: " << strerror(errno) << std::endl;
+                close(fd);
+                return false;
+            }
+            if (n == 0) eof = true;
+            have += n;
+            readPos += n;
+        }
+        if (have == 0) break;
+
+        size_t len = cutPoint(buf.data(), have);
+        unsigned char digest[SHA256_DIGEST_LENGTH];
+        std::string hash = toHex(SHA256(buf.data(), len, digest));
+        bool existed = false;
+        if (!putChunk(hash, buf.data(), len, existed)) {
+            close(fd);
+            return false;
+        }
+        if (existed) {
+            reused++;
+            reusedBytes += len;
+        } else {
+            written++;
+        }
+        chunks.push_back({hash, static_cast<long long>(len)});
+
+        memmove(buf.data(), buf.data() + len, have - len);
+        have -= len;
+    }
+    close(fd);
+
+    if (chunks.empty() || !DBManager::getInstance().storeChunkManifest(blob_id, chunks)) return false;
+    // Manifest đã commit: BlobReader mở sau đây đi theo chunk, reader đang giữ fd của blob vẫn đọc xong
+    BlobStore::unlink(blob_id);
+
+    blobsIngested++;
+    chunksWritten += written;
+    chunksReused += reused;
+    bytesReused += reusedBytes;
+    std::cout << "[ChunkStore] Blob " << blob_id << ": " << chunks.size() << " chunks, " << reused
+              << " already stored (" << reusedBytes << " bytes deduplicated)" << std::endl;
+    return true;
+}
+
+void ChunkStore::printStats() {
+    size_t depth;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        depth = queue.size();
+    }
+    std::cout << "Chunk Store:        " << blobsIngested.load() << " blobs chunked, " << chunksWritten.load()
+              << " chunks written, " << chunksReused.load() << " reused (" << (bytesReused.load() / 1024.0 / 1024.0)
+              << " MB saved), " << ingestFailures.load() << " failed, queue " << depth << ", "
+              << pendingExpired.load() << " expired uploads, " << chunksCollected.load() << " unreferenced removed\n";
+}
@@ -0,0 +1,228 @@
+#include "../../include/zero_copy_io.h"
+#include "../../../../Common/Protocol.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <endian.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+// Mỗi syscall tối đa 8MB để vòng lặp vẫn kiểm tra lỗi/EAGAIN đều đặn
+static constexpr size_t MAX_CHUNK_PER_CALL = 8 * 1024 * 1024;
+static constexpr size_t FALLBACK_BUFFER_SIZE = 65536;
+// Pipe lớn hơn mặc định (64KB) để mỗi cặp splice() chuyển được nhiều dữ liệu hơn
+static constexpr int SPLICE_PIPE_SIZE = 1024 * 1024;
+
+bool SplicePipe::open() {
+    if (isOpen()) return true;
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) return false;
+    readFd = fds[0];
+    writeFd = fds[1];
+    fcntl(writeFd, F_SETPIPE_SZ, SPLICE_PIPE_SIZE);  // không bắt buộc, lỗi thì giữ mặc định
+    return true;
+}
+
+void SplicePipe::close() {
+    if (readFd >= 0) ::close(readFd);
+    if (writeFd >= 0) ::close(writeFd);
+    readFd = writeFd = -1;
+}
+
+bool ZeroCopyIO::sendAll(int sockFd, const void* data, size_t len, int flags) {
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = ::send(sockFd, p, len, flags | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// file -> pipe -> socket. Dữ liệu kẹt trong pipe khi socket báo EAGAIN được bỏ đi
+// và *offset lùi lại tương ứng: file đọc lại được nên không cần giữ state giữa các lần gọi.
+static ssize_t spliceFileToSocket(int sockFd, int fileFd, off_t* offset, size_t want, SplicePipe& pipe) {
+    ssize_t inPipe = splice(fileFd, offset, pipe.writeFd, nullptr, want, SPLICE_F_MOVE);
+    if (inPipe <= 0) return inPipe;
+
+    ssize_t pushed = 0;
+    while (pushed < inPipe) {
+        ssize_t n = splice(pipe.readFd, nullptr, sockFd, nullptr, inPipe - pushed,
+                           SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            int savedErrno = errno;
+            *offset -= (inPipe - pushed);
+            pipe.close();  // bỏ phần dữ liệu còn trong pipe
+            errno = savedErrno;
+            return pushed > 0 ? pushed : -1;
+        }
+        pushed += n;
+    }
+    return pushed;
+}
+
+static ssize_t copyFileToSocket(int sockFd, int fileFd, off_t* offset, size_t want) {
+    char buffer[FALLBACK_BUFFER_SIZE];
+    ssize_t n = pread(fileFd, buffer, std::min(want, sizeof(buffer)), *offset);
+    if (n <= 0) return n;
+
+    ssize_t sent = 0;
+    while (sent < n) {
+        ssize_t s = ::send(sockFd, buffer + sent, n - sent, MSG_NOSIGNAL);
+        if (s < 0) {
+            if (errno == EINTR) continue;
+            if (sent > 0) break;  // chỉ tiến offset theo phần đã gửi thật
+            return -1;
+        }
+        sent += s;
+    }
+    *offset += sent;
+    return sent;
+}
+
+long long ZeroCopyIO::sendFileRange(int sockFd, int fileFd, off_t* offset, size_t count) {
+    enum class Mode { Sendfile, Splice, Copy } mode = Mode::Sendfile;
+    SplicePipe pipe;
+    size_t total = 0;
+
+    while (total < count) {
+        size_t want = std::min(count - total, MAX_CHUNK_PER_CALL);
+        ssize_t n = -1;
+
+        if (mode == Mode::Sendfile) {
+            n = ::sendfile(sockFd, fileFd, offset, want);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                mode = Mode::Splice;  // FS không hỗ trợ sendfile
+                continue;
+            }
+        } else if (mode == Mode::Splice) {
+            if (!pipe.open()) {
+                mode = Mode::Copy;
+                continue;
+            }
+            n = spliceFileToSocket(sockFd, fileFd, offset, want, pipe);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                mode = Mode::Copy;
+                continue;
+            }
+        } else {
+            n = copyFileToSocket(sockFd, fileFd, offset, want);
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return total;
+            return -1;
+        }
+        if (n == 0) {
+            errno = 0;  // EOF: file ngắn hơn kích thước đã báo
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+bool ZeroCopyIO::sendHeaderAndFile(int sockFd, const std::string& header, int fileFd, size_t fileSize) {
+    // MSG_MORE: header nằm chung segment với những byte payload đầu tiên
+    int flags = fileSize > 0 ? MSG_MORE : 0;
+    if (!sendAll(sockFd, header.data(), header.size(), flags)) return false;
+    if (fileSize == 0) return true;
+
+    off_t offset = 0;
+    return sendFileRange(sockFd, fileFd, &offset, fileSize) == static_cast<long long>(fileSize);
+}
+
+static long long copySocketToFile(int sockFd, int fileFd, off_t* offset, size_t count) {
+    char buffer[FALLBACK_BUFFER_SIZE];
+    ssize_t n;
+    do {
+        n = ::read(sockFd, buffer, std::min(count, sizeof(buffer)));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return n;
+
+    ssize_t written = 0;
+    while (written < n) {
+        ssize_t w = pwrite(fileFd, buffer + written, n - written, *offset);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        written += w;
+        *offset += w;
+    }
+    return written;
+}
+
+long long ZeroCopyIO::receiveToFile(int sockFd, int fileFd, off_t* offset, size_t count, SplicePipe* pipe) {
+    if (count == 0) return 0;
+    if (!pipe || !pipe->open()) {
+        return copySocketToFile(sockFd, fileFd, offset, count);
+    }
+
+    // Socket blocking: splice() chờ tới khi có dữ liệu như read().
+    // Socket non-blocking: SPLICE_F_NONBLOCK để trả EAGAIN thay vì chặn.
+    unsigned int flags = SPLICE_F_MOVE;
+    if (fcntl(sockFd, F_GETFL) & O_NONBLOCK) flags |= SPLICE_F_NONBLOCK;
+
+    ssize_t inPipe;
+    do {
+        inPipe = splice(sockFd, nullptr, pipe->writeFd, nullptr,
+                        std::min(count, static_cast<size_t>(SPLICE_PIPE_SIZE)), flags);
+    } while (inPipe < 0 && errno == EINTR);
+
+    if (inPipe < 0 && (errno == EINVAL || errno == ENOSYS)) {
+        pipe->close();  // kernel/socket không hỗ trợ splice: dùng đường copy
+        return copySocketToFile(sockFd, fileFd, offset, count);
+    }
+    if (inPipe <= 0) return inPipe;
+
+    // Đẩy hết dữ liệu trong pipe xuống file (file thường luôn blocking)
+    ssize_t drained = 0;
+    while (drained < inPipe) {
+        ssize_t n = splice(pipe->readFd, nullptr, fileFd, offset, inPipe - drained, SPLICE_F_MOVE);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            pipe->close();
+            return -1;
+        }
+        drained += n;
+    }
+    return drained;
+}
+
+std::string ZeroCopyIO::buildFileHeader(const std::string& relativePath, uint64_t fileSize) {
+    std::string header;
+    header.reserve(1 + 4 + 8 + relativePath.size());
+    header.push_back(static_cast<char>(TYPE_FILE));
+    uint32_t nameLen = htonl(relativePath.length());
+    header.append(reinterpret_cast<const char*>(&nameLen), 4);
+    uint64_t netSize = htobe64(fileSize);
+    header.append(reinterpret_cast<const char*>(&netSize), 8);
+    header.append(relativePath);
+    return header;
+}
+
+std::string ZeroCopyIO::buildDirHeader(const std::string& relativePath) {
+    std::string header;
+    header.reserve(1 + 4 + relativePath.size());
+    header.push_back(static_cast<char>(TYPE_DIR));
+    uint32_t nameLen = htonl(relativePath.length());
+    header.append(reinterpret_cast<const char*>(&nameLen), 4);
+    header.append(relativePath);
+    return header;
+}
+
+void ZeroCopyIO::setCork(int sockFd, bool enabled) {
+    int flag = enabled ? 1 : 0;
+    setsockopt(sockFd, IPPROTO_TCP, TCP_CORK, &flag, sizeof(flag));
+}
@@ -1,10 +1,13 @@
 #include "../include/thread_manager.h"
 #include "../include/db_manager.h"
 #include "../include/thread_monitor.h"
+#include "../include/transfer_executor.h"
 #include "../include/server_config.h"
+#include "../include/chunk_store.h"
 #include <iostream>
 #include <thread>
 #include <csignal>
+#include <cstring>
 
 AcceptorThread* globalAcceptor = nullptr;
 
@@ -13,11 +16,38 @@ void signalHandler(int signum) {
     if (globalAcceptor) {
         globalAcceptor->stop();
     }
+    TransferExecutor::getInstance().stop();
+    ChunkStore::getInstance().stop();
     ThreadMonitor::getInstance().stop();
     exit(signum);
 }
 
-int main() {
+// --transfer-mode=dedicated|epoll (mặc định dedicated)
+static bool parseArgs(int argc, char* argv[]) {
+    const char* MODE_PREFIX = "--transfer-mode=";
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], MODE_PREFIX, strlen(MODE_PREFIX)) == 0) {
+            std::string mode = argv[i] + strlen(MODE_PREFIX);
+            if (mode == "dedicated") {
+                ServerConfig::transferMode = TransferMode::Dedicated;
+            } else if (mode == "epoll") {
+                ServerConfig::transferMode = TransferMode::Epoll;
+            } else {
+                std::cerr << "[Main] Unknown transfer mode: " << mode << std::endl;
+                return false;
+            }
+        } else {
+            std::cerr << "[Main] Unknown argument: " << argv[i] << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [--transfer-mode=dedicated|epoll]" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (!parseArgs(argc, argv)) return -1;
+    
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
     
@@ -25,6 +55,16 @@ int main() {
     std::cout << "[Main] ThreadMonitor started" << std::endl;
     
     if (!DBManager::getInstance().connect()) return -1;
+    if (!DBManager::getInstance().rebuildSearchIndex()) {
+        std::cerr << "[Main] WARNING: search index not built, SEARCH returns only files added from now on" << std::endl;
+    }
+
+    bool epollMode = ServerConfig::transferMode == TransferMode::Epoll;
+    if (!epollMode) {
+        TransferExecutor::getInstance().start(ServerConfig::MAX_DEDICATED_THREADS,
+                                              ServerConfig::TRANSFER_QUEUE_CAPACITY);
+    }
+    ChunkStore::getInstance().start();
 
     AcceptorThread acceptor(ServerConfig::SERVER_PORT);
     globalAcceptor = &acceptor;
@@ -35,8 +75,13 @@ int main() {
     std::cout << "  - Fixed Worker Pool (" 
               << ServerConfig::FIXED_WORKER_THREADS << " threads, load-balanced)" << std::endl;
     std::cout << "  - 1 MonitorThread (stats reporting)" << std::endl;
-    std::cout << "  - DedicatedThreads (created on-demand for file I/O, max " 
-              << ServerConfig::MAX_DEDICATED_THREADS << ")" << std::endl;
+    std::cout << "  - DB connection pool (" << ServerConfig::DB_POOL_SIZE << " connections)" << std::endl;
+    if (epollMode) {
+        std::cout << "  - Transfer mode: epoll (non-blocking transfers inside worker event loops)" << std::endl;
+    } else {
+        std::cout << "  - Transfer mode: dedicated (pool of " << ServerConfig::MAX_DEDICATED_THREADS
+                  << " threads for file I/O, queue " << ServerConfig::TRANSFER_QUEUE_CAPACITY << ")" << std::endl;
+    }
     
     acceptor.run(); // Hàm này có vòng lặp vô hạn accept()
 
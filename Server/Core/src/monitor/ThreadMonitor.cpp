@@ -1,5 +1,13 @@
 #include "thread_monitor.h"
 #include "thread_manager.h"
+#include "transfer_executor.h"
+#include "db_pool.h"
+#include "db_manager.h"
+#include "quota_ledger.h"
+#include "search_index.h"
+#include "chunk_store.h"
+#include "request_handler.h"
+#include <algorithm>
 
 void ThreadMonitor::start() {
     if (running.load()) {
@@ -40,9 +48,14 @@ void ThreadMonitor::reportDedicatedThreadStart() {
 
 void ThreadMonitor::reportDedicatedThreadEnd() {
     stats.activeDedicatedThreads--;
-    
-    std::lock_guard<std::mutex> lock(dedicatedMutex);
-    finishedThreadIds.insert(std::this_thread::get_id());
+}
+
+void ThreadMonitor::reportEpollTransferStart() {
+    stats.activeEpollTransfers++;
+}
+
+void ThreadMonitor::reportEpollTransferEnd() {
+    stats.activeEpollTransfers--;
 }
 
 void ThreadMonitor::reportConnectionCount(std::thread::id workerId, int count) {
@@ -73,28 +86,53 @@ void ThreadMonitor::reportBytesTransferred(long long bytes) {
     stats.totalBytesTransferred += bytes;
 }
 
+void ThreadMonitor::reportCommandLatency(const std::string& command, long long micros) {
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    LatencyWindow& w = commandLatency[command];
+    if (w.samples.size() < static_cast<size_t>(ServerConfig::LATENCY_SAMPLE_WINDOW)) {
+        w.samples.push_back(micros);
+    } else {
+        w.samples[w.next] = micros;
+    }
+    w.next = (w.next + 1) % ServerConfig::LATENCY_SAMPLE_WINDOW;
+    w.count++;
+}
+
+void ThreadMonitor::printLatencyStats() {
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    if (commandLatency.empty()) return;
+    
+    std::cout << "Command Latency (last " << ServerConfig::LATENCY_SAMPLE_WINDOW << " samples, us):\n";
+    for (const auto& entry : commandLatency) {
+        std::vector<long long> sorted = entry.second.samples;
+        std::sort(sorted.begin(), sorted.end());
+        size_t n = sorted.size();
+        std::cout << "  " << entry.first << ": p50 " << sorted[n / 2]
+                  << ", p99 " << sorted[std::min(n - 1, n * 99 / 100)]
+                  << ", max " << sorted[n - 1]
+                  << " (total " << entry.second.count << ")\n";
+    }
+}
+
 void ThreadMonitor::printStats() {
     std::cout << "\n========== SYSTEM STATS ==========\n";
     std::cout << "Worker Threads:     " << stats.activeWorkerThreads.load() << "\n";
     std::cout << "Dedicated Threads:  " << stats.activeDedicatedThreads.load() << "\n";
+    std::cout << "Epoll Transfers:    " << stats.activeEpollTransfers.load() << "\n";
     std::cout << "Total Connections:  " << stats.totalConnections.load() << "\n";
     std::cout << "Bytes Transferred:  " << stats.totalBytesTransferred.load() 
               << " bytes (" << (stats.totalBytesTransferred.load() / 1024.0 / 1024.0) << " MB)\n";
+    TransferExecutor::getInstance().printStats();
+    DBConnectionPool::getInstance().printStats();
+    DBManager::getInstance().printCacheStats();
+    QuotaLedger::getInstance().printStats();
+    SearchIndex::getInstance().printStats();
+    ChunkStore::getInstance().printStats();
+    std::cout << "Folder Share:       " << FolderShareHandler::getInstance().sessionCount() << " sessions\n";
+    printLatencyStats();
     std::cout << "==================================\n" << std::endl;
 }
 
-bool ThreadMonitor::canCreateDedicatedThread() {
-    int dedicated = stats.activeDedicatedThreads.load();
-    
-    if (dedicated >= MAX_DEDICATED_THREADS) {
-        std::cout << "[Monitor]  Cannot create DedicatedThread: limit reached (" 
-                  << dedicated << "/" << MAX_DEDICATED_THREADS << ")" << std::endl;
-        return false;
-    }
-    
-    return true;
-}
-
 void ThreadMonitor::monitorLoop() {
     using namespace std::chrono;
     
@@ -111,8 +149,6 @@ void ThreadMonitor::monitorLoop() {
             printStats();
             lastPrintTime = now;
         }
-        
-        cleanupFinishedThreads();
     }
 }
 
@@ -135,31 +171,3 @@ void ThreadMonitor::unregisterWorkerThread(std::thread::id threadId) {
 int ThreadMonitor::getActiveWorkerCount() const {
     return stats.activeWorkerThreads.load();
 }
-
-void ThreadMonitor::registerDedicatedThread(std::thread::id threadId, std::thread&& thread) {
-    std::lock_guard<std::mutex> lock(dedicatedMutex);
-    dedicatedThreads.push_back(std::move(thread));
-    std::cout << "[Monitor] Dedicated thread registered. ID: " << threadId 
-              << " (Total active: " << stats.activeDedicatedThreads.load() << ")" << std::endl;
-}
-
-void ThreadMonitor::cleanupFinishedThreads() {
-    std::lock_guard<std::mutex> lock(dedicatedMutex);
-    
-    for (auto it = dedicatedThreads.begin(); it != dedicatedThreads.end(); ) {
-        if (it->joinable()) {
-            std::thread::id tid = it->get_id();
-            
-            if (finishedThreadIds.count(tid) > 0) {
-                it->join();
-                std::cout << "[Monitor] Cleaned up finished dedicated thread: " << tid << std::endl;
-                finishedThreadIds.erase(tid);
-                it = dedicatedThreads.erase(it);
-            } else {
-                ++it;
-            }
-        } else {
-            it = dedicatedThreads.erase(it);
-        }
-    }
-}
@@ -1,10 +1,13 @@
 #include "../../include/thread_manager.h"
 #include "../../include/db_manager.h"
+#include "../../include/request_handler.h"
 #include "../../include/thread_monitor.h"
 #include "../../include/server_config.h"
+#include "../../include/zero_copy_io.h"
+#include "../../include/blob_store.h"
+#include "../../include/chunk_store.h"
 #include "../../../../Common/Protocol.h"
 #include <iostream>
-#include <fstream>
 #include <vector>
 #include <filesystem>
 #include <unistd.h>
@@ -17,95 +20,156 @@
 #include <fcntl.h>
 #include <cerrno>
 #include <netinet/tcp.h>
+#include <algorithm>
 
 #define BUFFER_SIZE ServerConfig::BUFFER_SIZE
 #define STORAGE_PATH ServerConfig::STORAGE_PATH
 
-void DedicatedThread::handleUpload(int socketFd, std::string filename, long filesize, std::string username, long long parent_id, WorkerThread* workerRef) {
+void DedicatedThread::handleUpload(int socketFd, std::string filename, long filesize, const ClientSession& session, long long parent_id, WorkerThread* workerRef) {
+    const std::string& username = session.username;
     std::cout << "[SERVER] ===== UPLOAD FILE HANDLER =====" << std::endl;
     std::cout << "[SERVER] Receiving: " << filename << " (" << filesize << " bytes) from user: " << username << std::endl;
     
     ThreadMonitor::getInstance().reportDedicatedThreadStart();
 
-    std::string path = std::string(STORAGE_PATH) + filename;
+    // Nhận vào file tạm, có file_id (addFile) rồi mới đưa vào BlobStore
+    std::string path;
+    int fileFd = BlobStore::create(path);
     
-    // Create parent directories if filename contains path separators
-    size_t lastSlash = path.find_last_of('/');
-    if (lastSlash != std::string::npos) {
-        std::string dirPath = path.substr(0, lastSlash);
-        
-        // Create directories recursively using C++17 filesystem
-        namespace fs = std::filesystem;
-        try {
-            fs::create_directories(dirPath);
-            std::cout << "[Dedicated] Created directory: " << dirPath << std::endl;
-        } catch (const std::exception& e) {
-            std::cerr << "[Dedicated] Failed to create directory: " << e.what() << std::endl;
-            std::string err = std::string(CODE_FAIL) + " Cannot create directory on server\n";
+    if (fileFd < 0) {
+        std::string err = std::string(CODE_FAIL) + " Cannot create file on server\n";
+        send(socketFd, err.c_str(), err.length(), 0);
+        close(socketFd);
+        ThreadMonitor::getInstance().reportDedicatedThreadEnd();
+        return;
+    }
+    
+    // Cấp phát trước theo kích thước STOR khai báo: hết chỗ thì báo lỗi ngay,
+    // và file không bị phân mảnh khi nhiều upload lớn chạy song song
+    if (fallocate(fileFd, 0, 0, filesize) < 0) {
+        if (errno == ENOSPC) {
+            std::cerr << "[Dedicated] Not enough disk space for " << filename << std::endl;
+            close(fileFd);
+            BlobStore::discard(path);
+            std::string err = std::string(CODE_FAIL) + " Not enough space on server\n";
             send(socketFd, err.c_str(), err.length(), 0);
             close(socketFd);
             ThreadMonitor::getInstance().reportDedicatedThreadEnd();
             return;
         }
+        // EOPNOTSUPP (tmpfs cũ, FS không hỗ trợ): bỏ qua, ghi bình thường
     }
     
-    std::ofstream outfile(path, std::ios::binary);
-    
-    if (!outfile.is_open()) {
-        std::string err = std::string(CODE_FAIL) + " Cannot create file on server\n";
-        send(socketFd, err.c_str(), err.length(), 0);
+    std::string msg = std::string(CODE_DATA_OPEN) + " Ready to receive data\n";
+    send(socketFd, msg.c_str(), msg.length(), 0);
+
+    long totalReceived = receiveBody(socketFd, fileFd, 0, filesize, true);
+    close(fileFd);
+
+    ThreadMonitor::getInstance().reportBytesTransferred(totalReceived);
+    ThreadMonitor::getInstance().reportDedicatedThreadEnd();
+
+    if (totalReceived < filesize) {
+        // Upload dở dang: không ghi vào DB, xóa file tạm, đóng kết nối (giống chế độ epoll)
+        std::cerr << "[SERVER] Upload aborted at " << totalReceived << "/" << filesize << " bytes: " << filename << std::endl;
+        BlobStore::discard(path);
         close(socketFd);
-        ThreadMonitor::getInstance().reportDedicatedThreadEnd();
         return;
     }
-    
-    std::string msg = std::string(CODE_DATA_OPEN) + " Ready to receive data\n";
+
+    long long file_id = DBManager::getInstance().addFile(filename, filesize, session.userId, parent_id, nullptr, &path);
+    if (file_id < 0) {
+        std::cerr << "[SERVER] Upload FAILED: Cannot save " << filename << std::endl;
+        msg = std::string(CODE_FAIL) + " Cannot save file on server\n";
+    } else {
+        ChunkStore::getInstance().scheduleIngest(file_id, filesize);
+        std::cout << "[SERVER] Upload SUCCESS: " << filename << " (" << filesize << " bytes)" << std::endl;
+        msg = std::string(CODE_TRANSFER_COMPLETE) + " Upload success\n";
+    }
     send(socketFd, msg.c_str(), msg.length(), 0);
 
-    char buffer[BUFFER_SIZE];
-    long totalReceived = 0;
+    returnToWorker(socketFd, session, workerRef);
+}
+
+long DedicatedThread::receiveBody(int socketFd, int fileFd, long alreadyReceived, long filesize, bool sendAcks) {
+    // socket -> pipe -> file, dữ liệu không đi qua user space
+    SplicePipe pipe;
+    SplicePipe* splicePipe = ServerConfig::ZERO_COPY_UPLOAD ? &pipe : nullptr;
+    
+    off_t offset = alreadyReceived;
+    long totalReceived = alreadyReceived;
     const long ACK_GROUP_SIZE = 1048576;
-    long bytesSinceLastAck = 0;
+    long bytesSinceLastAck = alreadyReceived % ACK_GROUP_SIZE;
     
     while (totalReceived < filesize) {
-        int bytesRead = read(socketFd, buffer, BUFFER_SIZE);
+        // Không đọc vượt mốc 1MB: client dừng chờ 151 ACK đúng tại mốc này
+        size_t want = std::min(filesize - totalReceived, ACK_GROUP_SIZE - bytesSinceLastAck);
+        long long bytesRead = ZeroCopyIO::receiveToFile(socketFd, fileFd, &offset, want, splicePipe);
         if (bytesRead <= 0) break;
 
-        outfile.write(buffer, bytesRead);
         totalReceived += bytesRead;
         bytesSinceLastAck += bytesRead;
         
-        if (bytesSinceLastAck >= ACK_GROUP_SIZE && totalReceived < filesize) {
-            std::string ack = std::string(CODE_CHUNK_ACK) + " Received " + std::to_string(totalReceived) + " bytes\n";
-            send(socketFd, ack.c_str(), ack.length(), 0);
+        if (bytesSinceLastAck >= ACK_GROUP_SIZE) {
+            if (sendAcks && totalReceived < filesize) {
+                std::string ack = std::string(CODE_CHUNK_ACK) + " Received " + std::to_string(totalReceived) + " bytes\n";
+                send(socketFd, ack.c_str(), ack.length(), 0);
+            }
             bytesSinceLastAck = 0;
         }
     }
+    return totalReceived;
+}
 
-    outfile.close();
+void DedicatedThread::handleTempUpload(int socketFd, const std::string& tempPath, long filesize,
+                                       const std::string& initialData, const TempUploadCommit& commit,
+                                       const ClientSession& session, WorkerThread* workerRef) {
+    std::cout << "[Dedicated] Upload to " << tempPath << " (" << filesize << " bytes)" << std::endl;
 
-    bool saved = DBManager::getInstance().addFile(filename, totalReceived, username, parent_id);
-    if (!saved) {
-        std::cerr << "[SERVER] Upload FAILED: Database save error for " << filename << std::endl;
-    } else {
-        std::cout << "[SERVER] Upload SUCCESS: " << filename << " (" << totalReceived << " bytes)" << std::endl;
+    ThreadMonitor::getInstance().reportDedicatedThreadStart();
+
+    int fileFd = BlobStore::openTemp(tempPath);
+    std::string err;
+    if (fileFd < 0) {
+        err = std::string(CODE_FAIL) + " Cannot create file on server\n";
+    } else if (fallocate(fileFd, 0, 0, filesize) < 0 && errno == ENOSPC) {
+        err = std::string(CODE_FAIL) + " Not enough space on server\n";
+    } else if (!initialData.empty() &&
+               pwrite(fileFd, initialData.data(), initialData.size(), 0) != static_cast<ssize_t>(initialData.size())) {
+        err = std::string(CODE_FAIL) + " Cannot write file on server\n";
+    }
+    if (!err.empty()) {
+        if (fileFd >= 0) close(fileFd);
+        BlobStore::discard(tempPath);
+        send(socketFd, err.c_str(), err.length(), 0);
+        ThreadMonitor::getInstance().reportDedicatedThreadEnd();
+        returnToWorker(socketFd, session, workerRef);
+        return;
     }
 
-    msg = std::string(CODE_TRANSFER_COMPLETE) + " Upload success\n";
+    std::string msg = std::string(CODE_DATA_OPEN) + " Ready to receive\n";
     send(socketFd, msg.c_str(), msg.length(), 0);
-    
-    ThreadMonitor::getInstance().reportBytesTransferred(filesize);
+
+    // Client gửi một mạch, không chờ 151 ACK
+    long totalReceived = receiveBody(socketFd, fileFd, static_cast<long>(initialData.size()), filesize, false);
+    close(fileFd);
+
+    ThreadMonitor::getInstance().reportBytesTransferred(totalReceived);
     ThreadMonitor::getInstance().reportDedicatedThreadEnd();
-    
-    if (workerRef) {
-        ClientSession restoredSession;
-        restoredSession.socketFd = socketFd;
-        restoredSession.username = username;
-        restoredSession.isAuthenticated = true;
-        
-        workerRef->addClient(socketFd, restoredSession);
-        std::cout << "[Dedicated] Socket " << socketFd << " returned with session (user: " << username << ")" << std::endl;
+
+    if (totalReceived < filesize) {
+        // Mất kết nối giữa chừng: không còn luồng lệnh để trả lời
+        std::cerr << "[Dedicated] Connection lost during upload to " << tempPath << " (" << totalReceived << "/"
+                  << filesize << " bytes)" << std::endl;
+        BlobStore::discard(tempPath);
+        close(socketFd);
+        return;
     }
+
+    msg = commit();
+    send(socketFd, msg.c_str(), msg.length(), 0);
+
+    returnToWorker(socketFd, session, workerRef);
 }
 
 void DedicatedThread::sendFile(int socketFd, const std::string& fullPath, const std::string& relativePath) {
@@ -121,46 +185,20 @@ void DedicatedThread::sendFile(int socketFd, const std::string& fullPath, const
     fstat(fd, &st);
     uint64_t fileSize = st.st_size;
 
-    // Send TYPE_FILE
-    uint8_t type = TYPE_FILE;
-    send(socketFd, &type, 1, 0);
-
-    // Send name length
-    uint32_t nameLen = htonl(relativePath.length());
-    send(socketFd, &nameLen, 4, 0);
-
-    // Send file size
-    uint64_t netSize = htobe64(fileSize);
-    send(socketFd, &netSize, 8, 0);
-
-    // Send name
-    send(socketFd, relativePath.c_str(), relativePath.length(), 0);
-
-    // Send file data
-    char buffer[65536];
-    ssize_t n;
-    uint64_t totalSent = 0;
-    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
-        send(socketFd, buffer, n, 0);
-        totalSent += n;
+    // Header TYPE_FILE + dữ liệu file đi chung segment, payload qua sendfile()
+    std::string header = ZeroCopyIO::buildFileHeader(relativePath, fileSize);
+    if (!ZeroCopyIO::sendHeaderAndFile(socketFd, header, fd, fileSize)) {
+        std::cerr << "[DedicatedThread] Failed to send file: " << relativePath << " - " << strerror(errno) << std::endl;
     }
 
     close(fd);
-    std::cout << "[DedicatedThread] File sent: " << relativePath << " (" << totalSent << " bytes)" << std::endl;
+    std::cout << "[DedicatedThread] File sent: " << relativePath << " (" << fileSize << " bytes)" << std::endl;
 }
 
 void DedicatedThread::sendDirectory(int socketFd, const std::string& basePath, const std::string& relativePath) {
     std::cout << "[DedicatedThread] Sending directory: " << relativePath << std::endl;
-    // Send TYPE_DIR
-    uint8_t type = TYPE_DIR;
-    send(socketFd, &type, 1, 0);
-
-    // Send name length
-    uint32_t nameLen = htonl(relativePath.length());
-    send(socketFd, &nameLen, 4, 0);
-
-    // Send name
-    send(socketFd, relativePath.c_str(), relativePath.length(), 0);
+    std::string header = ZeroCopyIO::buildDirHeader(relativePath);
+    ZeroCopyIO::sendAll(socketFd, header.data(), header.size(), MSG_MORE);
 
     // Build full path
     std::string fullPath = basePath + "/" + relativePath;
@@ -195,192 +233,161 @@ void DedicatedThread::sendDirectory(int socketFd, const std::string& basePath, c
     closedir(dir);
 }
 
-// Gửi file từ storage, dùng filename đã lưu trong DB
-void DedicatedThread::sendFileFromDb(int socketFd, const std::string& filename, const std::string& relativePath) {
-    std::string fullPath = std::string(STORAGE_PATH) + filename;
-    std::cout << "[DedicatedThread] Sending file from DB: " << relativePath << " (path: " << fullPath << ")" << std::endl;
+// Gửi file từ BlobStore theo blob_id đã lưu trong DB
+bool DedicatedThread::sendFileFromDb(int socketFd, long long blob_id, const std::string& filename, const std::string& relativePath) {
+    std::cout << "[DedicatedThread] Sending file from DB: " << relativePath << " (blob: " << blob_id << ")" << std::endl;
     
     // Kiểm tra file tồn tại TRƯỚC khi gửi header
-    int fd = open(fullPath.c_str(), O_RDONLY);
-    if (fd < 0) {
-        std::cerr << "[DedicatedThread] File not found on disk, skipping: " << fullPath << " - " << strerror(errno) << std::endl;
+    BlobReader blob;
+    if (!blob.open(blob_id, filename)) {
+        std::cerr << "[DedicatedThread] File not found on disk, skipping: blob " << blob_id << " - " << strerror(errno) << std::endl;
         // KHÔNG gửi gì cả, skip file này
-        return;
+        return true;
     }
-
-    struct stat st;
-    fstat(fd, &st);
-    uint64_t fileSize = st.st_size;
-
-    // File tồn tại, bây giờ mới gửi header
-    // Send TYPE_FILE
-    uint8_t type = TYPE_FILE;
-    send(socketFd, &type, 1, 0);
-
-    // Send name length
-    uint32_t nameLen = htonl(relativePath.length());
-    send(socketFd, &nameLen, 4, 0);
-
-    // Send file size
-    uint64_t netSize = htobe64(fileSize);
-    send(socketFd, &netSize, 8, 0);
-
-    // Send name
-    send(socketFd, relativePath.c_str(), relativePath.length(), 0);
-
-    // Send file data
-    char buffer[65536];
-    ssize_t n;
-    uint64_t totalSent = 0;
-    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
-        send(socketFd, buffer, n, 0);
-        totalSent += n;
+    uint64_t fileSize = blob.size();
+
+    // File tồn tại, bây giờ mới gửi header (gộp với payload đầu tiên qua MSG_MORE)
+    std::string header = ZeroCopyIO::buildFileHeader(relativePath, fileSize);
+    off_t offset = 0;
+    if (!ZeroCopyIO::sendAll(socketFd, header.data(), header.size(), fileSize > 0 ? MSG_MORE : 0) ||
+        blob.sendRange(socketFd, &offset, fileSize) != static_cast<long long>(fileSize)) {
+        std::cerr << "[DedicatedThread] Failed to send file: " << relativePath << " at " << offset << "/" << fileSize
+                  << " bytes - " << strerror(errno) << std::endl;
+        return false;
     }
 
-    close(fd);
-    std::cout << "[DedicatedThread] File sent: " << relativePath << " (" << totalSent << " bytes)" << std::endl;
+    std::cout << "[DedicatedThread] File sent: " << relativePath << " (" << fileSize << " bytes)" << std::endl;
+    return true;
 }
 
-// Gửi directory đệ quy từ database
-void DedicatedThread::sendDirectoryFromDb(int socketFd, long long folder_id, const std::string& relativePath, const std::string& username) {
-    std::cout << "[DedicatedThread] Sending directory from DB: " << relativePath << " (id: " << folder_id << ")" << std::endl;
+// Gửi cây thư mục đã lấy sẵn từ database (getSubtree), không truy vấn DB giữa chừng
+bool DedicatedThread::sendDirectoryFromDb(int socketFd, const std::string& rootPath, const std::vector<SubtreeEntry>& subtree) {
+    std::cout << "[DedicatedThread] Sending directory from DB: " << rootPath << " (" << subtree.size() << " entries)" << std::endl;
     
-    // Send TYPE_DIR
-    uint8_t type = TYPE_DIR;
-    send(socketFd, &type, 1, 0);
-
-    // Send name length
-    uint32_t nameLen = htonl(relativePath.length());
-    send(socketFd, &nameLen, 4, 0);
-
-    // Send name
-    send(socketFd, relativePath.c_str(), relativePath.length(), 0);
-
-    // Lấy danh sách items trong folder từ database
-    auto items = DBManager::getInstance().getItemsInFolder(folder_id, username);
-    
-    for (const auto& item : items) {
-        std::string newRelPath = relativePath + "/" + item.name;
-        
-        if (item.is_folder) {
-            // Đệ quy cho subfolder
-            sendDirectoryFromDb(socketFd, item.file_id, newRelPath, username);
-        } else {
-            // Gửi file - tên file trong storage = item.name
-            sendFileFromDb(socketFd, item.name, newRelPath);
+    std::string header = ZeroCopyIO::buildDirHeader(rootPath);
+    if (!ZeroCopyIO::sendAll(socketFd, header.data(), header.size(), MSG_MORE)) return false;
+
+    for (const auto& node : subtree) {
+        std::string relPath = rootPath + "/" + node.relativePath;
+        if (node.item.is_folder) {
+            header = ZeroCopyIO::buildDirHeader(relPath);
+            if (!ZeroCopyIO::sendAll(socketFd, header.data(), header.size(), MSG_MORE)) return false;
+        } else if (!sendFileFromDb(socketFd, node.blob_id, node.item.name, relPath)) {
+            return false;
         }
     }
+    return true;
 }
 
-void DedicatedThread::handleFolderDownload(int socketFd, long long folder_id, const std::string& folderName, const std::string& username, WorkerThread* workerRef) {
+void DedicatedThread::handleFolderDownload(int socketFd, long long folder_id, const std::string& folderName,
+                                           const ClientSession& session, WorkerThread* workerRef) {
     std::cout << "[DedicatedThread] Downloading folder from DB: id=" << folder_id << ", name=" << folderName << std::endl;
     
     ThreadMonitor::getInstance().reportDedicatedThreadStart();
+
+    // Lấy cả cây trước khi mở luồng dữ liệu: socket không phải chờ DB giữa các file
+    auto subtree = DBManager::getInstance().getSubtree(folder_id);
     
-    // Disable Nagle's algorithm for immediate sending
-    int flag = 1;
-    setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(int));
+    // Cork cả luồng: các header TYPE_DIR/TYPE_FILE nhỏ được gom chung segment với dữ liệu
+    ZeroCopyIO::setCork(socketFd, true);
+
+    std::string ready = std::string(CODE_DATA_OPEN) + " Ready to send folder\n";
+    ZeroCopyIO::sendAll(socketFd, ready.data(), ready.size(), MSG_MORE);
 
-    // Gửi folder đệ quy từ database
-    sendDirectoryFromDb(socketFd, folder_id, folderName, username);
+    bool sent = sendDirectoryFromDb(socketFd, folderName, subtree);
 
-    // Send TYPE_END
+    // Send TYPE_END, bỏ cork để flush phần còn lại
     uint8_t type = TYPE_END;
-    ssize_t sent = send(socketFd, &type, 1, 0);
-    std::cout << "[DedicatedThread] Sent TYPE_END (bytes sent: " << sent << ")" << std::endl;
+    sent = sent && ZeroCopyIO::sendAll(socketFd, &type, 1);
+    ZeroCopyIO::setCork(socketFd, false);
+    ThreadMonitor::getInstance().reportDedicatedThreadEnd();
 
+    if (!sent) {
+        // Client đang đọc giữa một file: không còn đồng bộ khung lệnh, đóng kết nối như TransferStateMachine
+        std::cerr << "[DedicatedThread] Folder download aborted: " << folderName << std::endl;
+        close(socketFd);
+        return;
+    }
     std::cout << "[DedicatedThread] Folder download completed: " << folderName << std::endl;
     
-    ThreadMonitor::getInstance().reportDedicatedThreadEnd();
+    returnToWorker(socketFd, session, workerRef);
+}
+
+void DedicatedThread::waitForChunkAck(int socketFd) {
+    char ackBuf[256];
+    fd_set readfds;
+    struct timeval tv;
+    FD_ZERO(&readfds);
+    FD_SET(socketFd, &readfds);
+    tv.tv_sec = 3;
+    tv.tv_usec = 0;
     
-    // Trả socket về cho worker thay vì close
-    if (workerRef) {
-        ClientSession restoredSession;
-        restoredSession.socketFd = socketFd;
-        restoredSession.username = username;
-        restoredSession.isAuthenticated = true;
-        
-        workerRef->addClient(socketFd, restoredSession);
-        std::cout << "[DedicatedThread] Socket " << socketFd << " returned to worker (user: " << username << ")" << std::endl;
+    int ret = select(socketFd + 1, &readfds, NULL, NULL, &tv);
+    if (ret > 0) {
+        int n = recv(socketFd, ackBuf, sizeof(ackBuf) - 1, 0);
+        if (n > 0) {
+            ackBuf[n] = '\0';
+        }
     }
 }
 
-void DedicatedThread::handleDownload(int socketFd, std::string filename, std::string username, WorkerThread* workerRef) {
+void DedicatedThread::handleDownload(int socketFd, long long blob_id, std::string filename, const ClientSession& session, WorkerThread* workerRef, bool expectAcks) {
     ThreadMonitor::getInstance().reportDedicatedThreadStart();
 
-    std::string path = std::string(STORAGE_PATH) + filename;
-
-    std::ifstream infile(path, std::ios::binary | std::ios::ate);
-    if (!infile.is_open()) {
+    BlobReader blob;
+    if (!blob.open(blob_id, filename)) {
         std::string err = std::string(CODE_FAIL) + " File not found on server\n";
         send(socketFd, err.c_str(), err.length(), 0);
         
-        if (workerRef) {
-            ClientSession restoredSession;
-            restoredSession.socketFd = socketFd;
-            restoredSession.username = username;
-            restoredSession.isAuthenticated = true;
-            workerRef->addClient(socketFd, restoredSession);
-        }
+        returnToWorker(socketFd, session, workerRef);
         ThreadMonitor::getInstance().reportDedicatedThreadEnd();
         return;
     }
 
-    long filesize = infile.tellg();
-    infile.seekg(0, std::ios::beg);
+    long filesize = blob.size();
 
+    // Dòng 150 đi riêng: client RETR đọc status line rồi mới chờ dữ liệu mới
     std::string msg = std::string(CODE_DATA_OPEN) + " " + std::to_string(filesize) + "\n";
-    send(socketFd, msg.c_str(), msg.length(), 0);
+    ZeroCopyIO::sendAll(socketFd, msg.c_str(), msg.length());
 
-    char buffer[BUFFER_SIZE];
-    long totalSent = 0;
+    // Gửi theo nhóm 1MB qua sendfile(); client RETR ACK (151) sau mỗi nhóm
     const long ACK_GROUP_SIZE = 1048576;
-    long bytesSinceLastAck = 0;
+    off_t offset = 0;
     
-    while (!infile.eof()) {
-        infile.read(buffer, BUFFER_SIZE);
-        int bytesRead = infile.gcount();
-        if (bytesRead > 0) {
-            send(socketFd, buffer, bytesRead, 0);
-            totalSent += bytesRead;
-            bytesSinceLastAck += bytesRead;
-            
-            if (bytesSinceLastAck >= ACK_GROUP_SIZE && totalSent < filesize) {
-                char ackBuf[256];
-                fd_set readfds;
-                struct timeval tv;
-                FD_ZERO(&readfds);
-                FD_SET(socketFd, &readfds);
-                tv.tv_sec = 3;
-                tv.tv_usec = 0;
-                
-                int ret = select(socketFd + 1, &readfds, NULL, NULL, &tv);
-                if (ret > 0) {
-                    int n = recv(socketFd, ackBuf, sizeof(ackBuf) - 1, 0);
-                    if (n > 0) {
-                        ackBuf[n] = '\0';
-                    }
-                }
-                bytesSinceLastAck = 0;
-            }
+    while (offset < filesize) {
+        long remaining = filesize - offset;
+        size_t group = expectAcks ? std::min(ACK_GROUP_SIZE, remaining) : remaining;
+        long long sent = blob.sendRange(socketFd, &offset, group);
+        if (sent < static_cast<long long>(group)) {
+            // Không được báo 226 cho thân file bị cắt, socket cũng không trả về worker được nữa
+            std::cerr << "[Dedicated] Download aborted at " << offset << "/" << filesize
+                      << " bytes: " << strerror(errno) << std::endl;
+            ThreadMonitor::getInstance().reportBytesTransferred(offset);
+            ThreadMonitor::getInstance().reportDedicatedThreadEnd();
+            close(socketFd);
+            return;
+        }
+        
+        if (expectAcks && offset < filesize) {
+            waitForChunkAck(socketFd);
         }
     }
     
-    infile.close();
+    blob.close();
 
     msg = std::string(CODE_TRANSFER_COMPLETE) + " Download success\n";
     send(socketFd, msg.c_str(), msg.length(), 0);
 
-    ThreadMonitor::getInstance().reportBytesTransferred(filesize);
+    ThreadMonitor::getInstance().reportBytesTransferred(offset);
     ThreadMonitor::getInstance().reportDedicatedThreadEnd();
     
+    returnToWorker(socketFd, session, workerRef);
+}
+
+void DedicatedThread::returnToWorker(int socketFd, const ClientSession& session, WorkerThread* workerRef) {
+    // Trả socket về cho worker thay vì close, giữ nguyên trạng thái đăng nhập
     if (workerRef) {
-        ClientSession restoredSession;
-        restoredSession.socketFd = socketFd;
-        restoredSession.username = username;
-        restoredSession.isAuthenticated = true;
-        
-        workerRef->addClient(socketFd, restoredSession);
-        std::cout << "[Dedicated] Socket " << socketFd << " returned with session (user: " << username << ")" << std::endl;
+        workerRef->addClient(socketFd, session);
+        std::cout << "[Dedicated] Socket " << socketFd << " returned with session (user: " << session.username << ")" << std::endl;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,133 @@
+#include "../../include/transfer_executor.h"
+#include "../../include/server_config.h"
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+
+static const char* PRIORITY_NAMES[] = {"High", "Normal", "Low"};
+
+void TransferExecutor::start(int threadCount, size_t queueCapacity) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (running) {
+        std::cout << "[Transfer] Executor already running!" << std::endl;
+        return;
+    }
+
+    running = true;
+    capacity = queueCapacity;
+    threads.reserve(threadCount);
+    for (int i = 0; i < threadCount; i++) {
+        threads.emplace_back(&TransferExecutor::workerLoop, this);
+    }
+    std::cout << "[Transfer] Executor started: " << threadCount << " threads, queue capacity "
+              << queueCapacity << std::endl;
+}
+
+void TransferExecutor::stop() {
+    std::vector<Task> dropped;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running) return;
+        running = false;
+        for (auto& q : queues) {
+            for (auto& task : q) dropped.push_back(std::move(task));
+            q.clear();
+        }
+        queuedCount = 0;
+    }
+    queueCv.notify_all();
+
+    // Socket đã gỡ khỏi epoll của worker khi submit: không ai khác còn đóng nó
+    for (const Task& task : dropped) {
+        if (task.fd >= 0) close(task.fd);
+    }
+    if (!dropped.empty()) {
+        std::cout << "[Transfer] Dropped " << dropped.size() << " queued transfers, sockets closed" << std::endl;
+    }
+
+    for (auto& t : threads) {
+        if (t.joinable()) t.join();
+    }
+    threads.clear();
+    std::cout << "[Transfer] Executor stopped" << std::endl;
+}
+
+bool TransferExecutor::submit(TransferPriority priority, int fd, std::function<void()> task) {
+    int idx = static_cast<int>(priority);
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running || queuedCount >= capacity) {
+            stats[idx].rejected++;
+            std::cout << "[Transfer] Queue full (" << queuedCount << "/" << capacity
+                      << "), rejecting " << PRIORITY_NAMES[idx] << " transfer" << std::endl;
+            return false;
+        }
+
+        queues[idx].push_back({std::move(task), fd, std::chrono::steady_clock::now()});
+        queuedCount++;
+        stats[idx].submitted++;
+        stats[idx].maxDepth = std::max(stats[idx].maxDepth, queues[idx].size());
+    }
+    queueCv.notify_one();
+    return true;
+}
+
+int TransferExecutor::pickQueue() {
+    // Chống starvation: task ưu tiên thấp đã chờ quá lâu được chạy trước
+    auto now = std::chrono::steady_clock::now();
+    auto limit = std::chrono::milliseconds(ServerConfig::TRANSFER_STARVATION_MS);
+    for (int i = PRIORITY_COUNT - 1; i > 0; i--) {
+        if (!queues[i].empty() && now - queues[i].front().enqueuedAt >= limit) {
+            return i;
+        }
+    }
+
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        if (!queues[i].empty()) return i;
+    }
+    return -1;
+}
+
+void TransferExecutor::workerLoop() {
+    while (true) {
+        Task task;
+        int idx;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCv.wait(lock, [this] { return !running || queuedCount > 0; });
+            if (!running) return;
+
+            idx = pickQueue();
+            task = std::move(queues[idx].front());
+            queues[idx].pop_front();
+            queuedCount--;
+        }
+
+        long long waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - task.enqueuedAt).count();
+        stats[idx].totalWaitMs += waitMs;
+        long long prevMax = stats[idx].maxWaitMs.load();
+        while (waitMs > prevMax && !stats[idx].maxWaitMs.compare_exchange_weak(prevMax, waitMs)) {}
+
+        busyThreads++;
+        task.fn();
+        busyThreads--;
+        stats[idx].completed++;
+    }
+}
+
+void TransferExecutor::printStats() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    std::cout << "Transfer Pool:      " << busyThreads.load() << "/" << threads.size()
+              << " busy, " << queuedCount << "/" << capacity << " queued\n";
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        const auto& s = stats[i];
+        long long started = s.submitted.load() - static_cast<long long>(queues[i].size());
+        long long avgWait = started > 0 ? s.totalWaitMs.load() / started : 0;
+        std::cout << "  [" << PRIORITY_NAMES[i] << "] depth " << queues[i].size()
+                  << " (max " << s.maxDepth << "), submitted " << s.submitted.load()
+                  << ", completed " << s.completed.load()
+                  << ", rejected " << s.rejected.load()
+                  << ", wait avg/max " << avgWait << "/" << s.maxWaitMs.load() << " ms\n";
+    }
+}
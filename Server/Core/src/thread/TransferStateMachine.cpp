@@ -0,0 +1,341 @@
+#include "../../include/transfer_state_machine.h"
+#include "../../include/db_manager.h"
+#include "../../include/thread_monitor.h"
+#include "../../include/server_config.h"
+#include "../../include/blob_store.h"
+#include "../../include/chunk_store.h"
+#include "../../../../Common/Protocol.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+// Giống DedicatedThread: client gửi/chờ 151 ACK sau mỗi 1MB, chờ ACK tối đa 3s
+static constexpr long ACK_GROUP_SIZE = 1048576;
+static constexpr int ACK_TIMEOUT_SECONDS = 3;
+// Không có ACK (guest, folder, PUT_CHUNK, STOR_CHUNKED): mỗi lượt chuyển tối đa 1MB rồi nhường event loop
+static constexpr long SLICE_BYTES = 1048576;
+
+TransferStateMachine::TransferStateMachine(int socketFd, int fileFd, State state)
+    : socketFd(socketFd), fileFd(fileFd), state(state) {
+    savedSocketFlags = fcntl(socketFd, F_GETFL);
+    fcntl(socketFd, F_SETFL, savedSocketFlags | O_NONBLOCK);
+    ThreadMonitor::getInstance().reportEpollTransferStart();
+}
+
+TransferStateMachine::~TransferStateMachine() {
+    if (fileFd >= 0) close(fileFd);
+    // Upload chưa nhận đủ (peer đóng, lỗi socket, timeout, removeClient): bỏ file tạm đã fallocate
+    if (state == State::Receiving && !path.empty()) BlobStore::discard(path);
+    if (corked) ZeroCopyIO::setCork(socketFd, false);
+    // Trả lại cờ socket như trước transfer (vòng lệnh của worker không dùng O_NONBLOCK)
+    if (savedSocketFlags >= 0) fcntl(socketFd, F_SETFL, savedSocketFlags);
+    ThreadMonitor::getInstance().reportBytesTransferred(bytesDone + offset);
+    ThreadMonitor::getInstance().reportEpollTransferEnd();
+}
+
+std::unique_ptr<TransferStateMachine> TransferStateMachine::createUpload(int socketFd, const std::string& filename, long filesize,
+                                                                        const ClientSession& session, long long parent_id,
+                                                                        std::shared_ptr<QuotaReservation> quota,
+                                                                        std::string& error) {
+    std::string path;
+    int fileFd = BlobStore::create(path);
+    if (fileFd < 0) {
+        error = std::string(CODE_FAIL) + " Cannot create file on server\n";
+        return nullptr;
+    }
+    if (fallocate(fileFd, 0, 0, filesize) < 0 && errno == ENOSPC) {
+        close(fileFd);
+        BlobStore::discard(path);
+        error = std::string(CODE_FAIL) + " Not enough space on server\n";
+        return nullptr;
+    }
+
+    std::unique_ptr<TransferStateMachine> t(new TransferStateMachine(socketFd, fileFd, State::Receiving));
+    t->fileSize = filesize;
+    t->filename = filename;
+    t->path = path;
+    t->userId = session.userId;
+    t->parentId = parent_id;
+    t->quota = std::move(quota);
+    t->outBuf = std::string(CODE_DATA_OPEN) + " Ready to receive data\n";
+    std::cout << "[Transfer] Upload started: " << filename << " (" << filesize << " bytes) FD: " << socketFd << std::endl;
+    return t;
+}
+
+std::unique_ptr<TransferStateMachine> TransferStateMachine::createTempUpload(int socketFd, const std::string& tempPath,
+                                                                            long filesize, const std::string& initialData,
+                                                                            TempUploadCommit commit, std::string& error) {
+    int fileFd = BlobStore::openTemp(tempPath);
+    if (fileFd < 0) {
+        error = std::string(CODE_FAIL) + " Cannot create file on server\n";
+        return nullptr;
+    }
+    if ((fallocate(fileFd, 0, 0, filesize) < 0 && errno == ENOSPC) ||
+        (!initialData.empty() &&
+         pwrite(fileFd, initialData.data(), initialData.size(), 0) != static_cast<ssize_t>(initialData.size()))) {
+        error = std::string(CODE_FAIL) + (errno == ENOSPC ? " Not enough space on server\n" : " Cannot write file on server\n");
+        close(fileFd);
+        BlobStore::discard(tempPath);
+        return nullptr;
+    }
+
+    std::unique_ptr<TransferStateMachine> t(new TransferStateMachine(socketFd, fileFd, State::Receiving));
+    t->fileSize = filesize;
+    t->offset = initialData.size();
+    t->bytesSinceLastAck = initialData.size() % SLICE_BYTES;
+    t->expectAcks = false;  // Client gửi một mạch, không chờ 151
+    t->filename = tempPath;
+    t->path = tempPath;
+    t->commitTemp = std::move(commit);
+    t->outBuf = std::string(CODE_DATA_OPEN) + " Ready to receive\n";
+    std::cout << "[Transfer] Upload to " << tempPath << " started (" << filesize << " bytes) FD: " << socketFd << std::endl;
+    return t;
+}
+
+std::unique_ptr<TransferStateMachine> TransferStateMachine::createDownload(int socketFd, long long blob_id, const std::string& filename,
+                                                                          bool expectAcks, std::string& error) {
+    auto blob = std::make_unique<BlobReader>();
+    if (!blob->open(blob_id, filename)) {
+        error = std::string(CODE_FAIL) + " File not found on server\n";
+        return nullptr;
+    }
+    long long size = blob->size();
+
+    std::unique_ptr<TransferStateMachine> t(new TransferStateMachine(socketFd, -1, State::Sending));
+    t->blob = std::move(blob);
+    t->fileSize = size;
+    t->expectAcks = expectAcks;
+    t->nextAckAt = std::min<off_t>(ACK_GROUP_SIZE, size);
+    t->outBuf = std::string(CODE_DATA_OPEN) + " " + std::to_string(size) + "\n";
+    std::cout << "[Transfer] Download started: " << filename << " (" << size << " bytes) FD: " << socketFd << std::endl;
+    return t;
+}
+
+std::unique_ptr<TransferStateMachine> TransferStateMachine::createFolderDownload(int socketFd, long long folder_id,
+                                                                                const std::string& folderName) {
+    // Cả cây lấy bằng một câu SQL trước khi bắt đầu gửi
+    auto subtree = DBManager::getInstance().getSubtree(folder_id);
+    std::vector<FolderEntry> entries;
+    entries.reserve(subtree.size() + 1);
+    entries.push_back({folderName, "", 0, true});
+    for (const auto& node : subtree) {
+        std::string path = folderName + "/" + node.relativePath;
+        if (node.item.is_folder) {
+            entries.push_back({path, "", 0, true});
+        } else {
+            entries.push_back({path, node.item.name, node.blob_id, false});
+        }
+    }
+
+    std::unique_ptr<TransferStateMachine> t(new TransferStateMachine(socketFd, -1, State::SendingFolder));
+    t->blob = std::make_unique<BlobReader>();
+    t->folderEntries = std::move(entries);
+    // Cork cả luồng: header nhỏ được gom chung segment với dữ liệu
+    ZeroCopyIO::setCork(socketFd, true);
+    t->corked = true;
+    t->outBuf = std::string(CODE_DATA_OPEN) + " Ready to send folder\n";
+    std::cout << "[Transfer] Folder download started: " << folderName << " (" << t->folderEntries.size()
+              << " entries) FD: " << socketFd << std::endl;
+    return t;
+}
+
+uint32_t TransferStateMachine::wantedEvents() const {
+    if (!outBuf.empty()) return EPOLLOUT;
+    switch (state) {
+        case State::Sending:
+        case State::SendingFolder:
+        case State::Finishing:
+            return EPOLLOUT;
+        case State::WaitingAck:
+        case State::Receiving:
+            return EPOLLIN;
+    }
+    return EPOLLIN;
+}
+
+bool TransferStateMachine::flushOutput() {
+    while (!outBuf.empty()) {
+        ssize_t n = send(socketFd, outBuf.data(), outBuf.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        outBuf.erase(0, n);
+    }
+    return true;
+}
+
+TransferStateMachine::Result TransferStateMachine::advance() {
+    // Dòng trạng thái phải ra trước dữ liệu/ACK tiếp theo
+    if (!flushOutput()) return Result::Failed;
+    if (!outBuf.empty()) return Result::Pending;
+
+    switch (state) {
+        case State::Sending:    return pumpSend();
+        case State::WaitingAck: return readAck();
+        case State::Receiving:  return pumpReceive();
+        case State::SendingFolder: return pumpFolder();
+        case State::Finishing:  return Result::Finished;
+    }
+    return Result::Failed;
+}
+
+TransferStateMachine::Result TransferStateMachine::onTimer(std::chrono::steady_clock::time_point now) {
+    if (state != State::WaitingAck || now < ackDeadline) return Result::Pending;
+    state = State::Sending;  // Client không ACK: gửi tiếp như DedicatedThread
+    return advance();
+}
+
+TransferStateMachine::Result TransferStateMachine::pumpSend() {
+    // Mỗi lượt tối đa tới mốc ACK tiếp theo (hoặc 1MB), để các client khác trên worker không phải chờ
+    off_t groupEnd = expectAcks ? nextAckAt : std::min<off_t>(offset + SLICE_BYTES, fileSize);
+    if (offset < groupEnd) {
+        long long sent = blob->sendRange(socketFd, &offset, groupEnd - offset);
+        if (sent < 0) return Result::Failed;
+        if (offset < groupEnd) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return Result::Pending;
+            // Dòng 150 đã báo kích thước: thân bị cắt thì không được trả 226, ngắt kết nối
+            std::cerr << "[Transfer] Download aborted at " << offset << "/" << fileSize << " bytes" << std::endl;
+            return Result::Failed;
+        }
+    }
+
+    if (offset < fileSize) {
+        if (!expectAcks) return Result::Pending;
+        state = State::WaitingAck;
+        nextAckAt = std::min<off_t>(nextAckAt + ACK_GROUP_SIZE, fileSize);
+        ackDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(ACK_TIMEOUT_SECONDS);
+        return Result::Pending;
+    }
+
+    blob->close();
+    state = State::Finishing;
+    outBuf = std::string(CODE_TRANSFER_COMPLETE) + " Download success\n";
+    return advance();
+}
+
+TransferStateMachine::Result TransferStateMachine::readAck() {
+    char ackBuf[256];
+    ssize_t n = recv(socketFd, ackBuf, sizeof(ackBuf), 0);
+    if (n == 0) return Result::Failed;
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? Result::Pending : Result::Failed;
+    }
+    state = State::Sending;
+    return advance();
+}
+
+TransferStateMachine::Result TransferStateMachine::pumpReceive() {
+    SplicePipe* splicePipe = ServerConfig::ZERO_COPY_UPLOAD ? &pipe : nullptr;
+
+    while (offset < fileSize) {
+        // Không đọc vượt mốc 1MB: client dừng chờ 151 ACK đúng tại mốc này
+        long group = expectAcks ? ACK_GROUP_SIZE : SLICE_BYTES;
+        size_t want = std::min(fileSize - static_cast<long>(offset), group - bytesSinceLastAck);
+        long long bytesRead = ZeroCopyIO::receiveToFile(socketFd, fileFd, &offset, want, splicePipe);
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return Result::Pending;
+        if (bytesRead <= 0) {
+            // Upload dở dang: không ghi vào DB, destructor xóa file tạm
+            std::cerr << "[Transfer] Upload aborted at " << offset << "/" << fileSize << " bytes: " << filename << std::endl;
+            return Result::Failed;
+        }
+
+        bytesSinceLastAck += bytesRead;
+        if (bytesSinceLastAck >= group && offset < fileSize) {
+            bytesSinceLastAck = 0;
+            if (!expectAcks) return Result::Pending;
+            outBuf = std::string(CODE_CHUNK_ACK) + " Received " + std::to_string(offset) + " bytes\n";
+            // Mỗi lượt tối đa 1 nhóm ACK: nhường event loop cho client khác
+            return flushOutput() ? Result::Pending : Result::Failed;
+        }
+    }
+
+    finishUpload();
+    return advance();
+}
+
+TransferStateMachine::Result TransferStateMachine::pumpFolder() {
+    long long sliceStart = bytesDone + offset;
+
+    while (true) {
+        // Đang gửi dở một file
+        if (blob->isOpen()) {
+            if (offset < fileSize) {
+                long long sent = blob->sendRange(socketFd, &offset, fileSize - offset);
+                if (sent < 0) return Result::Failed;
+                if (offset < fileSize) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) return Result::Pending;
+                    // Header đã báo kích thước: file bị cắt ngắn thì luồng hỏng, phải ngắt
+                    std::cerr << "[Transfer] File shrank during folder download: " << folderEntries[nextEntry - 1].relativePath << std::endl;
+                    return Result::Failed;
+                }
+            }
+            blob->close();
+            bytesDone += fileSize;
+            offset = 0;
+            fileSize = 0;
+        }
+
+        if (nextEntry == folderEntries.size()) {
+            uint8_t type = TYPE_END;
+            outBuf.push_back(static_cast<char>(type));
+            state = State::Finishing;
+            if (!flushOutput()) return Result::Failed;
+            ZeroCopyIO::setCork(socketFd, false);
+            corked = false;
+            return advance();
+        }
+
+        if (bytesDone - sliceStart >= SLICE_BYTES) return Result::Pending;
+
+        const FolderEntry& entry = folderEntries[nextEntry++];
+        if (entry.isDir) {
+            outBuf += ZeroCopyIO::buildDirHeader(entry.relativePath);
+        } else {
+            // File không còn trên disk: bỏ qua, không gửi header (giống DedicatedThread)
+            if (!blob->open(entry.blobId, entry.storageName)) {
+                std::cerr << "[Transfer] File not found on disk, skipping: " << entry.relativePath
+                          << " (blob " << entry.blobId << ")" << std::endl;
+                continue;
+            }
+            offset = 0;
+            fileSize = blob->size();
+            outBuf += ZeroCopyIO::buildFileHeader(entry.relativePath, fileSize);
+        }
+
+        if (!flushOutput()) return Result::Failed;
+        if (!outBuf.empty()) return Result::Pending;
+    }
+}
+
+void TransferStateMachine::finishUpload() {
+    close(fileFd);
+    fileFd = -1;
+    state = State::Finishing;
+
+    // Ghi DB (và băm chunk với PUT_CHUNK) không chạy ở đây: worker lấy bằng takeCommit
+    if (commitTemp) {
+        pendingCommit = std::move(commitTemp);
+        return;
+    }
+
+    pendingCommit = [filename = filename, fileSize = fileSize, userId = userId, parentId = parentId, path = path,
+                     quota = std::move(quota)]() mutable {
+        // addFile đưa file tạm vào BlobStore (hoặc xóa nó nếu lỗi)
+        long long file_id = DBManager::getInstance().addFile(filename, fileSize, userId, parentId, nullptr, &path);
+        quota.reset();  // Đã cộng vào storage_used (hoặc lưu thất bại): trả chỗ đã giữ
+        if (file_id < 0) {
+            std::cerr << "[Transfer] Upload FAILED: Cannot save " << filename << std::endl;
+            return std::string(CODE_FAIL) + " Cannot save file on server\n";
+        }
+        ChunkStore::getInstance().scheduleIngest(file_id, fileSize);
+        std::cout << "[Transfer] Upload SUCCESS: " << filename << " (" << fileSize << " bytes)" << std::endl;
+        return std::string(CODE_TRANSFER_COMPLETE) + " Upload success\n";
+    };
+}
@@ -1,26 +1,50 @@
 #include "../../include/thread_manager.h"
 #include "../../include/request_handler.h"
 #include "../../include/thread_monitor.h"
+#include "../../include/transfer_executor.h"
+#include "../../include/blob_store.h"
+#include "../../include/chunk_store.h"
 #include "../../../../Common/Protocol.h"
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <cstring>
 #include <iostream>
-#include <sstream>
 #include <algorithm>
+#include <charconv>
+#include <iterator>
 #include <thread>
+#include <chrono>
 
-WorkerThread::WorkerThread() : running(true), epoll_fd(-1) {
+WorkerThread::WorkerThread() : running(true), epoll_fd(-1), wake_fd(-1) {
     epoll_fd = epoll_create1(0);
     if (epoll_fd == -1) {
         std::cerr << "[Worker] Failed to create epoll instance" << std::endl;
+        return;
+    }
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd;
+    if (wake_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) == -1) {
+        std::cerr << "[Worker] Failed to create wakeup eventfd: " << strerror(errno) << std::endl;
     }
 }
 
 void WorkerThread::stop() {
     running = false;
+    wakeUp();
+}
+
+void WorkerThread::wakeUp() {
+    uint64_t one = 1;
+    if (wake_fd != -1 && write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        std::cerr << "[Worker] Wakeup failed: " << strerror(errno) << std::endl;
+    }
 }
 
 void WorkerThread::addClient(int socketFd) {
@@ -37,6 +61,7 @@ void WorkerThread::addClient(int socketFd) {
     client_sockets.push_back(socketFd);
     sessions[socketFd] = ClientSession(); 
     sessions[socketFd].socketFd = socketFd;
+    sessions[socketFd].epollEvents = EPOLLIN;
     
     ThreadMonitor::getInstance().reportConnectionCount(myThreadId, client_sockets.size());
     
@@ -57,6 +82,13 @@ void WorkerThread::addClient(int socketFd, const ClientSession& session) {
     
     client_sockets.push_back(socketFd);
     sessions[socketFd] = session;
+    sessions[socketFd].epollEvents = EPOLLIN;
+    // Lệnh client gửi nối sau lệnh transfer: epoll không báo lại nên worker tự xử lý,
+    // đánh thức ngay thay vì chờ epoll_wait hết timeout
+    if (!session.inBuf.empty()) {
+        pendingInput.push_back(socketFd);
+        wakeUp();
+    }
     
     ThreadMonitor::getInstance().reportConnectionCount(myThreadId, client_sockets.size());
     
@@ -66,6 +98,8 @@ void WorkerThread::addClient(int socketFd, const ClientSession& session) {
 }
 
 void WorkerThread::removeClient(int fd, bool closeSocket) {
+    transfers.erase(fd);  // Hủy transfer dở dang (khôi phục cờ socket trước khi close)
+    
     std::lock_guard<std::mutex> lock(mtx);
     
     epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
@@ -106,11 +140,37 @@ void WorkerThread::run() {
             continue;
         }
         
+        checkTransferTimers();
+        
+        std::vector<int> pending;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            pending.swap(pendingInput);
+        }
+        for (int fd : pending) {
+            processInput(fd);
+        }
+        
         if (nfds == 0) continue;
         
         for (int i = 0; i < nfds; i++) {
             int fd = events[i].data.fd;
             
+            if (fd == wake_fd) {
+                uint64_t count;
+                while (read(wake_fd, &count, sizeof(count)) > 0) {}
+                continue;
+            }
+            
+            if (transfers.count(fd)) {
+                handleTransferEvent(fd, events[i].events);
+                continue;
+            }
+            
+            if (events[i].events & EPOLLOUT) {
+                handleClientWritable(fd);
+            }
+            
             if (events[i].events & EPOLLIN) {
                 handleClientMessage(fd);
             }
@@ -122,606 +182,1087 @@ void WorkerThread::run() {
         }
     }
     
+    if (wake_fd != -1) close(wake_fd);
     if (epoll_fd != -1) close(epoll_fd);
 }
 
-void WorkerThread::handleClientMessage(int fd) {
-    char buffer[1025] = {0};
-    int valread = read(fd, buffer, 1024);
-
-    if (valread <= 0) {
-        removeClient(fd, true);
-        return;
-    }
-
-    std::string msg(buffer);
-    while (!msg.empty() && (msg.back() == '\n' || msg.back() == '\r')) {
-        msg.pop_back();
-    }
+// Gửi hàng đợi phản hồi bằng sendmsg() gom nhiều buffer (tương đương writev, có thêm flags).
+// flags = MSG_DONTWAIT: gửi tới khi socket đầy; 0: chặn tới khi gửi hết.
+// false nếu socket lỗi.
+static bool drainOutput(int fd, ClientSession& session, int flags) {
+    const size_t MAX_IOV = 64;
     
-    std::cout << "[Recv FD:" << fd << "]: " << msg << std::endl;
-
-    std::string command, arg;
-    if (msg.find("SITE QUOTA_CHECK") == 0) {
-        command = "SITE QUOTA_CHECK";
-        arg = msg.substr(17);
-        std::cout << "[Worker] Detected SITE QUOTA_CHECK, arg: '" << arg << "'" << std::endl;
-    } else {
-        std::stringstream ss(msg);
-        ss >> command;
-        std::getline(ss, arg);
-        if (!arg.empty() && arg[0] == ' ') arg.erase(0, 1);
-    }
-    
-    std::cout << "[Worker] Parsed - Command: '" << command << "', Arg: '" << arg << "'" << std::endl;
-    
-    std::string response;
-
-
-    if (command == CMD_USER) {
-        std::lock_guard<std::mutex> lock(mtx);
-        response = AuthHandler::handleUser(fd, sessions[fd], arg);
-    } 
-    else if (command == CMD_PASS) {
-        std::lock_guard<std::mutex> lock(mtx);
-        response = AuthHandler::handlePass(fd, sessions[fd], arg);
-    }
-    else if (command == CMD_REGISTER) {
-        std::stringstream ss_reg(arg);
-        std::string u, p;
-        ss_reg >> u >> p;
-        if (!u.empty() && !p.empty()) 
-             response = AuthHandler::handleRegister(u, p);
-        else response = std::string(CODE_FAIL) + " Invalid format\n";
-    }
-    else if (command == CMD_LIST) {
-        std::lock_guard<std::mutex> lock(mtx);
-        long long parent_id = 0;
-        if (!arg.empty()) {
-            try {
-                parent_id = std::stoll(arg);
-            } catch (...) {
-                parent_id = 0;
-            }
+    while (session.outBytes > 0) {
+        struct iovec iov[MAX_IOV];
+        size_t count = 0;
+        for (auto it = session.outQueue.begin(); it != session.outQueue.end() && count < MAX_IOV; ++it, ++count) {
+            size_t skip = (count == 0) ? session.outHeadOffset : 0;
+            iov[count].iov_base = const_cast<char*>(it->data() + skip);
+            iov[count].iov_len = it->size() - skip;
+        }
+        
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t n = sendmsg(fd, &msg, flags | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
         }
-        response = CmdHandler::handleList(sessions[fd], parent_id);
-    }
-    else if (command == CMD_LISTSHARED) {
-        long long parent_id = -1;
-        if (!arg.empty()) {
-            try {
-                parent_id = std::stoll(arg);
-            } catch (...) {
-                parent_id = -1;
+        
+        session.outBytes -= n;
+        while (n > 0) {
+            size_t left = session.outQueue.front().size() - session.outHeadOffset;
+            if (static_cast<size_t>(n) < left) {
+                session.outHeadOffset += n;
+                break;
             }
+            n -= left;
+            session.outQueue.pop_front();
+            session.outHeadOffset = 0;
         }
-        std::lock_guard<std::mutex> lock(mtx);
-        response = CmdHandler::handleListShared(sessions[fd], parent_id);
     }
-    else if (command == CMD_SEARCH) {
-        std::lock_guard<std::mutex> lock(mtx);
-        response = CmdHandler::handleSearch(sessions[fd], arg);
+    return true;
+}
+
+void WorkerThread::updateClientEvents(int fd, ClientSession& session) {
+    if (transfers.count(fd)) return;  // Transfer epoll tự quản lý events
+    
+    // Hysteresis: ngừng đọc khi vượt HIGH_WATER, chỉ đọc lại khi đã xuống LOW_WATER
+    bool reading = (session.epollEvents & EPOLLIN)
+                   ? session.outBytes < ServerConfig::OUTPUT_HIGH_WATER
+                   : session.outBytes <= ServerConfig::OUTPUT_LOW_WATER;
+    uint32_t wanted = 0;
+    if (reading) wanted |= EPOLLIN;
+    if (session.outBytes > 0) wanted |= EPOLLOUT;
+    
+    if (wanted != session.epollEvents) {
+        struct epoll_event ev;
+        ev.events = wanted;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        session.epollEvents = wanted;
     }
-    else if (command == CMD_SHARE) {
-        std::stringstream ss_share(arg);
-        std::string fname, target;
-        ss_share >> fname >> target;
+}
+
+void WorkerThread::queueResponse(int fd, std::string data) {
+    bool ok = true;
+    {
         std::lock_guard<std::mutex> lock(mtx);
-        response = CmdHandler::handleShare(sessions[fd], fname, target);
+        auto it = sessions.find(fd);
+        if (it == sessions.end()) return;
+        
+        ClientSession& session = it->second;
+        session.outBytes += data.size();
+        session.outQueue.push_back(std::move(data));
+        // Thử gửi ngay: đa số phản hồi nhỏ đi hết ở đây, không cần chờ EPOLLOUT
+        ok = drainOutput(fd, session, MSG_DONTWAIT);
+        if (ok) updateClientEvents(fd, session);
     }
-    else if (command == CMD_DELETE) {
+    if (!ok) removeClient(fd, true);
+}
+
+void WorkerThread::handleClientWritable(int fd) {
+    bool ok = true;
+    bool resume = false;
+    {
         std::lock_guard<std::mutex> lock(mtx);
-        response = CmdHandler::handleDelete(sessions[fd], arg);
-    }
-    else if (command == CMD_RENAME) {
-        std::stringstream ss(arg);
-        long long fileId;
-        std::string newName;
-        ss >> fileId >> newName;
-        
-        std::cout << "[RENAME] Received: file_id=" << fileId << ", new_name='" << newName 
-                  << "', username=" << sessions[fd].username << std::endl;
+        auto it = sessions.find(fd);
+        if (it == sessions.end()) return;
         
-        std::lock_guard<std::mutex> lock(mtx);
-        response = CmdHandler::handleRename(sessions[fd], fileId, newName);
+        ClientSession& session = it->second;
+        bool wasReading = session.epollEvents & EPOLLIN;
+        ok = drainOutput(fd, session, MSG_DONTWAIT);
+        if (ok) {
+            updateClientEvents(fd, session);
+            resume = !wasReading && (session.epollEvents & EPOLLIN) && !session.inBuf.empty();
+        }
+    }
+    if (!ok) {
+        removeClient(fd, true);
+    } else if (resume) {
+        processInput(fd);  // Chạy tiếp các lệnh pipelined đã bị tạm dừng
     }
+}
+
+// File <= SMALL_TRANSFER_BYTES được xếp vào hàng đợi ưu tiên cao
+static bool isSmallFile(long long blob_id, const std::string& filename) {
+    BlobReader blob;
+    return blob.open(blob_id, filename) && blob.size() <= ServerConfig::SMALL_TRANSFER_BYTES;
+}
+
+bool WorkerThread::handOffTransfer(int fd, TransferPriority priority, std::function<void(const ClientSession&)> job) {
+    ClientSession session = sessions[fd];
+    // Gỡ khỏi epoll trước khi submit: thread transfer có thể chạy ngay lập tức
+    removeClient(fd, false);
     
-    else if (command == CMD_UPLOAD_CHECK) {
-        std::stringstream ss_quota(arg);
-        std::string fname;
-        long fsize = 0;
-        ss_quota >> fname >> fsize;
-        
-        std::cout << "[Worker] Checking quota for: " << fname << ", Size: " << fsize << std::endl;
-        
-        std::lock_guard<std::mutex> lock(mtx);
-        response = FileIOHandler::handleQuotaCheck(sessions[fd], fsize);
+    bool queued = TransferExecutor::getInstance().submit(priority, fd, [job, session, fd]() mutable {
+        // Phản hồi tồn đọng phải ra trước dữ liệu transfer; chặn ở thread transfer, không chặn worker
+        drainOutput(fd, session, 0);
+        job(session);
+    });
+    if (!queued) {
+        addClient(fd, session);
     }
+    return queued;
+}
 
-    else if (command == CMD_UPLOAD) {
-        std::string fname;
-        long fsize = 0;
-        long long parent_id = 0;
-        std::stringstream ss_up(arg);
-        ss_up >> fname >> fsize >> parent_id;
-        
-        std::cout << "[Worker::CMD_UPLOAD] File: " << fname << ", Size: " << fsize << ", Parent ID: " << parent_id << std::endl;
-
-        if (fsize <= 0) {
-            std::cout << "[Worker::CMD_UPLOAD] Invalid file size" << std::endl;
-            response = std::string(CODE_FAIL) + " Invalid file size\n";
-        } else if (!ThreadMonitor::getInstance().canCreateDedicatedThread()) {
-            std::cout << "[Worker::CMD_UPLOAD] System overloaded" << std::endl;
-            response = "503 System overloaded\n";
-        } else {
-            std::string username = sessions[fd].username;
-            std::cout << "[Worker::CMD_UPLOAD] Starting dedicated thread for upload" << std::endl;
-            removeClient(fd, false);
-            
-            std::thread t([fd, fname, fsize, username, parent_id, this]() {
-                DedicatedThread dt;
-                dt.handleUpload(fd, fname, fsize, username, parent_id, this);
-            });
-            
-            std::thread::id tid = t.get_id();
-            t.detach();
-            
+bool WorkerThread::handOffCommand(int fd, TransferPriority priority, std::function<std::string()> work) {
+    return handOffTransfer(fd, priority, [fd, work, this](const ClientSession& session) {
+        std::string response = work();
+        if (!ZeroCopyIO::sendAll(fd, response.data(), response.size())) {
+            close(fd);
             return;
         }
+        addClient(fd, session);
+    });
+}
+
+bool WorkerThread::startFolderDownload(int fd, long long folder_id, const std::string& folderName) {
+    if (ServerConfig::transferMode == TransferMode::Epoll) {
+        if (!canStartTransfer()) return false;
+        startTransfer(fd, TransferStateMachine::createFolderDownload(fd, folder_id, folderName));
+        return true;
     }
-    else if (command == CMD_DOWNLOAD) {
-        std::string fname = arg;
-        std::cout << "[Worker::CMD_DOWNLOAD] File: " << fname << ", User: " << sessions[fd].username << std::endl;
-        
-        bool hasPerm = false;
-        {
-             std::lock_guard<std::mutex> lock(mtx);
-             hasPerm = FileIOHandler::checkDownloadPermission(sessions[fd], fname);
-        }
+    
+    return handOffTransfer(fd, TransferPriority::Low,
+        [fd, folder_id, folderName, this](const ClientSession& session) {
+            DedicatedThread dt;
+            dt.handleFolderDownload(fd, folder_id, folderName, session, this);
+        });
+}
 
-        if (!hasPerm) {
-            std::cout << "[Worker::CMD_DOWNLOAD] Permission denied" << std::endl;
-            response = std::string(CODE_FAIL) + " Permission denied\n";
-        } else if (!ThreadMonitor::getInstance().canCreateDedicatedThread()) {
-            std::cout << "[Worker::CMD_DOWNLOAD] System overloaded" << std::endl;
-            response = "503 System overloaded\n";
-        } else {
-            std::string username = sessions[fd].username;
-            std::cout << "[Worker::CMD_DOWNLOAD] Starting dedicated thread for download" << std::endl;
-            removeClient(fd, false);
-
-            std::thread t([fd, fname, username, this]() {
-                DedicatedThread dt;
-                dt.handleDownload(fd, fname, username, this);
-            });
-            
-            t.detach();
-            return;
-        }
+std::string WorkerThread::startTempUpload(int fd, const std::string& tempPath, long size, TempUploadCommit commit) {
+    // Dữ liệu có thể đã nằm sẵn trong inBuf (đọc chung với dòng lệnh)
+    std::string initialData;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::string& in = sessions[fd].inBuf;
+        size_t take = std::min<size_t>(size, in.size());
+        initialData.assign(in, 0, take);
+        in.erase(0, take);
     }
-    else if (command == "DOWNLOAD_FOLDER") {
-        // Parse folder_id từ client (thay vì folder_name)
-        long long folder_id = 0;
-        std::stringstream ss_folder_id(arg);
-        ss_folder_id >> folder_id;
-        
-        std::string username = sessions[fd].username;
-        
-        std::cout << "[Worker] DOWNLOAD_FOLDER request: folder_id=" << folder_id << " by user: " << username << std::endl;
-        
-        // Kiểm tra folder tồn tại trong database
-        FileRecordEx folderInfo = DBManager::getInstance().getFileInfo(folder_id);
-        
-        if (folderInfo.file_id < 0 || !folderInfo.is_folder) {
-            std::cout << "[Worker] Folder not found in database or not a folder" << std::endl;
-            response = std::string(CODE_FAIL) + " Folder not found\n";
-        } else {
-            std::cout << "[Worker] Folder found in DB: " << folderInfo.name << ", checking permissions..." << std::endl;
-            
-            // Kiểm tra quyền - user sở hữu hoặc được share
-            bool hasPerm = (folderInfo.owner == username);
-            if (!hasPerm) {
-                // Kiểm tra shared permission
-                hasPerm = DBManager::getInstance().hasSharedAccess(folder_id, username);
-            }
-            
-            if (!hasPerm) {
-                std::cout << "[Worker] Permission denied" << std::endl;
-                response = std::string(CODE_FAIL) + " Permission denied\n";
-            } else {
-                std::cout << "[Worker] Permission OK, sending folder..." << std::endl;
-                // Send ready response
-                response = std::string(CODE_DATA_OPEN) + " Ready to send folder\n";
-                send(fd, response.c_str(), response.length(), 0);
-                
-                // Handle folder download với folder_id - truyền this để trả socket về sau
-                DedicatedThread dt;
-                dt.handleFolderDownload(fd, folder_id, folderInfo.name, username, this);
-                return;
-            }
+
+    std::string response;
+    if (ServerConfig::transferMode == TransferMode::Epoll) {
+        auto transfer = canStartTransfer()
+            ? TransferStateMachine::createTempUpload(fd, tempPath, size, initialData, std::move(commit), response)
+            : nullptr;
+        if (transfer) {
+            startTransfer(fd, std::move(transfer));
+            return {};
         }
+        if (response.empty()) response = "503 System overloaded\n";
+    } else {
+        TransferPriority priority = size <= ServerConfig::SMALL_TRANSFER_BYTES
+                                    ? TransferPriority::High : TransferPriority::Normal;
+        bool queued = handOffTransfer(fd, priority,
+            [fd, tempPath, size, initialData, commit, this](const ClientSession& session) {
+                DedicatedThread dt;
+                dt.handleTempUpload(fd, tempPath, size, initialData, commit, session, this);
+            });
+        if (queued) return {};
+
+        std::cout << "[Worker] Upload to " << tempPath << ": System overloaded\n";
+        response = "503 System overloaded\n";
     }
-    else if (command == "GET_FOLDER_STRUCTURE") {
-        long long folder_id = 0;
-        std::stringstream ss_folder(arg);
-        ss_folder >> folder_id;
-        
-        std::cout << "[Worker::CMD_GET_FOLDER_STRUCTURE] Folder ID: " << folder_id << ", User: " << sessions[fd].username << std::endl;
-        
+    return response;
+}
+
+void WorkerThread::startTransfer(int fd, std::unique_ptr<TransferStateMachine> transfer) {
+    uint32_t armed = EPOLLIN;
+    {
+        // Phản hồi tồn đọng phải ra trước dòng 150: chuyển sang output của transfer
         std::lock_guard<std::mutex> lock(mtx);
-        response = CmdHandler::handleGetFolderStructure(sessions[fd], folder_id);
+        ClientSession& session = sessions[fd];
+        std::string pending;
+        for (const auto& chunk : session.outQueue) pending += chunk;
+        transfer->prependOutput(pending.substr(session.outHeadOffset));
+        session.outQueue.clear();
+        session.outHeadOffset = 0;
+        session.outBytes = 0;
+        armed = session.epollEvents;
     }
     
-    else if (command == "SHARE_FOLDER") {
-        long long folder_id = 0;
-        std::string target_user;
-        std::stringstream ss_share_folder(arg);
-        ss_share_folder >> folder_id >> target_user;
-        
-        std::cout << "[Worker::CMD_SHARE_FOLDER] Folder ID: " << folder_id << ", Target: " << target_user << ", User: " << sessions[fd].username << std::endl;
-        
-        std::cout << "[Worker] SHARE_FOLDER: folder_id=" << folder_id 
-                  << ", target=" << target_user << std::endl;
-        
-        std::lock_guard<std::mutex> lock(mtx);
-        response = CmdHandler::handleShareFolder(sessions[fd], folder_id, target_user);
+    TransferSlot& slot = transfers[fd];
+    slot.machine = std::move(transfer);
+    slot.armedEvents = armed;
+    applyTransferResult(fd, slot.machine->advance());
+}
+
+void WorkerThread::handleTransferEvent(int fd, uint32_t events) {
+    TransferStateMachine::Result result = transfers[fd].machine->advance();
+    if (result == TransferStateMachine::Result::Pending && (events & (EPOLLERR | EPOLLHUP))) {
+        result = TransferStateMachine::Result::Failed;
     }
+    applyTransferResult(fd, result);
+}
+
+void WorkerThread::applyTransferResult(int fd, TransferStateMachine::Result result) {
+    uint32_t wanted = EPOLLIN;
     
-    else if (command == "UPLOAD_FILE") {
-        std::string session_id;
-        long long old_file_id = 0;
-        long file_size = 0;
-        
-        std::stringstream ss_upload_folder(arg);
-        ss_upload_folder >> session_id >> old_file_id >> file_size;
-        
-        std::cout << "[Worker] UPLOAD_FILE: session=" << session_id 
-                  << ", file_id=" << old_file_id 
-                  << ", size=" << file_size << std::endl;
-        
-        if (file_size <= 0) {
-            response = std::string(CODE_FAIL) + " Invalid file size\n";
-        } else if (!ThreadMonitor::getInstance().canCreateDedicatedThread()) {
-            response = "503 System overloaded\n";
-        } else {
-            std::string ack = std::string(CODE_DATA_OPEN) + " Ready to receive\n";
-            send(fd, ack.c_str(), ack.length(), 0);
-            
-            char* file_buffer = new char[file_size];
-            long total_received = 0;
-            
-            while (total_received < file_size) {
-                int bytes_read = read(fd, file_buffer + total_received, 
-                                     file_size - total_received);
-                if (bytes_read <= 0) {
-                    std::cerr << "[Worker] Connection lost during folder file transfer" << std::endl;
-                    delete[] file_buffer;
-                    removeClient(fd, true);
-                    return;
-                }
-                total_received += bytes_read;
-            }
-            
-            std::cout << "[Worker] Received " << total_received << " bytes for folder file" << std::endl;
-            
-            bool success = FolderShareHandler::getInstance().receiveFile(
-                session_id,
-                old_file_id,
-                file_buffer,
-                file_size
-            );
-            
-            delete[] file_buffer;
-            
-            if (!success) {
-                response = std::string(CODE_FAIL) + " Failed to save folder file\n";
-            } else {
-                if (FolderShareHandler::getInstance().isComplete(session_id)) {
-                    FolderShareHandler::getInstance().finalize(session_id);
-                    
-                    response = std::string(CODE_TRANSFER_COMPLETE) + " Folder share completed\n";
-                    
-                    FolderShareHandler::getInstance().cleanup(session_id);
-                    
-                    std::cout << "[Worker] Folder share completed: " << session_id << std::endl;
-                } else {
-                    std::string progress = FolderShareHandler::getInstance().getProgress(session_id);
-                    response = "202 " + progress + "\n";
-                }
-            }
-        }
+    if (result == TransferStateMachine::Result::Failed) {
+        std::cout << "[Worker] Transfer failed on FD: " << fd << std::endl;
+        removeClient(fd, true);
+        return;
+    }
+    if (result == TransferStateMachine::Result::Pending) {
+        wanted = transfers[fd].machine->wantedEvents();
     }
     
-    else if (command == "CREATE_FOLDER") {
-        std::stringstream ss_create(arg);
-        std::string foldername;
-        long long parent_id = 0;
-        ss_create >> foldername >> parent_id;
-        
-        if (!sessions[fd].isAuthenticated) {
-            response = std::string(CODE_FAIL) + " Please login first\n";
-        } else {
+    TransferSlot& slot = transfers[fd];
+    if (slot.armedEvents != wanted) {
+        struct epoll_event ev;
+        ev.events = wanted;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        slot.armedEvents = wanted;
+    }
+    
+    if (result == TransferStateMachine::Result::Finished) {
+        TempUploadCommit commit = slot.machine->takeCommit();
+        transfers.erase(fd);  // Socket quay về chế độ lệnh (EPOLLIN)
+        {
             std::lock_guard<std::mutex> lock(mtx);
-            long long folder_id = DBManager::getInstance().createFolder(foldername, parent_id, sessions[fd].username);
-            
-            if (folder_id != -1) {
-                std::cout << "[Server] Created folder: " << foldername << " (ID: " << folder_id << ")" << std::endl;
-                response = std::string(CODE_OK) + " Folder created|FOLDER_ID:" + std::to_string(folder_id) + "\n";
-            } else {
-                std::cerr << "[Server] Failed to create folder: " << foldername << std::endl;
-                response = std::string(CODE_FAIL) + " Failed to create folder\n";
-            }
+            sessions[fd].epollEvents = wanted;
+        }
+        // Upload xong: ghi DB / kiểm tra chunk trên TransferExecutor, không chặn event loop.
+        // Hàng đợi đầy thì chạy tại chỗ: dữ liệu đã nhận đủ, không bỏ
+        if (commit) {
+            if (handOffCommand(fd, TransferPriority::High, commit)) return;
+            queueResponse(fd, commit());
         }
+        processInput(fd);     // Lệnh client đã gửi nối sau lệnh transfer
     }
+}
+
+void WorkerThread::checkTransferTimers() {
+    if (transfers.empty()) return;
     
-    else if (command == "CHECK_SHARE_PROGRESS") {
-        std::string session_id = arg;
-        
-        std::cout << "[Worker] CHECK_SHARE_PROGRESS: " << session_id << std::endl;
-        
-        auto session_ptr = FolderShareHandler::getInstance().getSession(session_id);
-        
-        if (!session_ptr) {
-            response = std::string(CODE_FAIL) + " Session not found\n";
-        } else {
-            std::string progress = FolderShareHandler::getInstance().getProgress(session_id);
-            response = "200 " + progress + "\n";
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::pair<int, TransferStateMachine::Result>> results;
+    for (auto& entry : transfers) {
+        TransferStateMachine::Result result = entry.second.machine->onTimer(now);
+        if (result != TransferStateMachine::Result::Pending || entry.second.machine->wantedEvents() != entry.second.armedEvents) {
+            results.emplace_back(entry.first, result);
         }
     }
-    
-    else if (command == "CANCEL_FOLDER_SHARE") {
-        std::string session_id = arg;
-        
-        std::cout << "[Worker] CANCEL_FOLDER_SHARE: " << session_id << std::endl;
-        
-        FolderShareHandler::getInstance().cleanup(session_id);
-        
-        response = "200 Share cancelled\n";
+    for (const auto& r : results) {
+        applyTransferResult(r.first, r.second);
     }
-    
-    // ===== SHARE CODE COMMANDS =====
-    else if (command == CMD_GENERATE_SHARE_CODE) {
-        // Arg format: file_id [max_uses]
-        long long file_id = 0;
-        int max_uses = 0;
-        
-        std::stringstream ss_gen(arg);
-        ss_gen >> file_id >> max_uses;
-        
-        std::cout << "[Worker] GENERATE_SHARE_CODE: file_id=" << file_id << ", max_uses=" << max_uses << std::endl;
-        
-        if (!sessions[fd].isAuthenticated) {
-            response = std::string(CODE_FAIL) + " Not authenticated\n";
-        } else if (file_id <= 0) {
-            response = std::string(CODE_FAIL) + " Invalid file_id\n";
-        } else {
-            std::string code = DBManager::getInstance().generateShareCode(file_id, sessions[fd].username, max_uses);
-            if (code.empty()) {
-                response = std::string(CODE_FAIL) + " Failed to generate share code\n";
-            } else {
-                response = std::string(CODE_OK) + " " + code + "\n";
-            }
-        }
+}
+
+void WorkerThread::handleClientMessage(int fd) {
+    char buffer[4096];
+    int valread = read(fd, buffer, sizeof(buffer));
+
+    if (valread <= 0) {
+        removeClient(fd, true);
+        return;
     }
-    
-    else if (command == CMD_REDEEM_SHARE_CODE) {
-        std::string share_code = arg;
-        
-        std::cout << "[Worker] REDEEM_SHARE_CODE: code=" << share_code << std::endl;
-        
-        if (!sessions[fd].isAuthenticated) {
-            response = std::string(CODE_FAIL) + " Not authenticated\n";
-        } else if (share_code.empty()) {
-            response = std::string(CODE_FAIL) + " Invalid share code\n";
-        } else {
-            long long file_id = DBManager::getInstance().redeemShareCode(share_code, sessions[fd].username);
-            if (file_id < 0) {
-                response = std::string(CODE_FAIL) + " Invalid or expired share code\n";
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        sessions[fd].inBuf.append(buffer, valread);
+    }
+    processInput(fd);
+}
+
+void WorkerThread::processInput(int fd) {
+    while (true) {
+        std::string line;
+        bool overflow = false;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = sessions.find(fd);
+            if (it == sessions.end()) return;  // Đã ngắt kết nối hoặc chuyển sang TransferExecutor
+            if (!(it->second.epollEvents & EPOLLIN)) return;  // Backpressure: chờ client đọc bớt phản hồi
+            
+            std::string& in = it->second.inBuf;
+            size_t nl = in.find('\n');
+            if (nl == std::string::npos) {
+                overflow = in.size() > ServerConfig::MAX_COMMAND_LINE;
+                if (!overflow) return;  // Chờ phần còn lại của dòng
             } else {
-                FileRecordEx fileInfo = DBManager::getInstance().getFileById(file_id);
-                response = std::string(CODE_OK) + " " + std::to_string(file_id) + "|" + 
-                          fileInfo.name + "|" + (fileInfo.is_folder ? "1" : "0") + "|" + fileInfo.owner + "\n";
+                line = in.substr(0, nl);
+                in.erase(0, nl + 1);
             }
         }
-    }
-    
-    else if (command == CMD_GET_MY_SHARES) {
-        std::cout << "[Worker] GET_MY_SHARES for user: " << sessions[fd].username << std::endl;
         
-        if (!sessions[fd].isAuthenticated) {
-            response = std::string(CODE_FAIL) + " Not authenticated\n";
-        } else {
-            std::vector<ShareInfo> shares = DBManager::getInstance().getMyShares(sessions[fd].username);
-            std::stringstream ss_resp;
-            ss_resp << CODE_OK << " " << shares.size() << "\n";
-            for (const auto& share : shares) {
-                ss_resp << share.shared_id << "|" << share.file_id << "|" << share.filename << "|"
-                       << (share.is_folder ? "1" : "0") << "|" << share.shared_with_username << "|"
-                       << share.permission << "|" << share.shared_at << "\n";
-            }
-            response = ss_resp.str();
+        if (overflow) {
+            std::cout << "[Worker] Command line too long on FD: " << fd << std::endl;
+            std::string err = "500 Command line too long\n";
+            send(fd, err.c_str(), err.length(), MSG_NOSIGNAL);
+            removeClient(fd, true);
+            return;
         }
-    }
-    
-    else if (command == CMD_REVOKE_SHARE) {
-        // Arg format: file_id target_username
-        long long file_id = 0;
-        std::string target_username;
         
-        std::stringstream ss_revoke(arg);
-        ss_revoke >> file_id >> target_username;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
         
-        std::cout << "[Worker] REVOKE_SHARE: file_id=" << file_id << ", target=" << target_username << std::endl;
-        
-        if (!sessions[fd].isAuthenticated) {
-            response = std::string(CODE_FAIL) + " Not authenticated\n";
-        } else if (file_id <= 0 || target_username.empty()) {
-            response = std::string(CODE_FAIL) + " Invalid arguments\n";
-        } else {
-            bool success = DBManager::getInstance().revokeShare(file_id, sessions[fd].username, target_username);
-            if (success) {
-                response = std::string(CODE_OK) + " Share revoked\n";
-            } else {
-                response = std::string(CODE_FAIL) + " Failed to revoke share\n";
-            }
+        auto start = std::chrono::steady_clock::now();
+        lastCommand.clear();
+        handleCommand(fd, line);
+        if (!lastCommand.empty()) {
+            auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            ThreadMonitor::getInstance().reportCommandLatency(lastCommand, micros);
         }
-    }
-    
-    else if (command == CMD_GET_MY_SHARE_CODES) {
-        std::cout << "[Worker] GET_MY_SHARE_CODES for user: " << sessions[fd].username << std::endl;
         
-        if (!sessions[fd].isAuthenticated) {
-            response = std::string(CODE_FAIL) + " Not authenticated\n";
-        } else {
-            std::vector<ShareCodeInfo> codes = DBManager::getInstance().getMyShareCodes(sessions[fd].username);
-            std::stringstream ss_resp;
-            ss_resp << CODE_OK << " " << codes.size() << "\n";
-            for (const auto& code : codes) {
-                ss_resp << code.code_id << "|" << code.share_code << "|" << code.file_id << "|"
-                       << code.filename << "|" << (code.is_folder ? "1" : "0") << "|"
-                       << code.max_uses << "|" << code.current_uses << "|" << code.created_at << "\n";
-            }
-            response = ss_resp.str();
-        }
+        // Transfer epoll đang giữ socket: các dòng còn lại chạy sau khi transfer xong
+        if (transfers.count(fd)) return;
     }
-    
-    else if (command == CMD_DELETE_SHARE_CODE) {
-        std::string share_code = arg;
-        
-        std::cout << "[Worker] DELETE_SHARE_CODE: code=" << share_code << std::endl;
-        
-        if (!sessions[fd].isAuthenticated) {
-            response = std::string(CODE_FAIL) + " Not authenticated\n";
-        } else if (share_code.empty()) {
-            response = std::string(CODE_FAIL) + " Invalid share code\n";
-        } else {
-            bool success = DBManager::getInstance().deleteShareCode(share_code, sessions[fd].username);
-            if (success) {
-                response = std::string(CODE_OK) + " Share code deleted\n";
-            } else {
-                response = std::string(CODE_FAIL) + " Failed to delete share code\n";
-            }
-        }
+}
+
+// Tách token tiếp theo (phân cách bởi khoảng trắng); arg bị cắt bỏ phần đã đọc
+static std::string_view nextToken(std::string_view& arg) {
+    size_t start = arg.find_first_not_of(" \t");
+    if (start == std::string_view::npos) {
+        arg = std::string_view();
+        return arg;
     }
-    
-    // ===== GUEST MODE COMMANDS =====
-    
-    else if (command == CMD_GUEST_REDEEM) {
-        std::string share_code = arg;
-        std::cout << "[Worker] GUEST_REDEEM: code=" << share_code << std::endl;
-        
-        if (share_code.empty()) {
-            response = std::string(CODE_FAIL) + " Invalid share code\n";
-        } else {
-            long long file_id;
-            std::string filename;
-            bool is_folder;
-            std::string owner;
-            long long size;
-            
-            bool success = DBManager::getInstance().guestRedeemShareCode(
-                share_code, file_id, filename, is_folder, owner, size);
-            
-            if (success) {
-                // Format: 200 file_id|filename|is_folder|owner|size
-                response = std::string(CODE_OK) + " " + 
-                          std::to_string(file_id) + "|" + 
-                          filename + "|" + 
-                          (is_folder ? "1" : "0") + "|" + 
-                          owner + "|" + 
-                          std::to_string(size) + "\n";
-            } else {
-                response = std::string(CODE_FAIL) + " Invalid or expired share code\n";
-            }
+    arg.remove_prefix(start);
+    size_t end = std::min(arg.find_first_of(" \t"), arg.size());
+    std::string_view token = arg.substr(0, end);
+    arg.remove_prefix(end);
+    return token;
+}
+
+// Parse số không cấp phát (from_chars); token không hợp lệ -> fallback
+template <typename T>
+static T parseNumber(std::string_view token, T fallback) {
+    T value;
+    auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+    return result.ec == std::errc() ? value : fallback;
+}
+
+WorkerThread::CommandHandler WorkerThread::findCommand(std::string_view name) {
+    // Sắp xếp theo tên để tìm nhị phân; static_assert giữ đúng thứ tự khi thêm lệnh mới
+    static constexpr CommandEntry COMMANDS[] = {
+        {CMD_ACCEPT_FOLDER_COPY,    &WorkerThread::cmdAcceptFolderCopy},
+        {CMD_CANCEL_FOLDER_SHARE,   &WorkerThread::cmdCancelFolderShare},
+        {CMD_CHECK_SHARE_PROGRESS,  &WorkerThread::cmdCheckShareProgress},
+        {CMD_CHUNK_QUERY,           &WorkerThread::cmdChunkQuery},
+        {CMD_CREATE_FOLDER,         &WorkerThread::cmdCreateFolder},
+        {CMD_DELETE,                &WorkerThread::cmdDelete},
+        {CMD_DELETE_SHARE_CODE,     &WorkerThread::cmdDeleteShareCode},
+        {CMD_DOWNLOAD_FOLDER,       &WorkerThread::cmdDownloadFolder},
+        {CMD_GENERATE_SHARE_CODE,   &WorkerThread::cmdGenerateShareCode},
+        {CMD_GET_FOLDER_OFFERS,     &WorkerThread::cmdGetFolderOffers},
+        {CMD_GET_FOLDER_STRUCTURE,  &WorkerThread::cmdGetFolderStructure},
+        {CMD_GET_MY_SHARES,         &WorkerThread::cmdGetMyShares},
+        {CMD_GET_MY_SHARE_CODES,    &WorkerThread::cmdGetMyShareCodes},
+        {CMD_GUEST_DOWNLOAD,        &WorkerThread::cmdGuestDownload},
+        {CMD_GUEST_DOWNLOAD_FOLDER, &WorkerThread::cmdGuestDownloadFolder},
+        {CMD_GUEST_LIST,            &WorkerThread::cmdGuestList},
+        {CMD_GUEST_REDEEM,          &WorkerThread::cmdGuestRedeem},
+        {CMD_LIST,                  &WorkerThread::cmdList},
+        {CMD_LISTSHARED,            &WorkerThread::cmdListShared},
+        {CMD_PASS,                  &WorkerThread::cmdPass},
+        {CMD_PUT_CHUNK,             &WorkerThread::cmdPutChunk},
+        {CMD_REDEEM_SHARE_CODE,     &WorkerThread::cmdRedeemShareCode},
+        {CMD_REGISTER,              &WorkerThread::cmdRegister},
+        {CMD_RENAME,                &WorkerThread::cmdRename},
+        {CMD_DOWNLOAD,              &WorkerThread::cmdDownload},
+        {CMD_REVOKE_SHARE,          &WorkerThread::cmdRevokeShare},
+        {CMD_SEARCH,                &WorkerThread::cmdSearch},
+        {CMD_SHARE,                 &WorkerThread::cmdShare},
+        {CMD_SHARE_FOLDER,          &WorkerThread::cmdShareFolder},
+        {CMD_UPLOAD_CHECK,          &WorkerThread::cmdQuotaCheck},
+        {CMD_UPLOAD,                &WorkerThread::cmdUpload},
+        {CMD_STOR_CHUNKED,          &WorkerThread::cmdStorChunked},
+        {CMD_USER,                  &WorkerThread::cmdUser},
+    };
+    constexpr auto isSorted = [](const auto& table) {
+        for (size_t i = 1; i < std::size(table); i++) {
+            if (!(table[i - 1].name < table[i].name)) return false;
         }
+        return true;
+    };
+    static_assert(isSorted(COMMANDS), "COMMANDS phải sắp xếp theo tên");
+
+    auto it = std::lower_bound(std::begin(COMMANDS), std::end(COMMANDS), name,
+                               [](const CommandEntry& entry, std::string_view key) { return entry.name < key; });
+    return (it != std::end(COMMANDS) && it->name == name) ? it->handler : nullptr;
+}
+
+std::string_view WorkerThread::splitCommand(std::string_view line, std::string_view& arg) {
+    std::string_view quotaPrefix(CMD_UPLOAD_CHECK);
+    if (line.substr(0, quotaPrefix.size()) == quotaPrefix) {
+        // Lệnh duy nhất có khoảng trắng trong tên
+        arg = line.substr(std::min(line.size(), quotaPrefix.size() + 1));
+        return quotaPrefix;
     }
-    
-    else if (command == CMD_GUEST_LIST) {
-        long long folder_id = 0;
-        try {
-            folder_id = std::stoll(arg);
-        } catch (...) {
-            folder_id = 0;
-        }
-        
-        std::cout << "[Worker] GUEST_LIST: folder_id=" << folder_id << std::endl;
-        
-        std::vector<FileRecordEx> files = DBManager::getInstance().guestListFolder(folder_id);
-        
-        // Format: 200 file_id|filename|is_folder|size|owner;file_id|...
-        std::string data;
-        for (const auto& file : files) {
-            if (!data.empty()) data += ";";
-            data += std::to_string(file.file_id) + "|" + 
-                   file.name + "|" + 
-                   (file.is_folder ? "1" : "0") + "|" + 
-                   std::to_string(file.size) + "|" + 
-                   file.owner;
+    arg = line;
+    std::string_view command = nextToken(arg);
+    if (!arg.empty() && arg[0] == ' ') arg.remove_prefix(1);
+    return command;
+}
+
+void WorkerThread::handleCommand(int fd, std::string msg) {
+    std::cout << "[Recv FD:" << fd << "]: " << msg << '\n';
+
+    std::string_view arg;
+    std::string_view command = splitCommand(msg, arg);
+
+    std::string response;
+    CommandHandler handler = findCommand(command);
+    if (handler) {
+        lastCommand.assign(command.data(), command.size());
+        response = (this->*handler)(fd, arg);
+    } else {
+        std::cout << "[Worker] UNKNOWN COMMAND: '" << command << "'\n";
+        lastCommand.clear();  // Không tạo mục latency cho lệnh rác
+        response = "500 Unknown command\n";
+    }
+
+    if (!response.empty()) {
+        queueResponse(fd, std::move(response));
+    }
+}
+
+std::string WorkerThread::cmdUser(int fd, std::string_view arg) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return AuthHandler::handleUser(fd, sessions[fd], std::string(arg));
+}
+
+std::string WorkerThread::cmdPass(int fd, std::string_view arg) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return AuthHandler::handlePass(fd, sessions[fd], std::string(arg));
+}
+
+std::string WorkerThread::cmdRegister(int, std::string_view arg) {
+    std::string_view u = nextToken(arg);
+    std::string_view p = nextToken(arg);
+    if (u.empty() || p.empty()) return std::string(CODE_FAIL) + " Invalid format\n";
+    return AuthHandler::handleRegister(std::string(u), std::string(p));
+}
+
+// LIST <parent_id> [<sort> <page_size> [cursor]]: có sort thì trả về một trang
+std::string WorkerThread::cmdList(int fd, std::string_view arg) {
+    long long parent_id = parseNumber(nextToken(arg), 0LL);
+    std::string sort(nextToken(arg));
+    long long pageSize = parseNumber(nextToken(arg), 0LL);
+    std::string cursor(nextToken(arg));
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!sort.empty()) return CmdHandler::handleListPage(sessions[fd], parent_id, sort, pageSize, cursor);
+    return CmdHandler::handleList(sessions[fd], parent_id);
+}
+
+std::string WorkerThread::cmdListShared(int fd, std::string_view arg) {
+    long long parent_id = parseNumber(nextToken(arg), -1LL);
+    std::string sort(nextToken(arg));
+    long long pageSize = parseNumber(nextToken(arg), 0LL);
+    std::string cursor(nextToken(arg));
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!sort.empty()) return CmdHandler::handleListSharedPage(sessions[fd], parent_id, sort, pageSize, cursor);
+    return CmdHandler::handleListShared(sessions[fd], parent_id);
+}
+
+std::string WorkerThread::cmdSearch(int fd, std::string_view arg) {
+    std::string keyword(nextToken(arg));
+    long long page = parseNumber(nextToken(arg), 0LL);
+    std::lock_guard<std::mutex> lock(mtx);
+    return CmdHandler::handleSearch(sessions[fd], keyword, page);
+}
+
+std::string WorkerThread::cmdShare(int fd, std::string_view arg) {
+    std::string fname(nextToken(arg));
+    std::string target(nextToken(arg));
+    std::lock_guard<std::mutex> lock(mtx);
+    return CmdHandler::handleShare(sessions[fd], fname, target);
+}
+
+std::string WorkerThread::cmdDelete(int fd, std::string_view arg) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return CmdHandler::handleDelete(sessions[fd], std::string(arg));
+}
+
+std::string WorkerThread::cmdRename(int fd, std::string_view arg) {
+    long long fileId = parseNumber(nextToken(arg), 0LL);
+    std::string newName(nextToken(arg));
+
+    std::cout << "[RENAME] Received: file_id=" << fileId << ", new_name='" << newName
+              << "', username=" << sessions[fd].username << '\n';
+
+    std::lock_guard<std::mutex> lock(mtx);
+    return CmdHandler::handleRename(sessions[fd], fileId, newName);
+}
+
+std::string WorkerThread::cmdQuotaCheck(int fd, std::string_view arg) {
+    std::string_view fname = nextToken(arg);
+    long fsize = parseNumber(nextToken(arg), 0L);
+
+    std::cout << "[Worker] Checking quota for: " << fname << ", Size: " << fsize << '\n';
+
+    std::lock_guard<std::mutex> lock(mtx);
+    return FileIOHandler::handleQuotaCheck(sessions[fd], fsize);
+}
+
+std::string WorkerThread::cmdUpload(int fd, std::string_view arg) {
+    std::string fname(nextToken(arg));
+    long fsize = parseNumber(nextToken(arg), 0L);
+    long long parent_id = parseNumber(nextToken(arg), 0LL);
+
+    std::cout << "[Worker::CMD_UPLOAD] File: " << fname << ", Size: " << fsize << ", Parent ID: " << parent_id << '\n';
+
+    std::string response;
+    if (fsize <= 0) {
+        std::cout << "[Worker::CMD_UPLOAD] Invalid file size\n";
+        return std::string(CODE_FAIL) + " Invalid file size\n";
+    }
+
+    // Chỗ đã giữ bởi QUOTA_CHECK; client bỏ qua bước đó hoặc khai size lớn hơn thì giữ chỗ tại đây
+    std::shared_ptr<QuotaReservation> quota;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        quota = std::move(sessions[fd].quotaReservation);
+        sessions[fd].quotaReservation.reset();
+    }
+    if (!quota || quota->size() < fsize) {
+        quota.reset();
+        quota = QuotaLedger::getInstance().reserve(sessions[fd].userId, fsize);
+    }
+    if (!quota) {
+        std::cout << "[Worker::CMD_UPLOAD] Quota exceeded\n";
+        return std::string(CODE_FAIL) + " Quota exceeded\n";
+    }
+
+    if (ServerConfig::transferMode == TransferMode::Epoll) {
+        auto transfer = canStartTransfer()
+            ? TransferStateMachine::createUpload(fd, fname, fsize, sessions[fd], parent_id, quota, response) : nullptr;
+        if (transfer) {
+            startTransfer(fd, std::move(transfer));
+            return {};
         }
-        response = std::string(CODE_OK) + " " + data + "\n";
+        if (response.empty()) response = "503 System overloaded\n";
+    } else {
+        TransferPriority priority = fsize <= ServerConfig::SMALL_TRANSFER_BYTES
+                                    ? TransferPriority::High : TransferPriority::Normal;
+        bool queued = handOffTransfer(fd, priority,
+            [fd, fname, fsize, parent_id, quota, this](const ClientSession& session) mutable {
+                DedicatedThread dt;
+                dt.handleUpload(fd, fname, fsize, session, parent_id, this);
+                quota.reset();  // addFile đã cộng vào storage_used: trả chỗ đã giữ
+            });
+        if (queued) return {};
+
+        std::cout << "[Worker::CMD_UPLOAD] System overloaded\n";
+        response = "503 System overloaded\n";
     }
-    
-    else if (command == "GUEST_DOWNLOAD") {
-        long long file_id = 0;
-        try {
-            file_id = std::stoll(arg);
-        } catch (...) {
-            file_id = 0;
+    return response;
+}
+
+std::string WorkerThread::cmdDownload(int fd, std::string_view arg) {
+    std::string fname(arg);
+    std::cout << "[Worker::CMD_DOWNLOAD] File: " << fname << ", User: " << sessions[fd].username << '\n';
+
+    bool hasPerm = false;
+    long long blob_id = -1;
+    {
+         std::lock_guard<std::mutex> lock(mtx);
+         hasPerm = FileIOHandler::checkDownloadPermission(sessions[fd], fname, blob_id);
+    }
+
+    std::string response;
+    if (!hasPerm) {
+        std::cout << "[Worker::CMD_DOWNLOAD] Permission denied\n";
+        response = std::string(CODE_FAIL) + " Permission denied\n";
+    } else if (ServerConfig::transferMode == TransferMode::Epoll) {
+        auto transfer = canStartTransfer()
+            ? TransferStateMachine::createDownload(fd, blob_id, fname, true, response) : nullptr;
+        if (transfer) {
+            startTransfer(fd, std::move(transfer));
+            return {};
         }
-        
-        std::cout << "[Worker] GUEST_DOWNLOAD: file_id=" << file_id << std::endl;
-        
-        FileRecordEx fileInfo = DBManager::getInstance().getFileInfo(file_id);
-        
-        if (fileInfo.file_id < 0) {
-            std::cout << "[Worker] File not found" << std::endl;
-            response = std::string(CODE_FAIL) + " File not found\n";
-        } else if (fileInfo.is_folder) {
-            std::cout << "[Worker] Target is a folder, not a file" << std::endl;
-            response = std::string(CODE_FAIL) + " Not a file\n";
-        } else {
-            std::cout << "[Worker] File found, sending..." << std::endl;
-            response = std::string(CODE_DATA_OPEN) + " " + std::to_string(fileInfo.size) + "\n";
-            send(fd, response.c_str(), response.length(), 0);
-            
-            DedicatedThread dt;
-            dt.handleDownload(fd, fileInfo.name, "guest", this);
-            return;
+        if (response.empty()) response = "503 System overloaded\n";
+    } else {
+        TransferPriority priority = isSmallFile(blob_id, fname) ? TransferPriority::High : TransferPriority::Normal;
+        bool queued = handOffTransfer(fd, priority,
+            [fd, blob_id, fname, this](const ClientSession& session) {
+                DedicatedThread dt;
+                dt.handleDownload(fd, blob_id, fname, session, this);
+            });
+        if (queued) return {};
+
+        std::cout << "[Worker::CMD_DOWNLOAD] System overloaded\n";
+        response = "503 System overloaded\n";
+    }
+    return response;
+}
+
+std::string WorkerThread::cmdDownloadFolder(int fd, std::string_view arg) {
+    // Parse folder_id từ client (thay vì folder_name)
+    long long folder_id = parseNumber(nextToken(arg), 0LL);
+    std::string username = sessions[fd].username;
+
+    std::cout << "[Worker] DOWNLOAD_FOLDER request: folder_id=" << folder_id << " by user: " << username << '\n';
+
+    // Kiểm tra folder tồn tại trong database
+    FileRecordEx folderInfo = DBManager::getInstance().getFileInfo(folder_id);
+    if (folderInfo.file_id < 0 || !folderInfo.is_folder) {
+        std::cout << "[Worker] Folder not found in database or not a folder\n";
+        return std::string(CODE_FAIL) + " Folder not found\n";
+    }
+
+    std::cout << "[Worker] Folder found in DB: " << folderInfo.name << ", checking permissions...\n";
+
+    // Kiểm tra quyền - user sở hữu hoặc được share
+    long long user_id = sessions[fd].userId;
+    bool hasPerm = (folderInfo.owner_id == user_id);
+    if (!hasPerm) {
+        hasPerm = DBManager::getInstance().hasSharedAccess(folder_id, user_id);
+    }
+    if (!hasPerm) {
+        std::cout << "[Worker] Permission denied\n";
+        return std::string(CODE_FAIL) + " Permission denied\n";
+    }
+
+    std::cout << "[Worker] Permission OK, sending folder...\n";
+    if (startFolderDownload(fd, folder_id, folderInfo.name)) return {};
+    return "503 System overloaded\n";
+}
+
+std::string WorkerThread::cmdGetFolderStructure(int fd, std::string_view arg) {
+    long long folder_id = parseNumber(nextToken(arg), 0LL);
+
+    std::cout << "[Worker::CMD_GET_FOLDER_STRUCTURE] Folder ID: " << folder_id << ", User: " << sessions[fd].username << '\n';
+
+    std::lock_guard<std::mutex> lock(mtx);
+    return CmdHandler::handleGetFolderStructure(sessions[fd], folder_id);
+}
+
+std::string WorkerThread::cmdShareFolder(int fd, std::string_view arg) {
+    // SHARE_FOLDER <folder_id> <user> [COPY]
+    long long folder_id = parseNumber(nextToken(arg), 0LL);
+    std::string target_user(nextToken(arg));
+    bool copy = nextToken(arg) == "COPY";
+
+    std::cout << "[Worker::CMD_SHARE_FOLDER] Folder ID: " << folder_id << ", Target: " << target_user
+              << (copy ? " (copy)" : "") << ", User: " << sessions[fd].username << '\n';
+
+    std::lock_guard<std::mutex> lock(mtx);
+    return CmdHandler::handleShareFolder(sessions[fd], folder_id, target_user, copy);
+}
+
+std::string WorkerThread::cmdChunkQuery(int fd, std::string_view arg) {
+    if (!sessions[fd].isAuthenticated) {
+        return std::string(CODE_FAIL) + " Please login first\n";
+    }
+
+    // "h1,h2,..." -> mỗi hash một ký tự theo thứ tự: 1 = user chưa có, client phải PUT_CHUNK.
+    // Chỉ tính chunk user đã gửi hoặc nằm trong file của chính user: không lộ file của người khác
+    std::string_view list = nextToken(arg);
+    std::vector<ChunkRef> chunks;
+    while (!list.empty()) {
+        size_t comma = std::min(list.find(','), list.size());
+        std::string hash(list.substr(0, comma));
+        list.remove_prefix(std::min(comma + 1, list.size()));
+        if (!ChunkStore::isValidHash(hash) || chunks.size() >= CHUNK_QUERY_MAX) {
+            return std::string(CODE_FAIL) + " Invalid chunk list\n";
         }
+        chunks.push_back({std::move(hash), -1});
     }
-    
-    else if (command == "GUEST_DOWNLOAD_FOLDER") {
-        long long folder_id = 0;
-        try {
-            folder_id = std::stoll(arg);
-        } catch (...) {
-            folder_id = 0;
+    if (chunks.empty()) {
+        return std::string(CODE_FAIL) + " Invalid chunk list\n";
+    }
+    if (!DBManager::getInstance().findHeldChunks(sessions[fd].userId, chunks)) {
+        return std::string(CODE_FAIL) + " Cannot query chunks\n";
+    }
+    std::string missing;
+    for (const ChunkRef& chunk : chunks) missing.push_back(chunk.size < 0 ? '1' : '0');
+    return std::string(CODE_OK) + " " + missing + "\n";
+}
+
+std::string WorkerThread::cmdPutChunk(int fd, std::string_view arg) {
+    std::string hash(nextToken(arg));
+    long size = parseNumber(nextToken(arg), 0L);
+
+    if (!sessions[fd].isAuthenticated) {
+        return std::string(CODE_FAIL) + " Please login first\n";
+    }
+    if (!ChunkStore::isValidHash(hash) || size <= 0 || size > CHUNK_MAX_BYTES) {
+        return std::string(CODE_FAIL) + " Invalid chunk\n";
+    }
+    // Chỉ bỏ qua chunk chính user đã có; chunk user khác đã gửi vẫn phải nhận đủ dữ liệu
+    long long user_id = sessions[fd].userId;
+    std::vector<ChunkRef> held{{hash, -1}};
+    if (!DBManager::getInstance().findHeldChunks(user_id, held)) {
+        return std::string(CODE_FAIL) + " Cannot query chunks\n";
+    }
+    if (held[0].size >= 0) {
+        return std::string(CODE_OK) + " Chunk already stored\n";
+    }
+    // Chunk chưa được STOR_CHUNKED dùng vẫn tính vào quota cho tới khi hết hạn
+    auto quota = QuotaLedger::getInstance().reserve(user_id, size);
+    if (!quota) {
+        return std::string(CODE_FAIL) + " Quota exceeded\n";
+    }
+
+    std::string tempPath = BlobStore::newTempPath();
+    return startTempUpload(fd, tempPath, size, [tempPath, hash, size, user_id, quota]() {
+        return ChunkStore::storeUploaded(tempPath, hash, size, user_id)
+            ? std::string(CODE_TRANSFER_COMPLETE) + " Chunk stored\n"
+            : std::string(CODE_FAIL) + " Chunk rejected\n";
+    });
+}
+
+// STOR_CHUNKED: manifest trong file tạm là count digest liên tiếp; mọi chunk phải là chunk user
+// đã PUT_CHUNK hoặc nằm trong file của chính user (biết hash thôi thì không đủ)
+static std::string commitChunkedFile(const std::string& manifestPath, const std::string& fname,
+                                     long long parent_id, long long user_id, long count) {
+    std::vector<ChunkRef> chunks;
+    if (!ChunkStore::readManifest(manifestPath, count, chunks)) {
+        return std::string(CODE_FAIL) + " Cannot read manifest\n";
+    }
+    long long pendingBytes = 0;
+    if (!DBManager::getInstance().findHeldChunks(user_id, chunks, &pendingBytes)) {
+        return std::string(CODE_FAIL) + " Cannot query chunks\n";
+    }
+
+    long long total = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (chunks[i].size < 0) {
+            return std::string(CODE_FAIL) + " Missing chunk " + std::to_string(i) + "\n";
         }
-        
-        std::cout << "[Worker] GUEST_DOWNLOAD_FOLDER: folder_id=" << folder_id << std::endl;
-        
-        FileRecordEx folderInfo = DBManager::getInstance().getFileInfo(folder_id);
-        
-        if (folderInfo.file_id < 0 || !folderInfo.is_folder) {
-            std::cout << "[Worker] Folder not found" << std::endl;
-            response = std::string(CODE_FAIL) + " Folder not found\n";
-        } else {
-            std::cout << "[Worker] Folder found, sending..." << std::endl;
-            response = std::string(CODE_DATA_OPEN) + " Ready to send folder\n";
-            send(fd, response.c_str(), response.length(), 0);
-            
-            DedicatedThread dt;
-            dt.handleFolderDownload(fd, folder_id, folderInfo.name, "guest", this);
-            return;
+        total += chunks[i].size;
+    }
+
+    // Quota tính theo kích thước file, không theo dung lượng thực sau khử trùng lặp.
+    // Phần đã PUT_CHUNK đã nằm trong storage_used, addFile chuyển nó sang tính cho file
+    auto quota = QuotaLedger::getInstance().reserve(user_id, total - pendingBytes);
+    if (!quota) {
+        return std::string(CODE_FAIL) + " Quota exceeded\n";
+    }
+    long long file_id = DBManager::getInstance().addFile(fname, total, user_id, parent_id, &chunks);
+    if (file_id < 0) {
+        std::cerr << "[Worker] STOR_CHUNKED: Database save error for " << fname << '\n';
+        return std::string(CODE_FAIL) + " Failed to save file\n";
+    }
+    std::cout << "[Worker] STOR_CHUNKED: " << fname << " (" << total << " bytes, " << count << " chunks)\n";
+    return std::string(CODE_TRANSFER_COMPLETE) + " Upload success\n";
+}
+
+std::string WorkerThread::cmdStorChunked(int fd, std::string_view arg) {
+    std::string fname(nextToken(arg));
+    long long parent_id = parseNumber(nextToken(arg), 0LL);
+    long count = parseNumber(nextToken(arg), 0L);
+
+    std::cout << "[Worker] STOR_CHUNKED: File: " << fname << ", Parent ID: " << parent_id << ", Chunks: " << count << '\n';
+
+    if (!sessions[fd].isAuthenticated) {
+        return std::string(CODE_FAIL) + " Please login first\n";
+    }
+    if (fname.empty() || count <= 0 || count > CHUNK_MANIFEST_MAX) {
+        return std::string(CODE_FAIL) + " Invalid manifest\n";
+    }
+
+    // Sau dòng lệnh: count digest SHA-256 (32 byte nhị phân mỗi chunk) theo thứ tự trong file
+    long long user_id = sessions[fd].userId;
+    std::string tempPath = BlobStore::newTempPath();
+    return startTempUpload(fd, tempPath, count * static_cast<long>(ChunkStore::DIGEST_BYTES),
+        [tempPath, fname, parent_id, user_id, count]() {
+            return commitChunkedFile(tempPath, fname, parent_id, user_id, count);
+        });
+}
+
+std::string WorkerThread::cmdCreateFolder(int fd, std::string_view arg) {
+    std::string foldername(nextToken(arg));
+    long long parent_id = parseNumber(nextToken(arg), 0LL);
+
+    if (!sessions[fd].isAuthenticated) {
+        return std::string(CODE_FAIL) + " Please login first\n";
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    long long folder_id = DBManager::getInstance().createFolder(foldername, parent_id, sessions[fd].userId);
+    if (folder_id == -1) {
+        std::cerr << "[Server] Failed to create folder: " << foldername << '\n';
+        return std::string(CODE_FAIL) + " Failed to create folder\n";
+    }
+    std::cout << "[Server] Created folder: " << foldername << " (ID: " << folder_id << ")\n";
+    return std::string(CODE_OK) + " Folder created|FOLDER_ID:" + std::to_string(folder_id) + "\n";
+}
+
+std::string WorkerThread::cmdAcceptFolderCopy(int fd, std::string_view arg) {
+    std::string session_id(nextToken(arg));
+    std::cout << "[Worker] ACCEPT_FOLDER_COPY: " << session_id << '\n';
+
+    if (!sessions[fd].isAuthenticated) {
+        return std::string(CODE_FAIL) + " Please login first\n";
+    }
+    // Chép cả cây có thể mất vài giây: không chạy trên event loop của worker
+    long long user_id = sessions[fd].userId;
+    bool queued = handOffCommand(fd, TransferPriority::Normal, [session_id, user_id]() {
+        long long fileCount = 0;
+        long long folder_id = FolderShareHandler::getInstance().acceptFolderShare(session_id, user_id, fileCount);
+        if (folder_id == -1) {
+            return std::string(CODE_FAIL) + " Failed to copy folder\n";
         }
+        return std::string(CODE_OK) + " Folder copied|FOLDER_ID:" + std::to_string(folder_id) +
+               "|FILES:" + std::to_string(fileCount) + "\n";
+    });
+    if (queued) return {};
+    return "503 System overloaded\n";
+}
+
+std::string WorkerThread::cmdGetFolderOffers(int fd, std::string_view) {
+    if (!sessions[fd].isAuthenticated) {
+        return std::string(CODE_FAIL) + " Please login first\n";
     }
-    
-    else {
-        std::cout << "[Worker] UNKNOWN COMMAND: '" << command << "'" << std::endl;
-        response = "500 Unknown command\n";
+    auto offers = FolderShareHandler::getInstance().pendingOffers(sessions[fd].userId);
+    std::string response = std::string(CODE_OK) + " " + std::to_string(offers.size()) + "\n";
+    for (const auto& offer : offers) {
+        response += offer->session_id + "|" + std::to_string(offer->source_folder_id) + "|" + offer->folder_name + "|"
+                  + offer->owner_username + "\n";
     }
+    return response;
+}
 
-    if (!response.empty()) {
-        send(fd, response.c_str(), response.length(), 0);
+// Phiên chỉ người share và người nhận được xem/hủy
+static std::shared_ptr<FolderShareSession> findShareSession(const std::string& session_id, long long user_id) {
+    auto share = FolderShareHandler::getInstance().getSession(session_id);
+    if (!share || (share->owner_id != user_id && share->recipient_id != user_id)) return nullptr;
+    return share;
+}
+
+std::string WorkerThread::cmdCheckShareProgress(int fd, std::string_view arg) {
+    std::string session_id(arg);
+    std::cout << "[Worker] CHECK_SHARE_PROGRESS: " << session_id << '\n';
+
+    if (!findShareSession(session_id, sessions[fd].userId)) {
+        return std::string(CODE_FAIL) + " Session not found\n";
+    }
+    std::string progress = FolderShareHandler::getInstance().getProgress(session_id);
+    return "200 " + progress + "\n";
+}
+
+std::string WorkerThread::cmdCancelFolderShare(int fd, std::string_view arg) {
+    std::string session_id(arg);
+    std::cout << "[Worker] CANCEL_FOLDER_SHARE: " << session_id << '\n';
+
+    if (!findShareSession(session_id, sessions[fd].userId)) {
+        return std::string(CODE_FAIL) + " Session not found\n";
+    }
+    FolderShareHandler::getInstance().cleanup(session_id);
+    return "200 Share cancelled\n";
+}
+
+// ===== SHARE CODE COMMANDS =====
+
+std::string WorkerThread::cmdGenerateShareCode(int fd, std::string_view arg) {
+    // Arg format: file_id [max_uses]
+    long long file_id = parseNumber(nextToken(arg), 0LL);
+    int max_uses = parseNumber(nextToken(arg), 0);
+
+    std::cout << "[Worker] GENERATE_SHARE_CODE: file_id=" << file_id << ", max_uses=" << max_uses << '\n';
+
+    if (!sessions[fd].isAuthenticated) {
+        return std::string(CODE_FAIL) + " Not authenticated\n";
+    }
+    if (file_id <= 0) {
+        return std::string(CODE_FAIL) + " Invalid file_id\n";
+    }
+    std::string code = DBManager::getInstance().generateShareCode(file_id, sessions[fd].userId, max_uses);
+    if (code.empty()) {
+        return std::string(CODE_FAIL) + " Failed to generate share code\n";
+    }
+    return std::string(CODE_OK) + " " + code + "\n";
+}
+
+std::string WorkerThread::cmdRedeemShareCode(int fd, std::string_view arg) {
+    std::string share_code(arg);
+    std::cout << "[Worker] REDEEM_SHARE_CODE: code=" << share_code << '\n';
+
+    if (!sessions[fd].isAuthenticated) {
+        return std::string(CODE_FAIL) + " Not authenticated\n";
+    }
+    if (share_code.empty()) {
+        return std::string(CODE_FAIL) + " Invalid share code\n";
+    }
+    long long file_id = DBManager::getInstance().redeemShareCode(share_code, sessions[fd].userId);
+    if (file_id < 0) {
+        return std::string(CODE_FAIL) + " Invalid or expired share code\n";
+    }
+    FileRecordEx fileInfo = DBManager::getInstance().getFileById(file_id);
+    return std::string(CODE_OK) + " " + std::to_string(file_id) + "|" +
+           fileInfo.name + "|" + (fileInfo.is_folder ? "1" : "0") + "|" + fileInfo.owner + "\n";
+}
+
+std::string WorkerThread::cmdGetMyShares(int fd, std::string_view) {
+    std::cout << "[Worker] GET_MY_SHARES for user: " << sessions[fd].username << '\n';
+
+    if (!sessions[fd].isAuthenticated) {
+        return std::string(CODE_FAIL) + " Not authenticated\n";
+    }
+    std::vector<ShareInfo> shares = DBManager::getInstance().getMyShares(sessions[fd].userId);
+    std::string response = std::string(CODE_OK) + " " + std::to_string(shares.size()) + "\n";
+    for (const auto& share : shares) {
+        response += std::to_string(share.shared_id) + "|" + std::to_string(share.file_id) + "|" + share.filename + "|"
+                  + (share.is_folder ? "1" : "0") + "|" + share.shared_with_username + "|"
+                  + share.permission + "|" + share.shared_at + "\n";
+    }
+    return response;
+}
+
+std::string WorkerThread::cmdRevokeShare(int fd, std::string_view arg) {
+    // Arg format: file_id target_username
+    long long file_id = parseNumber(nextToken(arg), 0LL);
+    std::string target_username(nextToken(arg));
+
+    std::cout << "[Worker] REVOKE_SHARE: file_id=" << file_id << ", target=" << target_username << '\n';
+
+    if (!sessions[fd].isAuthenticated) {
+        return std::string(CODE_FAIL) + " Not authenticated\n";
+    }
+    if (file_id <= 0 || target_username.empty()) {
+        return std::string(CODE_FAIL) + " Invalid arguments\n";
+    }
+    bool success = DBManager::getInstance().revokeShare(file_id, sessions[fd].userId, target_username);
+    if (!success) {
+        return std::string(CODE_FAIL) + " Failed to revoke share\n";
+    }
+    return std::string(CODE_OK) + " Share revoked\n";
+}
+
+std::string WorkerThread::cmdGetMyShareCodes(int fd, std::string_view) {
+    std::cout << "[Worker] GET_MY_SHARE_CODES for user: " << sessions[fd].username << '\n';
+
+    if (!sessions[fd].isAuthenticated) {
+        return std::string(CODE_FAIL) + " Not authenticated\n";
+    }
+    std::vector<ShareCodeInfo> codes = DBManager::getInstance().getMyShareCodes(sessions[fd].userId);
+    std::string response = std::string(CODE_OK) + " " + std::to_string(codes.size()) + "\n";
+    for (const auto& code : codes) {
+        response += std::to_string(code.code_id) + "|" + code.share_code + "|" + std::to_string(code.file_id) + "|"
+                  + code.filename + "|" + (code.is_folder ? "1" : "0") + "|"
+                  + std::to_string(code.max_uses) + "|" + std::to_string(code.current_uses) + "|" + code.created_at + "\n";
+    }
+    return response;
+}
+
+std::string WorkerThread::cmdDeleteShareCode(int fd, std::string_view arg) {
+    std::string share_code(arg);
+    std::cout << "[Worker] DELETE_SHARE_CODE: code=" << share_code << '\n';
+
+    if (!sessions[fd].isAuthenticated) {
+        return std::string(CODE_FAIL) + " Not authenticated\n";
+    }
+    if (share_code.empty()) {
+        return std::string(CODE_FAIL) + " Invalid share code\n";
+    }
+    bool success = DBManager::getInstance().deleteShareCode(share_code, sessions[fd].userId);
+    if (!success) {
+        return std::string(CODE_FAIL) + " Failed to delete share code\n";
+    }
+    return std::string(CODE_OK) + " Share code deleted\n";
+}
+
+// ===== GUEST MODE COMMANDS =====
+
+std::string WorkerThread::cmdGuestRedeem(int, std::string_view arg) {
+    std::string share_code(arg);
+    std::cout << "[Worker] GUEST_REDEEM: code=" << share_code << '\n';
+
+    if (share_code.empty()) {
+        return std::string(CODE_FAIL) + " Invalid share code\n";
+    }
+
+    long long file_id;
+    std::string filename;
+    bool is_folder;
+    std::string owner;
+    long long size;
+
+    bool success = DBManager::getInstance().guestRedeemShareCode(
+        share_code, file_id, filename, is_folder, owner, size);
+    if (!success) {
+        return std::string(CODE_FAIL) + " Invalid or expired share code\n";
+    }
+
+    // Format: 200 file_id|filename|is_folder|owner|size
+    return std::string(CODE_OK) + " " +
+           std::to_string(file_id) + "|" +
+           filename + "|" +
+           (is_folder ? "1" : "0") + "|" +
+           owner + "|" +
+           std::to_string(size) + "\n";
+}
+
+std::string WorkerThread::cmdGuestList(int, std::string_view arg) {
+    long long folder_id = parseNumber(nextToken(arg), 0LL);
+    std::cout << "[Worker] GUEST_LIST: folder_id=" << folder_id << '\n';
+
+    std::vector<FileRecordEx> files = DBManager::getInstance().guestListFolder(folder_id);
+
+    // Format: 200 file_id|filename|is_folder|size|owner;file_id|...
+    std::string data;
+    for (const auto& file : files) {
+        if (!data.empty()) data += ";";
+        data += std::to_string(file.file_id) + "|" +
+               file.name + "|" +
+               (file.is_folder ? "1" : "0") + "|" +
+               std::to_string(file.size) + "|" +
+               file.owner;
+    }
+    return std::string(CODE_OK) + " " + data + "\n";
+}
+
+std::string WorkerThread::cmdGuestDownload(int fd, std::string_view arg) {
+    long long file_id = parseNumber(nextToken(arg), 0LL);
+    std::cout << "[Worker] GUEST_DOWNLOAD: file_id=" << file_id << '\n';
+
+    FileRecordEx fileInfo = DBManager::getInstance().getFileInfo(file_id);
+    if (fileInfo.file_id < 0) {
+        std::cout << "[Worker] File not found\n";
+        return std::string(CODE_FAIL) + " File not found\n";
+    }
+    if (fileInfo.is_folder) {
+        std::cout << "[Worker] Target is a folder, not a file\n";
+        return std::string(CODE_FAIL) + " Not a file\n";
+    }
+
+    long long blob_id = DBManager::getInstance().getBlobId(file_id);
+    if (blob_id < 0) {
+        return std::string(CODE_FAIL) + " File not found\n";
+    }
+
+    std::cout << "[Worker] File found, sending...\n";
+    // Guest client không gửi 151 ACK (expectAcks = false)
+    std::string fname = fileInfo.name;
+    std::string response;
+    if (ServerConfig::transferMode == TransferMode::Epoll) {
+        auto transfer = canStartTransfer()
+            ? TransferStateMachine::createDownload(fd, blob_id, fname, false, response) : nullptr;
+        if (transfer) {
+            startTransfer(fd, std::move(transfer));
+            return {};
+        }
+        if (response.empty()) response = "503 System overloaded\n";
+    } else {
+        TransferPriority priority = isSmallFile(blob_id, fname) ? TransferPriority::High : TransferPriority::Low;
+        bool queued = handOffTransfer(fd, priority,
+            [fd, blob_id, fname, this](const ClientSession& session) {
+                DedicatedThread dt;
+                dt.handleDownload(fd, blob_id, fname, session, this, false);
+            });
+        if (queued) return {};
+        response = "503 System overloaded\n";
     }
-}
\ No newline at end of file
+    return response;
+}
+
+std::string WorkerThread::cmdGuestDownloadFolder(int fd, std::string_view arg) {
+    long long folder_id = parseNumber(nextToken(arg), 0LL);
+    std::cout << "[Worker] GUEST_DOWNLOAD_FOLDER: folder_id=" << folder_id << '\n';
+
+    FileRecordEx folderInfo = DBManager::getInstance().getFileInfo(folder_id);
+    if (folderInfo.file_id < 0 || !folderInfo.is_folder) {
+        std::cout << "[Worker] Folder not found\n";
+        return std::string(CODE_FAIL) + " Folder not found\n";
+    }
+
+    std::cout << "[Worker] Folder found, sending...\n";
+    if (startFolderDownload(fd, folder_id, folderInfo.name)) return {};
+    return "503 System overloaded\n";
+}
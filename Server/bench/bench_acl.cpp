@@ -0,0 +1,100 @@
+// hasSharedAccess trên file lá của cây sâu 1, 10, 50 folder, folder trên cùng được share cho reader.
+// So sánh cách cũ (đi ngược cây: COUNT trên SHAREDFILES + tra parent_id mỗi tầng, rồi kiểm tra owner;
+// chép lại ở legacyAccess) với truy vấn một round trip hiện tại, lần đầu (aclCache trống) và lần sau.
+//   bench_acl [leaves=200]
+#include "bench_util.h"
+#include <cstdlib>
+#include <functional>
+
+// Thuật toán cũ của DBManager::hasSharedAccess
+static bool legacyAccess(long long file_id, long long user_id) {
+    DBLease lease;
+    long long current = file_id;
+    while (current > 0) {
+        DBStatement shared(lease, "SELECT COUNT(*) FROM SHAREDFILES WHERE file_id = ? AND user_id = ?");
+        shared.bind(current).bind(user_id);
+        if (shared.execute() && shared.fetch() && shared.getInt(0) > 0) return true;
+        DBStatement parent(lease, "SELECT parent_id FROM FILES WHERE file_id = ?");
+        parent.bind(current);
+        if (!parent.execute() || !parent.fetch() || parent.isNull(0)) break;
+        current = parent.getInt(0);
+    }
+    DBStatement owner(lease, "SELECT COUNT(*) FROM FILES WHERE file_id = ? AND owner_id = ?");
+    owner.bind(file_id).bind(user_id);
+    return owner.execute() && owner.fetch() && owner.getInt(0) > 0;
+}
+
+// Chuỗi depth folder lồng nhau dưới thư mục gốc của owner, leaves file trong folder sâu nhất.
+// Trả về folder trên cùng, leafIds = file_id các file lá
+static long long buildChain(const bench::ScratchUser& owner, int depth, int leaves, std::vector<long long>& leafIds) {
+    DBManager& db = DBManager::getInstance();
+    long long top = db.createFolder("acl_d" + std::to_string(depth), 0, owner.id);
+    long long deepest = top;
+    for (int level = 1; level < depth && deepest > 0; level++) {
+        deepest = db.createFolder("lvl" + std::to_string(level), deepest, owner.id);
+    }
+    if (deepest < 0) return -1;
+
+    const std::string d = std::to_string(deepest);
+    if (!bench::exec({"INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) "
+                      "WITH RECURSIVE seq (n) AS (SELECT 1 UNION ALL SELECT n + 1 FROM seq WHERE n < " +
+                          std::to_string(leaves) + ") "
+                      "SELECT " + std::to_string(owner.id) + ", " + d + ", CONCAT('leaf', n), FALSE, 1024 FROM seq",
+                      "UPDATE FILES f JOIN FILES p ON p.file_id = f.parent_id "
+                      "SET f.path = CONCAT(p.path, f.file_id, '/') WHERE f.parent_id = " + d})) {
+        return -1;
+    }
+    DBLease lease;
+    DBStatement stmt(lease, "SELECT file_id FROM FILES WHERE parent_id = ? AND is_folder = FALSE");
+    stmt.bind(deepest);
+    if (!stmt.execute()) return -1;
+    while (stmt.fetch()) leafIds.push_back(stmt.getInt(0));
+    return top;
+}
+
+static void measure(const char* name, const std::vector<long long>& leafIds, long long user_id,
+                    const std::function<bool(long long, long long)>& check) {
+    int granted = 0;
+    auto start = bench::Clock::now();
+    long long statements = bench::countStatements([&] {
+        for (long long id : leafIds) granted += check(id, user_id);
+    });
+    double ms = bench::msSince(start);
+    std::cout << "    " << name << ": " << ms * 1000.0 / leafIds.size() << " us/file, "
+              << static_cast<double>(statements) / leafIds.size() << " câu SQL/file, " << granted << "/"
+              << leafIds.size() << " được phép" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int leaves = argc > 1 ? atoi(argv[1]) : 200;
+
+    DBManager& db = DBManager::getInstance();
+    if (!db.connect()) {
+        std::cerr << "Cannot connect to database" << std::endl;
+        return 2;
+    }
+    bench::ScratchUser owner("acl_owner");
+    bench::ScratchUser reader("acl_reader");
+    bench::ScratchUser stranger("acl_stranger");
+    if (!owner.ok() || !reader.ok() || !stranger.ok()) {
+        std::cerr << "Cannot create test users" << std::endl;
+        return 2;
+    }
+
+    auto current = [&db](long long file_id, long long user_id) { return db.hasSharedAccess(file_id, user_id); };
+    for (int depth : {1, 10, 50}) {
+        std::vector<long long> leafIds;
+        long long top = buildChain(owner, depth, leaves, leafIds);
+        if (top < 0 || leafIds.empty() || !db.shareFolderWithUser(top, reader.name)) {
+            std::cerr << "Cannot build depth " << depth << " tree" << std::endl;
+            return 2;
+        }
+        std::cout << "Độ sâu " << depth << ", " << leafIds.size() << " file lá:\n";
+        measure("Cũ (đi ngược cây)           ", leafIds, reader.id, legacyAccess);
+        measure("Một truy vấn (aclCache trống)", leafIds, reader.id, current);
+        measure("Một truy vấn (aclCache có)  ", leafIds, reader.id, current);
+        measure("Cũ, không có quyền          ", leafIds, stranger.id, legacyAccess);
+        measure("Một truy vấn, không có quyền", leafIds, stranger.id, current);
+    }
+    return 0;
+}
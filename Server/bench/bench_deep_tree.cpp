@@ -0,0 +1,165 @@
+// Cây sâu tổng hợp: một chuỗi `depth` folder lồng nhau, mỗi folder filesPerFolder file.
+// Tại các node ở tầng 10, 100 và sâu nhất, so sánh:
+//   con cháu: CTE đệ quy theo parent_id  vs  range scan idx_path (path > X.path AND path < upper)
+//   tổ tiên:  đi ngược parent_id (mỗi tầng một câu)  vs  CTE đệ quy  vs  tách id trong path rồi tra khóa chính
+// FILES.path là VARCHAR(2048): với file_id ~7 chữ số, chuỗi sâu tối đa khoảng 250 tầng.
+//   bench_deep_tree [depth=200] [filesPerFolder=50] [reps=20]
+#include "bench_util.h"
+#include <cstdlib>
+#include <functional>
+
+static std::string pathUpperBound(const std::string& path) {
+    return path.substr(0, path.size() - 1) + "0";
+}
+
+// Chuỗi folder dưới gốc của owner; chain[i] = (file_id, path) của folder tầng i + 1
+static bool buildChain(long long owner_id, long long depth, long long filesPerFolder,
+                       std::vector<std::pair<long long, std::string>>& chain) {
+    long long top = DBManager::getInstance().createFolder("deep_root", 0, owner_id);
+    if (top < 0) return false;
+    const std::string u = std::to_string(owner_id), t = std::to_string(top);
+    auto seq = [](long long n) {
+        return "WITH RECURSIVE seq (n) AS (SELECT 1 UNION ALL SELECT n + 1 FROM seq WHERE n < " +
+               std::to_string(n) + ") ";
+    };
+    // Tạo phẳng dưới top rồi nối thành chuỗi theo thứ tự file_id, tính path bằng CTE từ top
+    bool ok = bench::exec({
+        "SET SESSION cte_max_recursion_depth = 100000000",
+        "INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) " + seq(depth - 1) +
+            "SELECT " + u + ", " + t + ", CONCAT('lvl', n), TRUE, 0 FROM seq",
+        "UPDATE FILES f JOIN (SELECT file_id, LAG(file_id) OVER (ORDER BY file_id) AS prev "
+        "                     FROM FILES WHERE parent_id = " + t + " AND is_folder = TRUE) c "
+        "ON c.file_id = f.file_id SET f.parent_id = c.prev WHERE c.prev IS NOT NULL",
+        "UPDATE FILES f JOIN ("
+        "    WITH RECURSIVE tree (file_id, path) AS ("
+        "        SELECT file_id, CAST(path AS CHAR(2048) CHARACTER SET ascii) FROM FILES WHERE file_id = " + t +
+        "        UNION ALL"
+        "        SELECT c.file_id, CONCAT(tree.path, c.file_id, '/') FROM tree JOIN FILES c ON c.parent_id = tree.file_id"
+        "    ) SELECT file_id, path FROM tree"
+        ") x ON x.file_id = f.file_id SET f.path = x.path WHERE f.file_id <> " + t,
+        "INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) " + seq(filesPerFolder) +
+            "SELECT " + u + ", p.file_id, CONCAT('file', seq.n), FALSE, 1024 FROM seq "
+            "JOIN FILES p ON p.owner_id = " + u + " AND p.is_folder = TRUE",
+        "UPDATE FILES f JOIN FILES p ON p.file_id = f.parent_id "
+        "SET f.path = CONCAT(p.path, f.file_id, '/') WHERE f.owner_id = " + u + " AND f.path = ''",
+    });
+    if (!ok) return false;
+
+    DBLease lease;
+    DBStatement stmt(lease,
+        "SELECT file_id, path FROM FILES WHERE owner_id = ? AND is_folder = TRUE ORDER BY LENGTH(path)");
+    stmt.bind(owner_id);
+    if (!stmt.execute()) return false;
+    while (stmt.fetch()) chain.emplace_back(stmt.getInt(0), stmt.getString(1));
+    return static_cast<long long>(chain.size()) == depth;
+}
+
+static long long countRows(DBStatement& stmt) {
+    if (!stmt.execute()) {
+        std::cerr << "[Bench] " << stmt.error() << std::endl;
+        return -1;
+    }
+    long long rows = 0;
+    while (stmt.fetch()) rows++;
+    return rows;
+}
+
+static long long descendantsCte(long long id, const std::string&) {
+    DBLease lease;
+    DBStatement stmt(lease,
+        "WITH RECURSIVE sub (file_id) AS ("
+        "    SELECT file_id FROM FILES WHERE parent_id = ? AND is_deleted = FALSE"
+        "    UNION ALL"
+        "    SELECT f.file_id FROM sub JOIN FILES f ON f.parent_id = sub.file_id AND f.is_deleted = FALSE"
+        ") SELECT file_id FROM sub");
+    stmt.bind(id);
+    return countRows(stmt);
+}
+
+static long long descendantsPath(long long, const std::string& path) {
+    DBLease lease;
+    DBStatement stmt(lease, "SELECT file_id FROM FILES WHERE path > ? AND path < ? AND is_deleted = FALSE");
+    stmt.bind(path).bind(pathUpperBound(path));
+    return countRows(stmt);
+}
+
+static long long ancestorsWalk(long long id, const std::string&) {
+    DBLease lease;
+    long long rows = 0;
+    while (true) {
+        DBStatement stmt(lease, "SELECT parent_id FROM FILES WHERE file_id = ?");
+        stmt.bind(id);
+        if (!stmt.execute() || !stmt.fetch() || stmt.isNull(0) || stmt.getInt(0) <= 0) break;
+        id = stmt.getInt(0);
+        rows++;
+    }
+    return rows;
+}
+
+static long long ancestorsCte(long long id, const std::string&) {
+    DBLease lease;
+    DBStatement stmt(lease,
+        "WITH RECURSIVE up (file_id, parent_id) AS ("
+        "    SELECT file_id, parent_id FROM FILES WHERE file_id = ?"
+        "    UNION ALL"
+        "    SELECT f.file_id, f.parent_id FROM up JOIN FILES f ON f.file_id = up.parent_id"
+        ") SELECT file_id FROM up WHERE file_id <> ?");
+    stmt.bind(id).bind(id);
+    return countRows(stmt);
+}
+
+// Các id trong path của node (trừ chính nó) tra theo khóa chính
+static long long ancestorsPath(long long id, const std::string&) {
+    DBLease lease;
+    DBStatement stmt(lease,
+        "SELECT a.file_id FROM FILES x "
+        "JOIN JSON_TABLE(CONCAT('[', REPLACE(TRIM(BOTH '/' FROM x.path), '/', ','), ']'), "
+        "                '$[*]' COLUMNS (id BIGINT PATH '$')) j "
+        "JOIN FILES a ON a.file_id = j.id "
+        "WHERE x.file_id = ? AND a.file_id <> x.file_id");
+    stmt.bind(id);
+    return countRows(stmt);
+}
+
+using Query = long long (*)(long long, const std::string&);
+
+static void measure(const char* name, Query query, const std::pair<long long, std::string>& node, int reps) {
+    long long rows = 0;
+    auto start = bench::Clock::now();
+    long long statements = bench::countStatements([&] {
+        for (int i = 0; i < reps; i++) rows = query(node.first, node.second);
+    });
+    std::cout << "    " << name << ": " << bench::msSince(start) / reps << " ms, " << rows << " dòng, "
+              << statements / reps << " câu SQL" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    long long depth = argc > 1 ? atoll(argv[1]) : 200;
+    long long filesPerFolder = argc > 2 ? atoll(argv[2]) : 50;
+    int reps = argc > 3 ? atoi(argv[3]) : 20;
+
+    DBManager& db = DBManager::getInstance();
+    if (!db.connect()) {
+        std::cerr << "Cannot connect to database" << std::endl;
+        return 2;
+    }
+    bench::ScratchUser owner("deep_owner");
+    std::vector<std::pair<long long, std::string>> chain;
+    if (!owner.ok() || !buildChain(owner.id, depth, filesPerFolder, chain)) {
+        std::cerr << "Cannot build a chain of depth " << depth << " (path dài hơn 2048 ký tự?)" << std::endl;
+        return 2;
+    }
+
+    std::cout << "Chuỗi sâu " << depth << " folder, " << depth * filesPerFolder << " file\n";
+    for (long long level : {10LL, 100LL, depth}) {
+        if (level > depth) continue;
+        const auto& node = chain[level - 1];
+        std::cout << "  Tầng " << level << ":\n";
+        measure("Con cháu, CTE theo parent_id   ", descendantsCte, node, reps);
+        measure("Con cháu, range idx_path       ", descendantsPath, node, reps);
+        measure("Tổ tiên, mỗi tầng một câu      ", ancestorsWalk, node, reps);
+        measure("Tổ tiên, CTE theo parent_id    ", ancestorsCte, node, reps);
+        measure("Tổ tiên, id trong path (PK)    ", ancestorsPath, node, reps);
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Chi phí dispatch một dòng lệnh: cách cũ (stringstream >> command, chuỗi if/else so sánh
+// std::string, stringstream/stoll cho tham số số) so với bảng lệnh constexpr + string_view + from_chars.
+// Chỉ đo phần tách/tra lệnh/parse tham số đầu, không gọi handler. Không cần DB.
+//   bench_dispatch [iterations=2000000]
+#include "bench_util.h"
+#include "../Core/include/thread_manager.h"
+#include "../../Common/Protocol.h"
+#include <charconv>
+#include <cstdlib>
+#include <sstream>
+
+// Thứ tự so sánh của chuỗi if/else cũ trong WorkerThread::handleClientMessage
+static const char* const LEGACY_CHAIN[] = {
+    CMD_USER, CMD_PASS, CMD_REGISTER, CMD_LIST, CMD_LISTSHARED, CMD_SEARCH, CMD_SHARE, CMD_DELETE,
+    CMD_RENAME, CMD_UPLOAD_CHECK, CMD_UPLOAD, CMD_DOWNLOAD, "DOWNLOAD_FOLDER", "GET_FOLDER_STRUCTURE",
+    "SHARE_FOLDER", "UPLOAD_FILE", "CREATE_FOLDER", "CHECK_SHARE_PROGRESS", "CANCEL_FOLDER_SHARE",
+    CMD_GENERATE_SHARE_CODE, CMD_REDEEM_SHARE_CODE, CMD_GET_MY_SHARES, CMD_REVOKE_SHARE,
+    CMD_GET_MY_SHARE_CODES, CMD_DELETE_SHARE_CODE, CMD_GUEST_REDEEM, CMD_GUEST_LIST, "GUEST_DOWNLOAD",
+    "GUEST_DOWNLOAD_FOLDER",
+};
+
+// Lệnh có tham số đầu là số (id/kích thước)
+static bool numericFirstArg(std::string_view command) {
+    return command == CMD_LIST || command == CMD_LISTSHARED || command == CMD_RENAME ||
+           command == CMD_DOWNLOAD_FOLDER || command == CMD_GET_FOLDER_STRUCTURE ||
+           command == CMD_SHARE_FOLDER || command == CMD_GENERATE_SHARE_CODE || command == CMD_UPLOAD_CHECK;
+}
+
+static long long legacyDispatch(const std::string& msg) {
+    std::string command, arg;
+    if (msg.find("SITE QUOTA_CHECK") == 0) {
+        command = "SITE QUOTA_CHECK";
+        arg = msg.substr(17);
+    } else {
+        std::stringstream ss(msg);
+        ss >> command;
+        std::getline(ss, arg);
+        if (!arg.empty() && arg[0] == ' ') arg.erase(0, 1);
+    }
+    for (size_t i = 0; i < std::size(LEGACY_CHAIN); i++) {
+        if (command == LEGACY_CHAIN[i]) {
+            if (!numericFirstArg(command)) return i;
+            long long id = 0;
+            try {
+                id = std::stoll(arg);
+            } catch (...) {
+            }
+            return i + id;
+        }
+    }
+    return -1;
+}
+
+static long long tableDispatch(const std::string& msg) {
+    std::string_view arg;
+    std::string_view command = WorkerThread::splitCommand(msg, arg);
+    if (!WorkerThread::isKnownCommand(command)) return -1;
+    if (!numericFirstArg(command)) return command.size();
+    size_t end = std::min(arg.find(' '), arg.size());
+    long long id = 0;
+    std::from_chars(arg.data(), arg.data() + end, id);
+    return command.size() + id;
+}
+
+template <typename Fn>
+static double nsPerCommand(const std::vector<std::string>& lines, long iterations, Fn&& dispatch, long long& sink) {
+    auto start = bench::Clock::now();
+    for (long i = 0; i < iterations; i++) {
+        sink += dispatch(lines[i % lines.size()]);
+    }
+    return bench::msSince(start) * 1e6 / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 2000000;
+
+    // Trộn theo tỉ lệ gần với log thật: LIST nhiều nhất, lệnh cuối chuỗi cũ (GUEST_*) ít
+    const std::vector<std::string> mixed = {
+        "LIST 0", "LIST 1532", "LIST 1532", "LISTSHARED -1", "PASS secret", "USER alice",
+        "RETR 88213", "STOR report.pdf 1048576 0", "SITE QUOTA_CHECK 1048576", "SEARCH invoice 0",
+        "GET_FOLDER_STRUCTURE 1532", "GUEST_LIST", "GUEST_DOWNLOAD 88213", "NOOP",
+    };
+    struct Case {
+        const char* name;
+        std::vector<std::string> lines;
+    } cases[] = {
+        {"LIST (đầu chuỗi cũ)", {"LIST 1532"}},
+        {"GUEST_DOWNLOAD_FOLDER (cuối chuỗi cũ)", {"GUEST_DOWNLOAD_FOLDER 1532"}},
+        {"Lệnh lạ", {"NOOP"}},
+        {"Trộn", mixed},
+    };
+
+    long long sink = 0;
+    std::cout << iterations << " dispatch mỗi trường hợp\n";
+    for (const Case& c : cases) {
+        double legacy = nsPerCommand(c.lines, iterations, legacyDispatch, sink);
+        double table = nsPerCommand(c.lines, iterations, tableDispatch, sink);
+        std::cout << "  " << c.name << ": if/else + stringstream " << legacy << " ns, bảng lệnh + from_chars "
+                  << table << " ns (x" << legacy / table << ")" << std::endl;
+    }
+    return sink == 42 ? 1 : 0;  // Dùng sink để compiler không bỏ vòng lặp
+}
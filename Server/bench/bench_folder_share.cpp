@@ -0,0 +1,170 @@
+// Bảng phiên folder share (FolderShareHandler: 16 shard, mỗi shard một mutex) khi đầy ~100k phiên.
+// Nhiều thread cùng lúc: initiateFolderShare (thêm phiên), getSession (tra phiên) trên id ngẫu nhiên,
+// rồi sweepAll hủy một nửa số phiên đã quá TTL trong lúc các thread khác vẫn tra phiên.
+// So sánh 1 thread với nhiều thread để thấy tranh chấp khóa shard; kiểm tra không mất phiên nào.
+//   bench_folder_share [sessions=100000] [threads=16] [lookupsPerThread=100000]
+#include "bench_util.h"
+#include "../Core/include/request_handler.h"
+#include "../Core/include/server_config.h"
+#include <atomic>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+namespace {
+
+long long steadyMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        bench::Clock::now().time_since_epoch()).count();
+}
+
+// Handler in một dòng log cho mỗi phiên: tắt cout trong lúc đo
+struct QuietCout {
+    QuietCout() : saved(std::cout.rdbuf(nullptr)) {}
+    ~QuietCout() { std::cout.rdbuf(saved); std::cout.clear(); }
+    std::streambuf* saved;
+};
+
+struct Result {
+    double wallMs = 0;
+    long long ops = 0;
+    long long misses = 0;
+    std::vector<double> latencyUs;
+};
+
+// threads thread cùng chạy op(thread, i) perThread lần, đo latency từng lần
+template <typename Op>
+Result runConcurrent(int threads, long long perThread, Op op) {
+    std::vector<std::vector<double>> samples(threads);
+    std::atomic<long long> misses{0};
+    std::vector<std::thread> pool;
+    auto start = bench::Clock::now();
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back([&, t] {
+            samples[t].reserve(perThread);
+            for (long long i = 0; i < perThread; i++) {
+                auto begin = bench::Clock::now();
+                bool ok = op(t, i);
+                samples[t].push_back(bench::msSince(begin) * 1000.0);
+                if (!ok) misses++;
+            }
+        });
+    }
+    for (auto& th : pool) th.join();
+
+    Result r;
+    r.wallMs = bench::msSince(start);
+    r.ops = threads * perThread;
+    r.misses = misses.load();
+    for (auto& s : samples) r.latencyUs.insert(r.latencyUs.end(), s.begin(), s.end());
+    return r;
+}
+
+void report(const std::string& label, Result& r) {
+    std::cout << "  " << label << ": " << r.ops << " lần, " << (long long)(r.ops / (r.wallMs / 1000.0))
+              << " lần/s, p50 " << bench::percentile(r.latencyUs, 50) << " us, p99 "
+              << bench::percentile(r.latencyUs, 99) << " us, max " << bench::percentile(r.latencyUs, 100)
+              << " us\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    long long sessions = argc > 1 ? atoll(argv[1]) : 100000;
+    int threads = argc > 2 ? atoi(argv[2]) : 16;
+    long long lookupsPerThread = argc > 3 ? atoll(argv[3]) : 100000;
+    if (threads < 2) threads = 2;
+    sessions -= sessions % threads;
+
+    DBManager& db = DBManager::getInstance();
+    if (!db.connect()) {
+        std::cerr << "Cannot connect to database" << std::endl;
+        return 2;
+    }
+    bench::ScratchUser owner("share_owner");
+    bench::ScratchUser recipient("share_recipient");
+    long long folder = owner.ok() && recipient.ok() ? db.createFolder("share_root", 0, owner.id) : -1;
+    if (folder < 0) {
+        std::cerr << "Cannot create test data" << std::endl;
+        return 2;
+    }
+
+    FolderShareHandler& handler = FolderShareHandler::getInstance();
+    std::vector<std::string> ids(sessions), live;
+    Result insert, single, contended, during;
+    size_t expired = 0, remaining = 0, leftover = 0;
+    double sweepMs = 0;
+    {
+        QuietCout quiet;
+
+        // Thêm phiên: mỗi thread một đoạn của ids. Folder/user đọc từ cache của DBManager sau lần đầu
+        long long perThread = sessions / threads;
+        insert = runConcurrent(threads, perThread, [&](int t, long long i) {
+            std::string id = handler.initiateFolderShare(owner.name, folder, recipient.name);
+            ids[t * perThread + i] = id;
+            return !id.empty();
+        });
+
+        // Tra phiên ngẫu nhiên: 1 thread rồi threads thread
+        auto lookup = [&](int t, long long) {
+            thread_local std::mt19937_64 rng(t * 7919 + 1);
+            return handler.getSession(ids[rng() % ids.size()]) != nullptr;
+        };
+        single = runConcurrent(1, lookupsPerThread, lookup);
+        contended = runConcurrent(threads, lookupsPerThread, lookup);
+
+        // Một nửa số phiên quá TTL; sweepAll chạy trong lúc threads - 1 thread tra nửa còn lại
+        const long long staleMs = steadyMs() - ServerConfig::FOLDER_SHARE_SESSION_TTL_SECONDS * 1000LL - 1000;
+        for (long long i = 0; i < sessions; i++) {
+            auto session = handler.getSession(ids[i]);
+            if (i % 2 == 0 && session) session->last_activity_ms = staleMs;
+            else live.push_back(ids[i]);
+        }
+        std::atomic<bool> sweeping{true};
+        std::vector<std::vector<double>> samples(threads - 1);
+        std::atomic<long long> misses{0};
+        std::vector<std::thread> readers;
+        for (int t = 0; t < threads - 1; t++) {
+            readers.emplace_back([&, t] {
+                std::mt19937_64 rng(t * 104729 + 3);
+                while (sweeping.load()) {
+                    auto begin = bench::Clock::now();
+                    if (!handler.getSession(live[rng() % live.size()])) misses++;
+                    samples[t].push_back(bench::msSince(begin) * 1000.0);
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));  // Cho các thread tra chạy trước
+        auto start = bench::Clock::now();
+        expired = handler.sweepAll();
+        sweepMs = bench::msSince(start);
+        sweeping = false;
+        for (auto& th : readers) th.join();
+        for (auto& s : samples) during.latencyUs.insert(during.latencyUs.end(), s.begin(), s.end());
+        during.ops = during.latencyUs.size();
+        during.wallMs = sweepMs + 50;
+        during.misses = misses.load();
+        remaining = handler.sessionCount();
+
+        for (const auto& id : live) handler.cleanup(id);
+        leftover = handler.sessionCount();
+    }
+
+    std::cout << sessions << " phiên, " << threads << " thread\n";
+    report("initiateFolderShare", insert);
+    report("getSession, 1 thread", single);
+    report("getSession, " + std::to_string(threads) + " thread", contended);
+    std::cout << "  sweepAll: " << expired << " phiên hết hạn trong " << sweepMs << " ms\n";
+    report("getSession trong lúc sweep", during);
+
+    long long staleCount = sessions - static_cast<long long>(live.size());
+    if (insert.misses || single.misses || contended.misses || during.misses ||
+        static_cast<long long>(expired) != staleCount || remaining != live.size() || leftover != 0) {
+        std::cerr << "Session table mismatch: " << insert.misses << "/" << single.misses << "/"
+                  << contended.misses << "/" << during.misses << " miss, " << expired << " expired of "
+                  << staleCount << ", " << remaining << " remaining of " << live.size() << ", "
+                  << leftover << " leftover" << std::endl;
+        return 1;
+    }
+    return 0;
+}
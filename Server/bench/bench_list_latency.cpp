@@ -0,0 +1,159 @@
+// Độ trễ LIST trên các worker khi không tải và khi một DOWNLOAD_FOLDER lớn đang chạy.
+// Chạy như client thật vào server đang chạy: mở 2 x FIXED_WORKER_THREADS kết nối LIST để chắc chắn
+// có kết nối nằm cùng worker với kết nối download (Acceptor chia cho worker ít kết nối nhất).
+// LIST chạy trên một folder rỗng do bench tạo (phản hồi đúng một dòng), xóa lại khi xong.
+//   bench_list_latency <host> <port> <user> <pass> <folder_id cần download> [rounds=200]
+#include "bench_util.h"
+#include "../Core/include/server_config.h"
+#include "../../Common/Protocol.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+struct Conn {
+    int fd = -1;
+    std::string buffer;
+
+    bool sendLine(const std::string& line) {
+        std::string data = line + "\n";
+        return send(fd, data.c_str(), data.length(), MSG_NOSIGNAL) == (ssize_t)data.length();
+    }
+    bool readLine(std::string& line) {
+        size_t pos;
+        while ((pos = buffer.find('\n')) == std::string::npos) {
+            char chunk[4096];
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) return false;
+            buffer.append(chunk, n);
+        }
+        line = buffer.substr(0, pos);
+        buffer.erase(0, pos + 1);
+        return true;
+    }
+    std::string request(const std::string& line) {
+        std::string reply;
+        if (!sendLine(line) || !readLine(reply)) return {};
+        return reply;
+    }
+    ~Conn() {
+        if (fd >= 0) close(fd);
+    }
+};
+
+static bool openSession(Conn& conn, const char* host, const char* port, const std::string& user,
+                        const std::string& pass) {
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0) return false;
+    conn.fd = socket(res->ai_family, res->ai_socktype, 0);
+    bool connected = conn.fd >= 0 && connect(conn.fd, res->ai_addr, res->ai_addrlen) == 0;
+    freeaddrinfo(res);
+    if (!connected) return false;
+    conn.request(std::string(CMD_USER) + " " + user);
+    return conn.request(std::string(CMD_PASS) + " " + pass).rfind(CODE_LOGIN_SUCCESS, 0) == 0;
+}
+
+// Một vòng: mỗi kết nối gửi một LIST, ghi lại thời gian tới khi có dòng phản hồi
+static bool listRound(std::vector<Conn>& conns, const std::string& cmd, std::vector<std::vector<double>>& samples) {
+    for (size_t i = 0; i < conns.size(); i++) {
+        auto start = bench::Clock::now();
+        std::string reply = conns[i].request(cmd);
+        if (reply.empty()) return false;
+        samples[i].push_back(bench::msSince(start));
+    }
+    return true;
+}
+
+static void report(const char* phase, std::vector<std::vector<double>>& samples) {
+    std::vector<double> all;
+    double worstP99 = 0;
+    for (auto& s : samples) {
+        all.insert(all.end(), s.begin(), s.end());
+        worstP99 = std::max(worstP99, bench::percentile(s, 99));
+    }
+    std::cout << "  " << phase << ": " << all.size() << " LIST, p50 " << bench::percentile(all, 50) << " ms, p99 "
+              << bench::percentile(all, 99) << " ms, p99 tệ nhất theo kết nối " << worstP99 << " ms" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 6) {
+        std::cerr << "Usage: " << argv[0] << " <host> <port> <user> <pass> <folder_id> [rounds]" << std::endl;
+        return 2;
+    }
+    const char* host = argv[1];
+    const char* port = argv[2];
+    std::string user = argv[3], pass = argv[4];
+    long long downloadId = atoll(argv[5]);
+    int rounds = argc > 6 ? atoi(argv[6]) : 200;
+
+    Conn control, download;
+    if (!openSession(control, host, port, user, pass) || !openSession(download, host, port, user, pass)) {
+        std::cerr << "Cannot log in to " << host << ":" << port << std::endl;
+        return 2;
+    }
+    std::string folderName = "bench_list_" + std::to_string(getpid());
+    std::string created = control.request(std::string(CMD_CREATE_FOLDER) + " " + folderName + " 0");
+    size_t idPos = created.find("FOLDER_ID:");
+    if (created.rfind(CODE_OK, 0) != 0 || idPos == std::string::npos) {
+        std::cerr << "CREATE_FOLDER failed: " << created << std::endl;
+        return 2;
+    }
+    std::string listCmd = std::string(CMD_LIST) + " " + created.substr(idPos + 10);
+
+    std::vector<Conn> conns(2 * ServerConfig::FIXED_WORKER_THREADS);
+    for (Conn& conn : conns) {
+        if (!openSession(conn, host, port, user, pass)) {
+            std::cerr << "Cannot open LIST connection" << std::endl;
+            return 2;
+        }
+    }
+    std::cout << conns.size() << " LIST connections, folder " << downloadId << " download\n";
+
+    int status = 0;
+    std::vector<std::vector<double>> idle(conns.size()), busy(conns.size());
+    for (int r = 0; r < rounds && status == 0; r++) {
+        if (!listRound(conns, listCmd, idle)) status = 1;
+    }
+
+    // Kết nối download đọc hết dữ liệu tới khi im lặng 1s; LIST chạy song song tới khi download xong
+    std::string opened = download.request(std::string(CMD_DOWNLOAD_FOLDER) + " " + std::to_string(downloadId));
+    if (status == 0 && opened.rfind(CODE_DATA_OPEN, 0) != 0) {
+        std::cerr << "DOWNLOAD_FOLDER failed: " << opened << std::endl;
+        status = 2;
+    }
+    std::atomic<bool> draining{status == 0};
+    long long downloaded = download.buffer.size();
+    double downloadMs = 0;
+    std::thread drainer([&] {
+        auto start = bench::Clock::now();
+        char chunk[65536];
+        pollfd pfd{download.fd, POLLIN, 0};
+        while (draining && poll(&pfd, 1, 1000) > 0) {
+            ssize_t n = recv(download.fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) break;
+            downloaded += n;
+        }
+        downloadMs = bench::msSince(start);
+        draining = false;
+    });
+    while (draining && status == 0) {
+        if (!listRound(conns, listCmd, busy)) status = 1;
+    }
+    draining = false;
+    drainer.join();
+
+    if (status == 1) std::cerr << "LIST connection dropped" << std::endl;
+    if (status == 0) {
+        report("Không tải", idle);
+        report("Đang DOWNLOAD_FOLDER", busy);
+        std::cout << "  Download: " << downloaded / 1048576.0 << " MB trong " << downloadMs << " ms" << std::endl;
+    }
+    control.request(std::string(CMD_DELETE) + " " + folderName);
+    return status;
+}
@@ -0,0 +1,135 @@
+// Câu SQL nối chuỗi qua mysql_query (server parse + plan mỗi lần) so với DBStatement
+// (prepare một lần cho mỗi kết nối, sau đó chỉ execute bằng binary protocol) cho các truy vấn nóng.
+// Cả hai chạy trên cùng một kết nối; SHOW SESSION STATUS cho thấy Com_select (câu text) được thay bằng
+// Com_stmt_execute và Com_stmt_prepare chỉ tăng ở lần đầu.
+//   bench_prepared [iterations=5000]
+#include "bench_util.h"
+#include <cstdlib>
+#include <map>
+
+static const char* const COUNTERS = "'Com_select', 'Com_stmt_prepare', 'Com_stmt_execute'";
+
+static std::map<std::string, long long> sessionStatus(DBLease& lease) {
+    std::map<std::string, long long> status;
+    MYSQL*& conn = lease.handle();
+    if (lease.query(std::string("SHOW SESSION STATUS WHERE Variable_name IN (") + COUNTERS + ")")) return status;
+    MYSQL_RES* res = mysql_store_result(conn);
+    if (!res) return status;
+    while (MYSQL_ROW row = mysql_fetch_row(res)) status[row[0]] = atoll(row[1]);
+    mysql_free_result(res);
+    return status;
+}
+
+struct Query {
+    const char* name;
+    const char* sql;                          // Dạng prepared (dấu ?)
+    std::vector<std::string> params;          // Giá trị theo thứ tự ?, đã là literal SQL cho bản nối chuỗi
+    std::vector<bool> numeric;
+};
+
+// Thay từng ? bằng giá trị (chuỗi được escape) như code DBManager cũ
+static std::string interpolate(MYSQL* conn, const Query& q) {
+    std::string out;
+    size_t p = 0;
+    for (const char* c = q.sql; *c; c++) {
+        if (*c != '?') {
+            out += *c;
+            continue;
+        }
+        const std::string& value = q.params[p];
+        if (q.numeric[p]) {
+            out += value;
+        } else {
+            std::vector<char> escaped(value.size() * 2 + 1);
+            mysql_real_escape_string(conn, escaped.data(), value.c_str(), value.size());
+            out += "'" + std::string(escaped.data()) + "'";
+        }
+        p++;
+    }
+    return out;
+}
+
+static long long runText(DBLease& lease, const Query& q) {
+    MYSQL*& conn = lease.handle();
+    if (lease.query(interpolate(conn, q))) return -1;
+    MYSQL_RES* res = mysql_store_result(conn);
+    long long rows = 0;
+    if (res) {
+        while (mysql_fetch_row(res)) rows++;
+        mysql_free_result(res);
+    }
+    return rows;
+}
+
+static long long runPrepared(DBLease& lease, const Query& q) {
+    DBStatement stmt(lease, q.sql);
+    for (size_t i = 0; i < q.params.size(); i++) {
+        if (q.numeric[i]) stmt.bind(atoll(q.params[i].c_str()));
+        else stmt.bind(q.params[i]);
+    }
+    if (!stmt.execute()) return -1;
+    long long rows = 0;
+    while (stmt.fetch()) rows++;
+    return rows;
+}
+
+template <typename Fn>
+static void measure(DBLease& lease, const char* mode, const Query& q, int iterations, Fn&& run) {
+    auto before = sessionStatus(lease);
+    auto start = bench::Clock::now();
+    long long rows = 0;
+    for (int i = 0; i < iterations; i++) rows = run(lease, q);
+    double us = bench::msSince(start) * 1000.0 / iterations;
+    auto after = sessionStatus(lease);
+    std::cout << "    " << mode << ": " << us << " us/lần (" << rows << " dòng)";
+    for (const auto& [name, value] : after) std::cout << ", " << name << " +" << value - before[name];
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 5000;
+
+    DBManager& db = DBManager::getInstance();
+    if (!db.connect()) {
+        std::cerr << "Cannot connect to database" << std::endl;
+        return 2;
+    }
+    bench::ScratchUser user("prep_bench");
+    long long root = user.ok() ? bench::buildTree(user.id, "prep_root", 0, 200, 1024) : -1;
+    if (root < 0) {
+        std::cerr << "Cannot create test data" << std::endl;
+        return 2;
+    }
+    const std::string uid = std::to_string(user.id), rid = std::to_string(root);
+
+    const Query queries[] = {
+        {"checkUser", "SELECT user_id FROM USERS WHERE username = ? AND password_hash = ?",
+         {user.name, "bench"}, {false, false}},
+        {"getStorageUsed", "SELECT storage_used_bytes FROM USERS WHERE user_id = ?", {uid}, {true}},
+        {"getFileInfo",
+         "SELECT file_id, owner_id, parent_id, name, is_folder, size_bytes, path FROM FILES WHERE file_id = ?",
+         {rid}, {true}},
+        {"hasSharedAccess",
+         "SELECT EXISTS(SELECT 1 FROM FILES x JOIN SHAREDFILES sf "
+         "              ON sf.user_id = ? AND LOCATE(CONCAT('/', sf.file_id, '/'), x.path) > 0 "
+         "              WHERE x.file_id = ?) "
+         "    OR EXISTS(SELECT 1 FROM FILES WHERE file_id = ? AND owner_id = ?)",
+         {uid, rid, rid, uid}, {true, true, true, true}},
+        {"getFiles (LIST 200 file)",
+         "SELECT f.name, IF(f.is_folder, f.subtree_size_bytes, f.size_bytes), u.username, f.file_id, f.is_folder "
+         "FROM FILES f JOIN USERS u ON f.owner_id = u.user_id "
+         "WHERE f.owner_id = ? AND f.parent_id = ? AND f.is_deleted = FALSE "
+         "ORDER BY f.is_folder DESC, f.name",
+         {uid, rid}, {true, true}},
+    };
+
+    // Giữ một lease cho cả chương trình: mọi câu chạy trên cùng kết nối nên SESSION STATUS so sánh được
+    DBLease lease;
+    std::cout << iterations << " lần mỗi truy vấn\n";
+    for (const Query& q : queries) {
+        std::cout << "  " << q.name << ":\n";
+        measure(lease, "mysql_query (nối chuỗi)", q, iterations, runText);
+        measure(lease, "DBStatement (prepared) ", q, iterations, runPrepared);
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Kiểm tra quota trước STOR với user có 50k file: SUM(size_bytes) trên FILES như cách cũ so với
+// đọc USERS.storage_used_bytes và QuotaLedger::reserve (O(1) trong process).
+// Sau đó 16 upload 10MB cùng kiểm tra khi chỉ còn trống 100MB: kiểm tra rồi mới ghi (cũ) cho qua
+// cả 16, reserve chỉ cho qua 10.
+//   bench_quota [files=50000] [reps=200]
+#include "bench_util.h"
+#include "../Core/include/quota_ledger.h"
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+
+static const long long UPLOAD_SIZE = 10LL * 1048576;
+static const int UPLOADERS = 16;
+
+static long long legacyUsed(long long user_id) {
+    DBLease lease;
+    DBStatement stmt(lease,
+        "SELECT COALESCE(SUM(size_bytes), 0) FROM FILES "
+        "WHERE owner_id = ? AND is_folder = FALSE AND is_deleted = FALSE");
+    stmt.bind(user_id);
+    if (!stmt.execute() || !stmt.fetch()) return -1;
+    return stmt.getInt(0);
+}
+
+static long long storageLimit(long long user_id) {
+    DBLease lease;
+    DBStatement stmt(lease, "SELECT storage_limit_bytes FROM USERS WHERE user_id = ?");
+    stmt.bind(user_id);
+    if (!stmt.execute() || !stmt.fetch()) return -1;
+    return stmt.getInt(0);
+}
+
+template <typename Fn>
+static void measure(const char* name, int reps, Fn&& check) {
+    auto start = bench::Clock::now();
+    for (int i = 0; i < reps; i++) check();
+    std::cout << "  " << name << ": " << bench::msSince(start) * 1000.0 / reps << " us/lần" << std::endl;
+}
+
+// Chạy UPLOADERS thread cùng lúc, trả về số thread được cho upload
+template <typename Fn>
+static int race(Fn&& admit) {
+    std::atomic<int> admitted{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < UPLOADERS; i++) {
+        threads.emplace_back([&] {
+            while (!go) std::this_thread::yield();
+            if (admit()) admitted++;
+        });
+    }
+    go = true;
+    for (auto& t : threads) t.join();
+    return admitted;
+}
+
+int main(int argc, char* argv[]) {
+    long long files = argc > 1 ? atoll(argv[1]) : 50000;
+    int reps = argc > 2 ? atoi(argv[2]) : 200;
+
+    DBManager& db = DBManager::getInstance();
+    if (!db.connect()) {
+        std::cerr << "Cannot connect to database" << std::endl;
+        return 2;
+    }
+    bench::ScratchUser user("quota_bench");
+    long long folders = std::max(1LL, files / 1000);
+    if (!user.ok() || bench::buildTree(user.id, "quota_root", folders, files / folders, 1024) < 0) {
+        std::cerr << "Cannot create test data" << std::endl;
+        return 2;
+    }
+    // Giới hạn = đang dùng + 100MB; đặt trước lần reserve đầu tiên (QuotaLedger nạp tài khoản lúc đó)
+    long long used = db.getStorageUsed(user.id);
+    long long limit = used + 10 * UPLOAD_SIZE;
+    bench::exec({"UPDATE USERS SET storage_limit_bytes = " + std::to_string(limit) +
+                 " WHERE user_id = " + std::to_string(user.id)});
+
+    QuotaLedger& ledger = QuotaLedger::getInstance();
+    std::cout << files << " file, đang dùng " << used << " / " << limit << " byte\n";
+    measure("SUM(size_bytes) (cũ)          ", reps, [&] { legacyUsed(user.id); });
+    measure("USERS.storage_used_bytes      ", reps, [&] { db.getStorageUsed(user.id); });
+    measure("QuotaLedger::reserve + release", reps, [&] { ledger.reserve(user.id, UPLOAD_SIZE); });
+
+    // Cũ: mỗi upload tự tính SUM rồi so với limit; chưa upload nào ghi xong nên đều thấy còn chỗ
+    int legacyAdmitted = race([&] { return legacyUsed(user.id) + UPLOAD_SIZE <= storageLimit(user.id); });
+    std::vector<std::shared_ptr<QuotaReservation>> held(UPLOADERS);
+    std::atomic<int> slot{0};
+    int ledgerAdmitted = race([&] {
+        auto r = ledger.reserve(user.id, UPLOAD_SIZE);
+        held[slot++] = r;  // Giữ tới hết race như upload đang chạy
+        return r != nullptr;
+    });
+
+    std::cout << UPLOADERS << " upload " << UPLOAD_SIZE / 1048576 << "MB song song, còn trống "
+              << (limit - used) / 1048576 << "MB: kiểm tra SUM cho qua " << legacyAdmitted
+              << " (vượt " << std::max(0LL, legacyAdmitted * UPLOAD_SIZE - (limit - used)) / 1048576
+              << "MB), reserve cho qua " << ledgerAdmitted << std::endl;
+    return ledgerAdmitted * UPLOAD_SIZE <= limit - used ? 0 : 1;
+}
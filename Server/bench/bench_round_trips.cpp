@@ -0,0 +1,71 @@
+// Số câu SQL (round trip) của từng thao tác metadata khi session đã giữ user_id từ PASS.
+// Trước đây mỗi thao tác dưới đây mở đầu bằng SELECT user_id FROM USERS WHERE username = ...;
+// cột "+tra username" là số câu nếu vẫn phải tra như vậy. Cuối cùng so sánh getUserId
+// khi trúng userIdCache và khi phải hỏi DB (username không tồn tại thì không được cache).
+//   bench_round_trips [iterations=2000]
+#include "bench_util.h"
+#include <cstdlib>
+#include <functional>
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+
+    DBManager& db = DBManager::getInstance();
+    if (!db.connect()) {
+        std::cerr << "Cannot connect to database" << std::endl;
+        return 2;
+    }
+    bench::ScratchUser owner("rt_owner");
+    bench::ScratchUser reader("rt_reader");
+    long long root = owner.ok() && reader.ok() ? bench::buildTree(owner.id, "rt_root", 10, 10, 1024) : -1;
+    if (root < 0) {
+        std::cerr << "Cannot create test data" << std::endl;
+        return 2;
+    }
+    const long long u = owner.id;
+    long long fileId = -1, folderId = -1;
+
+    struct Op {
+        const char* name;
+        std::function<void()> run;
+        bool readOnly;  // Chạy lần hai để thấy cache; thao tác ghi chỉ chạy một lần
+    } ops[] = {
+        {"getFiles (LIST gốc)", [&] { db.getFiles(u, 0); }, true},
+        {"getFiles (LIST folder)", [&] { db.getFiles(u, root); }, true},
+        {"getSharedFiles", [&] { db.getSharedFiles(reader.id); }, true},
+        {"hasSharedAccess", [&] { db.hasSharedAccess(root, reader.id); }, true},
+        {"getStorageUsed", [&] { db.getStorageUsed(u); }, true},
+        {"createFolder", [&] { folderId = db.createFolder("rt_dir", root, u); }, false},
+        {"addFile", [&] { fileId = db.addFile("rt_file.bin", 4096, u, root); }, false},
+        {"renameFile", [&] { db.renameFile(fileId, "rt_renamed.bin", u); }, false},
+        {"generateShareCode", [&] { db.generateShareCode(fileId, u); }, false},
+        {"deleteFile", [&] { db.deleteFile("rt_renamed.bin", u); }, false},
+    };
+
+    long long total = 0, legacyTotal = 0;
+    std::cout << "Số câu SQL mỗi thao tác (lần đầu / lần sau, +tra username):\n";
+    for (Op& op : ops) {
+        long long first = bench::countStatements(op.run);
+        long long again = op.readOnly ? bench::countStatements(op.run) : first;
+        total += again;
+        legacyTotal += again + 1;
+        std::cout << "  " << op.name << ": " << first << " / " << again << " (" << again + 1 << ")" << std::endl;
+    }
+    std::cout << "  Tổng một lượt: " << total << " câu, nếu tra username mỗi lệnh: " << legacyTotal << std::endl;
+
+    // getUserId: trúng cache (user vừa đăng ký) so với phải SELECT (username không tồn tại)
+    auto start = bench::Clock::now();
+    long long hitStatements = bench::countStatements([&] {
+        for (int i = 0; i < iterations; i++) db.getUserId(owner.name);
+    });
+    double hitUs = bench::msSince(start) * 1000.0 / iterations;
+    std::string missing = "rt_missing_" + std::to_string(getpid());
+    start = bench::Clock::now();
+    long long missStatements = bench::countStatements([&] {
+        for (int i = 0; i < iterations; i++) db.getUserId(missing);
+    });
+    double missUs = bench::msSince(start) * 1000.0 / iterations;
+    std::cout << "getUserId x" << iterations << ": cache hit " << hitUs << " us/lần (" << hitStatements
+              << " câu), DB " << missUs << " us/lần (" << missStatements << " câu)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,64 @@
+// Lấy toàn bộ cây con của một folder ~10k node (100 folder x 99 file): getSubtree và
+// getFolderStructure (một câu SQL) so với cách cũ collectFilesRecursive (mỗi folder một lần
+// getItemsInFolder, mỗi lần tra user_id theo username; chép lại ở legacyWalk).
+//   bench_subtree [folders=100] [filesPerFolder=99]
+#include "bench_util.h"
+#include <cstdlib>
+#include <functional>
+
+static void legacyWalk(long long folder_id, const std::string& username, size_t& nodes) {
+    DBLease lease;
+    DBStatement user(lease, "SELECT user_id FROM USERS WHERE username = ?");
+    user.bind(username);
+    if (!user.execute() || !user.fetch()) return;
+    long long user_id = user.getInt(0);
+
+    std::vector<long long> subfolders;
+    {
+        DBStatement stmt(lease,
+            "SELECT file_id, name, is_folder, size_bytes FROM FILES "
+            "WHERE parent_id = ? AND owner_id = ? AND is_deleted = FALSE");
+        stmt.bind(folder_id).bind(user_id);
+        if (!stmt.execute()) return;
+        while (stmt.fetch()) {
+            nodes++;
+            if (stmt.getInt(2)) subfolders.push_back(stmt.getInt(0));
+        }
+    }
+    for (long long id : subfolders) legacyWalk(id, username, nodes);
+}
+
+static void measure(const char* name, const std::function<size_t()>& fetch) {
+    size_t nodes = 0;
+    auto start = bench::Clock::now();
+    long long statements = bench::countStatements([&] { nodes = fetch(); });
+    std::cout << "  " << name << ": " << bench::msSince(start) << " ms, " << statements << " câu SQL, " << nodes
+              << " node" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    long long folders = argc > 1 ? atoll(argv[1]) : 100;
+    long long filesPerFolder = argc > 2 ? atoll(argv[2]) : 99;
+
+    DBManager& db = DBManager::getInstance();
+    if (!db.connect()) {
+        std::cerr << "Cannot connect to database" << std::endl;
+        return 2;
+    }
+    bench::ScratchUser owner("subtree_owner");
+    long long root = owner.ok() ? bench::buildTree(owner.id, "subtree_root", folders, filesPerFolder, 1024) : -1;
+    if (root < 0) {
+        std::cerr << "Cannot create test data" << std::endl;
+        return 2;
+    }
+
+    std::cout << "Cây " << folders << " folder x " << filesPerFolder << " file:\n";
+    measure("Cũ (mỗi folder một truy vấn)", [&] {
+        size_t nodes = 0;
+        legacyWalk(root, owner.name, nodes);
+        return nodes;
+    });
+    measure("getSubtree                  ", [&] { return db.getSubtree(root).size(); });
+    measure("getFolderStructure          ", [&] { return db.getFolderStructure(root, owner.id).size(); });
+    return 0;
+}
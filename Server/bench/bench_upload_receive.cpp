@@ -0,0 +1,160 @@
+// CPU của thread nhận upload cho mỗi GB: đường cũ (read() 4KB rồi write() vào file) so với
+// ZeroCopyIO::receiveToFile (fallocate trước, splice socket -> pipe -> file).
+// Giống DedicatedThread::handleUpload: nhận từng nhóm 1MB rồi gửi 151 ACK, client chờ ACK mới gửi tiếp.
+// Không cần DB hay server: client là một thread gửi qua TCP loopback tới chính process.
+//   bench_upload_receive [MB=2048] [file=/tmp/bench_upload.bin]
+#include "../Core/include/zero_copy_io.h"
+#include "../../Common/Protocol.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <unistd.h>
+#include <ctime>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const long ACK_GROUP_SIZE = 1048576;
+
+static double threadCpuMs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Client: gửi total byte theo nhóm 1MB, sau mỗi nhóm (trừ nhóm cuối) đọc một dòng 151
+static void sendUpload(int fd, long long total) {
+    std::vector<char> data(ACK_GROUP_SIZE, 'x');
+    long long sent = 0;
+    char ack[128];
+    while (sent < total) {
+        long group = static_cast<long>(std::min<long long>(ACK_GROUP_SIZE, total - sent));
+        if (!ZeroCopyIO::sendAll(fd, data.data(), group)) return;
+        sent += group;
+        if (sent < total) {
+            size_t got = 0;
+            while (got == 0 || ack[got - 1] != '\n') {
+                ssize_t n = recv(fd, ack + got, sizeof(ack) - got, 0);
+                if (n <= 0) return;
+                got += n;
+            }
+        }
+    }
+}
+
+static void sendAck(int fd, long long received) {
+    std::string ack = std::string(CODE_CHUNK_ACK) + " Received " + std::to_string(received) + " bytes\n";
+    send(fd, ack.c_str(), ack.length(), 0);
+}
+
+// Đường cũ: buffer 4KB trên stack, mỗi byte qua user space hai lần
+static long long receiveCopy(int sock, int fileFd, long long total) {
+    char buffer[4096];
+    long long received = 0, sinceAck = 0;
+    while (received < total) {
+        size_t want = std::min<long long>({(long long)sizeof(buffer), total - received, ACK_GROUP_SIZE - sinceAck});
+        ssize_t n = read(sock, buffer, want);
+        if (n <= 0) break;
+        if (write(fileFd, buffer, n) != n) break;
+        received += n;
+        sinceAck += n;
+        if (sinceAck >= ACK_GROUP_SIZE) {
+            if (received < total) sendAck(sock, received);
+            sinceAck = 0;
+        }
+    }
+    return received;
+}
+
+// Đường hiện tại: như DedicatedThread::receiveInto
+static long long receiveSplice(int sock, int fileFd, long long total) {
+    if (fallocate(fileFd, 0, 0, total) < 0) std::cerr << "fallocate: " << strerror(errno) << std::endl;
+    SplicePipe pipe;
+    bool usePipe = pipe.open();
+    off_t offset = 0;
+    long long received = 0, sinceAck = 0;
+    while (received < total) {
+        size_t want = std::min(total - received, ACK_GROUP_SIZE - sinceAck);
+        long long n = ZeroCopyIO::receiveToFile(sock, fileFd, &offset, want, usePipe ? &pipe : nullptr);
+        if (n <= 0) break;
+        received += n;
+        sinceAck += n;
+        if (sinceAck >= ACK_GROUP_SIZE) {
+            if (received < total) sendAck(sock, received);
+            sinceAck = 0;
+        }
+    }
+    return received;
+}
+
+struct Result {
+    double cpuMs;
+    double wallMs;
+};
+
+static bool runOnce(const char* name, long long total, const std::string& path,
+                    long long (*receive)(int, int, long long), Result& result) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (listener < 0 || bind(listener, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 1) < 0 ||
+        getsockname(listener, (sockaddr*)&addr, &len) < 0) {
+        std::cerr << "Cannot listen on loopback: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::thread client([addr, total] {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, (const sockaddr*)&addr, sizeof(addr)) == 0) sendUpload(fd, total);
+        close(fd);
+    });
+    int sock = accept(listener, nullptr, nullptr);
+    close(listener);
+    int fileFd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    double cpuStart = threadCpuMs();
+    auto wallStart = std::chrono::steady_clock::now();
+    long long received = (sock >= 0 && fileFd >= 0) ? receive(sock, fileFd, total) : -1;
+    fsync(fileFd);
+    result.cpuMs = threadCpuMs() - cpuStart;
+    result.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+
+    close(sock);
+    close(fileFd);
+    client.join();
+    unlink(path.c_str());
+    if (received != total) {
+        std::cerr << name << ": received " << received << " of " << total << " bytes" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    long long mb = argc > 1 ? atoll(argv[1]) : 2048;
+    std::string path = argc > 2 ? argv[2] : "/tmp/bench_upload.bin";
+    long long total = mb * 1048576;
+    double gb = total / 1073741824.0;
+
+    struct Mode {
+        const char* name;
+        long long (*receive)(int, int, long long);
+    } modes[] = {{"copy (read+write 4KB)", receiveCopy}, {"splice + fallocate", receiveSplice}};
+
+    std::cout << "Upload " << mb << " MB to " << path << " over loopback, 151 ACK every 1MB\n";
+    for (const Mode& mode : modes) {
+        Result r;
+        if (!runOnce(mode.name, total, path, mode.receive, r)) return 1;
+        std::cout << "  " << mode.name << ": receiver CPU " << r.cpuMs / gb << " ms/GB, "
+                  << (mb / (r.wallMs / 1000.0)) << " MB/s" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+// Phần dùng chung của các chương trình trong Server/bench (cmake .. -DBUILD_BENCH=ON).
+// Chạy trên database cấu hình trong server_config.h (dựng từ database/schema.sql + migrations).
+// Dữ liệu tạo thêm thuộc về user tạm (ScratchUser), bị xóa cùng user khi chương trình kết thúc.
+
+#include "../Core/include/db_manager.h"
+#include "../Core/include/db_pool.h"
+#include "../Core/include/db_statement.h"
+#include "../Core/include/server.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+inline double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// p trong [0, 100]; samples bị sắp xếp lại
+inline double percentile(std::vector<double>& samples, double p) {
+    if (samples.empty()) return 0;
+    std::sort(samples.begin(), samples.end());
+    size_t index = std::min(samples.size() - 1, static_cast<size_t>(p / 100.0 * samples.size()));
+    return samples[index];
+}
+
+// Số câu SQL thread này gửi trong lúc chạy fn (DBLease::statementCount)
+template <typename Fn>
+long long countStatements(Fn&& fn) {
+    long long before = DBLease::statementCount();
+    fn();
+    return DBLease::statementCount() - before;
+}
+
+// Các câu SQL không trả kết quả, chạy lần lượt trên cùng một kết nối (biến SESSION còn hiệu lực)
+inline bool exec(const std::vector<std::string>& statements) {
+    DBLease lease;
+    MYSQL*& conn = lease.handle();
+    if (!conn) return false;
+    for (const std::string& sql : statements) {
+        if (lease.query(sql)) {
+            std::cerr << "[Bench] SQL failed: " << mysql_error(conn) << "\n  " << sql.substr(0, 200) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// User tạm <prefix>_<pid>, quota 1 TB. Hủy thì xóa user, FILES của user bị xóa theo (ON DELETE CASCADE)
+class ScratchUser {
+public:
+    explicit ScratchUser(const std::string& prefix) : name(prefix + "_" + std::to_string(getpid())) {
+        DBManager& db = DBManager::getInstance();
+        if (!db.registerUser(name, "bench")) return;
+        id = db.getUserId(name);
+        if (id > 0) {
+            exec({"UPDATE USERS SET storage_limit_bytes = 1099511627776 WHERE user_id = " + std::to_string(id)});
+        }
+    }
+    ~ScratchUser() {
+        if (id > 0) exec({"DELETE FROM USERS WHERE user_id = " + std::to_string(id)});
+    }
+    ScratchUser(const ScratchUser&) = delete;
+    ScratchUser& operator=(const ScratchUser&) = delete;
+
+    bool ok() const { return id > 0; }
+    ClientSession session() const {
+        ClientSession s;
+        s.username = name;
+        s.userId = id;
+        s.isAuthenticated = true;
+        return s;
+    }
+
+    std::string name;
+    long long id = -1;
+};
+
+// Folder gốc mới `name` của user_id gồm `folders` folder con, mỗi folder con có filesPerFolder file
+// size fileSize (folders = 0: file nằm thẳng trong gốc). Ghi bằng vài câu SQL theo lô thay vì từng
+// dòng qua DBManager; path, subtree_* và storage_used đúng như khi tạo qua server.
+// Trả về file_id của gốc, -1 nếu lỗi
+inline long long buildTree(long long user_id, const std::string& name, long long folders,
+                           long long filesPerFolder, long long fileSize) {
+    long long root = DBManager::getInstance().createFolder(name, 0, user_id);
+    if (root < 0) return -1;
+
+    const std::string u = std::to_string(user_id), r = std::to_string(root);
+    auto seq = [](long long n) {
+        return "WITH RECURSIVE seq (n) AS (SELECT 1 UNION ALL SELECT n + 1 FROM seq WHERE n < " +
+               std::to_string(n) + ") ";
+    };
+    long long fileCount = std::max(folders, 1LL) * filesPerFolder;
+
+    std::vector<std::string> sql = {"SET SESSION cte_max_recursion_depth = 100000000"};
+    if (folders > 0) {
+        sql.push_back("INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) " + seq(folders) +
+                      "SELECT " + u + ", " + r + ", CONCAT('dir', n), TRUE, 0 FROM seq");
+        sql.push_back("UPDATE FILES f JOIN FILES p ON p.file_id = f.parent_id "
+                      "SET f.path = CONCAT(p.path, f.file_id, '/') WHERE f.parent_id = " + r);
+    }
+    sql.push_back("INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) " + seq(filesPerFolder) +
+                  "SELECT " + u + ", p.file_id, CONCAT('file', seq.n), FALSE, " + std::to_string(fileSize) +
+                  " FROM seq JOIN FILES p ON " +
+                  (folders > 0 ? "p.parent_id = " + r + " AND p.is_folder = TRUE" : "p.file_id = " + r));
+    sql.push_back("UPDATE FILES f JOIN FILES p ON p.file_id = f.parent_id "
+                  "SET f.path = CONCAT(p.path, f.file_id, '/') WHERE f.path = '' AND " +
+                  (folders > 0 ? "p.parent_id = " + r : "f.parent_id = " + r));
+    if (folders > 0) {
+        sql.push_back("UPDATE FILES SET subtree_size_bytes = " + std::to_string(filesPerFolder * fileSize) +
+                      ", subtree_file_count = " + std::to_string(filesPerFolder) +
+                      " WHERE parent_id = " + r + " AND is_folder = TRUE");
+    }
+    sql.push_back("UPDATE FILES SET subtree_size_bytes = " + std::to_string(fileCount * fileSize) +
+                  ", subtree_file_count = " + std::to_string(fileCount) + " WHERE file_id = " + r);
+    sql.push_back("UPDATE USERS SET storage_used_bytes = storage_used_bytes + " +
+                  std::to_string(fileCount * fileSize) + " WHERE user_id = " + u);
+    return exec(sql) ? root : -1;
+}
+
+} // namespace bench
+
+#endif // BENCH_UTIL_H
@@ -0,0 +1,102 @@
+// Regression test: chunk có ref_count về 0 bị dọn khỏi CHUNKS và kho chunk (dropUnreferencedChunks),
+// chunk còn file sống dùng thì giữ nguyên; manifest mới không được trỏ tới chunk đã bị dọn.
+// Hai chunk ngẫu nhiên A, B của user tạm: file a = [A, B], file b = [B]; xóa a, dọn, rồi xóa b, dọn.
+#include "bench_util.h"
+#include "../Core/include/blob_store.h"
+#include "../Core/include/chunk_store.h"
+#include <openssl/sha.h>
+#include <random>
+
+static int failures = 0;
+
+static void check(const std::string& what, bool ok) {
+    if (!ok) failures++;
+    std::cout << (ok ? "[PASS] " : "[FAIL] ") << what << std::endl;
+}
+
+// ref_count của chunk, -1 nếu không còn dòng CHUNKS
+static long long refCount(const std::string& hash) {
+    DBLease lease;
+    if (!lease.handle()) return -2;
+    DBStatement stmt(lease, "SELECT ref_count FROM CHUNKS WHERE chunk_hash = UNHEX(?)");
+    stmt.bind(hash);
+    if (!stmt.execute()) return -2;
+    return stmt.fetch() ? stmt.getInt(0) : -1;
+}
+
+static bool stored(const std::string& hash) {
+    return ChunkStore::storedSize(hash) >= 0;
+}
+
+// PUT_CHUNK size byte ngẫu nhiên cho user_id; trả về hash, "" nếu lỗi
+static std::string putRandomChunk(long long user_id, size_t size) {
+    static std::mt19937_64 rng(std::random_device{}());
+    std::vector<unsigned char> data(size);
+    for (auto& b : data) b = static_cast<unsigned char>(rng());
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    std::string hash = ChunkStore::toHex(SHA256(data.data(), data.size(), digest));
+
+    std::string tempPath;
+    int fd = BlobStore::create(tempPath);
+    if (fd < 0) return "";
+    bool written = write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    close(fd);
+    if (!written) {
+        BlobStore::discard(tempPath);
+        return "";
+    }
+    return ChunkStore::storeUploaded(tempPath, hash, size, user_id) ? hash : "";
+}
+
+// Dọn tới khi hết chunk ref_count 0
+static bool collect() {
+    long long dropped;
+    while ((dropped = DBManager::getInstance().dropUnreferencedChunks(1000)) == 1000) {}
+    return dropped >= 0;
+}
+
+int main() {
+    DBManager& db = DBManager::getInstance();
+    if (!db.connect()) {
+        std::cerr << "Cannot connect to database" << std::endl;
+        return 2;
+    }
+    bench::ScratchUser owner("chunk_gc_owner");
+    const long long size = 4096;
+    std::string a = owner.ok() ? putRandomChunk(owner.id, size) : "";
+    std::string b = owner.ok() ? putRandomChunk(owner.id, size) : "";
+    std::vector<ChunkRef> manifestA = {{a, size}, {b, size}}, manifestB = {{b, size}};
+    if (a.empty() || b.empty() || db.addFile("gc_a", 2 * size, owner.id, 0, &manifestA) < 0 ||
+        db.addFile("gc_b", size, owner.id, 0, &manifestB) < 0) {
+        std::cerr << "Cannot create test files" << std::endl;
+        return 2;
+    }
+
+    // 1. Cả hai chunk còn được dùng: dọn không đụng tới
+    check("ref_count sau khi tạo: A = 1, B = 2", refCount(a) == 1 && refCount(b) == 2);
+    check("dọn lần 1 chạy được", collect());
+    check("A, B còn nguyên", refCount(a) == 1 && refCount(b) == 2 && stored(a) && stored(b));
+
+    // 2. Xóa file a: A về 0 và bị dọn, B còn file b dùng
+    check("xóa gc_a", db.deleteFile("gc_a", owner.id));
+    check("ref_count sau khi xóa gc_a: A = 0, B = 1", refCount(a) == 0 && refCount(b) == 1);
+    check("dọn lần 2 chạy được", collect());
+    check("A bị xóa khỏi CHUNKS và kho", refCount(a) == -1 && !stored(a));
+    long long blobB = db.findDownloadBlob("gc_b", owner.id);
+    std::vector<ChunkRef> readB = db.getChunkManifest(blobB);
+    check("gc_b vẫn đọc được B", blobB >= 0 && readB.size() == 1 && readB[0].hash == b && stored(b) &&
+                                     refCount(b) == 1);
+
+    // 3. Manifest mới trỏ tới chunk đã dọn: từ chối, không tạo lại dòng CHUNKS
+    long long plain = db.addFile("gc_plain", size, owner.id);
+    check("manifest trỏ tới A đã dọn bị từ chối",
+          plain > 0 && !db.storeChunkManifest(plain, {{a, size}}) && refCount(a) == -1);
+
+    // 4. Xóa file cuối cùng dùng B
+    check("xóa gc_b", db.deleteFile("gc_b", owner.id));
+    check("dọn lần 3 chạy được", collect());
+    check("B bị xóa khỏi CHUNKS và kho", refCount(b) == -1 && !stored(b));
+
+    std::cout << (failures ? "FAILED: " : "OK: ") << failures << " check(s) failed" << std::endl;
+    return failures ? 1 : 0;
+}
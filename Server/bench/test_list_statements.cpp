@@ -0,0 +1,90 @@
+// Regression test: LIST / LISTSHARED phải gửi số câu SQL cố định, không tăng theo số dòng (N+1).
+// Chạy mọi folder trong dữ liệu của database/schema.sql, cộng một folder 500 folder con của user tạm;
+// mỗi folder LIST hai lần (cache trống / đã có cache). Lệnh nào vượt LIST_STATEMENT_BUDGET -> exit 1.
+#include "bench_util.h"
+#include "../Core/include/request_handler.h"
+#include "../Core/include/server_config.h"
+#include <utility>
+
+static int failures = 0;
+
+static void check(const std::string& what, long long statements) {
+    bool ok = statements <= ServerConfig::LIST_STATEMENT_BUDGET;
+    if (!ok) failures++;
+    std::cout << (ok ? "[PASS] " : "[FAIL] ") << what << ": " << statements << " statements (budget "
+              << ServerConfig::LIST_STATEMENT_BUDGET << ")" << std::endl;
+}
+
+static ClientSession sessionOf(long long user_id) {
+    ClientSession s;
+    s.username = "user" + std::to_string(user_id);
+    s.userId = user_id;
+    s.isAuthenticated = true;
+    return s;
+}
+
+static void checkList(long long user_id, long long folder_id) {
+    ClientSession s = sessionOf(user_id);
+    for (const char* pass : {"cold", "warm"}) {
+        long long n = bench::countStatements([&] { CmdHandler::handleList(s, folder_id); });
+        check("LIST user " + std::to_string(user_id) + " folder " + std::to_string(folder_id) + " (" + pass + ")", n);
+    }
+}
+
+static void checkListShared(long long user_id, long long folder_id) {
+    ClientSession s = sessionOf(user_id);
+    long long n = bench::countStatements([&] { CmdHandler::handleListShared(s, folder_id); });
+    check("LISTSHARED user " + std::to_string(user_id) + " folder " + std::to_string(folder_id), n);
+}
+
+// (user_id, folder_id) đọc từ DB; folder_id = 0 là thư mục gốc
+static std::vector<std::pair<long long, long long>> loadPairs(const char* sql) {
+    std::vector<std::pair<long long, long long>> pairs;
+    DBLease lease;
+    if (!lease.handle()) return pairs;
+    DBStatement stmt(lease, sql);
+    if (!stmt.execute()) return pairs;
+    while (stmt.fetch()) pairs.emplace_back(stmt.getInt(0), stmt.getInt(1));
+    return pairs;
+}
+
+int main() {
+    DBManager& db = DBManager::getInstance();
+    if (!db.connect()) {
+        std::cerr << "Cannot connect to database" << std::endl;
+        return 2;
+    }
+
+    // 1. Dữ liệu mẫu: thư mục gốc và mọi folder của từng user; LISTSHARED theo từng folder được share
+    for (const auto& [user_id, folder_id] : loadPairs(
+             "SELECT user_id, 0 FROM USERS UNION ALL "
+             "SELECT owner_id, file_id FROM FILES WHERE is_folder = TRUE AND is_deleted = FALSE")) {
+        checkList(user_id, folder_id);
+    }
+    for (const auto& [user_id, folder_id] : loadPairs(
+             "SELECT user_id, -1 FROM USERS UNION ALL "
+             "SELECT s.user_id, s.file_id FROM SHAREDFILES s JOIN FILES f ON f.file_id = s.file_id "
+             "WHERE f.is_folder = TRUE AND f.is_deleted = FALSE")) {
+        checkListShared(user_id, folder_id);
+    }
+
+    // 2. Folder 500 folder con (mỗi folder một file để size khác 0), của mình và được share
+    bench::ScratchUser owner("list_test_owner");
+    bench::ScratchUser reader("list_test_reader");
+    if (!owner.ok() || !reader.ok()) {
+        std::cerr << "Cannot create test users" << std::endl;
+        return 2;
+    }
+    long long wide = bench::buildTree(owner.id, "wide", 500, 1, 1024);
+    if (wide < 0 || !db.shareFolderWithUser(wide, reader.name)) {
+        std::cerr << "Cannot build test folder" << std::endl;
+        return 2;
+    }
+    checkList(owner.id, 0);
+    checkList(owner.id, wide);
+    checkListShared(reader.id, -1);
+    checkListShared(reader.id, wide);
+
+    std::cout << (failures ? "FAILED: " : "OK: ") << failures << " listing(s) over budget" << std::endl;
+    return failures ? 1 : 0;
+}
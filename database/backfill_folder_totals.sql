@@ -0,0 +1,30 @@
+-- ====================================
+-- BACKFILL FOLDER TOTALS
+-- Tính lại FILES.subtree_size_bytes / subtree_file_count cho mọi folder từ dữ liệu hiện có.
+-- Chạy một lần sau migration 001, hoặc bất cứ lúc nào cần đối soát lại.
+--   mysql -u <user> -p file_management < backfill_folder_totals.sql
+-- ====================================
+
+START TRANSACTION;
+
+-- Cây con chỉ đi qua các dòng chưa xóa (giống cách server cộng dồn khi thêm/xóa)
+UPDATE FILES f
+JOIN (
+    WITH RECURSIVE tree (root_id, file_id, is_folder, size_bytes) AS (
+        SELECT file_id, file_id, is_folder, size_bytes FROM FILES WHERE is_folder = TRUE
+        UNION ALL
+        SELECT t.root_id, c.file_id, c.is_folder, c.size_bytes
+        FROM tree t JOIN FILES c ON c.parent_id = t.file_id AND c.is_deleted = FALSE
+    )
+    SELECT root_id,
+           SUM(IF(is_folder, 0, size_bytes)) AS total_bytes,
+           SUM(IF(is_folder, 0, 1)) AS total_files
+    FROM tree GROUP BY root_id
+) agg ON agg.root_id = f.file_id
+SET f.subtree_size_bytes = agg.total_bytes,
+    f.subtree_file_count = agg.total_files,
+    f.updated_at = f.updated_at;
+
+COMMIT;
+
+SELECT COUNT(*) AS folders_updated FROM FILES WHERE is_folder = TRUE;
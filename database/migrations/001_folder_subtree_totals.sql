@@ -0,0 +1,12 @@
+-- ====================================
+-- MIGRATION 001: FOLDER SUBTREE TOTALS
+-- Thêm cột tổng dung lượng / số file của cả cây con cho folder.
+-- Sau khi chạy file này, chạy database/backfill_folder_totals.sql để tính giá trị ban đầu.
+-- Yêu cầu MySQL 8.0+ (recursive CTE).
+-- ====================================
+
+USE file_management;
+
+ALTER TABLE FILES
+    ADD COLUMN subtree_size_bytes BIGINT NOT NULL DEFAULT 0 AFTER size_bytes,
+    ADD COLUMN subtree_file_count BIGINT NOT NULL DEFAULT 0 AFTER subtree_size_bytes;
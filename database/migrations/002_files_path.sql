@@ -0,0 +1,43 @@
+-- ====================================
+-- MIGRATION 002: MATERIALIZED PATH FOR FILES
+-- FILES.path = chuỗi id tổ tiên gồm chính nó, vd "/1/4/9/".
+--   Con cháu của X : path > X.path AND path < (X.path đổi '/' cuối thành '0')  -> range scan idx_path
+--   Tổ tiên của X  : các id trong X.path                                      -> tra PK
+-- Yêu cầu MySQL 8.0+ (recursive CTE). Chạy sau 001.
+-- ====================================
+
+USE file_management;
+
+ALTER TABLE FILES
+    ADD COLUMN path VARCHAR(2048) CHARACTER SET ascii COLLATE ascii_bin NOT NULL DEFAULT '' AFTER is_deleted,
+    ADD INDEX idx_path (path);
+
+START TRANSACTION;
+
+-- Tính path cho toàn bộ dòng hiện có, đi từ các gốc (parent_id IS NULL) xuống
+UPDATE FILES f
+JOIN (
+    WITH RECURSIVE tree (file_id, path) AS (
+        SELECT file_id, CAST(CONCAT('/', file_id, '/') AS CHAR(2048) CHARACTER SET ascii)
+        FROM FILES WHERE parent_id IS NULL
+        UNION ALL
+        SELECT c.file_id, CONCAT(t.path, c.file_id, '/')
+        FROM tree t JOIN FILES c ON c.parent_id = t.file_id
+    )
+    SELECT file_id, path FROM tree
+) t ON t.file_id = f.file_id
+SET f.path = t.path,
+    f.updated_at = f.updated_at;
+
+-- Server giờ xóa folder kèm toàn bộ nội dung; áp dụng cho các folder đã xóa trước đây
+UPDATE FILES d
+JOIN FILES x ON x.is_folder = TRUE AND x.is_deleted = TRUE AND x.path != ''
+SET d.is_deleted = TRUE,
+    d.updated_at = d.updated_at
+WHERE d.path > x.path
+  AND d.path < CONCAT(LEFT(x.path, LENGTH(x.path) - 1), '0')
+  AND d.is_deleted = FALSE;
+
+COMMIT;
+
+SELECT COUNT(*) AS rows_without_path FROM FILES WHERE path = '';
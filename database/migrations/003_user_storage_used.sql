@@ -0,0 +1,28 @@
+-- ====================================
+-- MIGRATION 003: PER-USER STORAGE COUNTER
+-- USERS.storage_used_bytes = tổng size_bytes các file (không phải folder) chưa xóa của user.
+-- Server cập nhật cột trong cùng transaction với INSERT/xóa FILES; QUOTA_CHECK chỉ đọc cột này.
+-- Chạy sau 002 (cần cascade xóa nội dung folder đã xóa để tổng đúng).
+-- ====================================
+
+USE file_management;
+
+ALTER TABLE USERS
+    ADD COLUMN storage_used_bytes BIGINT NOT NULL DEFAULT 0 AFTER storage_limit_bytes;
+
+START TRANSACTION;
+
+UPDATE USERS u
+SET u.storage_used_bytes = (
+    SELECT COALESCE(SUM(f.size_bytes), 0) FROM FILES f
+    WHERE f.owner_id = u.user_id AND f.is_folder = FALSE AND f.is_deleted = FALSE
+);
+
+COMMIT;
+
+-- Đối soát: không nên trả về dòng nào
+SELECT u.user_id, u.storage_used_bytes, COALESCE(SUM(f.size_bytes), 0) AS actual_bytes
+FROM USERS u
+LEFT JOIN FILES f ON f.owner_id = u.user_id AND f.is_folder = FALSE AND f.is_deleted = FALSE
+GROUP BY u.user_id, u.storage_used_bytes
+HAVING u.storage_used_bytes != actual_bytes;
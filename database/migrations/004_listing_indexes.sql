@@ -0,0 +1,29 @@
+-- ====================================
+-- MIGRATION 004: KEYSET PAGINATION FOR LIST / LISTSHARED
+-- FILES.listing_size_bytes = kích thước hiển thị trong LIST (folder: subtree_size_bytes), cột sinh STORED
+-- để sắp xếp theo size dùng được index.
+-- Mỗi index khớp đúng một thứ tự "is_folder DESC, <cột>, file_id" của DBManager::listPage:
+--   idx_list_*   : LIST (owner_id = ? AND parent_id = ?/IS NULL)
+--   idx_shared_* : LISTSHARED trong folder được share (parent_id = ?, mọi owner)
+-- idx_owner / idx_parent là tiền tố của các index mới nên bỏ đi (khóa ngoại dùng index mới).
+-- Yêu cầu MySQL 8.0+ (index giảm dần). Chạy sau 003.
+-- ====================================
+
+USE file_management;
+
+ALTER TABLE FILES
+    ADD COLUMN listing_size_bytes BIGINT AS (IF(is_folder, subtree_size_bytes, size_bytes)) STORED AFTER subtree_file_count,
+    ADD INDEX idx_list_name (owner_id, parent_id, is_deleted, is_folder DESC, name, file_id),
+    ADD INDEX idx_list_size (owner_id, parent_id, is_deleted, is_folder, listing_size_bytes, file_id),
+    ADD INDEX idx_list_date (owner_id, parent_id, is_deleted, is_folder, created_at, file_id),
+    ADD INDEX idx_shared_name (parent_id, is_deleted, is_folder DESC, name, file_id),
+    ADD INDEX idx_shared_size (parent_id, is_deleted, is_folder, listing_size_bytes, file_id),
+    ADD INDEX idx_shared_date (parent_id, is_deleted, is_folder, created_at, file_id);
+
+ALTER TABLE FILES
+    DROP INDEX idx_owner,
+    DROP INDEX idx_parent;
+
+-- Kiểm tra: trang đầu của một folder lớn phải là "Using index condition"/"Backward index scan", không "Using filesort"
+-- EXPLAIN SELECT file_id FROM FILES f WHERE f.owner_id = 2 AND f.parent_id IS NULL AND f.is_deleted = FALSE
+--     ORDER BY f.is_folder DESC, f.name ASC, f.file_id ASC LIMIT 101;
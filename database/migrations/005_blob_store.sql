@@ -0,0 +1,14 @@
+-- ====================================
+-- MIGRATION 005: ID-KEYED BLOB STORE
+-- Dữ liệu file không còn đặt theo tên (STORAGE_PATH/<name>) mà theo blob_id:
+--   STORAGE_PATH/blobs/<xx>/<yy>/<blob_id>  (xem Server/Core/include/blob_store.h)
+-- FILES.blob_id NULL = blob của chính file_id (file upload trực tiếp); bản chép folder
+-- (SHARE_FOLDER ... COPY) giữ blob_id của dòng gốc nên không chép dữ liệu.
+-- Dữ liệu cũ không cần di chuyển: server không thấy blob thì đọc file theo tên như trước.
+-- Chạy sau 004.
+-- ====================================
+
+USE file_management;
+
+ALTER TABLE FILES
+    ADD COLUMN blob_id BIGINT NULL AFTER size_bytes;
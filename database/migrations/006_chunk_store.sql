@@ -0,0 +1,33 @@
+-- ====================================
+-- MIGRATION 006: CONTENT-DEFINED CHUNK STORE
+-- Blob lớn được cắt thành chunk theo nội dung (gear hash), mỗi chunk lưu một lần duy nhất ở
+--   STORAGE_PATH/chunks/<h0h1>/<h2h3>/<sha256 hex>  (xem Server/Core/include/chunk_store.h)
+-- CHUNKS: mỗi chunk một dòng, ref_count = số tham chiếu từ file còn sống: mỗi dòng FILES chưa xóa
+--   có blob chứa chunk (chunk lặp lại trong một manifest được tính mỗi lần). Server giữ giá trị này
+--   trong cùng transaction khi tạo file, xóa file/folder và chép folder. Chunk về 0 bị thread nền
+--   xóa cả dòng lẫn file (idx_ref_count để tìm mà không quét cả bảng).
+-- BLOB_CHUNKS: manifest của một blob (FILES.blob_id, NULL = file_id), đọc theo seq.
+-- Blob có manifest thì file STORAGE_PATH/blobs/.../<blob_id> đã bị xóa.
+-- Chạy sau 005.
+-- ====================================
+
+USE file_management;
+
+CREATE TABLE CHUNKS (
+    chunk_hash BINARY(32) PRIMARY KEY,
+    size_bytes INT NOT NULL,
+    ref_count BIGINT NOT NULL DEFAULT 0,
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+
+    INDEX idx_ref_count (ref_count)
+) ENGINE=InnoDB;
+
+CREATE TABLE BLOB_CHUNKS (
+    blob_id BIGINT NOT NULL,
+    seq INT NOT NULL,
+    chunk_hash BINARY(32) NOT NULL,
+    size_bytes INT NOT NULL,
+
+    PRIMARY KEY (blob_id, seq),
+    INDEX idx_chunk (chunk_hash)
+) ENGINE=InnoDB;
@@ -0,0 +1,27 @@
+-- ====================================
+-- MIGRATION 007: CHUNK UPLOADS CHƯA DÙNG
+-- PUT_CHUNK không còn đưa chunk thẳng vào kho chung. Chunk nằm riêng theo user ở
+--   STORAGE_PATH/chunks/pending/<user_id>/<sha256 hex>
+-- kèm một dòng CHUNK_UPLOADS; size tính vào USERS.storage_used_bytes cho tới khi STOR_CHUNKED
+-- dùng tới (chuyển vào kho chung, trừ lại rồi tính theo size file) hoặc quá
+-- PENDING_CHUNK_TTL_SECONDS thì bị dọn và trả quota.
+-- CHUNK_QUERY / PUT_CHUNK / STOR_CHUNKED chỉ coi là "đã có" chunk mà user đã PUT_CHUNK hoặc
+-- nằm trong file còn sống của chính user; idx_blob tìm các dòng FILES trỏ tới một blob.
+-- Chạy sau 006.
+-- ====================================
+
+USE file_management;
+
+CREATE TABLE CHUNK_UPLOADS (
+    user_id BIGINT NOT NULL,
+    chunk_hash BINARY(32) NOT NULL,
+    size_bytes INT NOT NULL,
+    uploaded_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+
+    PRIMARY KEY (user_id, chunk_hash),
+    FOREIGN KEY (user_id) REFERENCES USERS(user_id) ON DELETE CASCADE,
+    INDEX idx_uploaded (uploaded_at)
+) ENGINE=InnoDB;
+
+ALTER TABLE FILES
+    ADD INDEX idx_blob (blob_id);
@@ -17,6 +17,7 @@ CREATE TABLE USERS (
     username VARCHAR(255) NOT NULL UNIQUE,
     password_hash VARCHAR(255) NOT NULL,
     storage_limit_bytes BIGINT DEFAULT 1073741824,
+    storage_used_bytes BIGINT NOT NULL DEFAULT 0,  -- Tổng size_bytes các file chưa xóa, server cập nhật khi thêm/xóa file
     created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
     INDEX idx_username (username)
 ) ENGINE=InnoDB;
@@ -39,17 +40,30 @@ CREATE TABLE FILES (
     name VARCHAR(255) NOT NULL,
     is_folder BOOLEAN DEFAULT FALSE,
     size_bytes BIGINT DEFAULT 0,
+    blob_id BIGINT NULL,  -- Dữ liệu ở STORAGE_PATH/blobs/.../<blob_id>; NULL = chính file_id (migration 005)
+    subtree_size_bytes BIGINT NOT NULL DEFAULT 0,  -- Folder: tổng dung lượng file trong cả cây con
+    subtree_file_count BIGINT NOT NULL DEFAULT 0,  -- Folder: số file trong cả cây con
+    listing_size_bytes BIGINT AS (IF(is_folder, subtree_size_bytes, size_bytes)) STORED,  -- Cột size của LIST
     is_deleted BOOLEAN DEFAULT FALSE,
+    -- Chuỗi id tổ tiên gồm chính nó, vd "/1/4/9/". Con cháu của X: path trong khoảng (X.path, X.path đổi '/' cuối thành '0')
+    path VARCHAR(2048) CHARACTER SET ascii COLLATE ascii_bin NOT NULL DEFAULT '',
     created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
     updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
     
     FOREIGN KEY (owner_id) REFERENCES USERS(user_id) ON DELETE CASCADE,
     FOREIGN KEY (parent_id) REFERENCES FILES(file_id) ON DELETE CASCADE,
     
-    INDEX idx_owner (owner_id),
-    INDEX idx_parent (parent_id),
+    -- Phân trang LIST / LISTSHARED: "is_folder DESC, <name|size|date>, file_id" (xem migration 004)
+    INDEX idx_list_name (owner_id, parent_id, is_deleted, is_folder DESC, name, file_id),
+    INDEX idx_list_size (owner_id, parent_id, is_deleted, is_folder, listing_size_bytes, file_id),
+    INDEX idx_list_date (owner_id, parent_id, is_deleted, is_folder, created_at, file_id),
+    INDEX idx_shared_name (parent_id, is_deleted, is_folder DESC, name, file_id),
+    INDEX idx_shared_size (parent_id, is_deleted, is_folder, listing_size_bytes, file_id),
+    INDEX idx_shared_date (parent_id, is_deleted, is_folder, created_at, file_id),
     INDEX idx_name (name),
-    INDEX idx_deleted (is_deleted)
+    INDEX idx_deleted (is_deleted),
+    INDEX idx_path (path),
+    INDEX idx_blob (blob_id)
 ) ENGINE=InnoDB;
 
 CREATE TABLE SHAREDFILES (
@@ -98,6 +112,38 @@ CREATE TABLE SHARE_CODES (
     INDEX idx_file (file_id)
 ) ENGINE=InnoDB;
 
+-- Chunk store (migration 006): chunk lưu một lần, blob lớn trỏ tới chuỗi chunk theo seq
+CREATE TABLE CHUNKS (
+    chunk_hash BINARY(32) PRIMARY KEY,  -- SHA-256 của nội dung chunk
+    size_bytes INT NOT NULL,
+    ref_count BIGINT NOT NULL DEFAULT 0,  -- Số tham chiếu từ file còn sống (mỗi dòng FILES x số lần trong manifest)
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+
+    INDEX idx_ref_count (ref_count)  -- Thread nền tìm chunk về 0 để xóa
+) ENGINE=InnoDB;
+
+CREATE TABLE BLOB_CHUNKS (
+    blob_id BIGINT NOT NULL,  -- FILES.blob_id (NULL ở FILES = file_id)
+    seq INT NOT NULL,
+    chunk_hash BINARY(32) NOT NULL,
+    size_bytes INT NOT NULL,
+
+    PRIMARY KEY (blob_id, seq),
+    INDEX idx_chunk (chunk_hash)
+) ENGINE=InnoDB;
+
+-- Chunk đã PUT_CHUNK nhưng chưa STOR_CHUNKED (migration 007), size tính vào quota của user
+CREATE TABLE CHUNK_UPLOADS (
+    user_id BIGINT NOT NULL,
+    chunk_hash BINARY(32) NOT NULL,
+    size_bytes INT NOT NULL,
+    uploaded_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,  -- Quá PENDING_CHUNK_TTL_SECONDS thì bị dọn
+
+    PRIMARY KEY (user_id, chunk_hash),
+    FOREIGN KEY (user_id) REFERENCES USERS(user_id) ON DELETE CASCADE,
+    INDEX idx_uploaded (uploaded_at)
+) ENGINE=InnoDB;
+
 -- ====================================
 -- INITIAL DATA
 -- ====================================
@@ -139,6 +185,45 @@ INSERT INTO FILES (owner_id, parent_id, name, is_folder, size_bytes) VALUES
     (2, 19, 'Source_Code.zip', FALSE, 102400),
     (2, 19, 'notes.txt', FALSE, 4096);
 
+-- Tính FILES.path cho dữ liệu demo (giống migrations/002_files_path.sql)
+UPDATE FILES f
+JOIN (
+    WITH RECURSIVE tree (file_id, path) AS (
+        SELECT file_id, CAST(CONCAT('/', file_id, '/') AS CHAR(2048) CHARACTER SET ascii)
+        FROM FILES WHERE parent_id IS NULL
+        UNION ALL
+        SELECT c.file_id, CONCAT(t.path, c.file_id, '/')
+        FROM tree t JOIN FILES c ON c.parent_id = t.file_id
+    )
+    SELECT file_id, path FROM tree
+) t ON t.file_id = f.file_id
+SET f.path = t.path;
+
+-- Tính subtree_size_bytes/subtree_file_count cho dữ liệu demo
+-- (giống database/backfill_folder_totals.sql)
+UPDATE FILES f
+JOIN (
+    WITH RECURSIVE tree (root_id, file_id, is_folder, size_bytes) AS (
+        SELECT file_id, file_id, is_folder, size_bytes FROM FILES WHERE is_folder = TRUE
+        UNION ALL
+        SELECT t.root_id, c.file_id, c.is_folder, c.size_bytes
+        FROM tree t JOIN FILES c ON c.parent_id = t.file_id AND c.is_deleted = FALSE
+    )
+    SELECT root_id,
+           SUM(IF(is_folder, 0, size_bytes)) AS total_bytes,
+           SUM(IF(is_folder, 0, 1)) AS total_files
+    FROM tree GROUP BY root_id
+) agg ON agg.root_id = f.file_id
+SET f.subtree_size_bytes = agg.total_bytes,
+    f.subtree_file_count = agg.total_files;
+
+-- Tính storage_used_bytes cho dữ liệu demo (giống migrations/003_user_storage_used.sql)
+UPDATE USERS u
+SET u.storage_used_bytes = (
+    SELECT COALESCE(SUM(f.size_bytes), 0) FROM FILES f
+    WHERE f.owner_id = u.user_id AND f.is_folder = FALSE AND f.is_deleted = FALSE
+);
+
 -- Demo file shares
 INSERT INTO SHAREDFILES (file_id, user_id, permission_id) VALUES
     (13, 2, 1),
@@ -0,0 +1,22 @@
+#!/bin/bash
+# Chạy một benchmark trong Server/bench (build Release riêng ở Server/build_bench)
+# Usage: ./run_bench.sh <tên bench> [tham số...]
+# Các bench cần DB dùng cấu hình trong server_config.h và tự dọn user tạm khi xong
+
+cd "$(dirname "$0")/Server"
+if [ -z "$1" ]; then
+    echo "Usage: ./run_bench.sh <bench> [args...]"
+    echo "Benchmarks:"
+    for f in bench/bench_*.cpp; do
+        echo "  $(basename "$f" .cpp)"
+    done
+    exit 1
+fi
+NAME="$1"
+shift
+
+mkdir -p build_bench
+cd build_bench
+cmake .. -DBUILD_BENCH=ON -DCMAKE_BUILD_TYPE=Release > /dev/null || exit 1
+cmake --build . --target "$NAME" -j$(nproc) || exit 1
+./"$NAME" "$@"
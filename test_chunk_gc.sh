@@ -0,0 +1,14 @@
+#!/bin/bash
+# Regression test: chunk ref_count 0 bị dọn khỏi DB và kho chunk, chunk còn dùng thì giữ
+# Cần database đã dựng từ database/schema.sql (+ migrations), cấu hình DB trong server_config.h
+
+echo "=== Building test_chunk_gc ==="
+cd "$(dirname "$0")/Server"
+mkdir -p build
+cd build
+cmake .. -DBUILD_BENCH=ON > /dev/null || exit 1
+cmake --build . --target test_chunk_gc -j$(nproc) || exit 1
+
+echo ""
+echo "=== Unreferenced chunk GC ==="
+./test_chunk_gc
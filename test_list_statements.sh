@@ -0,0 +1,14 @@
+#!/bin/bash
+# Regression test: LIST/LISTSHARED không được gửi quá LIST_STATEMENT_BUDGET câu SQL (N+1)
+# Cần database đã dựng từ database/schema.sql (+ migrations), cấu hình DB trong server_config.h
+
+echo "=== Building test_list_statements ==="
+cd "$(dirname "$0")/Server"
+mkdir -p build
+cd build
+cmake .. -DBUILD_BENCH=ON > /dev/null || exit 1
+cmake --build . --target test_list_statements -j$(nproc) || exit 1
+
+echo ""
+echo "=== LIST statement budget ==="
+./test_list_statements